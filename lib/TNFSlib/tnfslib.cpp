@@ -14,6 +14,7 @@
 #include "fnUDP.h"
 #include "fnTcpClient.h"
 #include "tnfslib_udp.h"
+#include "tnfslib_pipeline.h"
 
 #include "utils.h"
 
@@ -53,6 +54,8 @@ int _tnfs_tcp_recv(tnfsMountInfo *m_info, tnfsPacket &pkt);
 _tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt);
 _tnfs_recv_result _tnfs_recv_and_validate(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt);
 uint8_t _tnfs_session_recovery(tnfsMountInfo *m_info, uint8_t command);
+int _tnfs_fill_cache_pipelined(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint32_t *loaded, bool *eof);
+int _tnfs_server_seek(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint32_t position);
 
 int _tnfs_adjust_with_full_path(tnfsMountInfo *m_info, char *buffer, const char *source, int bufflen);
 
@@ -379,11 +382,39 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
     pFHI->cache_available = 0;
     pFHI->cache_start = pFHI->file_position;
 
-    // How many bytes until we finish loading the cache
-    uint32_t bytes_remaining_to_load = sizeof(pFHI->cache);
+    // How many bytes until we finish loading the cache. Over UDP the whole cache
+    // is filled with several READs in flight, over TCP it's one packet's worth
+    bool pipelined = (m_info->protocol == TNFS_PROTOCOL_UDP);
+    uint32_t bytes_remaining_to_load = pipelined ? sizeof(pFHI->cache) : TNFS_READ_CHUNK;
+    uint32_t cache_size = bytes_remaining_to_load;
+
+    if (pipelined)
+    {
+        uint32_t loaded = 0;
+        bool eof = false;
+        error = _tnfs_fill_cache_pipelined(m_info, pFHI, &loaded, &eof);
+        bytes_remaining_to_load -= loaded;
+
+        if (eof)
+        {
+            bytes_remaining_to_load = 0;
+            cache_size = loaded;
+            // Handled as a READ answered with EOF below: bytes before it are
+            // kept, and with none on the PC build EOF goes up to tnfs_read()
+#ifndef ESP_PLATFORM
+            error = TNFS_RESULT_END_OF_FILE; // push EOF up
+#endif
+        }
+        else if (error > 0)
+        {
+            // Server refused (TRY_AGAIN, expired session...), finish one READ at a time
+            Debug_printf("_tnfs_fill_cache pipelined read failed (%u), continuing one at a time\r\n", error);
+            error = 0;
+        }
+    }
 
     // Keep making TNFS READ calls as long as we still have bytes to read
-    while (bytes_remaining_to_load > 0)
+    while (error == 0 && bytes_remaining_to_load > 0)
     {
         tnfsPacket packet;
         packet.command = TNFS_CMD_READ;
@@ -407,7 +438,7 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
                 // Copy the actual number of bytes returned to us into our cache
                 // (offset by how many bytes we've already put in the cache)
                 uint16_t bytes_read = TNFS_UINT16_FROM_LOHI_BYTEPTR(packet.payload + 1);
-                memcpy(pFHI->cache + (sizeof(pFHI->cache) - bytes_remaining_to_load),
+                memcpy(pFHI->cache + (cache_size - bytes_remaining_to_load),
                        packet.payload + 3, bytes_read);
 
                 // Keep track of our file position
@@ -450,12 +481,12 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
 #ifdef ESP_PLATFORM
     if (error == 0)
     {
-        pFHI->cache_available = sizeof(pFHI->cache) - bytes_remaining_to_load;
+        pFHI->cache_available = cache_size - bytes_remaining_to_load;
 #else
 // TODO review EOF handling
     if (error == 0 || error == TNFS_RESULT_END_OF_FILE)
     {
-        pFHI->cache_available = sizeof(pFHI->cache) - bytes_remaining_to_load;
+        pFHI->cache_available = cache_size - bytes_remaining_to_load;
         if (pFHI->cache_available > 0) error = 0; // neutralize EOF
 #endif
 #ifdef DEBUG
@@ -466,6 +497,99 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
     return error;
 }
 
+/*
+ Fills the cache with several READs in flight over UDP, see tnfslib_pipeline.h
+ Bytes read are placed in loaded, eof is set if the server reported end of file
+ Returns: 0: success; -1: failed to deliver/receive packet; other: TNFS error result code
+*/
+int _tnfs_fill_cache_pipelined(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint32_t *loaded, bool *eof)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
+    // One socket for the whole fill, replies to every request in flight come back to it
+    fnUDP udp;
+    tnfsPacket response;
+
+    tnfsReadTransport io;
+    io.send_read = [&](uint8_t sequence_num, uint16_t count) {
+        tnfsPacket packet;
+        packet.session_idl = TNFS_LOBYTE_FROM_UINT16(m_info->session);
+        packet.session_idh = TNFS_HIBYTE_FROM_UINT16(m_info->session);
+        packet.sequence_num = sequence_num;
+        packet.command = TNFS_CMD_READ;
+        packet.payload[0] = pFHI->handle_id;
+        packet.payload[1] = TNFS_LOBYTE_FROM_UINT16(count);
+        packet.payload[2] = TNFS_HIBYTE_FROM_UINT16(count);
+#ifdef DEBUG
+        _tnfs_debug_packet(packet, 3);
+#endif
+        return _tnfs_send(&udp, m_info, packet, 3);
+    };
+    io.recv_reply = [&](tnfsReadReply &reply) {
+        int l = _tnfs_recv(&udp, m_info, response);
+        if (l < TNFS_HEADER_SIZE + 1 || response.command != TNFS_CMD_READ)
+            return false;
+
+        reply.sequence_num = response.sequence_num;
+        reply.result = response.payload[0];
+        reply.length = 0;
+        if (reply.result == TNFS_RESULT_SUCCESS && l >= TNFS_HEADER_SIZE + 3)
+            reply.length = std::min(TNFS_UINT16_FROM_LOHI_BYTEPTR(response.payload + 1), l - TNFS_HEADER_SIZE - 3);
+        reply.data = response.payload + 3;
+        return true;
+    };
+    io.seek = [&](uint32_t position) {
+        return _tnfs_server_seek(m_info, pFHI, position);
+    };
+    io.millis = []() {
+        return (uint64_t)fnSystem.millis();
+    };
+    io.wait = []() {
+        if (SYSTEM_BUS.getShuttingDown())
+            return false;
+#ifdef ESP_PLATFORM
+        fnSystem.yield();
+#else
+        fnSystem.delay_microseconds(1000);
+#endif
+        return true;
+    };
+
+    uint32_t position = pFHI->file_position;
+    int result = _tnfs_read_pipelined(io, m_info->read_window, m_info->current_sequence_num,
+                                      position, pFHI->cache, sizeof(pFHI->cache),
+                                      loaded, eof, m_info->timeout_ms, m_info->max_retries);
+
+    pFHI->file_position = position + *loaded;
+
+    #ifdef VERBOSE_TNFS
+    Debug_printf("_tnfs_fill_cache_pipelined got %lu bytes, window %u, rtt %ums\r\n", *loaded, m_info->read_window.size, m_info->read_window.rtt_ms);
+    #endif
+
+    return result;
+}
+
+/*
+ Moves the server's file pointer without touching the cache or the client's position
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+*/
+int _tnfs_server_seek(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint32_t position)
+{
+    tnfsPacket packet;
+    packet.command = TNFS_CMD_LSEEK;
+    packet.payload[0] = pFHI->handle_id;
+    packet.payload[1] = SEEK_SET;
+    TNFS_UINT32_TO_LOHI_BYTEPTR(position, packet.payload + 2);
+
+    if (_tnfs_transaction(m_info, packet, 6))
+    {
+        if (packet.payload[0] == TNFS_RESULT_SUCCESS)
+            pFHI->file_position = position;
+        return packet.payload[0];
+    }
+    return -1;
+}
+
 /*
  Reads from an open file.
  Max bufflen is TNFS_PAYLOAD_SIZE - 3; any larger size will return an error
@@ -6,6 +6,7 @@
 
 #include "fnDNS.h"
 #include "fnTcpClient.h"
+#include "tnfslib_pipeline.h"
 
 
 #define TNFS_DEFAULT_PORT 16384
@@ -16,7 +17,7 @@
 #define TNFS_MAX_FILE_HANDLES 8 // Max number of file handles we'll open to the server
 #define TNFS_MAX_FILELEN 256
 
-#define TNFS_FILE_CACHE_SIZE 512 // 4 * 128 fits in a single packet when TNFS_MAX_READWRITE_PAYLOAD is 512
+#define TNFS_FILE_CACHE_SIZE (TNFS_READ_CHUNK * TNFS_READ_WINDOW_MAX) // Filled by pipelined READs over UDP, one packet at a time over TCP
 
 #define TNFS_INVALID_HANDLE -1
 #define TNFS_INVALID_SESSION 0 // We're assuming a '0' is never a valid session ID
@@ -115,6 +116,7 @@ public:
     uint8_t max_retries = TNFS_RETRIES;
     int timeout_ms = TNFS_TIMEOUT;
     uint8_t current_sequence_num = 0; // Updated with each transaction to the server
+    tnfsReadWindow read_window; // READs in flight when filling a file cache, adapted to loss
 
     int16_t dir_handle = TNFS_INVALID_HANDLE; // Stored from server's response to TNFS_OPENDIR
     uint16_t dir_entries = 0; // Stored from server's response to TNFS_OPENDIRX
@@ -0,0 +1,131 @@
+#include "tnfslib_pipeline.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "../../include/debug.h"
+
+int _tnfs_read_pipelined(tnfsReadTransport &io, tnfsReadWindow &window, uint8_t &sequence_num,
+                         uint32_t position, uint8_t *dest, uint32_t dest_size,
+                         uint32_t *loaded, bool *eof, int timeout_ms, uint8_t max_retries)
+{
+    *loaded = 0;
+    *eof = false;
+
+    uint8_t failures = 0;
+    window.size = std::max((uint8_t)TNFS_READ_WINDOW_MIN, std::min(window.size, (uint8_t)TNFS_READ_WINDOW_MAX));
+
+    while (*loaded < dest_size && *eof == false)
+    {
+        // Send this round's requests back to back
+        uint32_t wanted = dest_size - *loaded;
+        uint8_t count = std::min((uint32_t)window.size, (wanted + TNFS_READ_CHUNK - 1) / TNFS_READ_CHUNK);
+        uint8_t first = sequence_num;
+
+        uint8_t sent = 0;
+        for (; sent < count; sent++)
+        {
+            uint16_t bytes = std::min((uint32_t)TNFS_READ_CHUNK, wanted - (sent * TNFS_READ_CHUNK));
+            if (!io.send_read(sequence_num++, bytes))
+                break;
+        }
+
+        // Without an RTT yet use the full timeout, after that a few round trips
+        int timeout = timeout_ms;
+        if (window.rtt_ms > 0)
+            timeout = std::min(timeout_ms, std::max(TNFS_READ_MIN_TIMEOUT, window.rtt_ms * 4));
+
+        uint64_t ms_sent = io.millis();
+        uint64_t ms_last = ms_sent;
+
+        uint8_t next = 0;       // Next reply we can use
+        uint8_t received = 0;
+        uint32_t seen = 0;      // Bit per reply
+        bool broken = false;
+        int error = 0;
+
+        while (received < sent)
+        {
+            tnfsReadReply reply;
+            if (!io.recv_reply(reply))
+            {
+                if (io.millis() - ms_last >= (uint64_t)timeout)
+                    break;
+                if (!io.wait())
+                    return -1;
+                continue;
+            }
+
+            // Left over from an earlier round, or a duplicate
+            uint8_t k = reply.sequence_num - first;
+            if (k >= sent || (seen & (1u << k)))
+                continue;
+
+            seen |= (1u << k);
+            received++;
+            ms_last = io.millis();
+
+            if (k == 0)
+            {
+                uint16_t sample = std::max((uint64_t)1, ms_last - ms_sent);
+                window.rtt_ms = window.rtt_ms ? ((window.rtt_ms * 3) + sample) / 4 : sample;
+            }
+
+            // Arrived ahead of one we haven't seen, the rest of the round can't be trusted
+            if (broken || k != next)
+            {
+                broken = true;
+                continue;
+            }
+            next++;
+
+            if (reply.result == TNFS_RESULT_SUCCESS)
+            {
+                uint16_t bytes = std::min((uint32_t)reply.length, dest_size - *loaded);
+                memcpy(dest + *loaded, reply.data, bytes);
+                *loaded += bytes;
+            }
+            else if (reply.result == TNFS_RESULT_END_OF_FILE)
+            {
+                // The READs after this one get EOF too
+                *eof = true;
+            }
+            else
+            {
+                error = reply.result;
+                broken = true;
+            }
+        }
+
+        if (*eof)
+            break;
+
+        if (error == 0 && next == sent && sent == count)
+        {
+            // Clean round, try one more in flight next time
+            if (count == window.size && window.size < TNFS_READ_WINDOW_MAX)
+                window.size++;
+            failures = 0;
+            continue;
+        }
+
+        // Lost, reordered or refused: put the server's file pointer back after what we kept
+        if (error == 0)
+        {
+            window.size = std::max(TNFS_READ_WINDOW_MIN, window.size / 2);
+            Debug_printf("_tnfs_read_pipelined lost replies (%u of %u in order), window now %u\r\n", next, sent, window.size);
+        }
+
+        int result = io.seek(position + *loaded);
+        if (result != 0)
+            return result;
+
+        if (error != 0)
+            return error;
+
+        if (++failures > max_retries)
+            return -1;
+    }
+
+    return 0;
+}
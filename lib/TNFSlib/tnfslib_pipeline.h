@@ -0,0 +1,75 @@
+#ifndef _TNFSLIB_PIPELINE_H
+#define _TNFSLIB_PIPELINE_H
+
+/*
+ Pipelined READs
+
+ A TNFS READ carries no offset, the server reads from wherever the last
+ READ (or LSEEK) left its file pointer. It also handles requests in the
+ order they arrive. So several READs can be sent back to back, and the
+ data in each reply follows on from the one before it, as long as every
+ request got there and got there in order.
+
+ Replies are therefore only used in sequence. A reply that is lost, or
+ one that arrives ahead of an earlier one, means the server's file
+ pointer can't be trusted. The rest of that round is drained and
+ discarded, a LSEEK puts the pointer back after the last byte we kept,
+ and the window is halved. Every clean round that used the whole window
+ opens it by one more request.
+
+ The transport is passed in so this can be tested without the network stack.
+*/
+
+#include <cstdint>
+#include <functional>
+
+#define TNFS_READ_CHUNK 512         // Bytes per pipelined READ, fits a UDP datagram
+#define TNFS_READ_WINDOW_MIN 1
+#define TNFS_READ_WINDOW_START 4
+#define TNFS_READ_WINDOW_MAX 8      // READs in flight, TNFS_FILE_CACHE_SIZE holds this many chunks
+#define TNFS_READ_MIN_TIMEOUT 100   // Shortest wait (ms) before a reply is counted as lost
+
+// Also in tnfslib.h, which needs the network stack
+#ifndef TNFS_RESULT_SUCCESS
+#define TNFS_RESULT_SUCCESS 0x00
+#endif
+#ifndef TNFS_RESULT_END_OF_FILE
+#define TNFS_RESULT_END_OF_FILE 0x21
+#endif
+
+// One reply to a pipelined READ
+struct tnfsReadReply
+{
+    uint8_t sequence_num = 0;
+    uint8_t result = 0;
+    uint16_t length = 0;
+    const uint8_t *data = nullptr;
+};
+
+// How the pipeline talks to the server
+struct tnfsReadTransport
+{
+    std::function<bool(uint8_t sequence_num, uint16_t count)> send_read;
+    std::function<bool(tnfsReadReply &reply)> recv_reply; // false if nothing is waiting
+    std::function<int(uint32_t position)> seek;           // reliable LSEEK, returns the TNFS result or -1
+    std::function<uint64_t()> millis;
+    std::function<bool()> wait;                           // between polls, false to give up
+};
+
+// Window and round trip time, kept per mount
+struct tnfsReadWindow
+{
+    uint8_t size = TNFS_READ_WINDOW_START;
+    uint16_t rtt_ms = 0;
+};
+
+/*
+ Reads dest_size bytes starting at position (where the server's file pointer is)
+ Bytes read are placed in loaded, eof is set if the server reported end of file
+ Returns: 0: success or EOF; -1: failed to deliver/receive packets; other: TNFS error result code
+*/
+int _tnfs_read_pipelined(tnfsReadTransport &io, tnfsReadWindow &window, uint8_t &sequence_num,
+                         uint32_t position, uint8_t *dest, uint32_t dest_size,
+                         uint32_t *loaded, bool *eof, int timeout_ms, uint8_t max_retries);
+
+#endif // _TNFSLIB_PIPELINE_H
@@ -2,6 +2,7 @@
 
 #include "iec.h"
 #include "../../device/iec/meatloaf.h"
+#include "../../meatloaf/archive/archive_journal.h"
 
 #include <cstring>
 #include <memory>
@@ -120,6 +121,16 @@ void systemBus::service()
     }
   else
     fnLedManager.set(eLed::LED_BUS, active);
+
+  // Fold journaled archive saves back once the bus has been quiet for a while
+  static uint32_t lastActive = 0;
+  if( active )
+    lastActive = fnSystem.millis();
+  else if( (fnSystem.millis()-lastActive) > ARCHIVE_WRITEBACK_IDLE_MS )
+    {
+      if( ArchiveWriteBack::service() )
+        lastActive = fnSystem.millis();
+    }
 }
 
 
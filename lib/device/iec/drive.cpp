@@ -38,6 +38,7 @@
 #include "display.h"
 
 #include "meat_media.h"
+#include "link/link_prefetch.h"
 #include "qrmanager.h"
 
 
@@ -413,6 +414,9 @@ uint8_t iecChannelHandlerDir::readBufferData()
 
       if( entry != nullptr )
         {
+          // resolve link targets now so LOADing one doesn't wait on DNS
+          prefetchLinkHost(entry.get());
+
           // directory entry
           uint16_t size = entry->blocks();
           m_data[m_len++] = 1;
@@ -251,7 +251,10 @@ void iecNetwork::parse_json()
     if (channel_data.protocol)
         channel_data.protocol->status(&ns);
 
-    if (!channel_data.json->parse())
+    // With a query only its value is kept, without one the whole tree for any query
+    std::string query = pt.size() > 2 ? pt[2] : "";
+
+    if (!channel_data.json->parse(query))
     {
         Debug_printf("could not parse json");
         iecStatus.error = NETWORK_ERROR_GENERAL;
@@ -308,7 +311,7 @@ void iecNetwork::query_json()
     size_t len = channel_data.json->readValueLen();
     std::vector<uint8_t> buffer(len);
     channel_data.json->readValue(buffer.data(), buffer.size());
-    channel_data.receiveBuffer += std::string(buffer.begin(), buffer.end());
+    channel_data.receiveBuffer.append(buffer.data(), buffer.size());
 
     snprintf(reply, 80, "query set to %s", s.c_str());
     iecStatus.error = NETWORK_ERROR_SUCCESS;
@@ -351,11 +354,12 @@ void iecNetwork::parse_bite()
     //mstr::replaceAll(*receiveBuffer[channel], ":", "\":\"");
     //mstr::replaceAll(*receiveBuffer[channel], "\r", "\"\r\"");
     //mstr::replaceAll(*receiveBuffer[channel], "\"", "\"\"");
-    mstr::replaceAll(channel_data.receiveBuffer, "\"", "");
+    std::string receiveBuffer = channel_data.receiveBuffer.str();
+    mstr::replaceAll(receiveBuffer, "\"", "");
 
     // break up receiveBuffer[channel] into bites less than bite_size bytes
     std::string bites = "\"";
-    bites.reserve(channel_data.receiveBuffer.size() + (channel_data.receiveBuffer.size() / bite_size));
+    bites.reserve(receiveBuffer.size() + (receiveBuffer.size() / bite_size));
 
     int start = 0;
     int end = 0;
@@ -366,18 +370,18 @@ void iecNetwork::parse_bite()
         start = end;
 
         // Set remaining length
-        len = channel_data.receiveBuffer.size() - start;
+        len = receiveBuffer.size() - start;
         if ( len > bite_size )
             len = bite_size;
 
         // Don't make extra bites!
-        end = channel_data.receiveBuffer.find('\r', start);
+        end = receiveBuffer.find('\r', start);
         if ( end == std::string::npos )
             end = start + len; // None found so set end
 
         // Take a bite
         Debug_printv("start[%d] end[%d] len[%d] bite_size[%d]", start, end, len, bite_size);
-        std::string bite = channel_data.receiveBuffer.substr(start, len);
+        std::string bite = receiveBuffer.substr(start, len);
         bites += bite;
         Debug_printv("bite[%s]", bite.c_str());
 
@@ -386,7 +390,7 @@ void iecNetwork::parse_bite()
              bites += "\r\"";
 
         count++;
-    } while ( end < channel_data.receiveBuffer.size() );
+    } while ( end < receiveBuffer.size() );
  
     //bites += "\"";
     //Debug_printv("[%s]", bites.c_str());
@@ -1057,7 +1061,10 @@ bool iecNetwork::receive(NetworkData &channel_data, uint16_t rxBytes)
   channel_data.protocol->status(&ns);
   if( ns.rxBytesWaiting>0 )
     {
-      uint16_t blockSize = std::min(ns.rxBytesWaiting, rxBytes);
+      // No more than the ring has room for, the rest waits in the protocol
+      uint16_t blockSize = std::min({ (size_t)ns.rxBytesWaiting, (size_t)rxBytes, channel_data.receiveBuffer.space() });
+      if( blockSize == 0 )
+        return true;
       Debug_printf("bytes waiting: %u / blockSize: %u / connected: %u / error: %u ", ns.rxBytesWaiting, blockSize, ns.connected, ns.error);
       if( channel_data.protocol->read(blockSize) )
         {
@@ -1098,9 +1105,8 @@ uint8_t iecNetwork::read(uint8_t channel, uint8_t *buffer, uint8_t bufferSize, b
     if( !receive(channel_data, 2048) )
       return 0;
 
-  uint8_t n = std::min((int) channel_data.receiveBuffer.size(), (int) bufferSize);
-  memcpy(buffer, channel_data.receiveBuffer.data(), n);
-  channel_data.receiveBuffer.erase(0, n);
+  // Only the bytes taken are touched, the rest stays where it is in the ring
+  uint8_t n = channel_data.receiveBuffer.read(buffer, bufferSize);
 
   //if( n>0 ) Debug_printv("iecNetwork::read(#%d, %d, %d)", m_devnr, channel, bufferSize);
   return n;
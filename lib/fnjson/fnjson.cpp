@@ -88,6 +88,17 @@ void FNJSON::setReadQuery(const std::string &queryString, uint8_t queryParam)
  */
 cJSON *FNJSON::resolveQuery()
 {
+    // Only the first query's value was kept from a streamed document
+    if (_streamed)
+    {
+        if (_queryString != _streamedQuery)
+        {
+            Debug_printf("FNJSON::resolveQuery() - document was too big to keep, only \"%s\" can be read\r\n", _streamedQuery.c_str());
+            return nullptr;
+        }
+        return _json;
+    }
+
     if (_queryString.empty())
         return _json;
 
@@ -297,9 +308,9 @@ int FNJSON::readValueLen()
 }
 
 /**
- * Parse data from protocol
+ * Parse data from protocol, only the value query names if it names one
  */
-bool FNJSON::parse()
+bool FNJSON::parse(const std::string &query)
 {
     NetworkStatus ns;
 
@@ -310,11 +321,17 @@ bool FNJSON::parse()
         _json = nullptr;
     }
 
+    _streamed = false;
+
     if (_protocol == nullptr)
     {
         // Debug_printf("FNJSON::parse() - NULL protocol.\r\n");
         return false;
     }
+
+    if (!JSONQueryStream::whole(query))
+        return stream(query);
+
     _parseBuffer.clear();
     _protocol->status(&ns);
 #ifdef VERBOSE_PROTOCOL
@@ -331,8 +348,10 @@ bool FNJSON::parse()
         if (ns.rxBytesWaiting > 0)
         {
             _protocol->read(ns.rxBytesWaiting);
-            _parseBuffer += *_protocol->receiveBuffer;
-            _protocol->receiveBuffer->clear();
+            size_t len = _protocol->receiveBuffer->size();
+            size_t end = _parseBuffer.size();
+            _parseBuffer.resize(end + len);
+            _protocol->receiveBuffer->read((uint8_t *)&_parseBuffer[end], len);
         }
         _protocol->status(&ns);
 #ifdef ESP_PLATFORM
@@ -361,6 +380,65 @@ bool FNJSON::parse()
     return true;
 }
 
+/**
+ * Run the document through the query, keeping only the value it names.
+ * Reading stops as soon as that value is complete.
+ */
+bool FNJSON::stream(const std::string &pointer)
+{
+    JSONQueryStream query(pointer);
+    NetworkStatus ns;
+
+    _streamed = true;
+    _streamedQuery = pointer;
+    _parseBuffer.clear();
+
+    _protocol->status(&ns);
+    while (query.result() == JSONQueryStream::MORE)
+    {
+        if (ns.rxBytesWaiting > 0)
+        {
+            _protocol->read(ns.rxBytesWaiting);
+
+            char chunk[FNJSON_STREAM_CHUNK];
+            while (query.result() == JSONQueryStream::MORE && !_protocol->receiveBuffer->empty())
+            {
+                size_t len = _protocol->receiveBuffer->peek((uint8_t *)chunk, sizeof(chunk));
+                size_t used = 0;
+                query.feed(chunk, len, &used);
+                _protocol->receiveBuffer->consume(used);
+            }
+        }
+#ifdef ESP_PLATFORM
+        else if (!ns.connected)
+#else
+        else if (!ns.connected && ns.rxBytesWaiting == 0)
+#endif
+        {
+            query.finish();
+            break;
+        }
+
+        if (query.result() != JSONQueryStream::MORE)
+            break;
+
+        _protocol->status(&ns);
+#ifdef ESP_PLATFORM
+        vTaskDelay(10);
+#endif
+    }
+
+#ifdef VERBOSE_PROTOCOL
+    Debug_printf("FNJSON::stream() - result %d, value %u bytes, peak %u bytes\r\n", query.result(), query.match().size(), query.peak());
+#endif
+
+    if (query.result() != JSONQueryStream::FOUND)
+        return false;
+
+    _json = cJSON_Parse(query.match().c_str());
+    return _json != nullptr;
+}
+
 bool FNJSON::status(NetworkStatus *s)
 {
     // Debug_printf("FNJSON::status(%u) %s\r\n", json_bytes_remaining, getValue(_item).c_str());
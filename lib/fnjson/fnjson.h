@@ -13,6 +13,13 @@
 #include <string.h>
 
 #include "../network-protocol/Protocol.h"
+#include "json_stream.h"
+
+// Documents parsed without a query are parsed whole, and can be queried
+// any number of times. Given a query that names part of the document only
+// that value is kept as the document streams in, and only that query can
+// be read from it.
+#define FNJSON_STREAM_CHUNK 512
 
 class FNJSON
 {
@@ -26,7 +33,7 @@ public:
     cJSON *resolveQuery();
     bool status(NetworkStatus *status);
     
-    bool parse();
+    bool parse(const std::string &query = "");
     int readValueLen();
     bool readValue(uint8_t *buf, unsigned short len);
     std::string processString(std::string in);
@@ -42,6 +49,10 @@ private:
     std::string lineEnding;
     std::string getValue(cJSON *item);
     std::string _parseBuffer;
+
+    bool stream(const std::string &query);
+    bool _streamed = false;     // _json is only the value of _streamedQuery
+    std::string _streamedQuery;
 };
 
 #endif /* JSON_H */
\ No newline at end of file
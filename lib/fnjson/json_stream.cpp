@@ -0,0 +1,436 @@
+/**
+ * Streaming JSON pointer query for #FujiNet
+ */
+
+#include "json_stream.h"
+
+#include <algorithm>
+#include <cctype>
+
+/**
+ * ctor
+ */
+JSONQueryStream::JSONQueryStream(const std::string &pointer)
+{
+    reset(pointer);
+}
+
+/**
+ * Split the pointer into its unescaped tokens, the way cJSONUtils_GetPointer
+ * walks it. Anything not starting with '/' names the whole document.
+ */
+void JSONQueryStream::reset(const std::string &pointer)
+{
+    _tokens.clear();
+    _indexes.clear();
+
+    size_t pos = 0;
+    while (pos < pointer.size() && pointer[pos] == '/')
+    {
+        size_t end = pointer.find('/', pos + 1);
+        if (end == std::string::npos)
+            end = pointer.size();
+
+        std::string token;
+        for (size_t i = pos + 1; i < end; i++)
+        {
+            if (pointer[i] == '~' && i + 1 < end && pointer[i + 1] == '1')
+            {
+                token += '/';
+                i++;
+            }
+            else if (pointer[i] == '~' && i + 1 < end && pointer[i + 1] == '0')
+            {
+                token += '~';
+                i++;
+            }
+            else
+                token += pointer[i];
+        }
+
+        // Array index: digits, no leading zero
+        int64_t index = -1;
+        if (!token.empty() && token.size() < 10 && (token == "0" || token[0] != '0') &&
+            std::all_of(token.begin(), token.end(), [](char c) { return isdigit((uint8_t)c); }))
+            index = std::stoll(token);
+
+        _tokens.push_back(token);
+        _indexes.push_back(index);
+        pos = end;
+    }
+
+    _stack.clear();
+    _expect = VALUE;
+    _result = MORE;
+    _inString = _isKey = _inLiteral = false;
+    _escape = 0;
+    _unicode = _surrogate = 0;
+    _key.clear();
+    _collectKey = false;
+    _match.clear();
+    _capturing = false;
+    _captureDepth = 0;
+    _peak = 0;
+}
+
+/**
+ * Run the next piece of the document through the tokenizer
+ */
+JSONQueryStream::Result JSONQueryStream::feed(const char *data, size_t len, size_t *used)
+{
+    size_t i = 0;
+    while (i < len && _result == MORE)
+    {
+        if (!step(data[i++]))
+            _result = ERROR;
+    }
+
+    _peak = std::max(_peak, _match.size() + _key.size() + (_stack.size() * sizeof(Level)));
+
+    if (used != nullptr)
+        *used = i;
+
+    return _result;
+}
+
+/**
+ * No more document. A number at the very end has nothing after it to end it.
+ */
+JSONQueryStream::Result JSONQueryStream::finish()
+{
+    if (_result != MORE)
+        return _result;
+
+    if (_inLiteral)
+    {
+        _inLiteral = false;
+        valueEnd();
+    }
+
+    // Cut short
+    if (_result == MORE)
+        _result = ERROR;
+
+    return _result;
+}
+
+/**
+ * One character, false if it can't be JSON
+ */
+bool JSONQueryStream::step(char c)
+{
+    if (_inString)
+    {
+        if (_capturing)
+            _match += c;
+
+        if (_escape == 1)
+        {
+            _escape = 0;
+            switch (c)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                keyChar(c);
+                break;
+            case 'b':
+                keyChar('\b');
+                break;
+            case 'f':
+                keyChar('\f');
+                break;
+            case 'n':
+                keyChar('\n');
+                break;
+            case 'r':
+                keyChar('\r');
+                break;
+            case 't':
+                keyChar('\t');
+                break;
+            case 'u':
+                _escape = 2;
+                _unicode = 0;
+                break;
+            default:
+                return false;
+            }
+            return true;
+        }
+
+        if (_escape > 1)
+        {
+            if (!isxdigit((uint8_t)c))
+                return false;
+            _unicode = (_unicode << 4) | (isdigit((uint8_t)c) ? c - '0' : (tolower((uint8_t)c) - 'a' + 10));
+            if (++_escape == 6)
+            {
+                _escape = 0;
+                keyUnicode(_unicode);
+            }
+            return true;
+        }
+
+        if (c == '\\')
+        {
+            _escape = 1;
+            return true;
+        }
+
+        if (c == '"')
+        {
+            _inString = false;
+            if (_isKey)
+            {
+                Level &level = _stack.back();
+                level.keyMatch = false;
+                if (_collectKey)
+                {
+                    const std::string &token = _tokens[_stack.size() - 1];
+                    level.keyMatch = _key.size() == token.size() &&
+                                     std::equal(_key.begin(), _key.end(), token.begin(), [](char a, char b) {
+                                         return tolower((uint8_t)a) == tolower((uint8_t)b);
+                                     });
+                }
+                _key.clear();
+                _expect = COLON;
+            }
+            else
+                valueEnd();
+            return true;
+        }
+
+        if ((uint8_t)c < 0x20)
+            return false;
+
+        keyChar(c);
+        return true;
+    }
+
+    if (_inLiteral)
+    {
+        if (isalnum((uint8_t)c) || c == '+' || c == '-' || c == '.')
+        {
+            if (_capturing)
+                _match += c;
+            return true;
+        }
+
+        // The character after a number or true/false/null ends it
+        _inLiteral = false;
+        valueEnd();
+        if (_result != MORE)
+            return true;
+    }
+
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+    {
+        if (_capturing)
+            _match += c;
+        return true;
+    }
+
+    switch (_expect)
+    {
+    case FIRST_VALUE:
+        if (c == ']')
+            return close(true);
+        // fall through
+    case VALUE:
+        return valueStart(c);
+
+    case FIRST_KEY:
+        if (c == '}')
+            return close(false);
+        // fall through
+    case KEY:
+        if (c != '"')
+            return false;
+        if (_capturing)
+            _match += c;
+        _inString = true;
+        _isKey = true;
+        _collectKey = _stack.back().onPath && _stack.size() <= _tokens.size();
+        return true;
+
+    case COLON:
+        if (c != ':')
+            return false;
+        if (_capturing)
+            _match += c;
+        _expect = VALUE;
+        return true;
+
+    case COMMA:
+        if (c == ']' || c == '}')
+            return close(c == ']');
+        if (c != ',')
+            return false;
+        if (_capturing)
+            _match += c;
+        if (_stack.back().array)
+        {
+            _stack.back().index++;
+            _expect = VALUE;
+        }
+        else
+            _expect = KEY;
+        return true;
+
+    case DONE:
+    default:
+        return false;
+    }
+}
+
+/**
+ * First character of a value
+ */
+bool JSONQueryStream::valueStart(char c)
+{
+    // Does the pointer go through here?
+    bool onPath = true;
+    size_t depth = _stack.size();
+    if (depth > 0)
+        onPath = depth <= _tokens.size() && tokenMatches(_stack.back());
+
+    if (onPath && !_capturing && depth == _tokens.size())
+    {
+        _capturing = true;
+        _captureDepth = depth;
+    }
+
+    if (_capturing)
+        _match += c;
+    else if (onPath && c != '{' && c != '[')
+    {
+        // The pointer goes deeper than this value does
+        _result = NOT_FOUND;
+        return true;
+    }
+
+    switch (c)
+    {
+    case '{':
+    case '[':
+        _stack.push_back({c == '[', onPath && !_capturing, false, 0});
+        _expect = (c == '[') ? FIRST_VALUE : FIRST_KEY;
+        return true;
+
+    case '"':
+        _inString = true;
+        _isKey = false;
+        return true;
+
+    default:
+        if (c == '-' || isdigit((uint8_t)c) || c == 't' || c == 'f' || c == 'n')
+        {
+            _inLiteral = true;
+            return true;
+        }
+        return false;
+    }
+}
+
+/**
+ * A value is complete
+ */
+void JSONQueryStream::valueEnd()
+{
+    if (_capturing && _stack.size() == _captureDepth)
+    {
+        _capturing = false;
+        _result = FOUND;
+    }
+
+    if (_stack.empty())
+    {
+        _expect = DONE;
+        if (_result == MORE)
+            _result = NOT_FOUND;
+    }
+    else
+        _expect = COMMA;
+}
+
+/**
+ * ']' or '}'
+ */
+bool JSONQueryStream::close(bool array)
+{
+    if (_stack.empty() || _stack.back().array != array)
+        return false;
+
+    if (_capturing)
+        _match += array ? ']' : '}';
+
+    bool onPath = _stack.back().onPath;
+    _stack.pop_back();
+
+    // The pointer led in here and nothing in it matched
+    if (onPath && !_capturing)
+    {
+        _result = NOT_FOUND;
+        return true;
+    }
+
+    valueEnd();
+    return true;
+}
+
+/**
+ * Is the value coming up in level the one the pointer names next?
+ */
+bool JSONQueryStream::tokenMatches(const Level &level)
+{
+    if (!level.onPath)
+        return false;
+
+    if (level.array)
+        return _indexes[_stack.size() - 1] == (int64_t)level.index;
+
+    return level.keyMatch;
+}
+
+void JSONQueryStream::keyChar(char c)
+{
+    if (_isKey && _collectKey)
+        _key += c;
+}
+
+/**
+ * \uXXXX in a key, as UTF-8
+ */
+void JSONQueryStream::keyUnicode(uint32_t cp)
+{
+    if (cp >= 0xD800 && cp <= 0xDBFF)
+    {
+        _surrogate = cp;
+        return;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF && _surrogate != 0)
+        cp = 0x10000 + ((_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+    _surrogate = 0;
+
+    if (cp < 0x80)
+        keyChar(cp);
+    else if (cp < 0x800)
+    {
+        keyChar(0xC0 | (cp >> 6));
+        keyChar(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+        keyChar(0xE0 | (cp >> 12));
+        keyChar(0x80 | ((cp >> 6) & 0x3F));
+        keyChar(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        keyChar(0xF0 | (cp >> 18));
+        keyChar(0x80 | ((cp >> 12) & 0x3F));
+        keyChar(0x80 | ((cp >> 6) & 0x3F));
+        keyChar(0x80 | (cp & 0x3F));
+    }
+}
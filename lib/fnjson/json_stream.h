@@ -0,0 +1,102 @@
+/**
+ * Streaming JSON pointer query for #FujiNet
+ *
+ * Tokenizes a JSON document as it arrives and keeps only the text of
+ * the value a JSON pointer (as used by cJSONUtils_GetPointer, keys
+ * matched case insensitively, first of duplicate keys wins) names.
+ * Everything else is skipped, so memory is bounded by the answer, not
+ * by the document.
+ */
+
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class JSONQueryStream
+{
+public:
+    enum Result
+    {
+        MORE,       // need more of the document
+        FOUND,      // match() holds the value's text
+        NOT_FOUND,  // the document has no such value
+        ERROR       // not JSON
+    };
+
+    JSONQueryStream(const std::string &pointer = "");
+
+    // The pointer names the whole document, streaming it saves nothing
+    static bool whole(const std::string &pointer) { return pointer.empty() || pointer[0] != '/'; };
+
+    // Start over with another pointer
+    void reset(const std::string &pointer);
+
+    // Feed the next piece of the document. Stops at the end of the match,
+    // *used (if given) says how much of data was taken.
+    Result feed(const char *data, size_t len, size_t *used = nullptr);
+
+    // End of document
+    Result finish();
+
+    Result result() { return _result; };
+    const std::string &match() { return _match; };
+
+    // Most bytes held at once (match and key), for measuring
+    size_t peak() { return _peak; };
+
+private:
+    enum Expect : uint8_t
+    {
+        VALUE,
+        FIRST_VALUE,    // value or ']'
+        KEY,
+        FIRST_KEY,      // key or '}'
+        COLON,
+        COMMA,          // ',' or the container's close
+        DONE
+    };
+
+    struct Level
+    {
+        bool array;
+        bool onPath;    // this container is named by the pointer so far
+        bool keyMatch;  // current key is the pointer's next token
+        uint32_t index;
+    };
+
+    bool step(char c);
+    bool valueStart(char c);
+    void valueEnd();
+    bool close(bool array);
+    void keyChar(char c);
+    void keyUnicode(uint32_t cp);
+    bool tokenMatches(const Level &level);
+
+    std::vector<std::string> _tokens;
+    std::vector<int64_t> _indexes;  // tokens as array indexes, -1 if not one
+    std::vector<Level> _stack;
+    Expect _expect = VALUE;
+    Result _result = MORE;
+
+    // Lexer state
+    bool _inString = false;
+    bool _isKey = false;
+    bool _inLiteral = false;
+    uint8_t _escape = 0;        // 1 after '\\', 2..5 in \uXXXX
+    uint32_t _unicode = 0;
+    uint32_t _surrogate = 0;
+
+    std::string _key;           // only collected where it can match
+    bool _collectKey = false;
+
+    std::string _match;
+    bool _capturing = false;
+    size_t _captureDepth = 0;
+    size_t _peak = 0;
+};
+
+#endif /* JSON_STREAM_H */
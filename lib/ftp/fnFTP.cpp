@@ -5,6 +5,7 @@
 #include "fnFTP.h"
 
 #include <string.h>
+#include <strings.h>
 
 #include "../../include/debug.h"
 
@@ -636,6 +637,73 @@ int ftpparse(struct ftpparse *fp, char *buf, int len)
     return 0;
 }
 
+/*
+mlsdparse(&fp,buf,len) parses one line of MLSD output (RFC 3659),
+facts separated by ';' then a space and the name:
+
+type=file;size=174848;modify=20230412183021; game.d64
+
+Returns 0 for the "cdir" and "pdir" entries and lines without a name.
+*/
+int mlsdparse(struct ftpparse *fp, char *buf, int len)
+{
+    int i = 0;
+
+    fp->name = 0;
+    fp->namelen = 0;
+    fp->flagtrycwd = 0;
+    fp->flagtryretr = 0;
+    fp->sizetype = FTPPARSE_SIZE_UNKNOWN;
+    fp->size = 0;
+    fp->mtimetype = FTPPARSE_MTIME_UNKNOWN;
+    fp->mtime = 0;
+    fp->idtype = FTPPARSE_ID_UNKNOWN;
+    fp->id = 0;
+    fp->idlen = 0;
+
+    while (i < len && buf[i] != ' ')
+    {
+        int j = i;
+        while (j < len && buf[j] != ';' && buf[j] != ' ')
+            ++j;
+
+        char *fact = buf + i;
+        int factlen = j - i;
+
+        if (factlen > 5 && strncasecmp(fact, "type=", 5) == 0)
+        {
+            if ((factlen == 9 && strncasecmp(fact + 5, "file", 4) == 0))
+                fp->flagtryretr = 1;
+            else if ((factlen == 8 && strncasecmp(fact + 5, "dir", 3) == 0))
+                fp->flagtrycwd = 1;
+            else
+                return 0; // cdir, pdir, OS.unix=slink...
+        }
+        else if (factlen > 5 && strncasecmp(fact, "size=", 5) == 0)
+        {
+            fp->sizetype = FTPPARSE_SIZE_BINARY;
+            fp->size = getlong(fact + 5, factlen - 5);
+        }
+        else if (factlen >= 21 && strncasecmp(fact, "modify=", 7) == 0)
+        {
+            // YYYYMMDDHHMMSS, always UTC
+            fp->mtimetype = FTPPARSE_MTIME_LOCAL;
+            initbase();
+            fp->mtime = base + totai(getlong(fact + 7, 4), getlong(fact + 11, 2) - 1, getlong(fact + 13, 2))
+                + getlong(fact + 15, 2) * 3600 + getlong(fact + 17, 2) * 60 + getlong(fact + 19, 2);
+        }
+
+        i = (j < len && buf[j] == ';') ? j + 1 : j;
+    }
+
+    if (i + 1 >= len)
+        return 0;
+
+    fp->name = buf + i + 1;
+    fp->namelen = len - i - 1;
+    return 1;
+}
+
 fnFTP::fnFTP()
 {
     _stor = false;
@@ -781,7 +849,7 @@ bool fnFTP::reconnect()
     return login(username, password, hostname, control_port);
 }
 
-bool fnFTP::open_file(string path, bool stor)
+bool fnFTP::open_file(string path, bool stor, uint32_t offset)
 {
     if (!control->connected())
     {
@@ -803,6 +871,19 @@ bool fnFTP::open_file(string path, bool stor)
         return true;
     }
 
+    // Start the transfer further in
+    if (stor == false && offset > 0)
+    {
+        REST(offset);
+
+        if (parse_response() || _statusCode != 350)
+        {
+            Debug_printf("fnFTP::open_file(%s) server refused REST %lu. Response was: %s\r\n", path.c_str(), offset, controlResponse.c_str());
+            data->stop();
+            return true;
+        }
+    }
+
     // Do command
     if (stor == true)
     {
@@ -877,6 +958,47 @@ bool fnFTP::open_directory(string path, string pattern)
         return true;
     }
 
+    _mlsd = false;
+    return read_listing(path, pattern);
+}
+
+bool fnFTP::open_directory_mlsd(string path)
+{
+    if (!control->connected())
+    {
+        Debug_printf("fnFTP::open_directory_mlsd(%s) attempted while not logged in. Aborting.\r\n", path.c_str());
+        return true;
+    }
+
+    if (get_data_port())
+    {
+        Debug_printf("fnFTP::open_directory_mlsd(%s) could not get data port, aborting.\n", path.c_str());
+        return true;
+    }
+
+    MLSD(path);
+
+    if (parse_response())
+    {
+        Debug_printf("fnFTP::open_directory_mlsd(%s) Timed out waiting for 150 response.\r\n", path.c_str());
+        data->stop();
+        return true;
+    }
+
+    if (!(is_positive_preliminary_reply() && is_filesystem_related()))
+    {
+        // 500/502 when the server doesn't know MLSD
+        Debug_printf("fnFTP::open_directory_mlsd(%s) - %s\r\n", path.c_str(), controlResponse.c_str());
+        data->stop();
+        return true;
+    }
+
+    _mlsd = true;
+    return read_listing(path, "");
+}
+
+bool fnFTP::read_listing(string path, string pattern)
+{
     uint8_t buf[256];
 
     // if (buf == nullptr)
@@ -953,6 +1075,32 @@ bool fnFTP::read_directory(string &name, long &filesize, bool &is_dir)
     return dirBuffer.eof();
 }
 
+bool fnFTP::read_directory(string &name, long &filesize, bool &is_dir, time_t &mtime)
+{
+    string line;
+    struct ftpparse parse;
+
+    // Skip what doesn't parse, like "total 42" and MLSD's cdir/pdir
+    while (getline(dirBuffer, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        int found = _mlsd ? mlsdparse(&parse, (char *)line.c_str(), line.length())
+                          : ftpparse(&parse, (char *)line.c_str(), line.length());
+        if (!found)
+            continue;
+
+        name = string(parse.name, parse.namelen);
+        filesize = parse.size;
+        is_dir = (parse.flagtrycwd == 1);
+        mtime = parse.mtime;
+        return false;
+    }
+
+    return true;
+}
+
 bool fnFTP::read_file(uint8_t *buf, unsigned short len)
 {
     Debug_printf("fnFTP::read_file(%p, %u)\r\n", buf, len);
@@ -998,6 +1146,92 @@ bool fnFTP::close()
     return res;
 }
 
+bool fnFTP::abort()
+{
+    Debug_printf("fnFTP::abort()\r\n");
+    if (_stor)
+        return close();
+
+    if (data->connected())
+    {
+        data->stop();
+        ABOR();
+
+        // 426 for the transfer that was cut short, then 226 for the ABOR.
+        // A transfer that had finished already only gets the 226.
+        if (!parse_response() && (_statusCode == 426 || _statusCode == 450 || _statusCode == 451))
+            parse_response();
+    }
+    else if (_expect_control_response)
+    {
+        // Transfer is done, the 226 may still be on its way
+        parse_response();
+    }
+
+    _expect_control_response = false;
+    control->flush();
+    return !control->connected();
+}
+
+bool fnFTP::logged_in()
+{
+    return control->connected();
+}
+
+bool fnFTP::get_size(string path, uint32_t &filesize)
+{
+    if (!control->connected())
+        return true;
+
+    SIZE(path);
+
+    if (parse_response() || _statusCode != 213)
+        return true;
+
+    filesize = strtoul(controlResponse.substr(4).c_str(), nullptr, 10);
+    return false;
+}
+
+bool fnFTP::make_directory(string path)
+{
+    if (!control->connected())
+        return true;
+
+    MKD(path);
+    return parse_response() || !is_positive_completion_reply();
+}
+
+bool fnFTP::remove_file(string path)
+{
+    if (!control->connected())
+        return true;
+
+    DELE(path);
+    return parse_response() || !is_positive_completion_reply();
+}
+
+bool fnFTP::remove_directory(string path)
+{
+    if (!control->connected())
+        return true;
+
+    RMD(path);
+    return parse_response() || !is_positive_completion_reply();
+}
+
+bool fnFTP::rename_file(string from, string to)
+{
+    if (!control->connected())
+        return true;
+
+    RNFR(from);
+    if (parse_response() || !is_positive_intermediate_reply())
+        return true;
+
+    RNTO(to);
+    return parse_response() || !is_positive_completion_reply();
+}
+
 int fnFTP::status()
 {
     return _statusCode;
@@ -1231,3 +1465,51 @@ void fnFTP::STOR(string path)
     Debug_printf("fnFTP::STOR(%s)\r\n",path.c_str());
     control->write("STOR " + path + "\r\n");
 }
+
+void fnFTP::MLSD(string path)
+{
+    Debug_printf("fnFTP::MLSD(%s)\r\n",path.c_str());
+    control->write("MLSD " + path + "\r\n");
+}
+
+void fnFTP::REST(uint32_t offset)
+{
+    Debug_printf("fnFTP::REST(%lu)\r\n",offset);
+    control->write("REST " + std::to_string(offset) + "\r\n");
+}
+
+void fnFTP::SIZE(string path)
+{
+    Debug_printf("fnFTP::SIZE(%s)\r\n",path.c_str());
+    control->write("SIZE " + path + "\r\n");
+}
+
+void fnFTP::MKD(string path)
+{
+    Debug_printf("fnFTP::MKD(%s)\r\n",path.c_str());
+    control->write("MKD " + path + "\r\n");
+}
+
+void fnFTP::RMD(string path)
+{
+    Debug_printf("fnFTP::RMD(%s)\r\n",path.c_str());
+    control->write("RMD " + path + "\r\n");
+}
+
+void fnFTP::DELE(string path)
+{
+    Debug_printf("fnFTP::DELE(%s)\r\n",path.c_str());
+    control->write("DELE " + path + "\r\n");
+}
+
+void fnFTP::RNFR(string path)
+{
+    Debug_printf("fnFTP::RNFR(%s)\r\n",path.c_str());
+    control->write("RNFR " + path + "\r\n");
+}
+
+void fnFTP::RNTO(string path)
+{
+    Debug_printf("fnFTP::RNTO(%s)\r\n",path.c_str());
+    control->write("RNTO " + path + "\r\n");
+}
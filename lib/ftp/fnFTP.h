@@ -54,9 +54,10 @@ public:
      * Open file on FTP server
      * @param path to file to open.
      * @param stor TRUE means STOR, otherwise RETR
+     * @param offset where RETR starts, sent as REST when not 0
      * @return TRUE if error, FALSE if successful.
      */
-    bool open_file(string path, bool stor);
+    bool open_file(string path, bool stor, uint32_t offset = 0);
 
     /**
      * Open directory on FTP server, grab it, and return back.
@@ -66,6 +67,14 @@ public:
      */
     bool open_directory(string path, string pattern);
 
+    /**
+     * Open directory on FTP server with MLSD (RFC 3659), grab it, and return back.
+     * read_directory() then parses the MLSD facts instead of LIST output.
+     * @param path directory to retrieve.
+     * @return TRUE if error (or the server doesn't know MLSD), FALSE if successful.
+     */
+    bool open_directory_mlsd(string path);
+
     /**
      * Read and return one parsed line of directory
      * @param name pointer to output name
@@ -74,6 +83,16 @@ public:
      */
     bool read_directory(string& name, long& filesize, bool &is_dir);
 
+    /**
+     * Return the next entry of the directory, skipping lines that don't parse
+     * @param name pointer to output name
+     * @param filesize pointer to output filesize
+     * @param is_dir pointer to output directory flag
+     * @param mtime pointer to output modification time
+     * @return TRUE if there are no more entries, FALSE if successful
+     */
+    bool read_directory(string& name, long& filesize, bool &is_dir, time_t &mtime);
+
     /**
      * Read file from data socket into buffer.
      * @param buf target buffer
@@ -95,6 +114,49 @@ public:
      */
     bool close();
 
+    /**
+     * @brief stop the current transfer, keeping the control connection for the next one.
+     * @return TRUE if the control connection was lost, FALSE if still logged in.
+     */
+    bool abort();
+
+    /**
+     * @brief return if the control connection is up
+     */
+    bool logged_in();
+
+    /**
+     * @brief Ask server for the size of path (SIZE)
+     * @param path file to ask about
+     * @param filesize output size
+     * @return TRUE if error, FALSE if successful.
+     */
+    bool get_size(string path, uint32_t &filesize);
+
+    /**
+     * @brief Create directory path (MKD)
+     * @return TRUE if error, FALSE if successful.
+     */
+    bool make_directory(string path);
+
+    /**
+     * @brief Delete file path (DELE)
+     * @return TRUE if error, FALSE if successful.
+     */
+    bool remove_file(string path);
+
+    /**
+     * @brief Delete directory path (RMD)
+     * @return TRUE if error, FALSE if successful.
+     */
+    bool remove_directory(string path);
+
+    /**
+     * @brief Rename from to to (RNFR/RNTO)
+     * @return TRUE if error, FALSE if successful.
+     */
+    bool rename_file(string from, string to);
+
     /**
      * @brief parsed out response code from controlResponse
      * @return int containing parsed out response code.
@@ -166,6 +228,9 @@ private:
      */
     string password;
 
+    /* last listing came from MLSD */
+    bool _mlsd = false;
+
     /**
      * Directory buffer stream
      */
@@ -176,6 +241,12 @@ private:
      */
     unsigned short data_port = 0;
 
+    /**
+     * Retrieve the listing the server is sending into dirBuffer
+     * @return TRUE if error, FALSE if successful.
+     */
+    bool read_listing(string path, string pattern);
+
     /**
      * read and parse control response
      * @return true on error, false on success.
@@ -316,6 +387,49 @@ private:
      */
     void STOR(string path);
 
+    /**
+     * @brief ask server for a machine readable listing (RFC 3659)
+     * @param path path of directory listing
+     */
+    void MLSD(string path);
+
+    /**
+     * @brief start the next RETR at offset
+     * @param offset byte offset
+     */
+    void REST(uint32_t offset);
+
+    /**
+     * @brief ask server for the size of path
+     * @param path path of file
+     */
+    void SIZE(string path);
+
+    /**
+     * @brief make directory path
+     */
+    void MKD(string path);
+
+    /**
+     * @brief remove directory path
+     */
+    void RMD(string path);
+
+    /**
+     * @brief delete file path
+     */
+    void DELE(string path);
+
+    /**
+     * @brief rename from path, RNTO follows
+     */
+    void RNFR(string path);
+
+    /**
+     * @brief rename to path
+     */
+    void RNTO(string path);
+
 };
 
 #endif /* FNFTP_H */
\ No newline at end of file
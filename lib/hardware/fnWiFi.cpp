@@ -20,6 +20,7 @@
 //#include "fuji.h"
 #include "fnSystem.h"
 #include "fnConfig.h"
+#include "fnConnectionPool.h"
 #include "led.h"
 
 #include "httpd_server.h"
@@ -655,6 +656,9 @@ void WiFiManager::handle_station_stop()
     oHttpdServer.stop();
     fnSystem.Net.stop_sntp_client();
     tcp_server.stop();
+
+    // Parked keep-alive connections went down with the link
+    fnConnectionPool::clear();
 }
 
 void add_mdns_services()
@@ -707,6 +711,7 @@ void WiFiManager::_wifi_event_handler(void *arg, esp_event_base_t event_base,
             break;
         case IP_EVENT_STA_LOST_IP:
             Debug_println("IP_EVENT_STA_LOST_IP");
+            fnConnectionPool::clear();
             break;
         case IP_EVENT_ETH_GOT_IP:
             Debug_println("IP_EVENT_ETH_GOT_IP");
@@ -4,11 +4,16 @@
 #include <cstring>
 #include <vector>
 
+#include <freertos/queue.h>
+#include <lwip/sockets.h>
+
 #include "fnHttpClient.h"
 
 #include "../../include/debug.h"
 
 #include "fnSystem.h"
+#include "fnConnectionPool.h"
+#include "peoples_url_parser.h"
 #include "../fn_esp_http_client/fn_esp_http_client.h"
 
 #include "utils.h"
@@ -18,11 +23,25 @@ using namespace fujinet;
 #define HTTPCLIENT_WAIT_FOR_CONSUMER_TASK 20000 // 20s
 #define HTTPCLIENT_WAIT_FOR_HTTP_TASK 20000     // 20s
 
+#define HTTPCLIENT_WORKERS 2              // Long lived workers, more are started (and go away) when they're all busy
+#define HTTPCLIENT_WORKER_QUEUE 8
+#define HTTPCLIENT_WORKER_STACKSIZE 4096
+#define HTTPCLIENT_WORKER_PRIORITY 5
+#define HTTPCLIENT_ABORT_DRAIN 4096       // Body left unread on close() that's still worth reading to keep the connection
+
 const char *webdav_depths[] = {"0", "1", "infinity"};
 
+// Only handles from our own esp_http_client share connections with each other
+#define HTTPCLIENT_POOL_CLIENT "fnHttpClient"
+
+// Requests waiting for a worker, shared by every fnHttpClient
+static QueueHandle_t worker_jobs = nullptr;
+static std::mutex worker_lock;
+static int workers_running = 0;
+static int workers_idle = 0;
+
 fnHttpClient::fnHttpClient()
 {
-    _buffer = (char *)malloc(DEFAULT_HTTP_BUF_SIZE);
 }
 
 // Close connection, destroy any resoruces
@@ -31,13 +50,8 @@ fnHttpClient::~fnHttpClient()
     close();
 
     Debug_printv("BEFORE free heap/low: %lu/%lu", esp_get_free_heap_size(), esp_get_free_internal_heap_size());
-    if (_handle != nullptr)
-    {
-        esp_http_client_cleanup(_handle);
-    }
+    _release_handle();
 
-    free(_buffer);
-    _buffer = nullptr;
     Debug_printv("AFTER free heap/low: %lu/%lu", esp_get_free_heap_size(), esp_get_free_internal_heap_size());
 }
 
@@ -48,6 +62,26 @@ bool fnHttpClient::begin(const std::string &url)
     Debug_printf("fnHttpClient::begin \"%s\"\r\n", url.c_str());
 #endif
 
+    // Done with whatever we were talking to before
+    if (_handle != nullptr)
+    {
+        close();
+        _release_handle();
+    }
+
+    // Reuse a connection to the same server if one is parked
+    auto u = PeoplesUrlParser::parseURL(url);
+    _pool_key = fnConnectionPool::key(HTTPCLIENT_POOL_CLIENT, u->scheme, u->user, u->host, u->getPort());
+    _handle = (esp_http_client_handle_t)fnConnectionPool::acquire(_pool_key);
+    if (_handle != nullptr)
+    {
+#ifdef VERBOSE_HTTP
+        Debug_printf("fnHttpClient::begin reusing connection\r\n");
+#endif
+        _reset_handle(url);
+        return true;
+    }
+
     esp_http_client_config_t cfg;
     memset(&cfg, 0, sizeof(cfg));
     cfg.url = url.c_str();
@@ -92,8 +126,8 @@ int fnHttpClient::available()
     else
         len = esp_http_client_get_content_length(_handle);
 
-    if (len - _buffer_total_read >= 0)
-        result = len - _buffer_total_read;
+    if (len - _total_read >= 0)
+        result = len - _total_read;
 
     // Debug_printf("::available result: %d\r\n", result);
     return result;
@@ -116,58 +150,28 @@ int fnHttpClient::read(uint8_t *dest_buffer, int dest_bufflen)
     if (_handle == nullptr || dest_buffer == nullptr)
         return -1;
 
-    int bytes_left;
-    int bytes_to_copy;
-
-    int bytes_copied = 0;
-
-    // Start by using our own buffer if there's data there
-    if (_buffer_len > 0 && _buffer_pos < _buffer_len)
-    {
-        bytes_left = _buffer_len - _buffer_pos;
-        bytes_to_copy = dest_bufflen > bytes_left ? bytes_left : dest_bufflen;
-
-#ifdef VERBOSE_HTTP
-        Debug_printf("::read from buffer %d\r\n", bytes_to_copy);
-#endif
-        memcpy(dest_buffer, _buffer + _buffer_pos, bytes_to_copy);
-        _buffer_pos += bytes_to_copy;
-        _buffer_total_read += bytes_to_copy;
-
-        // Go ahead and return if we got as many bytes as requested
-        if (dest_bufflen == bytes_to_copy)
-            return bytes_to_copy;
-
-        bytes_copied = bytes_to_copy;
-    }
-
-    // Nothing left to read - later ESP-IDF versions provide esp_http_client_is_complete_data_received()
-    if (_transaction_done)
-    {
-        // Debug_println("::read download done");
-        return bytes_copied;
-    }
-
     // Make sure store our current task handle to respond to
     _taskh_consumer = xTaskGetCurrentTaskHandle();
 
-    // Our HTTP subtask is gone - say there's nothing left to read...
-    if (_taskh_subtask == nullptr)
+    // Start with whatever is left of the chunk we were lent
+    int bytes_copied = _take_chunk(dest_buffer, dest_bufflen);
+
+    while (bytes_copied < dest_bufflen)
     {
+        // Nothing left to read - the worker is done with our request
+        if (!_in_flight)
+        {
 #ifdef VERBOSE_HTTP
-        Debug_println("::read subtask gone");
+            Debug_println("::read download done");
 #endif
-        return bytes_copied;
-    }
+            break;
+        }
 
-    while (bytes_copied < dest_bufflen)
-    {
-        // Let the HTTP process task know to fill the buffer
-        // Debug_println("::read notifyGive");
-        xTaskNotifyGive(_taskh_subtask);
-        // Wait till the HTTP task lets us know it's filled the buffer
-        // Debug_println("::read notifyTake...");
-        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTPCLIENT_WAIT_FOR_HTTP_TASK)) != 1)
+        // Let the worker receive the next chunk into the buffer we just emptied
+        _return_chunk();
+
+        // Wait till it lets us know there's another chunk, or that there are no more
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTPCLIENT_WAIT_FOR_HTTP_TASK)) == 0)
         {
             // Abort if we timed-out receiving the data
 #ifdef VERBOSE_HTTP
@@ -175,59 +179,85 @@ int fnHttpClient::read(uint8_t *dest_buffer, int dest_bufflen)
 #endif
             return -1;
         }
-        // Debug_println("::read got notification");
-        if (_buffer_len <= 0)
-        {
-            // Debug_println("::read download done");
-            return bytes_copied;
-        }
 
-        int dest_size = dest_bufflen - bytes_copied;
-        bytes_to_copy = dest_size > _buffer_len ? _buffer_len : dest_size;
+        bytes_copied += _take_chunk(dest_buffer + bytes_copied, dest_bufflen - bytes_copied);
+    }
+
+    return bytes_copied;
+}
+
+// Copy out as much as fits of the chunk the worker lent us
+int fnHttpClient::_take_chunk(uint8_t *dest_buffer, int dest_bufflen)
+{
+    std::lock_guard<std::mutex> guard(_chunk_lock);
+
+    if (_chunk == nullptr)
+        return 0;
+
+    int bytes_to_copy = _chunk_len - _chunk_pos;
+    if (bytes_to_copy > dest_bufflen)
+        bytes_to_copy = dest_bufflen;
 
 #ifdef VERBOSE_HTTP
-        Debug_printf("dest_size=%d, dest_bufflen=%d, bytes_copied=%d, bytes_to_copy=%d\r\n", dest_size, dest_bufflen, bytes_copied, bytes_to_copy);
+    Debug_printf("::read from chunk %d of %d\r\n", bytes_to_copy, _chunk_len - _chunk_pos);
 #endif
+    memcpy(dest_buffer, _chunk + _chunk_pos, bytes_to_copy);
+    _chunk_pos += bytes_to_copy;
+    _total_read += bytes_to_copy;
 
-        memcpy(dest_buffer + bytes_copied, _buffer, bytes_to_copy);
-        _buffer_pos += bytes_to_copy;
-        _buffer_total_read += bytes_to_copy;
-        bytes_copied += bytes_to_copy;
-    }
-
-    return bytes_copied;
+    return bytes_to_copy;
 }
 
-// Thorws out any waiting response body without closing the connection
-void fnHttpClient::_flush_response()
+// Hand the worker its receive buffer back. False if it hadn't lent us one
+bool fnHttpClient::_return_chunk()
 {
-    // Debug_println("fnHttpClient::flush_response");
-    if (_handle == nullptr)
-        return;
+    TaskHandle_t worker;
+    {
+        std::lock_guard<std::mutex> guard(_chunk_lock);
 
-    _buffer_len = 0;
-    esp_http_client_set_post_field(_handle, nullptr, 0);
+        if (_chunk == nullptr)
+            return false;
 
-    // Nothing left to read
-    if (_transaction_done)
-        return;
+        _chunk = nullptr;
+        _chunk_pos = _chunk_len = 0;
+        worker = _taskh_worker;
+    }
+
+    xTaskNotifyGive(worker);
+    return true;
+}
 
-    // Our HTTP subtask is gone - nothing to do
-    if (_taskh_subtask == nullptr)
+// The worker has lent us a chunk
+bool fnHttpClient::_chunk_lent()
+{
+    std::lock_guard<std::mutex> guard(_chunk_lock);
+    return _chunk != nullptr;
+}
+
+// Wait for the worker to finish our request, dropping whatever body it still receives
+void fnHttpClient::_wait_for_worker()
+{
+    if (!_in_flight)
         return;
 
     // Make sure store our current task handle to respond to
     _taskh_consumer = xTaskGetCurrentTaskHandle();
-    do
+    while (_in_flight)
     {
-        // Let the HTTP process task know to fill the buffer
-        // Debug_println("::flush_response notifyGive");
-        xTaskNotifyGive(_taskh_subtask);
-        // Wait till the HTTP task lets us know it's filled the buffer
-        // Debug_println("::flush_response notifyTake...");
+        _return_chunk();
         ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTPCLIENT_WAIT_FOR_HTTP_TASK));
+    }
+}
+
+// Thorws out any waiting response body without closing the connection
+void fnHttpClient::_flush_response()
+{
+    // Debug_println("fnHttpClient::flush_response");
+    if (_handle == nullptr)
+        return;
 
-    } while (!_transaction_done);
+    _wait_for_worker();
+    esp_http_client_set_post_field(_handle, nullptr, 0);
     // Debug_println("fnHttpClient::flush_response done");
 }
 
@@ -235,21 +265,90 @@ void fnHttpClient::_flush_response()
 void fnHttpClient::close()
 {
     // Debug_println("::close");
-    _delete_subtask_if_running();
+    // Nobody will read the rest of the body, have the worker stop receiving it
+    if (_in_flight)
+    {
+        _abort = true;
+        _wait_for_worker();
+    }
 
-    if (_handle != nullptr)
+    // A connection with its response read to the end stays open, to be parked
+    if (_handle != nullptr && !_reusable())
         esp_http_client_close(_handle);
 
     _stored_headers.clear();
 }
 
+// The last transaction completed and the server kept the connection open
+bool fnHttpClient::_reusable()
+{
+    return _handle != nullptr && !_in_flight && !_hung_up && _transaction_done && _client_err == ESP_OK &&
+           _handle->state == HTTP_STATE_CONNECTED;
+}
+
+// Park the handle in the connection pool if it can be reused, clean it up if not
+void fnHttpClient::_release_handle()
+{
+    if (_handle == nullptr)
+        return;
+
+    if (_reusable())
+    {
+        _handle->user_data = nullptr;
+        fnConnectionPool::release(_pool_key, _handle, _pool_close, _pool_healthy);
+    }
+    else
+        esp_http_client_cleanup(_handle);
+
+    _handle = nullptr;
+    _transaction_done = false;
+#ifdef VERBOSE_HTTP
+    fnConnectionPool::print_stats();
+#endif
+}
+
+// A parked handle still has the last user's request set up on it
+void fnHttpClient::_reset_handle(const std::string &url)
+{
+    char *value = nullptr;
+    esp_http_client_get_header(_handle, "User-Agent", &value);
+    std::string agent = value != nullptr ? value : "";
+
+    http_header_clean(_handle->request->headers);
+    if (!agent.empty())
+        esp_http_client_set_header(_handle, "User-Agent", agent.c_str());
+
+    esp_http_client_set_url(_handle, url.c_str());
+    esp_http_client_set_header(_handle, "Host", _handle->connection_info.host);
+    esp_http_client_set_method(_handle, HTTP_METHOD_GET);
+    esp_http_client_set_post_field(_handle, nullptr, 0);
+
+    _handle->user_data = this;
+    _auth_type = HTTP_AUTH_TYPE_NONE;
+    _max_redirects = _handle->max_redirection_count == 0 ? 10 : _handle->max_redirection_count;
+}
+
+void fnHttpClient::_pool_close(void *handle)
+{
+    esp_http_client_close((esp_http_client_handle_t)handle);
+    esp_http_client_cleanup((esp_http_client_handle_t)handle);
+}
+
+// Nothing should arrive on an idle keep-alive connection, anything readable
+// is the server closing it
+bool fnHttpClient::_pool_healthy(void *handle)
+{
+    esp_http_client_handle_t h = (esp_http_client_handle_t)handle;
+    return h->state == HTTP_STATE_CONNECTED && h->transport != nullptr && esp_transport_poll_read(h->transport, 0) == 0;
+}
+
 /*
  Typical event order:
 
  HTTP_EVENT_HANDLER_ON_CONNECTED
  HTTP_EVENT_HEADERS_SENT
  HTTP_EVENT_ON_HEADER - once for each header received with header_key and header_value set
- HTTP_EVENT_ON_DATA - multiple times with data and datalen set up to BUFFER size
+ HTTP_EVENT_ON_DATA - multiple times with data and datalen set up to BUFFER size, data is the client's receive buffer
  HTTP_EVENT_ON_FINISH - value is returned to esp_http_client_perform() after this
  HTTP_EVENT_DISCONNECTED
 
@@ -327,31 +426,60 @@ esp_err_t fnHttpClient::_httpevent_handler(esp_http_client_event_t *evt)
         }
 #endif
 
-        // Check if this is our first time this event has been triggered
-        if (client->_transaction_begin == true)
+        // The reader closed on us. A short remainder is read and dropped to keep the connection,
+        // a longer one isn't worth waiting for
+        if (client->_abort)
         {
-            client->_transaction_begin = false;
-            client->_transaction_done = false;
-            // Let the main thread know we're done reading headers and have moved on to the data
-            xTaskNotifyGive(client->_taskh_consumer);
+            esp_http_client_handle_t h = client->_handle;
+            if (!client->_hung_up && (esp_http_client_is_chunked_response(h) ||
+                                      esp_http_client_get_content_length(h) - h->response->data_process > HTTPCLIENT_ABORT_DRAIN))
+            {
+#ifdef VERBOSE_HTTP
+                Debug_println("HTTP_EVENT_ON_DATA: Hanging up on unread body");
+#endif
+                int fd = esp_transport_get_socket(h->transport);
+                if (fd >= 0)
+                    shutdown(fd, SHUT_RDWR);
+                client->_hung_up = true;
+            }
+            break;
         }
 
-        // Wait to be told we can fill the buffer
-#ifdef VERBOSE_HTTP
-        Debug_println("HTTP_EVENT_ON_DATA: Waiting to start reading");
-#endif
-        ulTaskNotifyTake(1, pdMS_TO_TICKS(HTTPCLIENT_WAIT_FOR_CONSUMER_TASK));
-
 #ifdef VERBOSE_HTTP
         Debug_printf("HTTP_EVENT_ON_DATA: Data: %p, Datalen: %d\r\n", evt->data, evt->data_len);
 #endif
 
-        client->_buffer_pos = 0;
-        client->_buffer_len = (evt->data_len > DEFAULT_HTTP_BUF_SIZE) ? DEFAULT_HTTP_BUF_SIZE : evt->data_len;
-        memcpy(client->_buffer, evt->data, client->_buffer_len);
-
-        // Now let the reader know there's data in the buffer
+        // Lend the reader the receive buffer itself. The first chunk also tells _perform() the headers are in
+        {
+            std::lock_guard<std::mutex> guard(client->_chunk_lock);
+            client->_chunk = (const char *)evt->data;
+            client->_chunk_pos = 0;
+            client->_chunk_len = evt->data_len;
+        }
         xTaskNotifyGive(client->_taskh_consumer);
+
+        // The data is only good until we return, wait for the reader to hand it back
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTPCLIENT_WAIT_FOR_CONSUMER_TASK)) == 0)
+        {
+            bool returned;
+            {
+                std::lock_guard<std::mutex> guard(client->_chunk_lock);
+                returned = client->_chunk == nullptr;
+                client->_chunk = nullptr;
+                client->_chunk_pos = client->_chunk_len = 0;
+            }
+
+            if (returned)
+                // Handed back just now, its notification is on the way
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            else
+            {
+#ifdef VERBOSE_HTTP
+                Debug_println("HTTP_EVENT_ON_DATA: Reader stopped reading");
+#endif
+                client->_abort = true;
+            }
+        }
         break;
     }
 
@@ -376,62 +504,95 @@ esp_err_t fnHttpClient::_httpevent_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-void fnHttpClient::_perform_subtask(void *param)
+/*
+ Requests are performed on workers that outlive them. Up to HTTPCLIENT_WORKERS
+ stay around between requests; if they're all busy with bodies nobody has
+ finished reading, one is started just for this request and exits after it.
+*/
+bool fnHttpClient::_dispatch()
 {
-    fnHttpClient *parent = (fnHttpClient *)param;
-
-    // Reset our transaction state markers
-    parent->_transaction_begin = true;
-    parent->_transaction_done = false;
-    parent->_redirect_count = 0;
-    parent->_buffer_len = 0;
+    {
+        std::lock_guard<std::mutex> guard(worker_lock);
 
-    // Debug_printf("esp_http_client_perform start\r\n");
+        if (worker_jobs == nullptr)
+            worker_jobs = xQueueCreate(HTTPCLIENT_WORKER_QUEUE, sizeof(fnHttpClient *));
 
-    esp_err_t e = esp_http_client_perform(parent->_handle);
-#ifdef VERBOSE_HTTP
-    Debug_printf("esp_http_client_perform returned %d, stack HWM %u\r\n", e, uxTaskGetStackHighWaterMark(nullptr));
-#endif
+        if (workers_idle == 0)
+        {
+            bool persistent = workers_running < HTTPCLIENT_WORKERS;
+            if (xTaskCreate(_worker_task, "http_worker", HTTPCLIENT_WORKER_STACKSIZE, persistent ? worker_jobs : nullptr,
+                            HTTPCLIENT_WORKER_PRIORITY, nullptr) != pdPASS)
+            {
+                Debug_println("fnHttpClient: unable to start worker");
+                return false;
+            }
+            if (persistent)
+                workers_running++;
+            workers_idle++;
+        }
+        workers_idle--;
+    }
 
-    // Save error
-    parent->_client_err = e;
+    fnHttpClient *job = this;
+    xQueueSend(worker_jobs, &job, portMAX_DELAY);
+    return true;
+}
 
-    // Indicate there's nothing else to read
-    parent->_transaction_done = true;
+// param is non-null for the workers that stay
+void fnHttpClient::_worker_task(void *param)
+{
+    bool persistent = param != nullptr;
+    fnHttpClient *client;
 
-    // Don't send notifications if we're ignoring the response body
-    if (false == parent->_ignore_response_body)
+    do
     {
-        /*
-         If _transaction_begin is false, then we handled the HTTP_EVENT_ON_DATA event, and
-         read() has sent us a notification we need to accept before continuing.
-        */
-        if (false == parent->_transaction_begin)
-            ulTaskNotifyTake(1, pdMS_TO_TICKS(HTTPCLIENT_WAIT_FOR_CONSUMER_TASK));
-
-        /*
-         If we handled the HTTP_EVENT_ON_DATA event, then read() is waiting for a notification.
-         If we didn't handle that event, then _perform() is waiting for a notification.
-         Notify whichever of the two that they can continue.
-        */
-        xTaskNotifyGive(parent->_taskh_consumer);
-    }
+        if (xQueueReceive(worker_jobs, &client, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        // Don't touch client after this, it may be gone
+        client->_run();
+
+        if (persistent)
+        {
+            std::lock_guard<std::mutex> guard(worker_lock);
+            workers_idle++;
+        }
+    } while (persistent);
 
 #ifdef VERBOSE_HTTP
-    Debug_printv("_perform_subtask_exiting");
+    Debug_printv("extra worker exiting");
 #endif
-    TaskHandle_t tmp = parent->_taskh_subtask;
-    parent->_taskh_subtask = nullptr;
-    vTaskDelete(tmp);
+    vTaskDelete(nullptr);
 }
 
-void fnHttpClient::_delete_subtask_if_running()
+void fnHttpClient::_run()
 {
-    if (_taskh_subtask != nullptr)
-    {
-        vTaskDelete(_taskh_subtask);
-        _taskh_subtask = nullptr;
-    }
+    _taskh_worker = xTaskGetCurrentTaskHandle();
+    _redirect_count = 0;
+
+    // Closed before we got to it
+    esp_err_t e = ESP_FAIL;
+    if (!_abort)
+        e = esp_http_client_perform(_handle);
+#ifdef VERBOSE_HTTP
+    Debug_printf("esp_http_client_perform returned %d, stack HWM %u\r\n", e, uxTaskGetStackHighWaterMark(nullptr));
+#endif
+
+    // Save error
+    _client_err = e;
+
+    // Indicate there's nothing else to read
+    _transaction_done = true;
+    _taskh_worker = nullptr;
+
+    /*
+     Whoever is waiting - _perform() for the headers of a response without a body,
+     read() for the next chunk, or close() for us to be done - can continue. We're
+     done with the client as soon as _in_flight drops, so take the task to notify first.
+    */
+    TaskHandle_t consumer = _taskh_consumer;
+    _in_flight = false;
+    xTaskNotifyGive(consumer);
 }
 
 /*
@@ -446,29 +607,36 @@ int fnHttpClient::_perform()
     Debug_printf("%08lx _perform\r\n", fnSystem.millis());
 #endif
 
-    _buffer_total_read = 0;
+    _total_read = 0;
 
     // We want to process the response body (if any)
     _ignore_response_body = false;
+    _abort = false;
+    _hung_up = false;
+    _transaction_done = false;
+    _client_err = ESP_OK;
 
     // Handle the that HTTP task will use to notify us
     _taskh_consumer = xTaskGetCurrentTaskHandle();
 
-    // Start a new task to perform the http client work
-    _delete_subtask_if_running();
-    xTaskCreate(_perform_subtask, "perform_subtask", 4096, this, 5, &_taskh_subtask);
-#ifdef VERBOSE_HTTP
-    // Debug_printf("%08lx _perform subtask created\r\n", fnSystem.millis());
-#endif
+    // Have a worker perform the http client work
+    _in_flight = true;
+    if (!_dispatch())
+    {
+        _in_flight = false;
+        return -1;
+    }
 
-    // Wait until we have headers returned
-    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTPCLIENT_WAIT_FOR_HTTP_TASK)) == 0)
+    // Wait until we have headers returned: the first chunk of the body is in, or there is none
+    while (!_chunk_lent() && _in_flight)
     {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTPCLIENT_WAIT_FOR_HTTP_TASK)) == 0)
+        {
 #ifdef VERBOSE_HTTP
-        Debug_printf("Timed-out waiting for headers to load\r\n");
+            Debug_printf("Timed-out waiting for headers to load\r\n");
 #endif
-        //_delete_subtask_if_running();
-        return -1;
+            return -1;
+        }
     }
     // Debug_printf("%08lx _perform notified\r\n", fnSystem.millis());
     // Debug_printf("Notification of headers loaded\r\n");
@@ -504,86 +672,6 @@ int fnHttpClient::_perform()
     return status;
 }
 
-/*
- Performs an HTTP transaction using esp_http_client_open() and subsequent "streaming" functions.
- Although this is more flexible than the esp_http_client_perform() method, there doesn't
- seem to be a way of retrieving response headers from the server this way.  So we only use
- it for write-focused methods: PUT and arbitrary methods specified using send_request()
-*/
-int fnHttpClient::_perform_stream(esp_http_client_method_t method, uint8_t *write_data, int write_size)
-{
-#ifdef VERBOSE_HTTP
-    Debug_printf("%08lx _perform_stream\r\n", fnSystem.millis());
-#endif
-
-    if (_handle == nullptr)
-        return -1;
-
-    /* Headers added by HttpClient
-        <METHOD> <URI> HTTP/1.1
-        Host: <HOST>
-        User-Agent: <UserAgent>
-        Connection: <keep-alive/close>
-        Accept-Encoding: <encoding>
-        Authorization: Basic <authorization>
-    */
-
-    // Set method
-    esp_err_t e = esp_http_client_set_method(_handle, method);
-
-    // Add header specifying expected content size
-    if (write_data != nullptr && write_size > 0)
-    {
-        char buff[12];
-        __itoa(write_size, buff, 10);
-        set_header("Content-Length", buff);
-    }
-
-#ifdef VERBOSE_HTTP
-    Debug_printf("%08lx _perform_write open+write\r\n", fnSystem.millis());
-#endif
-    e = esp_http_client_open(_handle, write_size);
-    if (e != ESP_OK)
-    {
-        Debug_printf("_perform_write error %d during open\r\n", e);
-        return -1;
-    }
-
-    e = esp_http_client_write(_handle, (char *)write_data, write_size);
-    if (e < 0)
-    {
-        Debug_printf("_perform_write error during write\r\n");
-        return -1;
-    }
-
-    e = esp_http_client_fetch_headers(_handle);
-    if (e < 0)
-    {
-        Debug_printf("_perform_write error during fetch headers\r\n");
-        return -1;
-    }
-
-    // Collect results
-    int status = esp_http_client_get_status_code(_handle);
-#ifdef VERBOSE_HTTP
-    bool chunked = esp_http_client_is_chunked_response(_handle);
-    int length = esp_http_client_get_content_length(_handle);
-    Debug_printf("status = %d, length = %d, chunked = %d\r\n", status, length, chunked ? 1 : 0);
-#endif
-
-    // Read any returned data
-    int r = esp_http_client_read(_handle, _buffer, DEFAULT_HTTP_BUF_SIZE);
-    if (r > 0)
-    {
-        _buffer_len = r;
-#ifdef VERBOSE_HTTP
-        Debug_printf("_perform_write read %d bytes\r\n", r);
-#endif
-    }
-
-    return status;
-}
-
 int fnHttpClient::PUT(const char *put_data, int put_datalen)
 {
 #ifdef VERBOSE_HTTP
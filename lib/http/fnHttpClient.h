@@ -4,8 +4,10 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
+#include <atomic>
 #include <string>
 #include <map>
+#include <mutex>
 #include <vector>
 
 #include "fn_esp_http_client.h"
@@ -18,16 +20,24 @@ private:
     typedef std::map<std::string,std::string> header_map_t;
     typedef std::pair<std::string,std::string> header_entry_t;
 
-    char *_buffer = nullptr; // Will be allocated to DEFAULT_HTTP_BUF_SIZE
-    int _buffer_pos = 0;
-    int _buffer_len = 0;
-    int _buffer_total_read = 0;
+    /*
+     Body data is read() straight out of esp_http_client's receive buffer. The
+     worker running the request parks in HTTP_EVENT_ON_DATA with _chunk pointing
+     at it until the reader has taken it all and hands it back.
+    */
+    const char *_chunk = nullptr;
+    int _chunk_pos = 0;
+    int _chunk_len = 0;
+    int _total_read = 0;
+    std::mutex _chunk_lock;
 
     TaskHandle_t _taskh_consumer = nullptr;
-    TaskHandle_t _taskh_subtask = nullptr;
+    TaskHandle_t _taskh_worker = nullptr;
 
     bool _ignore_response_body = false;
-    bool _transaction_begin = false;
+    std::atomic<bool> _in_flight{false};  // Queued for or running on a worker
+    std::atomic<bool> _abort{false};      // Reader is gone, worker drops the rest of the body
+    std::atomic<bool> _hung_up{false};    // Worker shut the connection down to stop a long body
     bool _transaction_done = false;
     int _redirect_count = 0;
     int _max_redirects = 0;
@@ -39,16 +49,28 @@ private:
     header_map_t _stored_headers;
 
     esp_http_client_handle_t _handle = nullptr;
+    std::string _pool_key;
 
-    static void _perform_subtask(void *param);
+    static void _worker_task(void *param);
     static esp_err_t _httpevent_handler(esp_http_client_event_t *evt);
 
-    void _delete_subtask_if_running();
+    bool _dispatch();
+    void _run();
+    void _wait_for_worker();
+
+    int _take_chunk(uint8_t *dest_buffer, int dest_bufflen);
+    bool _return_chunk();
+    bool _chunk_lent();
 
     void _flush_response();
 
+    bool _reusable();
+    void _release_handle();
+    void _reset_handle(const std::string &url);
+    static void _pool_close(void *handle);
+    static bool _pool_healthy(void *handle);
+
     int _perform();
-    int _perform_stream(esp_http_client_method_t method, uint8_t *write_data, int write_size);
 
 public:
 
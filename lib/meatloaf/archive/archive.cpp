@@ -147,7 +147,7 @@ void Archive::close() {
 
 #if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
 int ArchiveMStream::s_rangeUsed = 0;
-esp_himem_rangehandle_t ArchiveMStream::s_range;
+HimemWindow ArchiveMStream::s_window;
 #endif
 
 bool ArchiveMStream::open(std::ios_base::openmode mode) {
@@ -156,23 +156,18 @@ bool ArchiveMStream::open(std::ios_base::openmode mode) {
 }
 
 void ArchiveMStream::close() {
+    // the worker reads from the archive, stop it before closing
+    m_inflater.reset();
     m_archive->close();
 
     if (m_haveData > 0) {
         if (m_dirty) {
+            // changes are already in the journal, just make sure they get folded back
+            if (m_journal) ArchiveWriteBack::schedule(m_containerUrl);
             m_dirty = false;
         }
 
-#if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
-        ESP_ERROR_CHECK(esp_himem_free(m_data));
-        Debug_printv("HIMEM available after free: %lu ", (uint32_t)esp_himem_get_free_size());
-
-        // if this was the last archive in use then free up the mapped range
-        if (s_rangeUsed > 0) s_rangeUsed--;
-        if (s_rangeUsed == 0) esp_himem_free_map_range(s_range);
-#else
-        delete[] m_data;
-#endif
+        freeData();
     }
 
     m_haveData = 0;
@@ -180,6 +175,20 @@ void ArchiveMStream::close() {
 
 bool ArchiveMStream::isOpen() { return m_archive->isOpen(); }
 
+void ArchiveMStream::freeData() {
+#if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
+    s_window.invalidate(m_data);
+    ESP_ERROR_CHECK(esp_himem_free(m_data));
+    Debug_printv("HIMEM available after free: %lu ", (uint32_t)esp_himem_get_free_size());
+
+    // if this was the last archive in use then free up the mapped range
+    if (s_rangeUsed > 0) s_rangeUsed--;
+    if (s_rangeUsed == 0) s_window.release();
+#else
+    delete[] m_data;
+#endif
+}
+
 void ArchiveMStream::readArchiveData() {
     if (m_archive->isOpen() && m_haveData == 0) {
 
@@ -201,18 +210,7 @@ void ArchiveMStream::readArchiveData() {
             return;
         }
 
-        // if mapped range is not yet created then create it now
-        if (s_rangeUsed == 0) {
-            esp_err_t status =
-                esp_himem_alloc_map_range(ESP_HIMEM_BLKSZ, &s_range);
-            if (status != ESP_OK) {
-                Debug_printv("Unable to allocate mapped range for HIMEM: %s", esp_err_to_name(status));
-                ESP_ERROR_CHECK(esp_himem_free(m_data));
-                m_haveData = -1;
-                return;
-            }
-        }
-
+        // the mapped range is created by the window on first use
         Debug_printv("HIMEM available after alloc : %lu ", (uint32_t)esp_himem_get_free_size());
 
         // increment mapped range usage counter
@@ -222,90 +220,150 @@ void ArchiveMStream::readArchiveData() {
         m_haveData = 1;
 #endif
 
-        Debug_printv("reading %lu bytes from archive", _size);
+        Debug_printv("inflating %lu bytes from archive", _size);
         archive *a = m_archive->getArchive();
+        m_extracted = 0;
 
-#if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
-        size = _size;
-        uint32_t pageStart = 0;
-        while (size > 0) {
-            
-            uint32_t s = std::min(size, (uint32_t)ESP_HIMEM_BLKSZ);
-
-            uint8_t *ptr;
-            ESP_ERROR_CHECK(esp_himem_map(m_data, s_range, pageStart, 0, ESP_HIMEM_BLKSZ, 0, (void **)&ptr));
-            uint32_t r = archive_read_data(a, ptr, s);
-            ESP_ERROR_CHECK(esp_himem_unmap(s_range, ptr, ESP_HIMEM_BLKSZ));
-            if (archive_errno(a) != ARCHIVE_OK || r != s) {
-                if (archive_errno(a) != ARCHIVE_OK) {
-                    Debug_printv("archive read error %i: %s", archive_errno(a), archive_error_string(a));
-                } else {
-                    Debug_printv(
-                        "expected to read %lu bytes from archive, got %lu", s, r);
+        // Decompress on the other core, read() drains the blocks as it needs them
+        m_inflater.reset(new ArchiveInflater([a](uint8_t *buf, uint32_t size) -> int32_t {
+            ssize_t r = archive_read_data(a, buf, size);
+            if (r < 0)
+                Debug_printv("archive read error %i: %s", archive_errno(a), archive_error_string(a));
+            return r;
+        }, _size));
+
+        if (!m_inflater->start()) {
+            // no worker, inflate everything right here
+            m_inflater.reset();
+
+            uint8_t buf[1024];
+            while (m_extracted < _size) {
+                ssize_t r = archive_read_data(a, buf, std::min(_size - m_extracted, (uint32_t)sizeof(buf)));
+                if (r <= 0) {
+                    Debug_printv("expected to read %lu bytes from archive, got %lu", _size, m_extracted);
+                    freeData();
+                    m_haveData = -1;
+                    return;
                 }
-
-                ESP_ERROR_CHECK(esp_himem_free(m_data));
-                m_haveData = -1;
-                return;
+                writeData(m_extracted, buf, r);
+                m_extracted += r;
             }
-
-            pageStart += s;
-            size -= s;
+            replayJournal();
         }
-#else
-        uint32_t r = archive_read_data(a, m_data, _size);
-        if (archive_errno(a) != ARCHIVE_OK || r != _size) {
-            if (archive_errno(a) != ARCHIVE_OK) {
-                Debug_printv("archive read error %i: %s", archive_errno(a), archive_error_string(a));
-            } else {
-                Debug_printv("expected to read %lu bytes from archive, got %lu", _size, r);
-            }
-            delete[] m_data;
+        else if (m_journal && ArchiveJournal::members(m_containerUrl).count(entry.pathname)) {
+            // journaled saves have to be applied before anything is read
+            fillData(_size);
+        }
+    }
+}
+
+bool ArchiveMStream::fillData(uint32_t upTo) {
+    if (upTo > _size) upTo = _size;
+
+    while (m_inflater && m_extracted < upTo) {
+        uint32_t length;
+        const uint8_t *block = m_inflater->peek(length);
+        if (block == nullptr) {
+            Debug_printv("expected to read %lu bytes from archive, got %lu", _size, m_extracted);
+            m_inflater.reset();
+            freeData();
             m_haveData = -1;
-            return;
+            return false;
         }
+
+        writeData(m_extracted, block, length);
+        m_extracted += length;
+        m_inflater->pop();
+    }
+
+    if (m_inflater && m_extracted >= _size) {
+        m_inflater.reset();
+        replayJournal();
+    }
+
+    return (m_haveData > 0 && m_extracted >= upTo);
+}
+
+void ArchiveMStream::finishInflate() {
+    if (m_inflater) fillData(_size);
+}
+
+void ArchiveMStream::replayJournal() {
+    // Apply saves that have not been written back into the archive yet
+    if (m_journal) {
+        ArchiveJournal::replay(m_containerUrl, entry.pathname, [this](uint32_t offset, const uint8_t *data, uint16_t length) {
+            writeData(offset, data, length);
+        });
+    }
+}
+
+uint32_t ArchiveMStream::readData(uint32_t offset, uint8_t *buf, uint32_t size) {
+    if (offset >= _size) return 0;
+    if (offset + size > _size) size = _size - offset;
+
+#if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
+    // blocks stay mapped between calls, only a block change remaps
+    uint32_t numRead = 0;
+    while (size > 0) {
+        uint32_t available;
+        uint8_t *ptr = s_window.map(m_data, offset, available);
+        if (ptr == nullptr) break;
+
+        uint32_t n = std::min(size, available);
+        memcpy(buf + numRead, ptr, n);
+        size -= n;
+        numRead += n;
+        offset += n;
+    }
+    return numRead;
+#else
+    memcpy(buf, m_data + offset, size);
+    return size;
 #endif
+}
+
+uint32_t ArchiveMStream::writeData(uint32_t offset, const uint8_t *buf, uint32_t size) {
+    if (offset >= _size) return 0;
+    if (offset + size > _size) size = _size - offset;
+
+#if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
+    uint32_t numWritten = 0;
+    while (size > 0) {
+        uint32_t available;
+        uint8_t *ptr = s_window.map(m_data, offset, available);
+        if (ptr == nullptr) break;
+
+        uint32_t n = std::min(size, available);
+        memcpy(ptr, buf + numWritten, n);
+        size -= n;
+        numWritten += n;
+        offset += n;
     }
+    return numWritten;
+#else
+    memcpy(m_data + offset, buf, size);
+    return size;
+#endif
 }
 
 uint32_t ArchiveMStream::read(uint8_t *buf, uint32_t size) {
     readArchiveData();
+    fillData(_position + size);
 
     if (m_haveData > 0) {
         // Debug_printv("calling read, buff size=[%ld]", size);
-
-#if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
-        if (_position + size > _size) size = _size - _position;
-        uint32_t numRead = 0;
-        while (size > 0) {
-
-            uint32_t pageStart = (_position / ESP_HIMEM_BLKSZ) * ESP_HIMEM_BLKSZ;
-            uint32_t offset = _position - pageStart;
-            uint32_t n = std::min(size, (uint32_t)ESP_HIMEM_BLKSZ - offset);
-
-            uint8_t *ptr;
-            ESP_ERROR_CHECK(esp_himem_map(m_data, s_range, pageStart, 0, ESP_HIMEM_BLKSZ, 0, (void **)&ptr));
-            memcpy(buf + numRead, ptr + offset, n);
-            ESP_ERROR_CHECK(esp_himem_unmap(s_range, ptr, ESP_HIMEM_BLKSZ));
-            size -= n;
-            numRead += n;
-            _position += n;
-        }
+        uint32_t numRead = readData(_position, buf, size);
+        _position += numRead;
 
         // Debug_printv("read [%lu] bytes", numRead);
         return numRead;
-
-#else
-        memcpy(buf, m_data + _position, size);
-        _position += size;
-        return size;
-#endif
     } else
         return 0;
 }
 
 uint32_t ArchiveMStream::write(const uint8_t *buf, uint32_t size) {
     readArchiveData();
+    fillData(_position + size);
 
     // NOTE: this function can NOT write past the end of the extracted file,
     //       i.e. it can NOT extend the size of a file, only modify existing
@@ -313,31 +371,17 @@ uint32_t ArchiveMStream::write(const uint8_t *buf, uint32_t size) {
     //       size anyways.
     if (m_haveData > 0) {
         // Debug_printv("calling write, size=[%ld]", size);
+        uint32_t numWritten = writeData(_position, buf, size);
 
-        if (_position + size > _size) size = _size - _position;
-        uint32_t numWritten = 0;
-
-#if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
-        while (size > 0) {
-            uint32_t pageStart = (_position / ESP_HIMEM_BLKSZ) * ESP_HIMEM_BLKSZ;
-            uint32_t offset = _position - pageStart;
-            uint32_t n = std::min(size, (uint32_t)ESP_HIMEM_BLKSZ - offset);
-
-            uint8_t *ptr;
-            ESP_ERROR_CHECK(esp_himem_map(m_data, s_range, pageStart, 0, ESP_HIMEM_BLKSZ, 0, (void **)&ptr));
-            memcpy(ptr + offset, buf + numWritten, n);
-            ESP_ERROR_CHECK(esp_himem_unmap(s_range, ptr, ESP_HIMEM_BLKSZ));
-            size -= n;
-            numWritten += n;
-            _position += n;
+        // Journal only the changed bytes, they are folded back into the
+        // archive later while the bus is idle
+        if (numWritten > 0 && m_journal) {
+            ArchiveJournal::append(m_containerUrl, entry.pathname, _position, buf, numWritten);
+            ArchiveWriteBack::schedule(m_containerUrl);
         }
-#else
-        memcpy(m_data + _position, buf, size);
-        _position += size;
-        numWritten = size;
-#endif
+        _position += numWritten;
 
-        // remember that data was written so we can re-zip the archive
+        // remember that data was written
         if (numWritten > 0) m_dirty = true;
 
         // Debug_printv("wrote [%lu] bytes", numWritten);
@@ -382,7 +426,7 @@ bool ArchiveMStream::seekEntry(std::string filename)
 
             //Debug_printv("filename[%s] entry.filename[%s]", filename.c_str(), entryFilename.c_str());
 
-            if (filename == entryFilename) // Match exact
+            if (filename == entryFilename || filename == entry.pathname) // Match exact, by name or full path
             {
                 return true;
             }
@@ -416,9 +460,13 @@ bool ArchiveMStream::seekEntry( uint16_t index )
     if ( !m_archive->isOpen() )
         return false;
 
+    // don't move the archive out from under the inflate worker
+    finishInflate();
+
     index--;
 
     entry.filename.clear();
+    entry.pathname.clear();
     entry.size = 0;
 
     archive *a = m_archive->getArchive();
@@ -430,6 +478,7 @@ bool ArchiveMStream::seekEntry( uint16_t index )
     const mode_t type = archive_entry_filetype(a_entry);
     if ( S_ISREG(type) ) {
         entry.filename = basename(archive_entry_pathname(a_entry));
+        entry.pathname = archive_entry_pathname(a_entry);
         entry.size = archive_entry_size(a_entry);
     }
 
@@ -492,6 +541,7 @@ bool ArchiveMFile::rewindDirectory()
         return false;
 
     dirIsOpen = true;
+    image->finishInflate();
     image->m_archive->open( std::ios_base::in );
     image->resetEntryCounter();
 
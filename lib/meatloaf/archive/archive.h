@@ -31,10 +31,14 @@
 #include "../meat_media.h"
 #include "../meatloaf.h"
 
+#include "archive_inflate.h"
+#include "archive_journal.h"
+
 #ifdef BOARD_HAS_PSRAM
 #include <esp_psram.h>
 #ifdef CONFIG_IDF_TARGET_ESP32
 #include <esp32/himem.h>
+#include "../device/himem.h"
 #endif
 #endif
 
@@ -101,6 +105,7 @@ class ArchiveMStream : public MMediaStream {
     struct archive_entry *a_entry;
     struct Entry {
         std::string filename;
+        std::string pathname;   // full path inside the archive
         uint32_t size;
     };
     Entry entry;
@@ -128,6 +133,12 @@ class ArchiveMStream : public MMediaStream {
 
    private:
     void readArchiveData();
+    bool fillData(uint32_t upTo);
+    void finishInflate();
+    void replayJournal();
+    void freeData();
+    uint32_t readData(uint32_t offset, uint8_t *buf, uint32_t size);
+    uint32_t writeData(uint32_t offset, const uint8_t *buf, uint32_t size);
 
     Archive *m_archive;
     std::ios_base::openmode m_mode;
@@ -135,12 +146,21 @@ class ArchiveMStream : public MMediaStream {
     int m_haveData;
     bool m_dirty;
 
+    // Members are inflated in the background, m_data is valid up to m_extracted
+    std::unique_ptr<ArchiveInflater> m_inflater;
+    uint32_t m_extracted = 0;
+
+    // Modified members are journaled next to the archive when it is writable
+    // and can be folded back into
+    std::string m_containerUrl;
+    bool m_journal = false;
+
 #if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
     // contains unzipped contents of archive (in HIMEM)
     esp_himem_handle_t m_data;
 
-    // memory range mapped to HIMEM
-    static esp_himem_rangehandle_t s_range;
+    // memory window mapped to HIMEM, shared by all archives
+    static HimemWindow s_window;
     static int s_rangeUsed;
 #else
     uint8_t *m_data;
@@ -167,7 +187,12 @@ class ArchiveMFile : public MFile {
     MStream *getDecodedStream(std::shared_ptr<MStream> is) {
         Debug_printv("[%s]", url.c_str());
 
-        return new ArchiveMStream(is);
+        auto stream = new ArchiveMStream(is);
+        if (sourceFile != nullptr) {
+            stream->m_containerUrl = sourceFile->url;
+            stream->m_journal = sourceFile->isWritable && ArchiveWriteBack::supported(sourceFile->url);
+        }
+        return stream;
     }
 
     bool isDirectory() override;
@@ -0,0 +1,163 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "archive_inflate.h"
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#include "../../../include/debug.h"
+
+ArchiveInflater::ArchiveInflater(Producer producer, uint32_t size)
+{
+    m_producer = producer;
+    m_size = size;
+    m_ring = new Block[ARCHIVE_INFLATE_RING_SIZE];
+}
+
+ArchiveInflater::~ArchiveInflater()
+{
+    stop();
+    delete[] m_ring;
+}
+
+bool ArchiveInflater::start()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (m_running || m_done)
+        return m_running;
+
+    m_running = true;
+    m_stop = false;
+
+#ifdef ESP_PLATFORM
+#if CONFIG_FREERTOS_UNICORE
+    BaseType_t rc = xTaskCreate(task, "ml_inflate", ARCHIVE_INFLATE_STACKSIZE, this, ARCHIVE_INFLATE_PRIORITY, NULL);
+#else
+    BaseType_t rc = xTaskCreatePinnedToCore(task, "ml_inflate", ARCHIVE_INFLATE_STACKSIZE, this, ARCHIVE_INFLATE_PRIORITY, NULL, ARCHIVE_INFLATE_CPUAFFINITY);
+#endif
+    if (rc != pdPASS)
+    {
+        Debug_printv("Unable to start inflate task");
+        m_running = false;
+        return false;
+    }
+#else
+    m_thread = std::thread(task, this);
+#endif
+
+    return true;
+}
+
+void ArchiveInflater::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_stop = true;
+        m_notFull.notify_all();
+
+        // The worker only touches the archive between checks of m_stop,
+        // wait for it to let go before the caller frees anything
+        while (m_running)
+            m_notEmpty.wait(lock);
+    }
+
+#ifndef ESP_PLATFORM
+    if (m_thread.joinable())
+        m_thread.join();
+#endif
+}
+
+void ArchiveInflater::task(void *arg)
+{
+    ArchiveInflater *inflater = (ArchiveInflater *)arg;
+    inflater->run();
+
+#ifdef ESP_PLATFORM
+    vTaskDelete(NULL);
+#endif
+}
+
+void ArchiveInflater::run()
+{
+    while (m_produced < m_size)
+    {
+        Block *block;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            while (m_count == ARCHIVE_INFLATE_RING_SIZE && !m_stop)
+                m_notFull.wait(lock);
+
+            if (m_stop)
+                break;
+
+            // The reader never touches the head block until it is counted
+            block = &m_ring[m_head];
+        }
+
+        uint32_t want = std::min(m_size - m_produced, (uint32_t)ARCHIVE_INFLATE_BLOCK_SIZE);
+        int32_t r = m_producer(block->data, want);
+        if (r <= 0)
+        {
+            Debug_printv("inflate stopped early produced[%lu] size[%lu]", m_produced, m_size);
+            m_failed = true;
+            break;
+        }
+        block->length = r;
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_head = (m_head + 1) % ARCHIVE_INFLATE_RING_SIZE;
+        m_count++;
+        m_produced += r;
+        m_notEmpty.notify_all();
+    }
+
+    // Notify while holding the lock, the owner may free us as soon as it's released
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_done = true;
+    m_running = false;
+    m_notEmpty.notify_all();
+}
+
+const uint8_t *ArchiveInflater::peek(uint32_t &length)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (m_count == 0 && m_running)
+        m_notEmpty.wait(lock);
+
+    if (m_count == 0)
+    {
+        length = 0;
+        return nullptr;
+    }
+
+    length = m_ring[m_tail].length;
+    return m_ring[m_tail].data;
+}
+
+void ArchiveInflater::pop()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (m_count == 0)
+        return;
+
+    m_tail = (m_tail + 1) % ARCHIVE_INFLATE_RING_SIZE;
+    m_count--;
+    m_notFull.notify_all();
+}
@@ -0,0 +1,100 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// Background inflate worker for archive members
+//
+// Decompression runs in its own task, pinned to the core the IEC bus task
+// is NOT running on (the bus task is pinned to core 1, see iec.cpp). The
+// worker fills a small ring of decompressed blocks and the bus side drains
+// it as it needs data, so inflate overlaps with sending bytes to the C64.
+// The ring is bounded: when the reader falls behind the worker waits.
+//
+// On non ESP builds the worker is a std::thread so it can be unit tested.
+//
+
+#ifndef MEATLOAF_ARCHIVE_INFLATE
+#define MEATLOAF_ARCHIVE_INFLATE
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#ifndef ESP_PLATFORM
+#include <thread>
+#endif
+
+#define ARCHIVE_INFLATE_BLOCK_SIZE 4096
+#define ARCHIVE_INFLATE_RING_SIZE  4
+
+#define ARCHIVE_INFLATE_STACKSIZE   8192
+#define ARCHIVE_INFLATE_PRIORITY    5
+#define ARCHIVE_INFLATE_CPUAFFINITY 0
+
+class ArchiveInflater {
+public:
+    // producer fills up to size bytes and returns the count, 0 or less on end/error
+    typedef std::function<int32_t(uint8_t *buf, uint32_t size)> Producer;
+
+    ArchiveInflater(Producer producer, uint32_t size);
+    ~ArchiveInflater();
+
+    bool start();
+    void stop();
+
+    // Next decompressed block, waits for the worker if the ring is empty.
+    // Returns nullptr at the end of the data (or on error).
+    const uint8_t *peek(uint32_t &length);
+    void pop();
+
+    bool failed() { return m_failed; }
+    uint32_t produced() { return m_produced; }
+
+private:
+    struct Block {
+        uint8_t data[ARCHIVE_INFLATE_BLOCK_SIZE];
+        uint32_t length;
+    };
+
+    static void task(void *arg);
+    void run();
+
+    Producer m_producer;
+    uint32_t m_size;
+    uint32_t m_produced = 0;
+
+    Block *m_ring = nullptr;
+    uint8_t m_head = 0;     // next block the worker fills
+    uint8_t m_tail = 0;     // next block the reader drains
+    uint8_t m_count = 0;
+
+    std::mutex m_lock;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+
+    bool m_running = false;
+    bool m_stop = false;
+    bool m_done = false;
+    bool m_failed = false;
+
+#ifndef ESP_PLATFORM
+    std::thread m_thread;
+#endif
+};
+
+#endif // MEATLOAF_ARCHIVE_INFLATE
@@ -0,0 +1,609 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "archive_journal.h"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+#include "../../../include/debug.h"
+
+#define ZIP_LOCAL_HEADER_SIG   0x04034b50
+#define ZIP_CENTRAL_HEADER_SIG 0x02014b50
+#define ZIP_END_OF_CD_SIG      0x06054b50
+#define ZIP_DESCRIPTOR_SIG     0x08074b50
+
+#define ZIP_LOCAL_HEADER_SIZE   30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_OF_CD_SIZE      22
+
+std::set<std::string> ArchiveWriteBack::pending;
+std::mutex ArchiveWriteBack::rewriting;
+
+
+/********************************************************
+ * Utility Functions
+ ********************************************************/
+
+static uint16_t zip_get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t zip_get32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static void zip_put16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void zip_put32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+static uint32_t zip_crc32(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *buf++;
+        for (uint8_t k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+// Central directory and end record of an archive
+struct ZipDirectory {
+    uint32_t offset = 0;
+    std::vector<uint8_t> cd;
+    std::vector<uint8_t> end;   // end record and comment
+};
+
+static bool zip_read_directory(MStream *zip, ZipDirectory &dir)
+{
+    // Find the end of central directory record
+    uint32_t zip_size = zip->size();
+    uint32_t tail_size = std::min(zip_size, (uint32_t)1024);
+    std::vector<uint8_t> tail(tail_size);
+    zip->seek(zip_size - tail_size);
+    if (tail_size < ZIP_END_OF_CD_SIZE || zip->read(tail.data(), tail_size) != tail_size)
+        return false;
+
+    int32_t eocd = tail_size - ZIP_END_OF_CD_SIZE;
+    while (eocd >= 0 && zip_get32(&tail[eocd]) != ZIP_END_OF_CD_SIG)
+        eocd--;
+    if (eocd < 0)
+    {
+        Debug_printv("End of central directory not found");
+        return false;
+    }
+
+    uint32_t comment = std::min((uint32_t)zip_get16(&tail[eocd + 20]), tail_size - eocd - ZIP_END_OF_CD_SIZE);
+    dir.end.assign(tail.begin() + eocd, tail.begin() + eocd + ZIP_END_OF_CD_SIZE + comment);
+    zip_put16(&dir.end[20], comment);
+
+    uint32_t cd_size = zip_get32(&dir.end[12]);
+    dir.offset = zip_get32(&dir.end[16]);
+    if (cd_size == 0xFFFFFFFF || dir.offset == 0xFFFFFFFF || zip_get16(&dir.end[4]) != 0 ||
+        dir.offset + cd_size > zip_size)
+    {
+        Debug_printv("ZIP64 and multi-disk archives are not supported");
+        return false;
+    }
+
+    dir.cd.resize(cd_size);
+    zip->seek(dir.offset);
+    return zip->read(dir.cd.data(), cd_size) == cd_size;
+}
+
+// Offset of each central directory entry
+static std::vector<uint32_t> zip_entries(const std::vector<uint8_t> &cd)
+{
+    std::vector<uint32_t> entries;
+
+    uint32_t p = 0;
+    while (p + ZIP_CENTRAL_HEADER_SIZE <= cd.size() && zip_get32(&cd[p]) == ZIP_CENTRAL_HEADER_SIG)
+    {
+        entries.push_back(p);
+        p += ZIP_CENTRAL_HEADER_SIZE + zip_get16(&cd[p + 28]) + zip_get16(&cd[p + 30]) + zip_get16(&cd[p + 32]);
+    }
+
+    return entries;
+}
+
+// Copy length bytes at offset in from to the current position of to
+static bool zip_copy(MStream *from, uint32_t offset, MStream *to, uint32_t length)
+{
+    uint8_t buf[1024];
+
+    from->seek(offset);
+    while (length > 0)
+    {
+        uint32_t n = from->read(buf, std::min(length, (uint32_t)sizeof(buf)));
+        if (n == 0 || to->write(buf, n) != n)
+            return false;
+        length -= n;
+    }
+
+    return true;
+}
+
+
+/********************************************************
+ * Journal
+ ********************************************************/
+
+bool ArchiveJournal::append(std::string containerUrl, std::string member, uint32_t offset, const uint8_t *buf, uint32_t size)
+{
+    if (member.empty() || member.size() > 255)
+        return false;
+
+    std::unique_ptr<MFile> file(MFSOwner::File(path(containerUrl)));
+    if (file == nullptr)
+        return false;
+
+    std::unique_ptr<MStream> journal(file->getSourceStream(std::ios_base::app));
+    if (journal == nullptr || !journal->isOpen())
+    {
+        Debug_printv("Unable to open journal [%s]", path(containerUrl).c_str());
+        return false;
+    }
+
+    while (size > 0)
+    {
+        uint16_t length = std::min(size, (uint32_t)UINT16_MAX);
+
+        uint8_t header[3 + 255 + 6];
+        uint16_t h = 0;
+        header[h++] = 'M';
+        header[h++] = 'J';
+        header[h++] = member.size();
+        memcpy(header + h, member.data(), member.size());
+        h += member.size();
+        zip_put32(header + h, offset);
+        h += 4;
+        zip_put16(header + h, length);
+        h += 2;
+
+        if (journal->write(header, h) != h || journal->write(buf, length) != length)
+        {
+            Debug_printv("Journal write failed [%s]", path(containerUrl).c_str());
+            return false;
+        }
+
+        buf += length;
+        offset += length;
+        size -= length;
+    }
+
+    return true;
+}
+
+uint32_t ArchiveJournal::replay(std::string containerUrl, std::string member, std::function<void(uint32_t, const uint8_t *, uint16_t)> apply)
+{
+    std::unique_ptr<MFile> file(MFSOwner::File(path(containerUrl)));
+    if (file == nullptr || !file->exists())
+        return 0;
+
+    std::unique_ptr<MStream> journal(file->getSourceStream(std::ios_base::in));
+    if (journal == nullptr || !journal->isOpen())
+        return 0;
+
+    uint32_t records = 0;
+    uint8_t buf[256];
+    while (journal->available())
+    {
+        uint8_t header[3];
+        if (journal->read(header, 3) != 3 || header[0] != 'M' || header[1] != 'J')
+            break;
+
+        std::string name(header[2], '\0');
+        uint8_t location[6];
+        if (journal->read((uint8_t *)&name[0], name.size()) != name.size() || journal->read(location, 6) != 6)
+            break;
+
+        uint32_t offset = zip_get32(location);
+        uint16_t length = zip_get16(location + 4);
+
+        if (name != member)
+        {
+            if (!journal->seek(length, SEEK_CUR))
+                break;
+            continue;
+        }
+
+        while (length > 0)
+        {
+            uint16_t n = std::min(length, (uint16_t)sizeof(buf));
+            if (journal->read(buf, n) != n)
+                return records;
+
+            apply(offset, buf, n);
+            offset += n;
+            length -= n;
+        }
+        records++;
+    }
+
+    if (records)
+        Debug_printv("replayed [%lu] journal records for [%s]", records, member.c_str());
+
+    return records;
+}
+
+std::set<std::string> ArchiveJournal::members(std::string containerUrl)
+{
+    std::set<std::string> names;
+
+    std::unique_ptr<MFile> file(MFSOwner::File(path(containerUrl)));
+    if (file == nullptr || !file->exists())
+        return names;
+
+    std::unique_ptr<MStream> journal(file->getSourceStream(std::ios_base::in));
+    if (journal == nullptr || !journal->isOpen())
+        return names;
+
+    while (journal->available())
+    {
+        uint8_t header[3];
+        if (journal->read(header, 3) != 3 || header[0] != 'M' || header[1] != 'J')
+            break;
+
+        std::string name(header[2], '\0');
+        uint8_t location[6];
+        if (journal->read((uint8_t *)&name[0], name.size()) != name.size() || journal->read(location, 6) != 6)
+            break;
+
+        names.insert(name);
+        if (!journal->seek(zip_get16(location + 4), SEEK_CUR))
+            break;
+    }
+
+    return names;
+}
+
+bool ArchiveJournal::clear(std::string containerUrl)
+{
+    std::unique_ptr<MFile> file(MFSOwner::File(path(containerUrl)));
+    if (file == nullptr || !file->exists())
+        return true;
+
+    return file->remove();
+}
+
+
+/********************************************************
+ * Write-back
+ ********************************************************/
+
+bool ArchiveWriteBack::supported(std::string containerUrl)
+{
+    return MFileSystem::byExtension(".zip", containerUrl);
+}
+
+void ArchiveWriteBack::schedule(std::string containerUrl)
+{
+    pending.insert(containerUrl);
+}
+
+bool ArchiveWriteBack::service()
+{
+    if (pending.empty())
+        return false;
+
+    // An archive is being compacted, folds wait for it
+    std::unique_lock<std::mutex> lock(rewriting, std::try_to_lock);
+    if (!lock.owns_lock())
+        return false;
+
+    std::string containerUrl = *pending.begin();
+    if (!supported(containerUrl))
+    {
+        pending.erase(containerUrl);
+        return true;
+    }
+
+    bool compact = false;
+    if (!foldZip(containerUrl, compact))
+    {
+        // Stays pending, the journal is replayed until a fold works out
+        Debug_printv("Fold failed, keeping journal [%s]", containerUrl.c_str());
+        return true;
+    }
+
+    ArchiveJournal::clear(containerUrl);
+    pending.erase(containerUrl);
+    lock.unlock();
+
+    if (compact)
+    {
+        std::string *param = new std::string(containerUrl);
+#ifdef ESP_PLATFORM
+        if (xTaskCreate(compactTask, "ml_compact", ARCHIVE_COMPACT_STACKSIZE, param, ARCHIVE_COMPACT_PRIORITY, NULL) != pdPASS)
+        {
+            Debug_printv("Unable to start compact task");
+            delete param;
+        }
+#else
+        std::thread(compactTask, param).detach();
+#endif
+    }
+
+    return true;
+}
+
+bool ArchiveWriteBack::foldZip(std::string containerUrl, bool &compact)
+{
+    Debug_printv("Folding journal into [%s]", containerUrl.c_str());
+
+    std::unique_ptr<MFile> file(MFSOwner::File(containerUrl));
+    if (file == nullptr || file->sourceFile == nullptr || !file->sourceFile->isWritable)
+        return false;
+
+    ZipDirectory dir;
+    {
+        std::unique_ptr<MStream> zip(file->sourceFile->getSourceStream(std::ios_base::in));
+        if (zip == nullptr || !zip->isOpen() || !zip_read_directory(zip.get(), dir))
+            return false;
+    }
+    std::vector<uint32_t> entries = zip_entries(dir.cd);
+
+    // The new member versions are extracted into a temp file while the
+    // archive can still be read, and go where the central directory was
+    std::string tempUrl = file->sourceFile->url + ARCHIVE_WRITEBACK_TEMP_EXT;
+    std::unique_ptr<MFile> tempFile(MFSOwner::File(tempUrl));
+    if (tempFile == nullptr)
+        return false;
+
+    std::unique_ptr<MStream> staged(tempFile->getSourceStream(std::ios_base::in | std::ios_base::out | std::ios_base::trunc));
+    if (staged == nullptr || !staged->isOpen())
+    {
+        Debug_printv("Unable to create [%s]", tempUrl.c_str());
+        return false;
+    }
+
+    auto abandon = [&]() {
+        staged.reset();
+        tempFile->remove();
+        return false;
+    };
+
+    uint8_t buf[1024];
+    uint32_t staged_size = 0;
+
+    for (auto &member : ArchiveJournal::members(containerUrl))
+    {
+        // Find the member in the central directory
+        uint32_t p = 0;
+        bool found = false;
+        for (uint32_t e : entries)
+        {
+            if (std::string((char *)&dir.cd[e + ZIP_CENTRAL_HEADER_SIZE], zip_get16(&dir.cd[e + 28])) == member)
+            {
+                p = e;
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            // Its saves can't go anywhere, keep them in the journal
+            Debug_printv("Member not in central directory [%s]", member.c_str());
+            return abandon();
+        }
+        if (zip_get16(&dir.cd[p + 8]) & 0x0001)
+        {
+            Debug_printv("Encrypted member can't be written back [%s]", member.c_str());
+            return abandon();
+        }
+
+        // Writes never change a member's size, anything else is a failed extract
+        uint32_t expected = zip_get32(&dir.cd[p + 24]);
+
+        // Open the member by its full path, the journal is replayed when it is extracted
+        std::unique_ptr<MFile> memberFile(MFSOwner::File(containerUrl + "/" + member));
+        std::unique_ptr<MStream> data(memberFile ? memberFile->getSourceStream(std::ios_base::in) : nullptr);
+        if (data == nullptr || !data->isOpen())
+            return abandon();
+
+        // Local header, CRC and sizes are patched in when the data is written
+        uint8_t local[ZIP_LOCAL_HEADER_SIZE] = { 0 };
+        zip_put32(local, ZIP_LOCAL_HEADER_SIG);
+        zip_put16(local + 4, 20);                              // version needed
+        zip_put16(local + 10, zip_get16(&dir.cd[p + 12]));     // mod time
+        zip_put16(local + 12, zip_get16(&dir.cd[p + 14]));     // mod date
+        zip_put16(local + 26, member.size());
+
+        staged->seek(staged_size);
+        if (staged->write(local, sizeof(local)) != sizeof(local) ||
+            staged->write((uint8_t *)member.data(), member.size()) != member.size())
+            return abandon();
+
+        // Members are written back stored, recompressing is left to the desktop
+        uint32_t crc = 0;
+        uint32_t length = 0;
+        uint32_t n;
+        while (length < expected && (n = data->read(buf, std::min(expected - length, (uint32_t)sizeof(buf)))) > 0)
+        {
+            crc = zip_crc32(crc, buf, n);
+            if (staged->write(buf, n) != n)
+                return abandon();
+            length += n;
+        }
+        data.reset();
+
+        if (length != expected)
+        {
+            Debug_printv("member[%s] extracted [%lu] of [%lu] bytes, keeping journal", member.c_str(), length, expected);
+            return abandon();
+        }
+
+        zip_put32(local + 14, crc);
+        zip_put32(local + 18, length);
+        zip_put32(local + 22, length);
+        staged->seek(staged_size);
+        if (staged->write(local, sizeof(local)) != sizeof(local))
+            return abandon();
+
+        // Point the central directory at the new version
+        zip_put16(&dir.cd[p + 8], zip_get16(&dir.cd[p + 8]) & ~0x0008); // no data descriptor
+        zip_put16(&dir.cd[p + 10], 0);                                 // stored
+        zip_put32(&dir.cd[p + 16], crc);
+        zip_put32(&dir.cd[p + 20], length);
+        zip_put32(&dir.cd[p + 24], length);
+        zip_put32(&dir.cd[p + 42], dir.offset + staged_size);
+
+        staged_size += ZIP_LOCAL_HEADER_SIZE + member.size() + length;
+        Debug_printv("member[%s] length[%lu] crc[%08lX]", member.c_str(), length, crc);
+    }
+
+    // Everything is ready, only now is the archive written to. The new
+    // versions replace the central directory, the new one goes after them.
+    // That never ends before the old end record did, nothing is left over.
+    std::unique_ptr<MStream> zip(file->sourceFile->getSourceStream(std::ios_base::in | std::ios_base::out));
+    if (zip == nullptr || !zip->isOpen())
+        return abandon();
+
+    uint32_t cd_offset = dir.offset + staged_size;
+    zip_put32(&dir.end[16], cd_offset);
+
+    zip->seek(dir.offset);
+    if (!zip_copy(staged.get(), 0, zip.get(), staged_size) ||
+        zip->write(dir.cd.data(), dir.cd.size()) != dir.cd.size() ||
+        zip->write(dir.end.data(), dir.end.size()) != dir.end.size())
+    {
+        Debug_printv("Write back into [%s] failed", containerUrl.c_str());
+        zip.reset();
+        return abandon();
+    }
+    zip.reset();
+    staged.reset();
+    tempFile->remove();
+
+    // What is still in use, the rest is dead space left by earlier versions
+    uint32_t live = 0;
+    for (uint32_t e : entries)
+        live += ZIP_LOCAL_HEADER_SIZE + zip_get16(&dir.cd[e + 28]) + zip_get16(&dir.cd[e + 30]) + zip_get32(&dir.cd[e + 20]);
+    uint32_t dead = (cd_offset > live) ? cd_offset - live : 0;
+    compact = (dead >= ARCHIVE_COMPACT_MIN_DEAD && dead > live);
+
+    return true;
+}
+
+void ArchiveWriteBack::compactTask(void *param)
+{
+    std::string *containerUrl = (std::string *)param;
+    {
+        std::lock_guard<std::mutex> lock(rewriting);
+        compactZip(*containerUrl);
+    }
+    delete containerUrl;
+
+#ifdef ESP_PLATFORM
+    vTaskDelete(NULL);
+#endif
+}
+
+bool ArchiveWriteBack::compactZip(std::string containerUrl)
+{
+    Debug_printv("Compacting [%s]", containerUrl.c_str());
+
+    std::unique_ptr<MFile> file(MFSOwner::File(containerUrl));
+    if (file == nullptr || file->sourceFile == nullptr || !file->sourceFile->isWritable)
+        return false;
+
+    std::unique_ptr<MStream> zip(file->sourceFile->getSourceStream(std::ios_base::in));
+    ZipDirectory dir;
+    if (zip == nullptr || !zip->isOpen() || !zip_read_directory(zip.get(), dir))
+        return false;
+
+    std::string tempUrl = file->sourceFile->url + ARCHIVE_WRITEBACK_TEMP_EXT;
+    std::unique_ptr<MFile> tempFile(MFSOwner::File(tempUrl));
+    if (tempFile == nullptr)
+        return false;
+
+    std::unique_ptr<MStream> out(tempFile->getSourceStream(std::ios_base::in | std::ios_base::out | std::ios_base::trunc));
+    if (out == nullptr || !out->isOpen())
+        return false;
+
+    auto abandon = [&]() {
+        out.reset();
+        tempFile->remove();
+        return false;
+    };
+
+    // Each member as it is, local header to data descriptor, one after the other
+    uint32_t offset = 0;
+    for (uint32_t p : zip_entries(dir.cd))
+    {
+        uint32_t local_offset = zip_get32(&dir.cd[p + 42]);
+        uint8_t local[ZIP_LOCAL_HEADER_SIZE];
+        zip->seek(local_offset);
+        if (zip->read(local, sizeof(local)) != sizeof(local) || zip_get32(local) != ZIP_LOCAL_HEADER_SIG)
+            return abandon();
+
+        uint32_t length = ZIP_LOCAL_HEADER_SIZE + zip_get16(local + 26) + zip_get16(local + 28) + zip_get32(&dir.cd[p + 20]);
+        if (zip_get16(&dir.cd[p + 8]) & 0x0008)
+        {
+            // The descriptor's signature is optional
+            uint8_t sig[4];
+            zip->seek(local_offset + length);
+            if (zip->read(sig, sizeof(sig)) != sizeof(sig))
+                return abandon();
+            length += (zip_get32(sig) == ZIP_DESCRIPTOR_SIG) ? 16 : 12;
+        }
+
+        if (!zip_copy(zip.get(), local_offset, out.get(), length))
+            return abandon();
+
+        zip_put32(&dir.cd[p + 42], offset);
+        offset += length;
+    }
+    zip.reset();
+
+    zip_put32(&dir.end[16], offset);
+    if (out->write(dir.cd.data(), dir.cd.size()) != dir.cd.size() ||
+        out->write(dir.end.data(), dir.end.size()) != dir.end.size())
+        return abandon();
+    out.reset();
+
+    // Swap the compacted archive in. Where renaming over an existing file
+    // isn't supported the original is moved aside first, and put back if
+    // the swap fails, so there is always a whole archive
+    std::string target = file->sourceFile->path;
+    if (tempFile->rename(target))
+        return true;
+
+    std::string backup = target + ARCHIVE_WRITEBACK_BACKUP_EXT;
+    if (!file->sourceFile->rename(backup))
+    {
+        Debug_printv("Unable to move [%s] aside", target.c_str());
+        return abandon();
+    }
+
+    std::unique_ptr<MFile> backupFile(MFSOwner::File(file->sourceFile->url + ARCHIVE_WRITEBACK_BACKUP_EXT));
+    if (!tempFile->rename(target))
+    {
+        Debug_printv("Unable to replace [%s], restoring it", target.c_str());
+        if (backupFile != nullptr)
+            backupFile->rename(target);
+        return abandon();
+    }
+
+    if (backupFile != nullptr)
+        backupFile->remove();
+
+    return true;
+}
@@ -0,0 +1,109 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// Write-back for modified archive members
+//
+// Writes into an extracted archive member (i.e. saving to a D64 inside a
+// ZIP) are appended to a sidecar journal next to the archive
+// ("games.zip" -> "games.zip.mlj"). The save costs only the bytes that
+// changed. The journal is replayed over the member every time it is
+// extracted again.
+//
+// When the bus is idle the journal is folded back into ZIP archives. The
+// extracted members it touched are staged in a temp file first, since the
+// archive can't be read once it is being written. Then a new stored copy
+// of each is written where the central directory was, followed by a new
+// central directory and end record. Unchanged members aren't touched, and
+// the old copies stay in the file as dead space. The journal is only
+// removed once the new end record is written, so saves survive a fold that
+// fails or is cut short by power loss.
+//
+// Once more than half of an archive is dead space it is compacted: copied
+// without the dead space by a low priority task, and swapped in for the
+// original. The bus never waits for that.
+//
+// Other archive formats can't be folded, so their members aren't journaled
+// and writes to them are only kept until the member is closed.
+//
+// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+//
+
+#ifndef MEATLOAF_ARCHIVE_JOURNAL
+#define MEATLOAF_ARCHIVE_JOURNAL
+
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "../meatloaf.h"
+
+#define ARCHIVE_JOURNAL_EXT ".mlj"
+#define ARCHIVE_WRITEBACK_IDLE_MS 5000
+#define ARCHIVE_WRITEBACK_TEMP_EXT ".fold"
+#define ARCHIVE_WRITEBACK_BACKUP_EXT ".old"
+
+#define ARCHIVE_COMPACT_MIN_DEAD  (64 * 1024)  // not worth copying the archive for less
+#define ARCHIVE_COMPACT_STACKSIZE 4096
+#define ARCHIVE_COMPACT_PRIORITY  1
+
+
+/********************************************************
+ * Journal
+ ********************************************************/
+
+class ArchiveJournal {
+public:
+    // Record layout: 'M' 'J' <name length> <name> <offset:u32le> <length:u16le> <data>
+    static bool append(std::string containerUrl, std::string member, uint32_t offset, const uint8_t *buf, uint32_t size);
+    static uint32_t replay(std::string containerUrl, std::string member, std::function<void(uint32_t, const uint8_t *, uint16_t)> apply);
+    static std::set<std::string> members(std::string containerUrl);
+    static bool clear(std::string containerUrl);
+
+private:
+    static std::string path(std::string containerUrl) {
+        return containerUrl + ARCHIVE_JOURNAL_EXT;
+    }
+};
+
+
+/********************************************************
+ * Write-back
+ ********************************************************/
+
+class ArchiveWriteBack {
+    static std::set<std::string> pending;
+
+    // Held while an archive is rewritten, by a fold or a compaction
+    static std::mutex rewriting;
+
+public:
+    // Only archives that can be folded back are journaled
+    static bool supported(std::string containerUrl);
+
+    static void schedule(std::string containerUrl);
+
+    // Fold one pending archive, call when the bus is idle
+    static bool service();
+
+private:
+    static bool foldZip(std::string containerUrl, bool &compact);
+    static bool compactZip(std::string containerUrl);
+    static void compactTask(void *param);
+};
+
+#endif // MEATLOAF_ARCHIVE_JOURNAL
@@ -0,0 +1,533 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// Only tinfl is needed. This is the one place the miniz implementation is
+// compiled, everything else must include it with MINIZ_HEADER_FILE_ONLY.
+#define MINIZ_NO_STDIO
+#define MINIZ_NO_ARCHIVE_APIS
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "../../vdrive/miniz.h"
+
+#include "gz.h"
+
+#include <cstring>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+#define GZ_ID1 0x1F
+#define GZ_ID2 0x8B
+#define GZ_DEFLATE 8
+
+// Header flags
+#define GZ_FHCRC    0x02
+#define GZ_FEXTRA   0x04
+#define GZ_FNAME    0x08
+#define GZ_FCOMMENT 0x10
+
+#define GZ_HEADER_SIZE  10
+#define GZ_TRAILER_SIZE 8
+
+#define GZ_SIDECAR_HEADER_SIZE 16
+
+// Everything needed to resume inflating from out_offset
+struct GZCheckpoint {
+    uint32_t in_offset;         // next compressed byte in the source
+    uint32_t out_offset;        // bytes inflated so far
+    uint32_t dict_ofs;          // next write position in dict
+    tinfl_decompressor inflator;
+    uint8_t dict[TINFL_LZ_DICT_SIZE];
+};
+
+
+/********************************************************
+ * Utility Functions
+ ********************************************************/
+
+static uint32_t gz_get32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static void gz_put32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+static GZCheckpoint *gz_alloc()
+{
+    GZCheckpoint *checkpoint = nullptr;
+#if defined(ESP_PLATFORM) && defined(BOARD_HAS_PSRAM)
+    checkpoint = (GZCheckpoint *)heap_caps_malloc(sizeof(GZCheckpoint), MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+#endif
+    if (checkpoint == nullptr)
+        checkpoint = (GZCheckpoint *)malloc(sizeof(GZCheckpoint));
+
+    return checkpoint;
+}
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+GZMStream::GZMStream(std::string url, std::shared_ptr<MStream> is)
+{
+    this->url = url;
+    m_source = is;
+    m_sidecarUrl = url + GZ_SIDECAR_EXTENSION;
+
+    // Without PSRAM there is no room for 44KB checkpoints, use the sidecar
+#if defined(ESP_PLATFORM) && !defined(BOARD_HAS_PSRAM)
+    m_sidecar = true;
+#endif
+}
+
+GZMStream::~GZMStream()
+{
+    close();
+}
+
+bool GZMStream::open(std::ios_base::openmode mode)
+{
+    if (m_isOpen)
+        return true;
+
+    if (m_source == nullptr || !m_source->isOpen())
+        return false;
+
+    m_in.reset(new uint8_t[GZ_INPUT_SIZE]);
+    m_live = gz_alloc();
+    if (m_live == nullptr)
+    {
+        Debug_printv("Out of memory for inflate state [%s]", url.c_str());
+        return false;
+    }
+
+    if (!readHeader())
+    {
+        Debug_printv("Not a gzip file [%s]", url.c_str());
+        close();
+        return false;
+    }
+
+    bool trailer = readTrailer();
+    if (trailer && m_sidecar)
+        loadSidecar();
+
+    m_isOpen = true;
+    restart();
+
+    if (trailer)
+        _size = m_isize;
+    else if (!scanToEnd())
+    {
+        close();
+        return false;
+    }
+
+    _position = 0;
+
+    Debug_printv("url[%s] size[%lu] checkpoints[%d] sidecar[%d]", url.c_str(), _size, m_index.size(), m_sidecar);
+    return true;
+}
+
+void GZMStream::close()
+{
+    m_isOpen = false;
+    freeCheckpoints();
+
+    if (m_live != nullptr)
+    {
+        free(m_live);
+        m_live = nullptr;
+    }
+    m_in.reset();
+}
+
+uint32_t GZMStream::read(uint8_t *buf, uint32_t size)
+{
+    if (!m_isOpen || _position >= _size)
+        return 0;
+
+    size = std::min(size, _size - _position);
+
+    uint32_t copied = 0;
+    while (copied < size)
+    {
+        if (!moveTo(_position))
+            break;
+
+        // _position is in the last 32KB of output, still in the dictionary
+        uint32_t back = m_live->out_offset - _position;
+        uint32_t offset = (m_live->dict_ofs - back) & (TINFL_LZ_DICT_SIZE - 1);
+        uint32_t length = std::min({ size - copied, back, (uint32_t)TINFL_LZ_DICT_SIZE - offset });
+
+        memcpy(buf + copied, m_live->dict + offset, length);
+        copied += length;
+        _position += length;
+    }
+
+    return copied;
+}
+
+bool GZMStream::seek(uint32_t pos)
+{
+    // Inflating to pos is left to the next read
+    if (pos > _size)
+        return false;
+
+    _position = pos;
+    return true;
+}
+
+
+/********************************************************
+ * gzip member
+ ********************************************************/
+
+bool GZMStream::readHeader()
+{
+    // The header is small, read it in one go and parse it from the input buffer
+    if (!m_source->seek(0))
+        return false;
+
+    uint32_t length = m_source->read(m_in.get(), GZ_INPUT_SIZE);
+    uint8_t *header = m_in.get();
+    if (length < GZ_HEADER_SIZE || header[0] != GZ_ID1 || header[1] != GZ_ID2 || header[2] != GZ_DEFLATE)
+        return false;
+
+    uint8_t flags = header[3];
+    uint32_t i = GZ_HEADER_SIZE;
+
+    if (flags & GZ_FEXTRA)
+    {
+        if (i + 2 > length)
+            return false;
+        i += 2 + (header[i] | (header[i + 1] << 8));
+    }
+
+    if (flags & GZ_FNAME)
+    {
+        while (i < length && header[i] != 0x00)
+            i++;
+        i++;
+    }
+
+    if (flags & GZ_FCOMMENT)
+    {
+        while (i < length && header[i] != 0x00)
+            i++;
+        i++;
+    }
+
+    if (flags & GZ_FHCRC)
+        i += 2;
+
+    if (i >= length)
+        return false;
+
+    m_dataStart = i;
+    return true;
+}
+
+bool GZMStream::readTrailer()
+{
+    // CRC32 and size of the uncompressed data are the last 8 bytes
+    uint32_t size = m_source->size();
+    if (size < m_dataStart + GZ_TRAILER_SIZE || !m_source->seek(size - GZ_TRAILER_SIZE))
+        return false;
+
+    uint8_t trailer[GZ_TRAILER_SIZE];
+    if (m_source->read(trailer, GZ_TRAILER_SIZE) != GZ_TRAILER_SIZE)
+        return false;
+
+    m_crc = gz_get32(trailer);
+    m_isize = gz_get32(trailer + 4);
+    return (m_isize > 0);
+}
+
+bool GZMStream::scanToEnd()
+{
+    // Source can't tell us the size, inflate it all once (building the index on the way)
+    restart();
+    while (inflate())
+        ;
+
+    _size = m_live->out_offset;
+    return !m_failed;
+}
+
+
+/********************************************************
+ * Inflate
+ ********************************************************/
+
+void GZMStream::restart()
+{
+    tinfl_init(&m_live->inflator);
+    m_live->in_offset = m_dataStart;
+    m_live->out_offset = 0;
+    m_live->dict_ofs = 0;
+
+    m_inAvailable = 0;
+    m_sourcePosition = m_dataStart;
+    m_done = false;
+    m_failed = false;
+}
+
+bool GZMStream::inflate()
+{
+    if (m_done)
+        return false;
+
+    bool refilled = false;
+    if (m_inAvailable == 0)
+    {
+        if (m_source->position() != m_sourcePosition)
+            m_source->seek(m_sourcePosition);
+
+        m_inOffset = 0;
+        m_inAvailable = m_source->read(m_in.get(), GZ_INPUT_SIZE);
+        m_sourcePosition += m_inAvailable;
+        refilled = true;
+    }
+
+    uint32_t flags = (m_sourcePosition < m_source->size()) ? TINFL_FLAG_HAS_MORE_INPUT : 0;
+    size_t in_bytes = m_inAvailable;
+    size_t out_bytes = TINFL_LZ_DICT_SIZE - m_live->dict_ofs;
+    tinfl_status status = tinfl_decompress(&m_live->inflator,
+                                           m_in.get() + m_inOffset, &in_bytes,
+                                           m_live->dict, m_live->dict + m_live->dict_ofs, &out_bytes,
+                                           flags);
+
+    m_inOffset += in_bytes;
+    m_inAvailable -= in_bytes;
+    m_live->in_offset += in_bytes;
+    m_live->out_offset += out_bytes;
+    m_live->dict_ofs = (m_live->dict_ofs + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+    if (status == TINFL_STATUS_DONE)
+    {
+        m_done = true;
+    }
+    else if (status < 0 || (refilled && in_bytes == 0 && out_bytes == 0))
+    {
+        Debug_printv("inflate failed status[%d] in[%lu] out[%lu]", status, m_live->in_offset, m_live->out_offset);
+        m_done = true;
+        m_failed = true;
+    }
+    else
+    {
+        addCheckpoint();
+    }
+
+    return (out_bytes > 0 || !m_done);
+}
+
+bool GZMStream::moveTo(uint32_t pos)
+{
+    auto inDictionary = [&]() {
+        uint32_t out = m_live->out_offset;
+        return (pos < out && out - pos <= std::min(out, (uint32_t)TINFL_LZ_DICT_SIZE));
+    };
+
+    if (inDictionary())
+        return true;
+
+    // Nearest checkpoint at or before pos
+    const Index *nearest = nullptr;
+    for (const auto &index : m_index)
+    {
+        if (index.out_offset > pos)
+            break;
+        nearest = &index;
+    }
+
+    // Carry on from where we are unless pos is behind us or a checkpoint is closer
+    uint32_t from = (nearest != nullptr) ? nearest->out_offset : 0;
+    if (m_live->out_offset > pos || m_live->out_offset < from || m_failed)
+    {
+        if (nearest == nullptr || !restoreCheckpoint(*nearest))
+            restart();
+    }
+
+    while (!inDictionary())
+    {
+        if (!inflate())
+            return inDictionary();
+    }
+
+    return true;
+}
+
+
+/********************************************************
+ * Checkpoints
+ ********************************************************/
+
+void GZMStream::addCheckpoint()
+{
+    // Only on the first pass through each interval
+    uint32_t last = m_index.empty() ? 0 : m_index.back().out_offset;
+    if (m_index.size() >= GZ_CHECKPOINT_MAX || m_live->out_offset < last + GZ_CHECKPOINT_INTERVAL)
+        return;
+
+    Index index = { m_live->out_offset, nullptr, 0 };
+    if (m_sidecar)
+    {
+        if (!writeSidecar(index))
+            return;
+    }
+    else
+    {
+        index.mem = gz_alloc();
+        if (index.mem == nullptr)
+        {
+            Debug_printv("Out of memory for checkpoint at [%lu]", index.out_offset);
+            return;
+        }
+        memcpy(index.mem, m_live, sizeof(GZCheckpoint));
+    }
+
+    m_index.push_back(index);
+    // Debug_printv("checkpoint[%d] in[%lu] out[%lu]", m_index.size(), m_live->in_offset, m_live->out_offset);
+}
+
+bool GZMStream::restoreCheckpoint(const Index &index)
+{
+    if (index.mem != nullptr)
+        memcpy(m_live, index.mem, sizeof(GZCheckpoint));
+    else if (!readSidecar(index))
+        return false;
+
+    m_inAvailable = 0;
+    m_sourcePosition = m_live->in_offset;
+    m_done = false;
+    m_failed = false;
+    return true;
+}
+
+void GZMStream::freeCheckpoints()
+{
+    for (auto &index : m_index)
+    {
+        if (index.mem != nullptr)
+            free(index.mem);
+    }
+    m_index.clear();
+}
+
+
+/********************************************************
+ * Sidecar file
+ ********************************************************/
+
+// "MLGZ" <compressed size> <crc32> <isize> then one GZCheckpoint per record
+
+void GZMStream::loadSidecar()
+{
+    std::unique_ptr<MFile> file(MFSOwner::File(m_sidecarUrl));
+    if (file == nullptr || !file->exists())
+        return;
+
+    std::unique_ptr<MStream> sidecar(file->getSourceStream(std::ios_base::in));
+    if (sidecar == nullptr || !sidecar->isOpen())
+        return;
+
+    uint8_t header[GZ_SIDECAR_HEADER_SIZE];
+    if (sidecar->read(header, GZ_SIDECAR_HEADER_SIZE) != GZ_SIDECAR_HEADER_SIZE ||
+        memcmp(header, "MLGZ", 4) != 0 ||
+        gz_get32(header + 4) != m_source->size() ||
+        gz_get32(header + 8) != m_crc ||
+        gz_get32(header + 12) != m_isize ||
+        (sidecar->size() - GZ_SIDECAR_HEADER_SIZE) % sizeof(GZCheckpoint) != 0)
+    {
+        Debug_printv("Stale sidecar [%s]", m_sidecarUrl.c_str());
+        return;
+    }
+
+    for (uint32_t offset = GZ_SIDECAR_HEADER_SIZE;
+         offset + sizeof(GZCheckpoint) <= sidecar->size() && m_index.size() < GZ_CHECKPOINT_MAX;
+         offset += sizeof(GZCheckpoint))
+    {
+        // in_offset, out_offset, dict_ofs
+        uint32_t offsets[3];
+        if (!sidecar->seek(offset) || sidecar->read((uint8_t *)offsets, sizeof(offsets)) != sizeof(offsets))
+            break;
+
+        m_index.push_back({ offsets[1], nullptr, offset });
+    }
+
+    m_sidecarStale = false;
+}
+
+bool GZMStream::writeSidecar(Index &index)
+{
+    if (m_sidecarUrl.empty())
+        return false;
+
+    std::unique_ptr<MFile> file(MFSOwner::File(m_sidecarUrl));
+    std::unique_ptr<MStream> sidecar;
+    if (file != nullptr)
+        sidecar.reset(file->getSourceStream(m_sidecarStale ? std::ios_base::out : std::ios_base::app));
+
+    if (sidecar == nullptr || !sidecar->isOpen())
+    {
+        // Read only media, do without checkpoints
+        Debug_printv("Unable to write sidecar [%s]", m_sidecarUrl.c_str());
+        m_sidecarUrl.clear();
+        return false;
+    }
+
+    if (m_sidecarStale)
+    {
+        uint8_t header[GZ_SIDECAR_HEADER_SIZE];
+        memcpy(header, "MLGZ", 4);
+        gz_put32(header + 4, m_source->size());
+        gz_put32(header + 8, m_crc);
+        gz_put32(header + 12, m_isize);
+
+        if (sidecar->write(header, GZ_SIDECAR_HEADER_SIZE) != GZ_SIDECAR_HEADER_SIZE)
+            return false;
+
+        m_sidecarStale = false;
+    }
+
+    index.sidecar_offset = GZ_SIDECAR_HEADER_SIZE + (m_index.size() * sizeof(GZCheckpoint));
+    if (sidecar->write((uint8_t *)m_live, sizeof(GZCheckpoint)) != sizeof(GZCheckpoint))
+    {
+        Debug_printv("Sidecar write failed [%s]", m_sidecarUrl.c_str());
+        m_sidecarStale = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool GZMStream::readSidecar(const Index &index)
+{
+    std::unique_ptr<MFile> file(MFSOwner::File(m_sidecarUrl));
+    if (file == nullptr)
+        return false;
+
+    std::unique_ptr<MStream> sidecar(file->getSourceStream(std::ios_base::in));
+    if (sidecar == nullptr || !sidecar->isOpen() || !sidecar->seek(index.sidecar_offset))
+        return false;
+
+    if (sidecar->read((uint8_t *)m_live, sizeof(GZCheckpoint)) != sizeof(GZCheckpoint) || m_live->out_offset != index.out_offset)
+    {
+        Debug_printv("Sidecar read failed [%s]", m_sidecarUrl.c_str());
+        return false;
+    }
+
+    return true;
+}
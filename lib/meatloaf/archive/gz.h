@@ -0,0 +1,179 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// GZ - gzip compressed disk images (.d64.gz, .g64.gz, ...)
+//
+// https://www.rfc-editor.org/rfc/rfc1952
+//
+// The image is gunzipped with miniz as it is read. While inflating, a
+// checkpoint (inflate state + the 32KB dictionary) is saved every
+// GZ_CHECKPOINT_INTERVAL bytes of output. A seek to an earlier sector
+// resumes from the nearest checkpoint instead of from the start of the
+// file. Checkpoints are kept in PSRAM when there is some, otherwise they
+// are written to a sidecar file (<image>.gzi) and reused on later mounts.
+//
+
+#ifndef MEATLOAF_ARCHIVE_GZ
+#define MEATLOAF_ARCHIVE_GZ
+
+#include "../meatloaf.h"
+#include "../disk/d64.h"
+#include "../disk/d71.h"
+#include "../disk/d81.h"
+#include "../disk/g64.h"
+
+#include "../../../include/debug.h"
+
+#define GZ_CHECKPOINT_INTERVAL (64 * 1024)
+#define GZ_CHECKPOINT_MAX 16
+#define GZ_INPUT_SIZE 4096
+#define GZ_SIDECAR_EXTENSION ".gzi"
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+// Inflate state + dictionary, defined in gz.cpp next to miniz
+struct GZCheckpoint;
+
+class GZMStream : public MStream {
+
+public:
+    GZMStream(std::string url, std::shared_ptr<MStream> is);
+    ~GZMStream() override;
+
+    // MStream methods
+    bool isOpen() override { return m_isOpen; };
+    bool isBrowsable() override { return false; };
+    bool isRandomAccess() override { return true; };
+
+    bool open(std::ios_base::openmode mode) override;
+    void close() override;
+
+    uint32_t read(uint8_t* buf, uint32_t size) override;
+    uint32_t write(const uint8_t *buf, uint32_t size) override { return 0; };
+
+    bool seek(uint32_t pos) override;
+
+protected:
+    struct Index {
+        uint32_t out_offset;
+        GZCheckpoint *mem;          // checkpoint in PSRAM
+        uint32_t sidecar_offset;    // or its record in the sidecar file
+    };
+
+    bool readHeader();
+    bool readTrailer();
+    bool scanToEnd();
+
+    void restart();
+    bool inflate();
+    bool moveTo(uint32_t pos);
+
+    void addCheckpoint();
+    bool restoreCheckpoint(const Index &index);
+    void freeCheckpoints();
+
+    void loadSidecar();
+    bool writeSidecar(Index &index);
+    bool readSidecar(const Index &index);
+
+    std::shared_ptr<MStream> m_source;
+    bool m_isOpen = false;
+
+    // gzip member
+    uint32_t m_dataStart = 0;
+    uint32_t m_crc = 0;
+    uint32_t m_isize = 0;
+
+    // Live inflate state, same layout as a checkpoint
+    GZCheckpoint *m_live = nullptr;
+    bool m_done = false;
+    bool m_failed = false;
+
+    std::unique_ptr<uint8_t[]> m_in;
+    uint32_t m_inOffset = 0;
+    uint32_t m_inAvailable = 0;
+    uint32_t m_sourcePosition = 0;
+
+    std::vector<Index> m_index;
+    std::string m_sidecarUrl;
+    bool m_sidecar = false;         // checkpoints go to the sidecar file
+    bool m_sidecarStale = true;     // sidecar has to be rewritten before appending
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+// Any disk image type, with its container gunzipped first
+template <class T>
+class GZMFile: public T {
+public:
+    GZMFile(std::string path) : T(path) {
+        this->isWritable = false;
+    };
+
+    MStream* getDecodedStream(std::shared_ptr<MStream> is) override
+    {
+        // Debug_printv("[%s]", this->url.c_str());
+        std::string imageUrl = (this->sourceFile != nullptr) ? this->sourceFile->url : this->url;
+        auto image = std::make_shared<GZMStream>(imageUrl, is);
+        image->open(std::ios_base::in);
+
+        return T::getDecodedStream(image);
+    }
+};
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class GZMFileSystem: public MFileSystem
+{
+public:
+    GZMFileSystem(): MFileSystem("gz") {};
+
+    bool handles(std::string fileName) override {
+        return byExtension(
+            {
+                ".d64.gz",
+                ".d71.gz",
+                ".d81.gz",
+                ".g64.gz"
+            },
+            fileName
+        );
+    }
+
+    MFile* getFile(std::string path) override {
+        if ( byExtension(".d71.gz", path) )
+            return new GZMFile<D71MFile>(path);
+        else if ( byExtension(".d81.gz", path) )
+            return new GZMFile<D81MFile>(path);
+        else if ( byExtension(".g64.gz", path) )
+            return new GZMFile<G64MFile>(path);
+
+        return new GZMFile<D64MFile>(path);
+    }
+};
+
+
+#endif /* MEATLOAF_ARCHIVE_GZ */
@@ -0,0 +1,326 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "zipcode.h"
+
+#include <cstring>
+
+// Compression method is stored in the top two bits of the track byte
+#define ZIPCODE_RAW  0x00
+#define ZIPCODE_FILL 0x40
+#define ZIPCODE_RLE  0x80
+
+// First track stored in each part (1!, 2!, 3!, 4!)
+static const uint8_t zipcode_first_track[ZIPCODE_PARTS + 1] = { 1, 9, 17, 26, ZIPCODE_TRACKS + 1 };
+
+
+/********************************************************
+ * Zipcode Utility Functions
+ ********************************************************/
+
+uint8_t ZipcodeMStream::partForTrack(uint8_t track)
+{
+    uint8_t part = 0;
+    while (part < ZIPCODE_PARTS - 1 && track >= zipcode_first_track[part + 1])
+        part++;
+
+    return part;
+}
+
+uint8_t ZipcodeMStream::sectorsInTrack(uint8_t track)
+{
+    if (track < 18) return 21;
+    if (track < 25) return 19;
+    if (track < 31) return 18;
+    return 17;
+}
+
+std::string ZipcodeMStream::partUrl(uint8_t part)
+{
+    // Swap the set number at the start of the file name
+    // "/games/1!zork" -> "/games/3!zork"
+    std::string partUrl = url;
+    size_t i = partUrl.find_last_of('/');
+    i = (i == std::string::npos) ? 0 : i + 1;
+    if (i < partUrl.size())
+        partUrl[i] = '1' + part;
+
+    return partUrl;
+}
+
+MStream* ZipcodeMStream::getPart(uint8_t part)
+{
+    if (m_parts[part] == nullptr)
+    {
+        std::string u = partUrl(part);
+        Debug_printv("opening part[%d] url[%s]", part + 1, u.c_str());
+
+        // The set is claimed by ZipcodeMFileSystem so we go through the
+        // source file to get at the raw bytes of the part
+        m_partFiles[part].reset(MFSOwner::File(u));
+        if (m_partFiles[part] == nullptr || m_partFiles[part]->sourceFile == nullptr)
+        {
+            Debug_printv("part[%d] not found", part + 1);
+            return nullptr;
+        }
+
+        auto s = m_partFiles[part]->sourceFile->getSourceStream(std::ios_base::in);
+        if (s == nullptr)
+        {
+            Debug_printv("part[%d] could not be opened", part + 1);
+            return nullptr;
+        }
+        m_parts[part].reset(s);
+    }
+
+    return m_parts[part].get();
+}
+
+// Walk the sector records of a track. When data is set the sectors are
+// decoded into it, otherwise they are skipped to find the next track.
+bool ZipcodeMStream::walkTrack(uint8_t track, uint8_t *data)
+{
+    uint8_t part = partForTrack(track);
+    MStream *stream = getPart(part);
+    if (stream == nullptr)
+        return false;
+
+    // Index forward from the last track we know the start of
+    if (m_trackIndex[track] == 0)
+    {
+        uint8_t first = zipcode_first_track[part];
+        if (m_trackIndex[first] == 0)
+            m_trackIndex[first] = (part == 0) ? 4 : 2; // load address (+ disk id in 1!)
+
+        uint8_t t = track;
+        while (m_trackIndex[t] == 0)
+            t--;
+
+        while (t < track)
+        {
+            if (!walkTrack(t, nullptr))
+                return false;
+            t++;
+        }
+    }
+
+    uint32_t pos = m_trackIndex[track];
+    if (!stream->seek(pos))
+        return false;
+
+    uint8_t count = sectorsInTrack(track);
+    uint8_t rle[256];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t header[2];
+        if (stream->read(header, 2) != 2)
+            return false;
+        pos += 2;
+
+        uint8_t method = header[0] & 0xC0;
+        uint8_t t = header[0] & 0x3F;
+        uint8_t s = header[1];
+        if (t != track || s >= count)
+        {
+            Debug_printv("bad sector record track[%d] sector[%d] expected track[%d]", t, s, track);
+            return false;
+        }
+
+        uint8_t *sector = (data != nullptr) ? data + (s * 256) : nullptr;
+        if (method == ZIPCODE_RAW)
+        {
+            if (sector != nullptr)
+            {
+                if (stream->read(sector, 256) != 256)
+                    return false;
+            }
+            else if (!stream->seek(pos + 256))
+                return false;
+
+            pos += 256;
+        }
+        else if (method == ZIPCODE_FILL)
+        {
+            uint8_t fill;
+            if (stream->read(&fill, 1) != 1)
+                return false;
+            pos += 1;
+
+            if (sector != nullptr)
+                memset(sector, fill, 256);
+        }
+        else if (method == ZIPCODE_RLE)
+        {
+            uint8_t len_rep[2];
+            if (stream->read(len_rep, 2) != 2)
+                return false;
+            pos += 2;
+
+            uint8_t length = len_rep[0];
+            uint8_t repcode = len_rep[1];
+            if (sector != nullptr)
+            {
+                if (stream->read(rle, length) != length)
+                    return false;
+
+                // <repcode> <count> <byte> expands to count x byte
+                uint16_t out = 0;
+                for (uint16_t in = 0; in < length && out < 256; in++)
+                {
+                    if (rle[in] == repcode && in + 2 < length)
+                    {
+                        uint8_t n = rle[++in];
+                        uint8_t b = rle[++in];
+                        while (n-- && out < 256)
+                            sector[out++] = b;
+                    }
+                    else
+                        sector[out++] = rle[in];
+                }
+            }
+            else if (!stream->seek(pos + length))
+                return false;
+
+            pos += length;
+        }
+        else
+        {
+            Debug_printv("unknown compression method[%02X] track[%d] sector[%d]", method, t, s);
+            return false;
+        }
+    }
+
+    // Remember where the next track starts
+    if (track < ZIPCODE_TRACKS && partForTrack(track + 1) == part)
+        m_trackIndex[track + 1] = pos;
+
+    return true;
+}
+
+uint8_t *ZipcodeMStream::getTrack(uint8_t track)
+{
+    CachedTrack *slot = &m_cache[0];
+    for (uint8_t i = 0; i < ZIPCODE_TRACK_CACHE; i++)
+    {
+        if (m_cache[i].track == track)
+        {
+            m_cache[i].used = ++m_cacheStamp;
+            return m_cache[i].data;
+        }
+
+        // Empty slot or least recently used
+        if (m_cache[i].used < slot->used)
+            slot = &m_cache[i];
+    }
+
+    //Debug_printv("decode track[%d]", track);
+    slot->track = 0;
+    slot->used = 0;
+    if (!walkTrack(track, slot->data))
+        return nullptr;
+
+    slot->track = track;
+    slot->used = ++m_cacheStamp;
+    return slot->data;
+}
+
+
+/********************************************************
+ * MStream impls
+ ********************************************************/
+
+bool ZipcodeMStream::isOpen()
+{
+    return (m_cache != nullptr);
+}
+
+bool ZipcodeMStream::open(std::ios_base::openmode mode)
+{
+    if (isOpen())
+        return true;
+
+    if (m_parts[0] == nullptr)
+        return false;
+
+    uint8_t load_address[2] = { 0 };
+    m_parts[0]->seek(0);
+    m_parts[0]->read(load_address, 2);
+    if (load_address[0] != 0xFE || load_address[1] != 0x03)
+        Debug_printv("unexpected load address [%02X%02X] url[%s]", load_address[1], load_address[0], url.c_str());
+
+    m_cache.reset(new CachedTrack[ZIPCODE_TRACK_CACHE]);
+    m_cacheStamp = 0;
+    _position = 0;
+
+    return true;
+}
+
+void ZipcodeMStream::close()
+{
+    m_cache.reset();
+
+    // Keep part 1, it was handed to us already opened
+    for (uint8_t i = 1; i < ZIPCODE_PARTS; i++)
+    {
+        m_parts[i].reset();
+        m_partFiles[i].reset();
+    }
+}
+
+uint32_t ZipcodeMStream::read(uint8_t* buf, uint32_t size)
+{
+    if (!isOpen())
+        return 0;
+
+    if (size > available())
+        size = available();
+
+    uint32_t bytesRead = 0;
+    while (bytesRead < size)
+    {
+        // Find the track that holds the current position
+        uint8_t track = 1;
+        uint32_t start = 0;
+        while (track < ZIPCODE_TRACKS && _position >= start + (sectorsInTrack(track) * 256))
+        {
+            start += sectorsInTrack(track) * 256;
+            track++;
+        }
+
+        uint8_t *data = getTrack(track);
+        if (data == nullptr)
+            break;
+
+        uint32_t offset = _position - start;
+        uint32_t n = std::min(size - bytesRead, (sectorsInTrack(track) * 256) - offset);
+        memcpy(buf + bytesRead, data + offset, n);
+
+        bytesRead += n;
+        _position += n;
+    }
+
+    return bytesRead;
+}
+
+bool ZipcodeMStream::seek(uint32_t pos)
+{
+    if (pos > _size)
+        return false;
+
+    _position = pos;
+    return true;
+}
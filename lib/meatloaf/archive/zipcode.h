@@ -20,4 +20,130 @@
 // https://ist.uwaterloo.ca/~schepers/formats/ZIP_DISK.TXT
 // https://ist.uwaterloo.ca/~schepers/formats/ZIP_FILE.TXT
 // https://ist.uwaterloo.ca/~schepers/formats/ZIP_SIX.TXT
-//
\ No newline at end of file
+//
+// A zipcode disk set is four files (1!name, 2!name, 3!name, 4!name) that
+// together hold the 35 tracks of a D64, one RLE packed sector at a time.
+// The set is presented as a virtual D64 stream. Tracks are decoded from
+// the parts on demand and the most recently used ones are kept in a
+// small cache, so the whole 170KB image is never held in memory.
+//
+
+#ifndef MEATLOAF_ARCHIVE_ZIPCODE
+#define MEATLOAF_ARCHIVE_ZIPCODE
+
+#include "../meatloaf.h"
+#include "../disk/d64.h"
+
+#include "../../../include/debug.h"
+
+#define ZIPCODE_PARTS 4
+#define ZIPCODE_TRACKS 35
+#define ZIPCODE_MAX_SECTORS 21
+#define ZIPCODE_D64_SIZE 174848
+#define ZIPCODE_TRACK_CACHE 4
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+// Virtual D64 built from the four parts of a zipcode set
+class ZipcodeMStream : public MStream {
+
+public:
+    ZipcodeMStream(std::string url, std::shared_ptr<MStream> part1)
+    {
+        // part1 is the stream of the file that was mounted
+        // the other parts are opened on first use
+        this->url = url;
+        m_parts[0] = part1;
+        _size = ZIPCODE_D64_SIZE;
+    };
+    ~ZipcodeMStream() override {
+        close();
+    }
+
+    // MStream methods
+    bool isOpen() override;
+    bool isBrowsable() override { return false; };
+    bool isRandomAccess() override { return true; };
+
+    bool open(std::ios_base::openmode mode) override;
+    void close() override;
+
+    uint32_t read(uint8_t* buf, uint32_t size) override;
+    uint32_t write(const uint8_t *buf, uint32_t size) override { return 0; };
+
+    bool seek(uint32_t pos) override;
+
+protected:
+    struct CachedTrack {
+        uint8_t track = 0;          // 0 = empty slot
+        uint32_t used = 0;          // LRU stamp
+        uint8_t data[ZIPCODE_MAX_SECTORS * 256];
+    };
+
+    std::string partUrl(uint8_t part);
+    MStream* getPart(uint8_t part);
+
+    uint8_t partForTrack(uint8_t track);
+    uint8_t sectorsInTrack(uint8_t track);
+
+    bool walkTrack(uint8_t track, uint8_t *data);
+    uint8_t *getTrack(uint8_t track);
+
+    std::shared_ptr<MStream> m_parts[ZIPCODE_PARTS];
+    std::unique_ptr<MFile> m_partFiles[ZIPCODE_PARTS];
+
+    // Offset of the first sector record of each track inside its part (0 = not indexed yet)
+    uint32_t m_trackIndex[ZIPCODE_TRACKS + 2] = { 0 };
+
+    std::unique_ptr<CachedTrack[]> m_cache;
+    uint32_t m_cacheStamp = 0;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class ZipcodeMFile: public D64MFile {
+public:
+    ZipcodeMFile(std::string path) : D64MFile(path) {
+        isWritable = false;
+    };
+
+    MStream* getDecodedStream(std::shared_ptr<MStream> is) override
+    {
+        // Debug_printv("[%s]", url.c_str());
+        std::string partUrl = (sourceFile != nullptr) ? sourceFile->url : url;
+        auto image = std::make_shared<ZipcodeMStream>(partUrl, is);
+        image->open(std::ios_base::in);
+
+        return new D64MStream(image);
+    }
+};
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class ZipcodeMFileSystem: public MFileSystem
+{
+public:
+    ZipcodeMFileSystem(): MFileSystem("zipcode") {};
+
+    bool handles(std::string fileName) override {
+        // Any part of the set mounts the whole disk
+        std::string name = fileName.substr(fileName.find_last_of('/') + 1);
+        return ( name.size() > 2 && name[0] >= '1' && name[0] <= '4' && name[1] == '!' );
+    }
+
+    MFile* getFile(std::string path) override {
+        return new ZipcodeMFile(path);
+    }
+};
+
+
+#endif /* MEATLOAF_ARCHIVE_ZIPCODE */
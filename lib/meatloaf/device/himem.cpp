@@ -0,0 +1,117 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "sdkconfig.h"
+#include "himem.h"
+
+#if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
+
+#include "../../../include/debug.h"
+
+bool HimemWindow::allocate()
+{
+    if (m_allocated)
+        return true;
+
+    esp_err_t status = esp_himem_alloc_map_range(ESP_HIMEM_BLKSZ * m_blocks, &m_range);
+    if (status != ESP_OK)
+    {
+        Debug_printv("Unable to allocate mapped range for HIMEM: %s", esp_err_to_name(status));
+        return false;
+    }
+
+    m_slots.assign(m_blocks, Slot());
+    m_allocated = true;
+    return true;
+}
+
+void HimemWindow::unmap(Slot &slot)
+{
+    if (slot.ptr != nullptr)
+        ESP_ERROR_CHECK(esp_himem_unmap(m_range, slot.ptr, ESP_HIMEM_BLKSZ));
+
+    slot = Slot();
+}
+
+uint8_t *HimemWindow::map(esp_himem_handle_t mem, uint32_t offset, uint32_t &available)
+{
+    if (!allocate())
+    {
+        available = 0;
+        return nullptr;
+    }
+
+    uint32_t block = offset / ESP_HIMEM_BLKSZ;
+    uint32_t block_offset = offset - (block * ESP_HIMEM_BLKSZ);
+    available = ESP_HIMEM_BLKSZ - block_offset;
+
+    // Already mapped?
+    Slot *victim = &m_slots[0];
+    for (auto &slot : m_slots)
+    {
+        if (slot.ptr != nullptr && slot.mem == mem && slot.block == block)
+        {
+            slot.used = ++m_stamp;
+            return slot.ptr + block_offset;
+        }
+
+        // Empty slot or least recently used
+        if (slot.used < victim->used)
+            victim = &slot;
+    }
+
+    unmap(*victim);
+
+    size_t range_offset = (victim - &m_slots[0]) * ESP_HIMEM_BLKSZ;
+    esp_err_t status = esp_himem_map(mem, m_range, block * ESP_HIMEM_BLKSZ, range_offset, ESP_HIMEM_BLKSZ, 0, (void **)&victim->ptr);
+    if (status != ESP_OK)
+    {
+        Debug_printv("Unable to map HIMEM block[%lu]: %s", block, esp_err_to_name(status));
+        victim->ptr = nullptr;
+        available = 0;
+        return nullptr;
+    }
+
+    victim->mem = mem;
+    victim->block = block;
+    victim->used = ++m_stamp;
+    return victim->ptr + block_offset;
+}
+
+void HimemWindow::invalidate(esp_himem_handle_t mem)
+{
+    for (auto &slot : m_slots)
+    {
+        if (slot.ptr != nullptr && slot.mem == mem)
+            unmap(slot);
+    }
+}
+
+void HimemWindow::release()
+{
+    if (!m_allocated)
+        return;
+
+    for (auto &slot : m_slots)
+        unmap(slot);
+
+    ESP_ERROR_CHECK(esp_himem_free_map_range(m_range));
+    m_slots.clear();
+    m_allocated = false;
+}
+
+#endif // CONFIG_IDF_TARGET_ESP32 && BOARD_HAS_PSRAM
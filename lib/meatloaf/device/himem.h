@@ -0,0 +1,77 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// HIMEM mapped window cache
+//
+// PSRAM above 4MB on the ESP32 can only be reached by mapping 32KB blocks
+// of it into a small address range. Mapping is not free, so the window
+// keeps the last N blocks mapped and only remaps when an access falls
+// outside all of them. Sequential 256 byte reads through a 32KB block
+// then cost one map instead of 128 map/unmap pairs.
+//
+// https://docs.espressif.com/projects/esp-idf/en/stable/esp32/api-reference/system/himem.html
+//
+
+#ifndef MEATLOAF_DEVICE_HIMEM
+#define MEATLOAF_DEVICE_HIMEM
+
+#if defined(CONFIG_IDF_TARGET_ESP32) && defined(BOARD_HAS_PSRAM)
+
+#include <cstdint>
+#include <vector>
+
+#include <esp32/himem.h>
+
+#define HIMEM_WINDOW_BLOCKS 2
+
+class HimemWindow {
+public:
+    HimemWindow(uint8_t blocks = HIMEM_WINDOW_BLOCKS) : m_blocks(blocks) {};
+    ~HimemWindow() { release(); };
+
+    // Map the block of mem that holds offset. Returns a pointer to offset and
+    // the number of bytes that can be used from it before the block ends.
+    uint8_t *map(esp_himem_handle_t mem, uint32_t offset, uint32_t &available);
+
+    // Drop any mapping of mem, call before mem is freed
+    void invalidate(esp_himem_handle_t mem);
+
+    // Unmap everything and give back the address range
+    void release();
+
+    bool isAllocated() { return m_allocated; }
+
+private:
+    struct Slot {
+        esp_himem_handle_t mem = nullptr;
+        uint32_t block = 0;
+        uint8_t *ptr = nullptr;
+        uint32_t used = 0;
+    };
+
+    bool allocate();
+    void unmap(Slot &slot);
+
+    uint8_t m_blocks;
+    bool m_allocated = false;
+    esp_himem_rangehandle_t m_range;
+    std::vector<Slot> m_slots;
+    uint32_t m_stamp = 0;
+};
+
+#endif // CONFIG_IDF_TARGET_ESP32 && BOARD_HAS_PSRAM
+#endif // MEATLOAF_DEVICE_HIMEM
@@ -41,13 +41,14 @@
 
 #include "meatloaf.h"
 #include "meat_buffer.h"
+#include "himem.h"
 
 class HighMemory 
 {
     private:
     esp_himem_handle_t mh;      // Handle for the address space we're using
-    esp_himem_rangehandle_t rh; // Handle for the actual RAM.
-    uint32_t *mem_ptr;          // Memory pointer
+    HimemWindow window;         // Blocks of mh currently mapped in
+    uint8_t *mem_ptr = nullptr; // Memory pointer
 
     protected:
 
@@ -81,8 +82,10 @@ class HighMemory
     }
 
     bool open(int block) {
-        esp_err_t r = esp_himem_map(mh, rh, block, 0, ESP_HIMEM_BLKSZ, 0, (void**)&mem_ptr);
-        return r;
+        // stays mapped until the window needs the slot for another block
+        uint32_t available;
+        mem_ptr = window.map(mh, block * ESP_HIMEM_BLKSZ, available);
+        return (mem_ptr != nullptr);
     }
 
     std::string read();
@@ -0,0 +1,64 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "link_prefetch.h"
+
+#include <memory>
+
+#include "../../../include/debug.h"
+
+#include "fnDNS.h"
+#include "peoples_url_parser.h"
+#include "string_utils.h"
+
+void prefetchLinkHost(MFile *entry)
+{
+    if ( entry == nullptr || entry->isDirectory() )
+        return;
+
+    // Links on a remote server would cost a request each to read
+    if ( entry->host.size() )
+        return;
+
+    if ( mstr::endsWith(entry->name, ".webloc", false) )
+    {
+        dns_prefetch(WEBLOC_HOST);
+        return;
+    }
+
+    if ( !mstr::endsWith(entry->name, ".url", false) )
+        return;
+
+    std::unique_ptr<MStream> istream( entry->getSourceStream() );
+    if ( istream == nullptr )
+        return;
+
+    uint32_t size = std::min(istream->size(), (uint32_t)LINK_PREFETCH_MAX_URL);
+    uint8_t url[LINK_PREFETCH_MAX_URL + 1];
+    size = istream->read(url, size);
+    url[size] = '\0';
+
+    std::string ml_url((char *)url);
+    mstr::trim(ml_url);
+
+    auto urlParser = PeoplesUrlParser::parseURL( ml_url );
+    if ( urlParser != nullptr && urlParser->host.size() )
+    {
+        Debug_printv("prefetch host[%s] for [%s]", urlParser->host.c_str(), entry->name.c_str());
+        dns_prefetch(urlParser->host.c_str());
+    }
+}
@@ -0,0 +1,34 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// Resolve the hosts link files point at while their directory is listed,
+// so LOADing one doesn't start with a DNS lookup
+//
+
+#ifndef MEATLOAF_LINK_PREFETCH
+#define MEATLOAF_LINK_PREFETCH
+
+#include "meatloaf.h"
+
+#define LINK_PREFETCH_MAX_URL 512   // .url files are read up to this size
+
+#define WEBLOC_HOST "api.meatloaf.cc"
+
+// If entry is a .url or .webloc file, start resolving its host
+void prefetchLinkHost(MFile *entry);
+
+#endif // MEATLOAF_LINK_PREFETCH
@@ -47,8 +47,10 @@
 
 // Archive
 #include "archive/archive.h"
+#include "archive/gz.h"
 #include "archive/ark.h"
 #include "archive/lbr.h"
+#include "archive/zipcode.h"
 
 // Cartridge
 
@@ -78,10 +80,12 @@
 // Loaders
 
 // Network
+#include "network/ftp.h"
 #include "network/http.h"
 #include "network/tnfs.h"
-// #include "network/ipfs.h"
-// #include "network/smb.h"
+#include "network/ipfs.h"
+#include "network/smb.h"
+#include "network/webdav.h"
 // #include "network/ws.h"
 
 // Scanners
@@ -110,8 +114,10 @@ SDFileSystem sdFS;
 
 // Archive
 ArchiveMFileSystem archiveFS;
+GZMFileSystem gzFS;
 ARKMFileSystem arkFS;
 LBRMFileSystem lbrFS;
+ZipcodeMFileSystem zipcodeFS;
 
 // Cartridge
 
@@ -134,9 +140,12 @@ G64MFileSystem g64FS;
 NIBMFileSystem nibFS;
 
 // Network
+FTPMFileSystem ftpFS;
 HTTPMFileSystem httpFS;
 TNFSMFileSystem tnfsFS;
-// IPFSFileSystem ipfsFS;
+SMBMFileSystem smbFS;
+WebDAVMFileSystem webdavFS;
+IPFSFileSystem ipfsFS;
 // TcpFileSystem tcpFS;
 //WSFileSystem wsFS;
 
@@ -156,8 +165,9 @@ std::vector<MFileSystem*> MFSOwner::availableFS {
 #ifdef SD_CARD
     &sdFS,
 #endif
+    &gzFS, // before archiveFS, it would take .d64.gz as a plain .gz
     &archiveFS, // extension-based FS have to be on top to be picked first, otherwise the scheme will pick them!
-    &arkFS, &lbrFS,
+    &arkFS, &lbrFS, &zipcodeFS,
 //#ifndef USE_VDRIVE
     &d64FS, &d71FS, &d80FS, &d81FS, &d82FS, &d90FS, &dnpFS, 
     &g64FS,
@@ -170,9 +180,9 @@ std::vector<MFileSystem*> MFSOwner::availableFS {
 
     &p00FS,
 
-    &httpFS, &tnfsFS,
+    &ftpFS, &httpFS, &tnfsFS, &smbFS, &webdavFS, &ipfsFS,
 //    &csipFS, &mlFS,
-//    &ipfsFS, &tcpFS,
+//    &tcpFS,
 //    &tnfsFS
 };
 
@@ -0,0 +1,583 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ftp.h"
+
+#include <strings.h>
+
+#include "fnSystem.h"
+
+#include "../../../include/debug.h"
+
+
+static std::map<std::string, std::shared_ptr<FTPMSession>> ftp_sessions;
+static std::mutex ftp_sessions_lock;
+
+
+static std::string parentPath(std::string path)
+{
+    size_t slash = path.rfind('/');
+    return (slash == std::string::npos || slash == 0) ? "/" : path.substr(0, slash);
+}
+
+
+/********************************************************
+ * Session implementations
+ ********************************************************/
+
+std::shared_ptr<FTPMSession> FTPMSession::get(std::string server, uint16_t port, std::string user, std::string password)
+{
+    std::string key = user + "@" + server + ":" + std::to_string(port);
+
+    std::lock_guard<std::mutex> guard(ftp_sessions_lock);
+    auto session = ftp_sessions.find(key);
+    if (session != ftp_sessions.end())
+        return session->second;
+
+    auto created = std::make_shared<FTPMSession>(server, port, user, password);
+    ftp_sessions[key] = created;
+    return created;
+}
+
+bool FTPMSession::connect()
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (ftp.logged_in())
+        return true;
+
+    // A dropped connection took any transfer with it
+    owner = nullptr;
+    m_listings.clear();
+
+    std::string user = m_user.empty() ? "anonymous" : m_user;
+    std::string password = m_user.empty() ? "meatloaf@meatloaf.cc" : m_password;
+    if (ftp.login(user, password, m_server, m_port))
+    {
+        Debug_printv("login failed server[%s:%d] status[%d]", m_server.c_str(), m_port, ftp.status());
+        ftp.logout();
+        return false;
+    }
+
+    return true;
+}
+
+void FTPMSession::disconnect()
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    ftp.logout();
+    owner = nullptr;
+    m_listings.clear();
+}
+
+void FTPMSession::release()
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (owner == nullptr)
+        return;
+
+    owner = nullptr;
+    ftp.abort();
+}
+
+bool FTPMSession::readListing(std::string path, std::vector<FTPDirEntry> &entries)
+{
+    release();
+    if (!connect())
+        return false;
+
+    bool failed = true;
+    if (m_mlsd)
+    {
+        failed = ftp.open_directory_mlsd(path);
+
+        // 500/502, the server doesn't have it
+        if (failed && ftp.logged_in() && ftp.status() >= 500 && ftp.status() <= 504)
+        {
+            Debug_printv("no MLSD on server[%s], using LIST", m_server.c_str());
+            m_mlsd = false;
+        }
+    }
+    if (!m_mlsd)
+        failed = ftp.open_directory(path, "");
+
+    if (failed)
+        return false;
+
+    entries.clear();
+    std::string name;
+    long size;
+    bool isDir;
+    time_t mtime;
+    while (!ftp.read_directory(name, size, isDir, mtime))
+    {
+        if (name.empty() || name[0] == '.')
+            continue; // Skip hidden files
+
+        FTPDirEntry entry;
+        entry.name = name;
+        entry.isDir = isDir;
+        entry.size = isDir ? 0 : (uint32_t)size;
+        entry.m_time = mtime;
+        entries.push_back(entry);
+    }
+
+    return true;
+}
+
+bool FTPMSession::listing(std::string path, std::vector<FTPDirEntry> &entries)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+
+    const std::vector<FTPDirEntry> *cached = m_listings.find(path, fnSystem.millis());
+    if (cached != nullptr)
+    {
+        entries = *cached;
+        return true;
+    }
+
+    // Once more on a fresh connection, the server may have dropped an idle one
+    if (!readListing(path, entries))
+    {
+        if (ftp.logged_in())
+            return false;
+
+        if (!readListing(path, entries))
+            return false;
+    }
+
+    m_listings.put(path, entries, fnSystem.millis());
+
+    Debug_printv("path[%s] entries[%d]", path.c_str(), entries.size());
+    return true;
+}
+
+bool FTPMSession::cached(std::string path, FTPDirEntry &entry)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+
+    std::vector<FTPDirEntry> entries;
+    if (!listing(parentPath(path), entries))
+        return false;
+
+    std::string name = path.substr(path.rfind('/') + 1);
+    for (auto &e : entries)
+    {
+        if (e.name == name)
+        {
+            entry = e;
+            return true;
+        }
+    }
+
+    // Typed on a C64, likely in the wrong case
+    for (auto &e : entries)
+    {
+        if (strcasecmp(e.name.c_str(), name.c_str()) == 0)
+        {
+            entry = e;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FTPMSession::invalidate(std::string path)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    m_listings.erase(parentPath(path));
+    m_listings.erase(path);
+}
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+std::shared_ptr<FTPMSession> FTPMFile::session()
+{
+    uint16_t p = port.empty() ? 21 : atoi(port.c_str());
+    return FTPMSession::get(host, p, user, password);
+}
+
+bool FTPMFile::stat(FTPDirEntry &entry)
+{
+    if (m_isNull)
+        return false;
+
+    if (m_remote == "/")
+    {
+        entry.isDir = true;
+        return true;
+    }
+
+    return session()->cached(m_remote, entry);
+}
+
+bool FTPMFile::isDirectory()
+{
+    FTPDirEntry entry;
+    return stat(entry) && entry.isDir;
+}
+
+bool FTPMFile::exists()
+{
+    FTPDirEntry entry;
+    return stat(entry);
+}
+
+time_t FTPMFile::getLastWrite()
+{
+    FTPDirEntry entry;
+    return stat(entry) ? entry.m_time : 0;
+}
+
+time_t FTPMFile::getCreationTime()
+{
+    // FTP doesn't tell us
+    return getLastWrite();
+}
+
+MStream* FTPMFile::getSourceStream(std::ios_base::openmode mode)
+{
+    MStream* istream = new FTPMStream(url, session(), m_remote);
+    istream->open(mode);
+    return istream;
+}
+
+MStream* FTPMFile::getDecodedStream(std::shared_ptr<MStream> is)
+{
+    return is.get(); // we don't have to process this stream in any way, just return the original stream
+}
+
+MStream* FTPMFile::createStream(std::ios_base::openmode mode)
+{
+    MStream* istream = new FTPMStream(url, session(), m_remote);
+    istream->open(mode);
+    return istream;
+}
+
+bool FTPMFile::mkDir()
+{
+    if (m_isNull || m_remote == "/")
+        return false;
+
+    auto s = session();
+    std::lock_guard<std::recursive_mutex> guard(s->lock);
+    s->release();
+    if (!s->connect())
+        return false;
+
+    s->invalidate(m_remote);
+    return !s->ftp.make_directory(m_remote);
+}
+
+bool FTPMFile::remove()
+{
+    FTPDirEntry entry;
+    if (m_remote == "/" || !stat(entry))
+        return false;
+
+    auto s = session();
+    std::lock_guard<std::recursive_mutex> guard(s->lock);
+    s->release();
+    if (!s->connect())
+        return false;
+
+    s->invalidate(m_remote);
+    if (entry.isDir)
+        return !s->ftp.remove_directory(m_remote);
+
+    return !s->ftp.remove_file(m_remote);
+}
+
+bool FTPMFile::rename(std::string dest)
+{
+    if (m_isNull || m_remote == "/" || dest.empty())
+        return false;
+
+    // Relative to the directory we're in
+    if (!mstr::startsWith(dest, "/"))
+        dest = parentPath(m_remote) + (parentPath(m_remote) == "/" ? "" : "/") + dest;
+
+    auto s = session();
+    std::lock_guard<std::recursive_mutex> guard(s->lock);
+    s->release();
+    if (!s->connect())
+        return false;
+
+    s->invalidate(m_remote);
+    s->invalidate(dest);
+    return !s->ftp.rename_file(m_remote, dest);
+}
+
+void FTPMFile::openDir()
+{
+    m_entries.clear();
+    m_entry = 0;
+    dirOpened = session()->listing(m_remote, m_entries);
+}
+
+void FTPMFile::closeDir()
+{
+    m_entries.clear();
+    m_entries.shrink_to_fit();
+    m_entry = 0;
+    dirOpened = false;
+}
+
+bool FTPMFile::rewindDirectory()
+{
+    if (!isDirectory())
+        return false;
+
+    openDir();
+    return dirOpened;
+}
+
+MFile* FTPMFile::getNextFileInDir()
+{
+    if (!dirOpened)
+        openDir();
+
+    if (m_entry >= m_entries.size())
+    {
+        closeDir();
+        return nullptr;
+    }
+
+    FTPDirEntry &entry = m_entries[m_entry++];
+    std::string entry_url = url + (mstr::endsWith(url, "/") ? "" : "/") + entry.name;
+
+    auto file = new FTPMFile(entry_url);
+    file->extension = " " + file->extension;
+    file->size = entry.size;
+
+    return file;
+}
+
+
+/********************************************************
+ * Stream implementations
+ ********************************************************/
+
+bool FTPMStream::open(std::ios_base::openmode mode)
+{
+    if (isOpen())
+        return true;
+
+    std::lock_guard<std::recursive_mutex> guard(m_session->lock);
+
+    m_reading = !(mode & std::ios_base::out);
+    _position = 0;
+    _size = 0;
+
+    if (m_reading)
+    {
+        // Size from the listing, the directory was most likely just read anyway
+        FTPDirEntry entry;
+        if (m_session->cached(m_remote, entry))
+        {
+            if (entry.isDir)
+                return false;
+            _size = entry.size;
+        }
+        else if (!m_session->connect() || m_session->ftp.get_size(m_remote, _size))
+        {
+            Debug_printv("not found path[%s]", m_remote.c_str());
+            return false;
+        }
+
+        // RETR waits for the first read, which may well be somewhere else
+        m_open = true;
+        return true;
+    }
+
+    m_session->release();
+    if (!m_session->connect())
+        return false;
+
+    m_session->invalidate(m_remote);
+    if (m_session->ftp.open_file(m_remote, true))
+    {
+        Debug_printv("STOR failed path[%s] status[%d]", m_remote.c_str(), m_session->ftp.status());
+        return false;
+    }
+
+    m_session->owner = this;
+    m_open = true;
+    return true;
+}
+
+bool FTPMStream::start(uint32_t pos)
+{
+    m_session->release();
+
+    // Once more on a fresh connection, the server may have dropped an idle one
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (!m_session->connect())
+            return false;
+
+        if (!m_session->ftp.open_file(m_remote, false, pos))
+        {
+            m_session->owner = this;
+            m_transferPos = pos;
+            return true;
+        }
+
+        if (m_session->ftp.logged_in())
+            break;
+    }
+
+    Debug_printv("RETR failed path[%s] offset[%lu] status[%d]", m_remote.c_str(), pos, m_session->ftp.status());
+    return false;
+}
+
+uint32_t FTPMStream::receive(uint8_t *buf, uint32_t len)
+{
+    fnFTP &ftp = m_session->ftp;
+
+    uint64_t started = fnSystem.millis();
+    while (ftp.data_available() == 0)
+    {
+        if (!ftp.data_connected() || fnSystem.millis() - started > FTP_TIMEOUT)
+            return 0;
+        fnSystem.delay(1);
+    }
+
+    uint32_t count = std::min((uint32_t)ftp.data_available(), std::min(len, (uint32_t)UINT16_MAX));
+    if (ftp.read_file(buf, count))
+        return 0;
+
+    m_transferPos += count;
+    return count;
+}
+
+uint32_t FTPMStream::read(uint8_t* buf, uint32_t size)
+{
+    if (!isOpen() || !buf || !m_reading)
+        return 0;
+
+    if (size > available())
+        size = available();
+
+    if (size == 0)
+        return 0;
+
+    std::lock_guard<std::recursive_mutex> guard(m_session->lock);
+
+    // Backwards, far ahead or taken over by another stream: start over from here
+    if (!transferring() || _position < m_transferPos || _position - m_transferPos > FTP_SEEK_SKIP)
+    {
+        if (!start(_position))
+        {
+            _error = 1;
+            return 0;
+        }
+    }
+
+    // A short way ahead, cheaper to read through than to REST
+    uint8_t skip[256];
+    while (m_transferPos < _position)
+    {
+        if (receive(skip, std::min((uint32_t)sizeof(skip), _position - m_transferPos)) == 0)
+        {
+            _error = 1;
+            return 0;
+        }
+    }
+
+    uint32_t bytesRead = 0;
+    while (bytesRead < size)
+    {
+        uint32_t count = receive(buf + bytesRead, size - bytesRead);
+        if (count == 0)
+            break;
+        bytesRead += count;
+    }
+
+    _position += bytesRead;
+    return bytesRead;
+}
+
+uint32_t FTPMStream::write(const uint8_t *buf, uint32_t size)
+{
+    if (!isOpen() || !buf || m_reading)
+        return 0;
+
+    std::lock_guard<std::recursive_mutex> guard(m_session->lock);
+
+    // Another stream needed the connection, the upload is over
+    if (!transferring())
+    {
+        _error = 1;
+        return 0;
+    }
+
+    uint32_t written = 0;
+    while (written < size)
+    {
+        uint16_t count = std::min(size - written, (uint32_t)UINT16_MAX);
+        if (m_session->ftp.write_file((uint8_t *)buf + written, count))
+        {
+            _error = 1;
+            break;
+        }
+        written += count;
+    }
+
+    _position += written;
+    if (_position > _size)
+        _size = _position;
+
+    return written;
+}
+
+bool FTPMStream::seek(uint32_t pos)
+{
+    if (!isOpen() || !m_reading || pos > _size)
+        return false;
+
+    // read() picks it up from the running transfer or with REST
+    _position = pos;
+    return true;
+}
+
+void FTPMStream::close()
+{
+    if (!m_open)
+        return;
+
+    std::lock_guard<std::recursive_mutex> guard(m_session->lock);
+    if (transferring())
+    {
+        if (m_reading)
+        {
+            m_session->release();
+        }
+        else
+        {
+            // Waits for the server to confirm the upload
+            m_session->ftp.close();
+            m_session->owner = nullptr;
+            m_session->invalidate(m_remote);
+        }
+    }
+
+    m_open = false;
+}
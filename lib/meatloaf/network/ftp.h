@@ -1 +1,222 @@
 // FTP:// - File Transfer Protocol
+//
+// ftp://[user[:password]@]server[:port]/path
+//
+// Built on fnFTP. Files on a server share one logged in control
+// connection (FTPMSession), and only one transfer runs on it at a time;
+// starting another one aborts the one before it. Directories are listed
+// once with MLSD (LIST when the server doesn't have it) and the listing
+// answers isDirectory()/exists()/size for every file in it for a few
+// seconds.
+//
+// Streams are random access. A seek starts the next RETR at the new
+// position with REST instead of downloading the file again, and short
+// forward seeks just read through the gap on the running transfer.
+//
+
+#ifndef MEATLOAF_SCHEME_FTP
+#define MEATLOAF_SCHEME_FTP
+
+#include "meatloaf.h"
+
+#include "fnFTP.h"
+#include "listing_cache.h"
+
+#include "../../../include/debug.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define FTP_DIR_CACHE_TTL 10000     // ms a listing is used for without asking again
+#define FTP_DIR_CACHE_LISTINGS 8    // listings kept per session
+#define FTP_SEEK_SKIP 4096          // forward seeks up to this far read through instead of REST
+
+
+struct FTPDirEntry {
+    std::string name;
+    bool isDir = false;
+    uint32_t size = 0;
+    time_t m_time = 0;
+};
+
+class FTPMStream;
+
+
+/********************************************************
+ * Session
+ ********************************************************/
+
+class FTPMSession {
+public:
+    FTPMSession(std::string server, uint16_t port, std::string user, std::string password) {
+        m_server = server;
+        m_port = port;
+        m_user = user;
+        m_password = password;
+    };
+    ~FTPMSession() {
+        disconnect();
+    };
+
+    // One control connection per server, port and user
+    static std::shared_ptr<FTPMSession> get(std::string server, uint16_t port, std::string user, std::string password);
+
+    bool connect();
+    void disconnect();
+
+    // Stop the transfer on the data connection so the control connection can be used
+    void release();
+
+    // Directory listing of path, from the cache when fresh
+    bool listing(std::string path, std::vector<FTPDirEntry> &entries);
+
+    // Entry for path from its directory's listing
+    bool cached(std::string path, FTPDirEntry &entry);
+
+    // Drop the cached listing of path's directory
+    void invalidate(std::string path);
+
+    fnFTP ftp;
+
+    // Stream whose transfer is running, nullptr when the connection is free
+    FTPMStream *owner = nullptr;
+
+    std::recursive_mutex lock;
+
+private:
+    bool readListing(std::string path, std::vector<FTPDirEntry> &entries);
+
+    std::string m_server;
+    uint16_t m_port;
+    std::string m_user;
+    std::string m_password;
+
+    bool m_mlsd = true;     // until the server says it doesn't know it
+
+    ListingCache<FTPDirEntry> m_listings{ FTP_DIR_CACHE_TTL, FTP_DIR_CACHE_LISTINGS };
+};
+
+
+/********************************************************
+ * File
+ ********************************************************/
+
+class FTPMFile: public MFile
+{
+
+public:
+    FTPMFile(std::string path): MFile(path) {
+        m_remote = mstr::startsWith(this->path, "/") ? this->path : "/" + this->path;
+        while (m_remote.size() > 1 && m_remote.back() == '/')
+            m_remote.pop_back();
+
+        m_isNull = host.empty();
+        m_rootfs = true;
+        //Debug_printv("url[%s] remote[%s]", url.c_str(), m_remote.c_str());
+    };
+    ~FTPMFile() {
+        closeDir();
+    }
+
+    MStream* getSourceStream(std::ios_base::openmode mode=std::ios_base::in) override ; // has to return OPENED stream
+    MStream* getDecodedStream(std::shared_ptr<MStream> src);
+    MStream* createStream(std::ios_base::openmode mode) override;
+
+    bool isDirectory() override;
+    time_t getLastWrite() override ;
+    time_t getCreationTime() override ;
+    bool rewindDirectory() override ;
+    MFile* getNextFileInDir() override ;
+    bool mkDir() override ;
+    bool exists() override ;
+
+    bool remove() override ;
+    bool rename(std::string dest);
+
+protected:
+    bool dirOpened = false;
+
+private:
+    std::shared_ptr<FTPMSession> session();
+    bool stat(FTPDirEntry &entry);
+    void openDir();
+    void closeDir();
+
+    std::string m_remote;   // absolute path on the server
+
+    std::vector<FTPDirEntry> m_entries;
+    size_t m_entry = 0;
+};
+
+
+/********************************************************
+ * Stream
+ ********************************************************/
+
+class FTPMStream: public MStream {
+public:
+    FTPMStream(std::string path, std::shared_ptr<FTPMSession> session, std::string remote) {
+        url = path;
+        m_session = session;
+        m_remote = remote;
+    }
+    ~FTPMStream() override {
+        close();
+    }
+
+    // MStream methods
+    bool isOpen() override { return m_open; };
+    bool isBrowsable() override { return false; };
+    bool isRandomAccess() override { return true; };
+
+    bool open(std::ios_base::openmode mode) override;
+    void close() override;
+
+    uint32_t read(uint8_t* buf, uint32_t size) override;
+    uint32_t write(const uint8_t *buf, uint32_t size) override;
+
+    bool seek(uint32_t pos) override;
+
+private:
+    // RETR from pos, aborting whatever else is on the connection
+    bool start(uint32_t pos);
+
+    // Up to len bytes from the data connection, 0 at the end or on timeout
+    uint32_t receive(uint8_t *buf, uint32_t len);
+
+    bool transferring() { return m_session->owner == this; };
+
+    std::shared_ptr<FTPMSession> m_session;
+    std::string m_remote;
+
+    bool m_open = false;
+    bool m_reading = true;
+    uint32_t m_transferPos = 0;     // where the running RETR is in the file
+};
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class FTPMFileSystem: public MFileSystem
+{
+public:
+    FTPMFileSystem(): MFileSystem("ftp") {};
+
+    bool handles(std::string name) {
+        if ( mstr::equals(name, (char *)"ftp:", false) )
+            return true;
+
+        return false;
+    }
+
+    MFile* getFile(std::string path) override {
+        return new FTPMFile(path);
+    }
+};
+
+
+#endif // MEATLOAF_SCHEME_FTP
@@ -29,6 +29,14 @@
  * MFile implementations
  ********************************************************/
 
+// Cached entry still describes the file the server has now
+static bool sameFile(const HTTPCacheEntry &entry, MeatHttpClient *client) {
+    if ( !entry.etag.empty() )
+        return entry.etag == client->m_etag;
+
+    return !entry.lastModified.empty() && entry.lastModified == client->m_lastModified;
+}
+
 MeatHttpClient* HTTPMFile::fromHeader() {
     if(client == nullptr) {
         //Debug_printv("Client was not present, creating");
@@ -41,9 +49,31 @@ MeatHttpClient* HTTPMFile::fromHeader() {
             url = mstr::dropLast(url, 1);
             Debug_printv("url[%s]", url.c_str());
         }
+
+        // Answered from the cache while it is fresh
+        HTTPCacheEntry entry;
+        bool cached = HTTPDiskCache::lookup(url, entry);
+        if ( cached && entry.fresh() ) {
+            client->url = url;
+            client->_exists = true;
+            client->_size = entry.size;
+            client->isText = entry.isText;
+            client->m_isDirectory = entry.isDirectory;
+            return client;
+        }
+
         //Debug_printv("before head url[%s]", url.c_str());
+        std::string key = url;
         client->HEAD(url);
         //Debug_printv("after head url[%s]", client->url.c_str());
+
+        if ( client->_exists && !client->m_noStore ) {
+            HTTPCacheEntry head;
+            client->toCacheEntry(key, head);
+            head.hasBody = ( cached && entry.hasBody && sameFile(entry, client) );
+            HTTPDiskCache::store(head);
+        }
+
         if (client->wasRedirected)
             resetURL(client->url);
     }
@@ -165,29 +195,209 @@ bool HTTPMFile::isText() {
  ********************************************************/
 bool HTTPMStream::open(std::ios_base::openmode mode) {
     bool r = false;
+    std::string key = url;
 
         if(mode == (std::ios_base::out | std::ios_base::app))
             r = _http.PUT(url);
         else if(mode == std::ios_base::out)
             r = _http.POST(url);
+        else if ( openCached() )
+            return true;
         else
-            r = _http.GET(url);
+            r = _http._is_open || _http.GET(url);   // revalidation may have fetched it already
 
         if ( r ) {
             _size = ( _http._range_size > 0) ? _http._range_size : _http._size;
             if ( _http.wasRedirected )
                 url = _http.url;
+
+            beginFill(key);
         }
 
     return r;
 }
 
+bool HTTPMStream::openCached() {
+    HTTPCacheEntry entry;
+    if ( !HTTPDiskCache::lookup(url, entry) || !entry.hasBody )
+        return false;
+
+    if ( !entry.fresh() )
+    {
+        // Ask the server if our copy is still current
+        _http.m_ifNoneMatch = entry.etag;
+        _http.m_ifModifiedSince = entry.lastModified;
+        bool r = _http.GET(url);
+        _http.m_ifNoneMatch.clear();
+        _http.m_ifModifiedSince.clear();
+
+        if ( r && _http.lastRC != 304 )
+        {
+            // Changed, the new version is already on its way
+            Debug_printv("changed url[%s]", url.c_str());
+            HTTPDiskCache::remove(url);
+            return false;
+        }
+
+        if ( r )
+        {
+            entry.expires = HTTPDiskCache::expiry(_http.m_maxAge);
+            HTTPDiskCache::store(entry);
+        }
+        else if ( _http.lastRC > 0 )
+        {
+            HTTPDiskCache::remove(url);
+            return false;
+        }
+        else
+        {
+            Debug_printv("server unreachable, using cached copy url[%s]", url.c_str());
+        }
+
+        // A 304 has no body, the connection goes back to the pool
+        _http.close();
+    }
+
+    m_cached = HTTPDiskCache::openBody(url);
+    if ( m_cached == nullptr )
+        return false;
+
+    //Debug_printv("cached url[%s] size[%lu]", url.c_str(), entry.size);
+    _size = entry.size;
+    _position = 0;
+    return true;
+}
+
+void HTTPMStream::beginFill(const std::string &key) {
+    if ( !_http.cacheable() )
+        return;
+
+    _http.toCacheEntry(key, m_fillEntry);
+    m_fillEntry.size = _size;
+
+    // Nothing is downloaded here, reads fill the copy as they go
+    m_fill = HTTPDiskCache::createBody(key);
+    m_filled = 0;
+}
+
+// Whatever read() got from the network extends the copy on the card. A read
+// past the end of the copy leaves it where it is until the reader comes back,
+// loads read from the start anyway
+void HTTPMStream::writeThrough(uint32_t offset, const uint8_t *buf, uint32_t size) {
+    if ( m_fill == nullptr || offset > m_filled || offset + size <= m_filled )
+        return;
+
+    uint32_t skip = m_filled - offset;
+    uint32_t bytes = size - skip;
+    if ( fwrite(buf + skip, 1, bytes, m_fill) != bytes )
+    {
+        HTTPDiskCache::abortBody(m_fill, m_fillEntry.url);
+        m_fill = nullptr;
+        return;
+    }
+
+    m_filled += bytes;
+    if ( m_filled < _size )
+        return;
+
+    bool committed = HTTPDiskCache::commitBody(m_fill, m_fillEntry);
+    m_fill = nullptr;
+    if ( !committed )
+        return;
+
+    // Complete, the rest is read from the card
+    m_cached = HTTPDiskCache::openBody(m_fillEntry.url);
+    if ( m_cached == nullptr )
+        return;
+
+    if ( fseek(m_cached, offset + size, SEEK_SET) != 0 )
+    {
+        fclose(m_cached);
+        m_cached = nullptr;
+        return;
+    }
+
+    Debug_printv("cached url[%s] size[%lu]", m_fillEntry.url.c_str(), _size);
+    stopPrefetch();
+    _http.close();
+}
+
 void HTTPMStream::close() {
     //Debug_printv("CLOSE called explicitly on this HTTP stream!");
+    if ( m_cached != nullptr )
+    {
+        fclose(m_cached);
+        m_cached = nullptr;
+    }
+    if ( m_fill != nullptr )
+    {
+        // Not read to the end, nothing to keep
+        HTTPDiskCache::abortBody(m_fill, m_fillEntry.url);
+        m_fill = nullptr;
+    }
+    stopPrefetch();
     _http.close();
 }
 
+bool HTTPMStream::startPrefetch() {
+    // Only worth it for Range capable files a few chunks long
+    if ( m_prefetchFailed || !_http.isFriendlySkipper || _size <= HTTP_PREFETCH_CHUNK_SIZE * 2 )
+        return false;
+
+    // Each worker gets its own connection
+    for ( auto &fetcher : m_fetchers )
+    {
+        fetcher.reset(new MeatHttpClient());
+        fetcher->url = url;
+    }
+
+    m_prefetch.reset(new HTTPPrefetcher([this](uint8_t worker, uint32_t offset, uint8_t *buf, uint32_t length) {
+        return m_fetchers[worker]->readRange(offset, buf, length);
+    }, _position, _size));
+
+    if ( !m_prefetch->start() )
+    {
+        stopPrefetch();
+        m_prefetchFailed = true;
+        return false;
+    }
+
+    Debug_printv("read-ahead from [%lu] url[%s]", _position, url.c_str());
+    return true;
+}
+
+void HTTPMStream::stopPrefetch() {
+    if ( m_prefetch == nullptr )
+        return;
+
+    Debug_printv("read-ahead stopped at [%lu] window[%d] latency[%lums] bandwidth[%lu B/s]", m_prefetch->position(), m_prefetch->window(), m_prefetch->latency(), m_prefetch->bandwidth());
+    m_prefetch.reset();
+
+    // Their connections go back to the pool
+    for ( auto &fetcher : m_fetchers )
+        fetcher.reset();
+}
+
 bool HTTPMStream::seek(uint32_t pos) {
+    if ( m_cached != nullptr )
+    {
+        if ( pos > _size || fseek(m_cached, pos, SEEK_SET) != 0 )
+            return false;
+
+        _position = pos;
+        return true;
+    }
+
+    if ( m_prefetch != nullptr )
+    {
+        if ( pos == m_prefetch->position() )
+        {
+            _position = pos;
+            return true;
+        }
+        stopPrefetch();
+    }
+
     if ( !_http._is_open )
     {
         Debug_printv("error");
@@ -195,7 +405,11 @@ bool HTTPMStream::seek(uint32_t pos) {
         return false;
     }
 
-    return _http.seek(pos);
+    if ( !_http.seek(pos) )
+        return false;
+
+    _position = pos;
+    return true;
 }
 
 uint32_t HTTPMStream::read(uint8_t* buf, uint32_t size) {
@@ -206,8 +420,42 @@ uint32_t HTTPMStream::read(uint8_t* buf, uint32_t size) {
         if ( size > available() )
             size = available();
 
-        bytesRead = _http.read(buf, size);
+        if ( m_cached != nullptr )
+        {
+            bytesRead = fread(buf, 1, size, m_cached);
+            _position += bytesRead;
+            return bytesRead;
+        }
+
+        // Once the stream is read sequentially, read ahead
+        m_sequential = ( _position == m_lastEnd ) ? m_sequential + 1 : 0;
+        if ( m_prefetch == nullptr && m_sequential >= HTTP_PREFETCH_TRIGGER )
+            startPrefetch();
+
+        if ( m_prefetch != nullptr )
+        {
+            bytesRead = m_prefetch->read(buf, size);
+            if ( bytesRead < size && m_prefetch->failed() )
+            {
+                // Carry on without it from where it stopped
+                stopPrefetch();
+                m_prefetchFailed = true;
+                if ( _http.seek(_position + bytesRead) )
+                    bytesRead += _http.read(buf + bytesRead, size - bytesRead);
+            }
+        }
+        else
+        {
+            // An inflated body's size is only known once it has all been read
+            bool growing = _http.streaming();
+            bytesRead = _http.read(buf, size);
+            if ( growing )
+                _size = _http._size;
+        }
+
+        writeThrough(_position, buf, bytesRead);
         _position += bytesRead;
+        m_lastEnd = _position;
         _error = _http._error;
     }
 
@@ -222,7 +470,7 @@ uint32_t HTTPMStream::write(const uint8_t *buf, uint32_t size) {
 
 
 bool HTTPMStream::isOpen() {
-    return _http._is_open;
+    return ( m_cached != nullptr ) || _http._is_open;
 };
 
 
@@ -250,6 +498,104 @@ bool MeatHttpClient::HEAD(std::string dstUrl) {
     return rc;
 }
 
+bool MeatHttpClient::PROPFIND(std::string dstUrl, uint8_t depth, const std::string &body) {
+    Debug_printv("PROPFIND depth[%d]", depth);
+    headers["Depth"] = std::to_string(depth);
+    headers["Content-Type"] = "application/xml; charset=\"utf-8\"";
+
+    // Sent again if the collection redirects (usually to add the trailing '/')
+    m_body = body;
+    bool rc = open(dstUrl, HTTP_METHOD_PROPFIND);
+    m_body.clear();
+    return rc;
+}
+
+bool MeatHttpClient::beginUpload(std::string dstUrl) {
+    Debug_printv("PUT chunked");
+
+    // Cached copies of the file we are about to replace are stale
+    HTTPBlockCache::invalidate(dstUrl);
+    HTTPDiskCache::remove(dstUrl);
+
+    url = dstUrl;
+    mstr::replaceAll(url, " ", "%20");
+    lastMethod = HTTP_METHOD_PUT;
+    _error = 0;
+    _position = 0;
+    _size = 0;
+
+    esp_err_t rc = ESP_FAIL;
+    for ( int retry = 2; retry > 0 && rc != ESP_OK; retry-- )
+    {
+        if ( _http == nullptr )
+            init();
+
+        esp_http_client_set_url(_http, url.c_str());
+        esp_http_client_set_method(_http, HTTP_METHOD_PUT);
+        for (const auto& pair : headers)
+            esp_http_client_set_header(_http, pair.first.c_str(), pair.second.c_str());
+
+        // A parked connection may still carry the last request's
+        esp_http_client_delete_header(_http, "Range");
+        esp_http_client_delete_header(_http, "If-None-Match");
+        esp_http_client_delete_header(_http, "If-Modified-Since");
+
+        // Nothing says how long a save will be, the body goes out chunked
+        rc = esp_http_client_open(_http, -1);
+        if ( rc != ESP_OK )
+        {
+            Debug_printv("Connection failed... retrying... [%d]", retry);
+            _is_open = false;
+            close();
+        }
+    }
+
+    if ( rc != ESP_OK )
+    {
+        _error = 1;
+        return false;
+    }
+
+    m_uploading = true;
+    _is_open = true;
+    return true;
+}
+
+bool MeatHttpClient::endUpload() {
+    if ( !m_uploading )
+        return false;
+
+    m_uploading = false;
+
+    // The last chunk is an empty one
+    lastRC = -1;
+    if ( writeChunk("", 0) )
+    {
+        esp_http_client_fetch_headers(_http);
+        lastRC = esp_http_client_get_status_code(_http);
+    }
+
+    Debug_printv("PUT url[%s] size[%lu] httpCode[%d]", url.c_str(), _position, lastRC);
+    if ( lastRC < 200 || lastRC >= 300 )
+    {
+        _error = 1;
+        return false;
+    }
+
+    _exists = true;
+    _size = _position;
+    return true;
+}
+
+bool MeatHttpClient::writeChunk(const char* buf, uint32_t size) {
+    char head[12];
+    int len = snprintf(head, sizeof head, "%lx\r\n", (unsigned long)size);
+
+    return ( esp_http_client_write(_http, head, len) == len )
+        && ( size == 0 || esp_http_client_write(_http, buf, size) == (int)size )
+        && ( esp_http_client_write(_http, "\r\n", 2) == 2 );
+}
+
 bool MeatHttpClient::processRedirectsAndOpen(uint32_t position, uint32_t size) {
     wasRedirected = false;
     m_isDirectory = false;
@@ -266,8 +612,34 @@ bool MeatHttpClient::processRedirectsAndOpen(uint32_t position, uint32_t size) {
         lastRC = openAndFetchHeaders(lastMethod, position, size);
         wasRedirected = true;
     }
-    
-    if(lastRC != HttpStatus_Ok && lastRC != 301 && lastRC != 206) {
+
+    // A compressed body is only any use from the start, anything else,
+    // or one that doesn't inflate, is asked for again without compression
+    if ( m_encoding != HTTPInflater::IDENTITY && lastRC >= 200 && lastRC < 300 && !startDecoding() ) {
+        Debug_printv("Content-Encoding fallback rc[%d] url[%s]", lastRC, url.c_str());
+        m_acceptEncoding = false;
+        isFriendlySkipper = false;
+        _range_size = 0;
+        _is_open = false;
+        close();
+
+        lastRC = openAndFetchHeaders(lastMethod, position, size);
+        if (lastRC == 206)
+            isFriendlySkipper = true;
+    }
+
+    // Conditional request and our copy is still good
+    if ( lastRC == 304 && (m_ifNoneMatch.size() || m_ifModifiedSince.size()) ) {
+        _is_open = true;
+        return true;
+    }
+
+    // Besides GET and HEAD: 207 Multi-Status for PROPFIND, 201 and 204 for DELETE and MKCOL
+    bool success = ( lastRC == HttpStatus_Ok || lastRC == 301 || lastRC == 206 );
+    if ( lastMethod != HTTP_METHOD_GET && lastMethod != HTTP_METHOD_HEAD && lastRC >= 200 && lastRC < 300 )
+        success = true;
+
+    if(!success) {
         Debug_printv("opening stream failed, httpCode=%d", lastRC);
         _error = lastRC;
         _is_open = false;
@@ -284,6 +656,13 @@ bool MeatHttpClient::processRedirectsAndOpen(uint32_t position, uint32_t size) {
 }
 
 bool MeatHttpClient::open(std::string dstUrl, esp_http_client_method_t meth) {
+    // Cached copies of a file we are about to change are stale
+    if ( meth == HTTP_METHOD_PUT || meth == HTTP_METHOD_POST || meth == HTTP_METHOD_DELETE )
+    {
+        HTTPBlockCache::invalidate(dstUrl);
+        HTTPDiskCache::remove(dstUrl);
+    }
+
     url = dstUrl;
     lastMethod = meth;
     _error = 0;
@@ -303,14 +682,72 @@ bool MeatHttpClient::open(std::string dstUrl, esp_http_client_method_t meth) {
 
 void MeatHttpClient::close() {
     if(_http != nullptr) {
-        if ( _is_open ) {
-            esp_http_client_close(_http);
+        if ( reusable() ) {
+            // Don't leave our headers on a connection someone else will use
+            for (const auto& pair : headers)
+                esp_http_client_delete_header(_http, pair.first.c_str());
+
+            HTTPConnectionPool::release(url, _http);
+            //Debug_printv("HTTP connection parked for reuse");
+        }
+        else {
+            if ( _is_open ) {
+                esp_http_client_close(_http);
+            }
+            esp_http_client_cleanup(_http);
+            Debug_printv("HTTP Close and Cleanup");
         }
-        esp_http_client_cleanup(_http);
-        Debug_printv("HTTP Close and Cleanup");
         _http = nullptr;
     }
     _is_open = false;
+    m_uploading = false;
+}
+
+bool MeatHttpClient::reusable() {
+    if ( !_is_open )
+        return false;
+
+    // No body on the wire
+    if ( lastMethod == HTTP_METHOD_HEAD || lastRC == 304 )
+        return true;
+
+    if ( lastRC < 200 || lastRC >= 300 )
+        return false;
+
+    // Keep it if the rest of the response is short enough to read off
+    if ( lastMethod == HTTP_METHOD_GET || lastMethod == HTTP_METHOD_PROPFIND )
+        return finish();
+
+    return false;
+}
+
+uint32_t MeatHttpClient::skip(uint32_t count) {
+    if ( !_is_open )
+        return 0;
+
+    if ( m_scratch == nullptr )
+        m_scratch.reset(new char[HTTP_SKIP_BUFFER_SIZE]);
+
+    uint32_t skipped = 0;
+    while ( skipped < count )
+    {
+        int bytes = esp_http_client_read(_http, m_scratch.get(), std::min(count - skipped, (uint32_t)HTTP_SKIP_BUFFER_SIZE));
+        if ( bytes <= 0 )
+            break;
+        skipped += bytes;
+    }
+
+    return skipped;
+}
+
+bool MeatHttpClient::finish(uint32_t limit) {
+    if ( !_is_open )
+        return false;
+
+    if ( !esp_http_client_is_complete_data_received(_http) )
+        skip(limit);
+
+    return esp_http_client_is_complete_data_received(_http);
 }
 
 void MeatHttpClient::setOnHeader(const std::function<int(char*, char*)> &lambda) {
@@ -324,8 +761,11 @@ bool MeatHttpClient::flush(uint32_t pos) {
     if (!_is_open)
         return false;
 
+    if ( m_scratch == nullptr )
+        m_scratch.reset(new char[HTTP_SKIP_BUFFER_SIZE]);
+
     int count = pos;
-    char c[HTTP_BLOCK_SIZE] = {0};
+    char *c = m_scratch.get();
     while(1)
     {
         int bytes = esp_http_client_read(_http, c, HTTP_BLOCK_SIZE);
@@ -352,22 +792,33 @@ bool MeatHttpClient::flush(uint32_t pos) {
 
 bool MeatHttpClient::seek(uint32_t pos) {
 
+    // The whole body is in memory
+    if ( _is_open && m_buffered ) {
+        if ( pos > m_decoded.size() )
+            return false;
+
+        _position = pos;
+        return true;
+    }
+
+    // Blocks are fetched on read, seeking is free
+    if ( useBlocks() ) {
+        if ( pos > _range_size )
+            return false;
+
+        _position = pos;
+        return true;
+    }
+
     if(isFriendlySkipper) {
 
-        if (_is_open) {
-            // Read to end of the stream
-            //Debug_printv("Skipping to end!");
-            while(1)
-            {
-                        char c[HTTP_BLOCK_SIZE];
-                int bytes = esp_http_client_read(_http, c, HTTP_BLOCK_SIZE);
-                if ( bytes < HTTP_BLOCK_SIZE )
-                    break;
-            }
+        // Finish this response so the next Range request goes out on the same connection
+        if ( _is_open && !finish() )
+        {
+            _is_open = false;
+            close();
         }
 
-        uint32_t delta = pos - _position;
-
         bool op = processRedirectsAndOpen(pos);
 
         //Debug_printv("SEEK in HTTPMStream %s: range request RC=%d", url.c_str(), lastRC);
@@ -375,22 +826,6 @@ bool MeatHttpClient::seek(uint32_t pos) {
         if(!op)
             return false;
 
-        if ( delta > HTTP_BLOCK_SIZE )
-        {
-            // flush the rest
-            //Debug_printv("_position[%lu] pos[%lu] available[%lu]", _position, pos, available());
-            int rc = 0;
-            do {
-                char c;
-                rc = esp_http_client_read(_http, &c, 1);
-                if(rc == -1)
-                    return false;
-            } while(rc);
-
-            if ( !processRedirectsAndOpen(pos) )
-                return false;
-        }
-
          // 200 = range not supported! according to https://developer.mozilla.org/en-US/docs/Web/HTTP/Range_requests
         if( lastRC == 206 )
         {
@@ -398,6 +833,9 @@ bool MeatHttpClient::seek(uint32_t pos) {
             _position = pos;
             return true;
         }
+
+        // The whole file is coming from the start, skip to pos below
+        _position = 0;
     }
 
     if ( lastMethod == HTTP_METHOD_GET ) 
@@ -405,30 +843,25 @@ bool MeatHttpClient::seek(uint32_t pos) {
         //Debug_printv("Server doesn't support resume, reading from start and discarding");
         // server doesn't support resume, so...
         if( pos < _position || pos == 0 ) {
-            // skipping backward let's simply reopen the stream...
-            close();
-            init();
+            // skipping backward, request the file again
+            // on the same connection if the rest of this response is short
+            if ( _is_open && !finish() )
+            {
+                _is_open = false;
+                close();
+            }
 
             if ( !open(url, lastMethod) )
                 return false;
 
-            // and read pos bytes - requires some buffer
-            for(int i = 0; i<pos; i++) {
-                char c;
-                int rc = esp_http_client_read(_http, &c, 1);
-                if(rc == -1)
-                    return false;
-            }
+            if ( discard(pos) != pos )
+                return false;
         }
         else {
-            auto delta = pos-_position;
-            // skipping forward let's skip a proper amount of bytes - requires some buffer
-            for(int i = 0; i<delta; i++) {
-                char c;
-                int rc = esp_http_client_read(_http, &c, 1);
-                if(rc == -1)
+            // skipping forward, discard the bytes in between
+            uint32_t delta = pos - _position;
+            if ( discard(delta) != delta )
                 return false;
-            }
         }
 
         _position = pos;
@@ -447,6 +880,12 @@ uint32_t MeatHttpClient::read(uint8_t* buf, uint32_t size) {
         processRedirectsAndOpen(0, size);
     }
 
+    if ( _is_open && useBlocks() )
+        return readBlocks(buf, size);
+
+    if ( _is_open && decoding() )
+        return readDecoded(buf, size);
+
     if (_is_open) {
         //Debug_printv("Reading HTTP Stream!");
         auto bytesRead= esp_http_client_read(_http, (char *)buf, size );
@@ -466,12 +905,271 @@ uint32_t MeatHttpClient::read(uint8_t* buf, uint32_t size) {
     return 0;
 };
 
+uint32_t MeatHttpClient::readBlocks(uint8_t* buf, uint32_t size) {
+    uint32_t bytesRead = 0;
+
+    while ( size > 0 && _position < _range_size )
+    {
+        uint32_t block = _position / HTTP_CACHE_BLOCK_SIZE;
+        uint32_t offset = _position % HTTP_CACHE_BLOCK_SIZE;
+
+        uint32_t count = HTTPBlockCache::read(blockKey(), block, offset, buf, size);
+        if ( count == 0 )
+        {
+            if ( !fetchBlock(block) )
+                break;
+
+            // Server ignored the Range request, fetchBlock() fell back to streaming
+            if ( !useBlocks() )
+                return bytesRead + read(buf, size);
+
+            continue;
+        }
+
+        buf += count;
+        size -= count;
+        bytesRead += count;
+        _position += count;
+    }
+
+    //Debug_printv("bytesRead[%lu] _position[%lu]", bytesRead, _position);
+    return bytesRead;
+}
+
+bool MeatHttpClient::fetchBlock(uint32_t block) {
+    uint32_t offset = block * HTTP_CACHE_BLOCK_SIZE;
+    uint32_t length = std::min((uint32_t)HTTP_CACHE_BLOCK_SIZE, _range_size - offset);
+    uint32_t position = _position;
+
+    int slot;
+    uint8_t *data = HTTPBlockCache::claim(slot);
+    if ( data == nullptr )
+        return false;
+
+    // Finish the previous response before the next request on this connection,
+    // or start over on a new one if there is too much of it left
+    if ( _is_open && !finish() )
+    {
+        _is_open = false;
+        close();
+    }
+
+    //Debug_printv("block[%lu] offset[%lu] length[%lu] url[%s]", block, offset, length, url.c_str());
+    if ( !processRedirectsAndOpen(offset, length) )
+    {
+        HTTPBlockCache::release(slot);
+        return false;
+    }
+
+    if ( lastRC != 206 )
+    {
+        // Whole file is coming from the start, read it the old way
+        Debug_printv("Range ignored, streaming url[%s]", url.c_str());
+        HTTPBlockCache::release(slot);
+        isFriendlySkipper = false;
+        _position = 0;
+        return seek(position);
+    }
+
+    uint32_t filled = readBody(data, length);
+
+    _position = position;
+    if ( filled < length )
+    {
+        Debug_printv("Short block[%lu] filled[%lu] length[%lu]", block, filled, length);
+        HTTPBlockCache::release(slot);
+        _error = 1;
+        return false;
+    }
+
+    // Key after the request, it carries this response's validator
+    HTTPBlockCache::commit(slot, blockKey(), block, length);
+    return true;
+}
+
+int32_t MeatHttpClient::readRange(uint32_t offset, uint8_t* buf, uint32_t length) {
+    lastMethod = HTTP_METHOD_GET;
+    m_acceptEncoding = false;   // raw bytes at offset or nothing
+
+    if ( _is_open && !finish() )
+    {
+        _is_open = false;
+        close();
+    }
+
+    if ( !processRedirectsAndOpen(offset, length) || lastRC != 206 )
+        return -1;
+
+    return readBody(buf, length);
+}
+
+bool MeatHttpClient::cacheable() {
+    if ( !_is_open || lastMethod != HTTP_METHOD_GET || m_noStore )
+        return false;
+
+    if ( lastRC != HttpStatus_Ok && lastRC != 206 )
+        return false;
+
+    // No way to know we got all of it, unless it was inflated to a known size
+    if ( esp_http_client_is_chunked_response(_http) && !decoding() )
+        return false;
+
+    if ( m_streaming )
+        return false;
+
+    uint32_t size = ( _range_size > 0 ) ? _range_size : _size;
+    return ( size > 0 && size <= HTTP_DISK_CACHE_MAX_FILE );
+}
+
+void MeatHttpClient::toCacheEntry(const std::string &key, HTTPCacheEntry &entry) {
+    entry.url = key;
+    entry.etag = m_etag;
+    entry.lastModified = m_lastModified;
+    entry.size = ( _range_size > 0 ) ? _range_size : _size;
+    entry.isDirectory = m_isDirectory;
+    entry.isText = isText;
+    entry.hasBody = false;
+    entry.expires = HTTPDiskCache::expiry(m_maxAge);
+}
+
+bool MeatHttpClient::startDecoding() {
+    if ( lastRC != HttpStatus_Ok || lastMethod != HTTP_METHOD_GET || m_encoding == HTTPInflater::UNSUPPORTED )
+        return false;
+
+    // The Range, if the server saw one, doesn't apply to the inflated body
+    isFriendlySkipper = false;
+    _range_size = 0;
+
+    m_inflater.reset(new HTTPInflater(m_encoding, [this](uint8_t *buf, uint32_t size) -> int32_t {
+        return esp_http_client_read(_http, (char *)buf, size);
+    }));
+
+    if ( m_decodedSize > 0 ) {
+        Debug_printv("inflating encoding[%d] size[%lu] url[%s]", m_encoding, m_decodedSize, url.c_str());
+        _size = m_decodedSize;
+        return true;
+    }
+
+    // Without the size nothing can tell where the file ends, a small one is
+    // inflated now so it has one
+    if ( m_scratch == nullptr )
+        m_scratch.reset(new char[HTTP_SKIP_BUFFER_SIZE]);
+
+    while ( m_decoded.size() < HTTP_INFLATE_BUFFER_MAX )
+    {
+        uint32_t bytes = m_inflater->read((uint8_t *)m_scratch.get(), std::min((uint32_t)HTTP_SKIP_BUFFER_SIZE, HTTP_INFLATE_BUFFER_MAX - (uint32_t)m_decoded.size()));
+        if ( bytes == 0 )
+            break;
+        m_decoded.insert(m_decoded.end(), m_scratch.get(), m_scratch.get() + bytes);
+    }
+
+    if ( m_inflater->failed() ) {
+        Debug_printv("inflate failed encoding[%d] url[%s]", m_encoding, url.c_str());
+        m_inflater.reset();
+        std::vector<uint8_t>().swap(m_decoded);
+        return false;
+    }
+
+    if ( m_inflater->done() ) {
+        Debug_printv("inflated encoding[%d] in[%lu] out[%u] url[%s]", m_encoding, m_inflater->consumed(), m_decoded.size(), url.c_str());
+        m_inflater.reset();
+        m_buffered = true;
+        _size = m_decoded.size();
+        return true;
+    }
+
+    // A bigger one is read from what is already inflated, then straight from
+    // the inflater, and its size keeps ahead of the reader until the end
+    Debug_printv("streaming encoding[%d] url[%s]", m_encoding, url.c_str());
+    m_streaming = true;
+    _size = m_inflater->produced() + HTTP_INFLATE_BUFFER_MAX;
+    return true;
+}
+
+uint32_t MeatHttpClient::readDecoded(uint8_t* buf, uint32_t size) {
+    uint32_t bytesRead = 0;
+
+    if ( _position < m_decoded.size() ) {
+        bytesRead = std::min(size, (uint32_t)m_decoded.size() - _position);
+        memcpy(buf, m_decoded.data() + _position, bytesRead);
+    }
+    else if ( !m_buffered ) {
+        // What was inflated ahead has been read, it isn't needed again
+        if ( m_decoded.size() )
+            std::vector<uint8_t>().swap(m_decoded);
+
+        bytesRead = m_inflater->read(buf, size);
+        if ( m_inflater->failed() )
+            _error = 1;
+    }
+
+    _position += bytesRead;
+
+    if ( m_streaming ) {
+        if ( m_inflater->done() || m_inflater->failed() ) {
+            _size = m_inflater->produced();
+            m_streaming = false;
+        }
+        else if ( _size < m_inflater->produced() + HTTP_INFLATE_BUFFER_MAX ) {
+            _size = m_inflater->produced() + HTTP_INFLATE_BUFFER_MAX;
+        }
+    }
+
+    return bytesRead;
+}
+
+uint32_t MeatHttpClient::discard(uint32_t count) {
+    if ( !decoding() )
+        return skip(count);
+
+    if ( m_scratch == nullptr )
+        m_scratch.reset(new char[HTTP_SKIP_BUFFER_SIZE]);
+
+    uint32_t discarded = 0;
+    while ( discarded < count )
+    {
+        uint32_t bytes = readDecoded((uint8_t *)m_scratch.get(), std::min(count - discarded, (uint32_t)HTTP_SKIP_BUFFER_SIZE));
+        if ( bytes == 0 )
+            break;
+        discarded += bytes;
+    }
+
+    return discarded;
+}
+
+uint32_t MeatHttpClient::readBody(uint8_t* buf, uint32_t length) {
+    uint32_t filled = 0;
+    while ( filled < length )
+    {
+        int bytes = esp_http_client_read(_http, (char *)buf + filled, length - filled);
+        if ( bytes <= 0 )
+            break;
+        filled += bytes;
+    }
+
+    return filled;
+}
+
 uint32_t MeatHttpClient::write(const uint8_t* buf, uint32_t size) {
     if (!_is_open) 
     {
         if ( setHeader( (char *)buf ) )
             return size;
     }
+    else if ( m_uploading )
+    {
+        // Straight from the caller's buffer, one chunk per write
+        if ( size == 0 )
+            return 0;
+
+        if ( !writeChunk((const char *)buf, size) )
+        {
+            _error = 1;
+            return 0;
+        }
+        _position += size;
+        return size;
+    }
     else
     {
         auto bytesWritten= esp_http_client_write(_http, (char *)buf, size );
@@ -486,6 +1184,22 @@ int MeatHttpClient::openAndFetchHeaders(esp_http_client_method_t method, uint32_
     if ( url.size() < 5)
         return 0;
 
+    if ( _http == nullptr )
+        init();
+
+    // Validators are taken from this response
+    m_etag.clear();
+    m_lastModified.clear();
+    m_maxAge = -1;
+    m_noStore = false;
+
+    m_encoding = HTTPInflater::IDENTITY;
+    m_decodedSize = 0;
+    m_inflater.reset();
+    std::vector<uint8_t>().swap(m_decoded);
+    m_buffered = false;
+    m_streaming = false;
+
     // Set URL and Method
     mstr::replaceAll(url, " ", "%20");
     esp_http_client_set_url(_http, url.c_str());
@@ -498,11 +1212,34 @@ int MeatHttpClient::openAndFetchHeaders(esp_http_client_method_t method, uint32_
         esp_http_client_set_header(_http, pair.first.c_str(), pair.second.c_str());
     }
 
-    // Set Range Header
-    char str[40];
-    snprintf(str, sizeof str, "bytes=%lu-%lu", position, (position + size + 5));
-    esp_http_client_set_header(_http, "Range", str);
-    //Debug_printv("seeking range[%s] url[%s]", str, url.c_str());
+    // Conditional request, a pooled connection may still carry the last one's
+    if ( m_ifNoneMatch.size() )
+        esp_http_client_set_header(_http, "If-None-Match", m_ifNoneMatch.c_str());
+    else
+        esp_http_client_delete_header(_http, "If-None-Match");
+
+    if ( m_ifModifiedSince.size() )
+        esp_http_client_set_header(_http, "If-Modified-Since", m_ifModifiedSince.c_str());
+    else
+        esp_http_client_delete_header(_http, "If-Modified-Since");
+
+    // Compressed bodies can only be read from the start, so only a GET for
+    // the start of a file not known to take Range requests asks for one
+    if ( m_acceptEncoding && method == HTTP_METHOD_GET && position == 0 && !isFriendlySkipper )
+        esp_http_client_set_header(_http, "Accept-Encoding", HTTP_INFLATE_ACCEPT);
+    else
+        esp_http_client_set_header(_http, "Accept-Encoding", "identity");
+
+    // Set Range Header, it only means something to GET and HEAD
+    if ( method == HTTP_METHOD_GET || method == HTTP_METHOD_HEAD )
+    {
+        char str[40];
+        snprintf(str, sizeof str, "bytes=%lu-%lu", position, (position + size + 5));
+        esp_http_client_set_header(_http, "Range", str);
+        //Debug_printv("seeking range[%s] url[%s]", str, url.c_str());
+    }
+    else
+        esp_http_client_delete_header(_http, "Range");
 
     // POST
     // const char *post_data = "{\"field1\":\"value1\"}";
@@ -514,7 +1251,10 @@ int MeatHttpClient::openAndFetchHeaders(esp_http_client_method_t method, uint32_
     int retry = 5;
     do
     {
-        rc = esp_http_client_open(_http, 0); // or open? It's not entirely clear...
+        rc = esp_http_client_open(_http, m_body.size()); // or open? It's not entirely clear...
+
+        if (rc == ESP_OK && m_body.size() && esp_http_client_write(_http, m_body.data(), m_body.size()) != (int)m_body.size())
+            rc = ESP_FAIL;
 
         if (rc == ESP_OK)
         {
@@ -532,7 +1272,9 @@ int MeatHttpClient::openAndFetchHeaders(esp_http_client_method_t method, uint32_
         //Debug_printv("after open rc[%d] status[%d]", rc, status);
         if ( rc != ESP_OK )
         {
+            // A parked connection may have been dropped by the server, never park this one again
             Debug_printv("Connection failed... retrying... [%d] status[%d]", retry, status);
+            _is_open = false;
             close();
             init();
         }
@@ -548,6 +1290,10 @@ esp_err_t MeatHttpClient::_http_event_handler(esp_http_client_event_t *evt)
 {
     MeatHttpClient* meatClient = (MeatHttpClient*)evt->user_data;
 
+    // Parked in the connection pool
+    if ( meatClient == nullptr )
+        return ESP_OK;
+
     switch(evt->event_id) {
         case HTTP_EVENT_ERROR: // This event occurs when there are any errors during execution
             Debug_printv("HTTP_EVENT_ERROR");
@@ -599,6 +1345,27 @@ esp_err_t MeatHttpClient::_http_event_handler(esp_http_client_event_t *evt)
             else if(mstr::equals("Last-Modified", evt->header_key, false))
             {
                 // Last-Modified, value=Thu, 03 Dec 1992 08:37:20 - may be used to get file date
+                meatClient->m_lastModified = evt->header_value;
+            }
+            else if(mstr::equals("ETag", evt->header_key, false))
+            {
+                meatClient->m_etag = evt->header_value;
+            }
+            else if(mstr::equals("Cache-Control", evt->header_key, false))
+            {
+                // Cache-Control, value=public, max-age=3600
+                std::string value = evt->header_value;
+                mstr::toLower(value);
+                if ( mstr::contains(value, (char *)"no-store") )
+                    meatClient->m_noStore = true;
+                else if ( mstr::contains(value, (char *)"no-cache") )
+                    meatClient->m_maxAge = 0;
+                else
+                {
+                    size_t pos = value.find("max-age=");
+                    if ( pos != std::string::npos )
+                        meatClient->m_maxAge = atoi(value.c_str() + pos + 8);
+                }
             }
             else if(mstr::equals("Content-Disposition", evt->header_key, false))
             {
@@ -616,6 +1383,17 @@ esp_err_t MeatHttpClient::_http_event_handler(esp_http_client_event_t *evt)
                 //Debug_printv("* Content len present '%s'", evt->header_value);
                 meatClient->_size = std::stoi(evt->header_value);
             }
+            else if(mstr::equals("Content-Encoding", evt->header_key, false))
+            {
+                meatClient->m_encoding = HTTPInflater::encoding(evt->header_value);
+            }
+            else if(mstr::equals("X-Uncompressed-Content-Length", evt->header_key, false) ||
+                    mstr::equals("X-Decompressed-Content-Length", evt->header_key, false) ||
+                    mstr::equals("X-Original-Content-Length", evt->header_key, false))
+            {
+                // Size of a compressed body once inflated
+                meatClient->m_decodedSize = atoi(evt->header_value);
+            }
             else if(mstr::equals("Location", evt->header_key, false))
             {
                 Debug_printv("* This page redirects from '%s' to '%s'", meatClient->url.c_str(), evt->header_value);
@@ -680,7 +1458,8 @@ esp_err_t MeatHttpClient::_http_event_handler(esp_http_client_event_t *evt)
                 // }
 
 
-                if (esp_http_client_is_chunked_response(evt->client)) {
+                // The size of a compressed body is worked out when it is opened
+                if (esp_http_client_is_chunked_response(evt->client) && meatClient->m_encoding == HTTPInflater::IDENTITY) {
                     int len;
                     esp_http_client_get_chunk_length(evt->client, &len);
                     meatClient->_size = len;
@@ -36,7 +36,24 @@
 //#include "../../include/version.h"
 #include "utils.h"
 
+#include "http_blocks.h"
+#include "http_cache.h"
+#include "http_inflate.h"
+#include "http_pool.h"
+#include "http_prefetch.h"
+
 #define HTTP_BLOCK_SIZE 256
+#define HTTP_SKIP_BUFFER_SIZE 4096
+#define HTTP_REUSE_DRAIN_MAX (16 * 1024)    // read at most this much of a response to keep its connection
+#define HTTP_PREFETCH_TRIGGER 4             // sequential reads before read-ahead starts
+
+// Compressed bodies without a decoded size are inflated into memory up to
+// this to find out how big they are, bigger ones are inflated as they are read
+#ifdef BOARD_HAS_PSRAM
+#define HTTP_INFLATE_BUFFER_MAX (256 * 1024)
+#else
+#define HTTP_INFLATE_BUFFER_MAX (16 * 1024)
+#endif
 
 //#define PRODUCT_ID "MEATLOAF CBM"
 //#define PLATFORM_DETAILS "C64; 6510; 2; NTSC; EN;" // Make configurable. This will help server side to select appropriate content.
@@ -54,13 +71,60 @@ class MeatHttpClient {
 
     std::map<std::string, std::string> headers;
 
+    // Range capable GETs are read through the shared block cache
+    bool useBlocks() {
+        return (lastMethod == HTTP_METHOD_GET && isFriendlySkipper && _range_size > 0);
+    }
+    std::string blockKey() {
+        return url + '\n' + (m_etag.empty() ? m_lastModified : m_etag);
+    }
+    bool fetchBlock(uint32_t block);
+    uint32_t readBlocks(uint8_t* buf, uint32_t size);
+
+    // Request body sent with the headers (PROPFIND)
+    std::string m_body;
+
+    // PUT body of unknown length, sent in chunks as it is written
+    bool m_uploading = false;
+    bool writeChunk(const char* buf, uint32_t size);
+
+    // Discard body bytes through a scratch buffer
+    std::unique_ptr<char[]> m_scratch;
+    uint32_t skip(uint32_t count);
+    bool finish(uint32_t limit = HTTP_REUSE_DRAIN_MAX);
+    bool reusable();
+
+    // Content-Encoding, the body is inflated as it is read
+    HTTPInflater::Encoding m_encoding = HTTPInflater::IDENTITY;
+    std::unique_ptr<HTTPInflater> m_inflater;
+    std::vector<uint8_t> m_decoded;     // start of the body, when the server didn't say how big it is
+    bool m_buffered = false;            // m_decoded is the whole body
+    bool m_streaming = false;           // size not known until the inflater is done
+    bool decoding() {
+        return ( m_inflater != nullptr || m_buffered );
+    }
+    bool startDecoding();
+    uint32_t readDecoded(uint8_t* buf, uint32_t size);
+    uint32_t discard(uint32_t count);
+
 public:
 
     MeatHttpClient() {
-        init();
+        // The client is created (or taken from the pool) on the first request
     }
 
     void init() {
+        // Reuse a connection to the same host if one is parked
+        if ( url.size() )
+        {
+            _http = HTTPConnectionPool::acquire(url);
+            if ( _http != nullptr )
+            {
+                esp_http_client_set_user_data(_http, this);
+                return;
+            }
+        }
+
         esp_http_client_config_t config;
         memset(&config, 0, sizeof(config));
         config.url = "https://api.meatloaf.cc/?$";
@@ -102,6 +166,11 @@ public:
     bool POST(std::string url);
     bool PUT(std::string url);
     bool HEAD(std::string url);
+    bool PROPFIND(std::string url, uint8_t depth, const std::string &body);
+
+    // Streamed PUT: open, write() the body, finish with endUpload()
+    bool beginUpload(std::string url);
+    bool endUpload();
 
     bool processRedirectsAndOpen(uint32_t position, uint32_t size = HTTP_BLOCK_SIZE);
     bool open(std::string url, esp_http_client_method_t meth);
@@ -113,6 +182,17 @@ public:
     uint32_t read(uint8_t* buf, uint32_t size);
     uint32_t write(const uint8_t* buf, uint32_t size);
 
+    // One Range GET into buf, returns the byte count or -1
+    int32_t readRange(uint32_t offset, uint8_t* buf, uint32_t length);
+
+    // Body bytes as they come off the wire, until length or the end of the response
+    uint32_t readBody(uint8_t* buf, uint32_t length);
+
+    // Complete GET response the server lets us keep
+    bool cacheable();
+    bool streaming() { return m_streaming; }
+    void toCacheEntry(const std::string &key, HTTPCacheEntry &entry);
+
     bool _is_open = false;
     bool _exists = false;
 
@@ -132,6 +212,18 @@ public:
     bool disableAutoRedirect = false;
     bool wasRedirected = false;
     std::string url;
+    std::string m_etag;
+    std::string m_lastModified;
+    int32_t m_maxAge = -1;
+    bool m_noStore = false;
+
+    // Ask for gzip/deflate, cleared when a server gets it wrong
+    bool m_acceptEncoding = true;
+    uint32_t m_decodedSize = 0;         // size of a compressed body once inflated, if the server said
+
+    // Validators for a conditional request, 304 counts as success
+    std::string m_ifNoneMatch;
+    std::string m_ifModifiedSince;
 
     int lastRC = 0;
 };
@@ -219,6 +311,26 @@ protected:
 
     MeatHttpClient _http;
 
+    // Body served from the SD card cache
+    FILE* m_cached = nullptr;
+    bool openCached();
+
+    // Body written through to the SD card cache as it is read
+    FILE* m_fill = nullptr;
+    HTTPCacheEntry m_fillEntry;
+    uint32_t m_filled = 0;
+    void beginFill(const std::string &key);
+    void writeThrough(uint32_t offset, const uint8_t *buf, uint32_t size);
+
+    // Read-ahead for sequential reads
+    bool startPrefetch();
+    void stopPrefetch();
+    uint32_t m_sequential = 0;
+    uint32_t m_lastEnd = 0;
+    bool m_prefetchFailed = false;
+    std::unique_ptr<HTTPPrefetcher> m_prefetch;
+    std::unique_ptr<MeatHttpClient> m_fetchers[HTTP_PREFETCH_WORKERS];
+
 private:
     friend class HTTPMFile;
 };
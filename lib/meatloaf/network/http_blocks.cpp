@@ -0,0 +1,124 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "http_blocks.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+#include "../../../include/debug.h"
+
+HTTPBlockCache::Entry HTTPBlockCache::entries[HTTP_CACHE_BLOCKS];
+uint32_t HTTPBlockCache::stamp = 0;
+std::mutex HTTPBlockCache::lock;
+
+uint32_t HTTPBlockCache::read(const std::string &key, uint32_t block, uint32_t offset, uint8_t *buf, uint32_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &entry : entries)
+    {
+        if (entry.busy || entry.length == 0 || entry.block != block || entry.key != key)
+            continue;
+
+        if (offset >= entry.length)
+            return 0;
+
+        size = std::min(size, entry.length - offset);
+        memcpy(buf, entry.data + offset, size);
+        entry.used = ++stamp;
+        return size;
+    }
+
+    return 0;
+}
+
+uint8_t *HTTPBlockCache::claim(int &slot)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Empty or least recently used, skipping slots being filled
+    Entry *victim = nullptr;
+    for (auto &entry : entries)
+    {
+        if (entry.busy)
+            continue;
+        if (victim == nullptr || entry.used < victim->used)
+            victim = &entry;
+    }
+
+    if (victim == nullptr)
+        return nullptr;
+
+    if (victim->data == nullptr)
+    {
+#if defined(ESP_PLATFORM) && defined(BOARD_HAS_PSRAM)
+        victim->data = (uint8_t *)heap_caps_malloc(HTTP_CACHE_BLOCK_SIZE, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+#endif
+        if (victim->data == nullptr)
+            victim->data = (uint8_t *)malloc(HTTP_CACHE_BLOCK_SIZE);
+        if (victim->data == nullptr)
+        {
+            Debug_printv("Out of memory for HTTP block");
+            return nullptr;
+        }
+    }
+
+    victim->key.clear();
+    victim->length = 0;
+    victim->used = 0;
+    victim->busy = true;
+
+    slot = victim - entries;
+    return victim->data;
+}
+
+void HTTPBlockCache::commit(int slot, const std::string &key, uint32_t block, uint32_t length)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Entry &entry = entries[slot];
+    entry.key = key;
+    entry.block = block;
+    entry.length = length;
+    entry.used = ++stamp;
+    entry.busy = false;
+}
+
+void HTTPBlockCache::release(int slot)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    entries[slot].busy = false;
+}
+
+void HTTPBlockCache::invalidate(const std::string &url)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &entry : entries)
+    {
+        // key is url + '\n' + validator
+        if (!entry.busy && entry.key.compare(0, url.size() + 1, url + '\n') == 0)
+        {
+            entry.key.clear();
+            entry.length = 0;
+            entry.used = 0;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// HTTP block cache
+//
+// Random access to a remote file (a D64 mounted over http://) is done in
+// aligned blocks of HTTP_CACHE_BLOCK_SIZE bytes fetched with one Range
+// request each. Blocks are kept in a small LRU cache shared by all
+// clients, keyed by URL + validator (ETag, or Last-Modified) + block
+// number, so a changed file on the server never matches old blocks.
+// Sector reads that land in a cached block cost no request at all.
+//
+
+#ifndef MEATLOAF_NETWORK_HTTP_BLOCKS
+#define MEATLOAF_NETWORK_HTTP_BLOCKS
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#ifdef BOARD_HAS_PSRAM
+#define HTTP_CACHE_BLOCK_SIZE (16 * 1024)
+#define HTTP_CACHE_BLOCKS 16
+#else
+#define HTTP_CACHE_BLOCK_SIZE (4 * 1024)
+#define HTTP_CACHE_BLOCKS 4
+#endif
+
+static_assert(HTTP_CACHE_BLOCK_SIZE >= 4096 && HTTP_CACHE_BLOCK_SIZE <= 65536, "HTTP_CACHE_BLOCK_SIZE must be 4KB to 64KB");
+
+class HTTPBlockCache {
+public:
+    // Copy from a cached block starting at offset. Returns 0 on a miss.
+    static uint32_t read(const std::string &key, uint32_t block, uint32_t offset, uint8_t *buf, uint32_t size);
+
+    // Take the least recently used slot to fetch a block into, then
+    // commit() it when it is filled or release() it on failure.
+    static uint8_t *claim(int &slot);
+    static void commit(int slot, const std::string &key, uint32_t block, uint32_t length);
+    static void release(int slot);
+
+    // Drop every block of url (all validators)
+    static void invalidate(const std::string &url);
+
+private:
+    struct Entry {
+        std::string key;
+        uint32_t block = 0;
+        uint32_t length = 0;
+        uint32_t used = 0;
+        bool busy = false;
+        uint8_t *data = nullptr;
+    };
+
+    static Entry entries[HTTP_CACHE_BLOCKS];
+    static uint32_t stamp;
+    static std::mutex lock;
+};
+
+#endif // MEATLOAF_NETWORK_HTTP_BLOCKS
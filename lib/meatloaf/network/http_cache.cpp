@@ -0,0 +1,404 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "http_cache.h"
+
+#include <dirent.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <memory>
+
+#include "fnFsSD.h"
+
+#include "../../../include/debug.h"
+
+#define HTTP_DISK_CACHE_VERSION 2
+#define HTTP_DISK_CACHE_EPOCH   1577836800      // 2020-01-01, anything earlier and the clock isn't set
+
+#define RECORD_DIRECTORY 0x01
+#define RECORD_TEXT      0x02
+
+struct HTTPCacheRecord {
+    char magic[4];          // "MLHC"
+    uint8_t version;
+    uint8_t flags;
+    uint16_t strings;       // url, etag and last-modified follow, each zero terminated
+    uint32_t size;
+    uint32_t body;          // bytes in <hash>.dat, 0 if metadata only
+    uint32_t expires;
+    uint32_t used;          // HTTPDiskCache::tick when it was last read
+};
+
+std::map<std::string, HTTPDiskCache::Item> HTTPDiskCache::index;
+uint32_t HTTPDiskCache::total = 0;
+uint32_t HTTPDiskCache::tick = 0;
+std::set<std::string> HTTPDiskCache::filling;
+bool HTTPDiskCache::loaded = false;
+std::mutex HTTPDiskCache::lock;
+
+static uint32_t cache_now()
+{
+    time_t now = time(nullptr);
+    return (now < HTTP_DISK_CACHE_EPOCH) ? 0 : (uint32_t)now;
+}
+
+bool HTTPCacheEntry::fresh()
+{
+    uint32_t now = cache_now();
+    return (now != 0 && now < expires);
+}
+
+uint32_t HTTPDiskCache::expiry(int32_t maxAge)
+{
+    uint32_t now = cache_now();
+    if (now == 0)
+        return 0;
+
+    return now + ((maxAge < 0) ? HTTP_DISK_CACHE_DEFAULT_TTL : maxAge);
+}
+
+std::string HTTPDiskCache::name(const std::string &url)
+{
+    // FNV-1a, FAT friendly and short enough to be cheap to open
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : url)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return hex;
+}
+
+std::string HTTPDiskCache::path(const std::string &name, const char *ext)
+{
+    return std::string(HTTP_DISK_CACHE_DIR "/") + name + ext;
+}
+
+bool HTTPDiskCache::ready()
+{
+    if (!fnSDFAT.running())
+        return false;
+
+    if (!loaded)
+        load();
+
+    return true;
+}
+
+void HTTPDiskCache::load()
+{
+    // Size up what previous boots left behind, only the records are read
+    loaded = true;
+    fnSDFAT.create_path(HTTP_DISK_CACHE_DIR);
+
+    std::string dir = std::string(fnSDFAT.basepath()) + HTTP_DISK_CACHE_DIR;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr)
+        return;
+
+    struct dirent *e;
+    while ((e = readdir(d)) != nullptr)
+    {
+        std::string file = e->d_name;
+        if (file.size() != 20 || file.compare(16, 4, ".met") != 0)
+        {
+            // Downloads cut short by a reset
+            if (file.size() == 20 && file.compare(16, 4, ".tmp") == 0)
+                fnSDFAT.remove(path(file.substr(0, 16), ".tmp").c_str());
+            continue;
+        }
+
+        FILE *f = fnSDFAT.file_open(path(file.substr(0, 16), ".met").c_str(), "rb");
+        if (f == nullptr)
+            continue;
+
+        HTTPCacheRecord record;
+        bool ok = (fread(&record, sizeof(record), 1, f) == 1 && memcmp(record.magic, "MLHC", 4) == 0 && record.version == HTTP_DISK_CACHE_VERSION);
+        fclose(f);
+
+        if (!ok)
+        {
+            drop(file.substr(0, 16));
+            continue;
+        }
+
+        index[file.substr(0, 16)] = { record.body, record.used };
+        total += record.body;
+        tick = std::max(tick, record.used);
+    }
+    closedir(d);
+
+    Debug_printv("entries[%d] bytes[%lu]", index.size(), total);
+}
+
+bool HTTPDiskCache::lookup(const std::string &url, HTTPCacheEntry &entry)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return false;
+
+    std::string key = name(url);
+    auto item = index.find(key);
+    if (item == index.end())
+        return false;
+
+    FILE *f = fnSDFAT.file_open(path(key, ".met").c_str(), "rb");
+    if (f == nullptr)
+        return false;
+
+    HTTPCacheRecord record;
+    std::unique_ptr<char[]> strings;
+    bool ok = (fread(&record, sizeof(record), 1, f) == 1 && record.strings > 0);
+    if (ok)
+    {
+        strings.reset(new char[record.strings + 1]);
+        ok = (fread(strings.get(), record.strings, 1, f) == 1);
+        strings[record.strings] = '\0';
+    }
+    fclose(f);
+
+    if (!ok)
+    {
+        drop(key);
+        return false;
+    }
+
+    // Three zero terminated strings
+    const char *s = strings.get();
+    const char *end = s + record.strings;
+    entry.url = s;
+    s += entry.url.size() + 1;
+    entry.etag = (s < end) ? s : "";
+    s += entry.etag.size() + 1;
+    entry.lastModified = (s < end) ? s : "";
+
+    // Hash collision
+    if (entry.url != url)
+        return false;
+
+    entry.size = record.size;
+    entry.isDirectory = (record.flags & RECORD_DIRECTORY);
+    entry.isText = (record.flags & RECORD_TEXT);
+    entry.hasBody = (record.body > 0);
+    entry.expires = record.expires;
+
+    item->second.used = ++tick;
+    return true;
+}
+
+bool HTTPDiskCache::write(const std::string &key, HTTPCacheEntry &entry, uint32_t body)
+{
+    HTTPCacheRecord record = {};
+    memcpy(record.magic, "MLHC", 4);
+    record.version = HTTP_DISK_CACHE_VERSION;
+    record.flags = (entry.isDirectory ? RECORD_DIRECTORY : 0) | (entry.isText ? RECORD_TEXT : 0);
+    record.strings = entry.url.size() + entry.etag.size() + entry.lastModified.size() + 3;
+    record.size = entry.size;
+    record.body = body;
+    record.expires = entry.expires;
+    record.used = ++tick;
+
+    FILE *f = fnSDFAT.file_open(path(key, ".met").c_str(), "wb");
+    if (f == nullptr)
+        return false;
+
+    bool ok = (fwrite(&record, sizeof(record), 1, f) == 1);
+    ok = ok && (fwrite(entry.url.c_str(), entry.url.size() + 1, 1, f) == 1);
+    ok = ok && (fwrite(entry.etag.c_str(), entry.etag.size() + 1, 1, f) == 1);
+    ok = ok && (fwrite(entry.lastModified.c_str(), entry.lastModified.size() + 1, 1, f) == 1);
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok)
+    {
+        Debug_printv("Write failed url[%s]", entry.url.c_str());
+        drop(key);
+        return false;
+    }
+
+    auto item = index.find(key);
+    if (item != index.end())
+        total -= item->second.body;
+    index[key] = { body, record.used };
+    total += body;
+
+    return true;
+}
+
+bool HTTPDiskCache::store(HTTPCacheEntry &entry)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return false;
+
+    // Keep the body we have unless the file changed under it
+    std::string key = name(entry.url);
+    auto item = index.find(key);
+    uint32_t body = (item != index.end() && entry.hasBody) ? item->second.body : 0;
+    if (item != index.end() && body == 0 && item->second.body > 0)
+        fnSDFAT.remove(path(key, ".dat").c_str());
+
+    if (!write(key, entry, body))
+        return false;
+
+    evict();
+    return true;
+}
+
+FILE *HTTPDiskCache::openBody(const std::string &url)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return nullptr;
+
+    std::string key = name(url);
+    auto item = index.find(key);
+    if (item == index.end() || item->second.body == 0)
+        return nullptr;
+
+    FILE *f = fnSDFAT.file_open(path(key, ".dat").c_str(), "rb");
+    if (f == nullptr)
+    {
+        drop(key);
+        return nullptr;
+    }
+
+    touch(key, item->second);
+    return f;
+}
+
+void HTTPDiskCache::touch(const std::string &key, Item &item)
+{
+    // Only the counter in the record changes, so the order survives a reboot
+    item.used = ++tick;
+
+    FILE *f = fnSDFAT.file_open(path(key, ".met").c_str(), "r+b");
+    if (f == nullptr)
+        return;
+
+    if (fseek(f, offsetof(HTTPCacheRecord, used), SEEK_SET) == 0)
+        fwrite(&item.used, sizeof(item.used), 1, f);
+    fclose(f);
+}
+
+FILE *HTTPDiskCache::createBody(const std::string &url)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return nullptr;
+
+    // Two readers of one url share the .tmp name, only the first fills it
+    std::string key = name(url);
+    if (filling.count(key))
+        return nullptr;
+
+    FILE *f = fnSDFAT.file_open(path(key, ".tmp").c_str(), "wb");
+    if (f != nullptr)
+        filling.insert(key);
+    return f;
+}
+
+bool HTTPDiskCache::commitBody(FILE *file, HTTPCacheEntry &entry)
+{
+    long body = ftell(file);
+    bool ok = (fclose(file) == 0 && body == (long)entry.size && body > 0);
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::string key = name(entry.url);
+    std::string tmp = path(key, ".tmp");
+    std::string dat = path(key, ".dat");
+    filling.erase(key);
+
+    if (ok)
+    {
+        fnSDFAT.remove(dat.c_str());
+        ok = fnSDFAT.rename(tmp.c_str(), dat.c_str());
+    }
+
+    if (!ok)
+    {
+        Debug_printv("Download not cached url[%s]", entry.url.c_str());
+        fnSDFAT.remove(tmp.c_str());
+        return false;
+    }
+
+    entry.hasBody = true;
+    if (!write(key, entry, body))
+        return false;
+
+    evict();
+    return true;
+}
+
+void HTTPDiskCache::abortBody(FILE *file, const std::string &url)
+{
+    fclose(file);
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::string key = name(url);
+    fnSDFAT.remove(path(key, ".tmp").c_str());
+    filling.erase(key);
+}
+
+void HTTPDiskCache::remove(const std::string &url)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return;
+
+    std::string key = name(url);
+    if (index.find(key) != index.end())
+        drop(key);
+}
+
+void HTTPDiskCache::drop(const std::string &key)
+{
+    fnSDFAT.remove(path(key, ".met").c_str());
+    fnSDFAT.remove(path(key, ".dat").c_str());
+
+    auto item = index.find(key);
+    if (item != index.end())
+    {
+        total -= item->second.body;
+        index.erase(item);
+    }
+}
+
+void HTTPDiskCache::evict()
+{
+    while (total > HTTP_DISK_CACHE_QUOTA || index.size() > HTTP_DISK_CACHE_MAX_ENTRIES)
+    {
+        // Least recently used, only bodies count against the quota
+        bool bodies = (total > HTTP_DISK_CACHE_QUOTA);
+        auto oldest = index.end();
+        for (auto i = index.begin(); i != index.end(); ++i)
+        {
+            if ((i->second.body > 0 || !bodies) && (oldest == index.end() || i->second.used < oldest->second.used))
+                oldest = i;
+        }
+
+        if (oldest == index.end())
+            break;
+
+        //Debug_printv("evicting [%s] bytes[%lu]", oldest->first.c_str(), oldest->second.body);
+        drop(oldest->first);
+    }
+}
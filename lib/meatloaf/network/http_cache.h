@@ -0,0 +1,118 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// Persistent HTTP cache on the SD card
+//
+// Remote images were downloaded again after every reboot. Files up to
+// HTTP_DISK_CACHE_MAX_FILE are now kept in SYSTEM_DIR/cache/http together
+// with their ETag/Last-Modified validators and what we know about them
+// (size, directory, text). Each url gets two files named by its hash:
+//
+//   <hash>.met  - record below, then url, etag and last-modified strings
+//   <hash>.dat  - body, only for entries that were downloaded
+//
+// An entry is fresh until its Cache-Control max-age runs out (or
+// HTTP_DISK_CACHE_DEFAULT_TTL if the server didn't send one) and is used
+// without asking the server. After that it is revalidated with
+// If-None-Match/If-Modified-Since, a 304 means the copy on SD is good.
+//
+// Freshness needs wall clock time, until SNTP has set the clock every
+// entry is revalidated. Bodies are evicted least recently used first once
+// they add up to more than HTTP_DISK_CACHE_QUOTA. Recency is a counter
+// kept in each record rather than the clock, it works before SNTP and
+// carries over from the last boot.
+//
+
+#ifndef MEATLOAF_NETWORK_HTTP_CACHE
+#define MEATLOAF_NETWORK_HTTP_CACHE
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "../../include/global_defines.h"
+
+#define HTTP_DISK_CACHE_DIR         SYSTEM_DIR "/cache/http"
+#define HTTP_DISK_CACHE_QUOTA       (16 * 1024 * 1024)
+#define HTTP_DISK_CACHE_MAX_FILE    (1024 * 1024)       // a D81 fits
+#define HTTP_DISK_CACHE_MAX_ENTRIES 512
+#define HTTP_DISK_CACHE_DEFAULT_TTL 60                  // seconds, without Cache-Control max-age
+
+struct HTTPCacheEntry {
+    std::string url;
+    std::string etag;
+    std::string lastModified;
+
+    uint32_t size = 0;
+    bool isDirectory = false;
+    bool isText = false;
+    bool hasBody = false;
+
+    uint32_t expires = 0;   // wall clock, 0 = always revalidate
+
+    bool fresh();
+};
+
+class HTTPDiskCache {
+public:
+    // Entry for url, false if there is none
+    static bool lookup(const std::string &url, HTTPCacheEntry &entry);
+
+    // Write entry, the body on SD is kept if entry.hasBody (it was revalidated)
+    static bool store(HTTPCacheEntry &entry);
+
+    // Body of a cached entry, opened for reading
+    static FILE *openBody(const std::string &url);
+
+    // Download a body through a temporary file, then commit or abort it.
+    // nullptr if the url is already being downloaded
+    static FILE *createBody(const std::string &url);
+    static bool commitBody(FILE *file, HTTPCacheEntry &entry);
+    static void abortBody(FILE *file, const std::string &url);
+
+    static void remove(const std::string &url);
+
+    // Wall clock expiry for a Cache-Control max-age, -1 if there was none
+    static uint32_t expiry(int32_t maxAge);
+
+private:
+    struct Item {
+        uint32_t body;
+        uint32_t used;      // tick when it was last read
+    };
+
+    static std::string name(const std::string &url);
+    static std::string path(const std::string &name, const char *ext);
+    static bool ready();
+    static void load();
+    static bool write(const std::string &name, HTTPCacheEntry &entry, uint32_t body);
+    static void drop(const std::string &name);
+    static void touch(const std::string &name, Item &item);
+    static void evict();
+
+    static std::map<std::string, Item> index;
+    static uint32_t total;
+    static uint32_t tick;
+    static std::set<std::string> filling;   // names with a .tmp being written
+    static bool loaded;
+    static std::mutex lock;
+};
+
+#endif // MEATLOAF_NETWORK_HTTP_CACHE
@@ -0,0 +1,324 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// miniz is compiled in archive/gz.cpp
+#define MINIZ_NO_STDIO
+#define MINIZ_NO_ARCHIVE_APIS
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#define MINIZ_HEADER_FILE_ONLY
+#include "../../vdrive/miniz.h"
+
+#include "http_inflate.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+#include "../../../include/debug.h"
+
+#define GZ_ID1 0x1F
+#define GZ_ID2 0x8B
+#define GZ_DEFLATE 8
+
+// Header flags
+#define GZ_FHCRC    0x02
+#define GZ_FEXTRA   0x04
+#define GZ_FNAME    0x08
+#define GZ_FCOMMENT 0x10
+
+#define GZ_TRAILER_SIZE 8
+
+struct HTTPInflateState {
+    uint32_t dict_ofs;          // next write position in dict
+    tinfl_decompressor inflator;
+    uint8_t dict[TINFL_LZ_DICT_SIZE];
+};
+
+
+/********************************************************
+ * Utility Functions
+ ********************************************************/
+
+HTTPInflater::Encoding HTTPInflater::encoding(std::string value)
+{
+    // Only one coding is ever applied to what we ask for
+    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t") + 1);
+
+    if ( value.empty() || value == "identity" )
+        return IDENTITY;
+    if ( value == "gzip" || value == "x-gzip" )
+        return GZIP;
+    if ( value == "deflate" )
+        return DEFLATE;
+
+    return UNSUPPORTED;
+}
+
+
+/********************************************************
+ * Inflater
+ ********************************************************/
+
+HTTPInflater::HTTPInflater(Encoding encoding, Source source)
+{
+    m_encoding = encoding;
+    m_source = source;
+}
+
+HTTPInflater::~HTTPInflater()
+{
+    free(m_state);
+}
+
+uint32_t HTTPInflater::read(uint8_t *buf, uint32_t size)
+{
+    if ( !m_started )
+    {
+        m_started = true;
+
+        m_in.reset(new uint8_t[HTTP_INFLATE_INPUT_SIZE]);
+#if defined(ESP_PLATFORM) && defined(BOARD_HAS_PSRAM)
+        m_state = (HTTPInflateState *)heap_caps_malloc(sizeof(HTTPInflateState), MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+#endif
+        if ( m_state == nullptr )
+            m_state = (HTTPInflateState *)malloc(sizeof(HTTPInflateState));
+        if ( m_state == nullptr )
+        {
+            fail("out of memory");
+            return 0;
+        }
+
+        tinfl_init(&m_state->inflator);
+        m_state->dict_ofs = 0;
+        m_crc = MZ_CRC32_INIT;
+
+        if ( !readHeader() )
+            return 0;
+    }
+
+    uint32_t copied = 0;
+    while ( copied < size )
+    {
+        if ( m_pending > 0 )
+        {
+            uint32_t length = std::min(size - copied, m_pending);
+            memcpy(buf + copied, m_state->dict + m_pendingOffset, length);
+            m_pendingOffset += length;
+            m_pending -= length;
+            copied += length;
+            continue;
+        }
+
+        if ( m_done || !inflate() )
+            break;
+    }
+
+    return copied;
+}
+
+bool HTTPInflater::refill()
+{
+    if ( m_eof )
+        return false;
+
+    int32_t bytes = m_source(m_in.get(), HTTP_INFLATE_INPUT_SIZE);
+    if ( bytes <= 0 )
+    {
+        m_eof = true;
+        if ( bytes < 0 )
+            fail("source error");
+        return false;
+    }
+
+    m_inOffset = 0;
+    m_inAvailable = bytes;
+    m_consumed += bytes;
+    return true;
+}
+
+bool HTTPInflater::next(uint8_t &byte)
+{
+    if ( m_inAvailable == 0 && !refill() )
+        return false;
+
+    byte = m_in[m_inOffset++];
+    m_inAvailable--;
+    return true;
+}
+
+bool HTTPInflater::readHeader()
+{
+    if ( m_encoding == DEFLATE )
+    {
+        // zlib wrapped: CM 8 and a header that checks out mod 31
+        if ( m_inAvailable < 2 && !refill() )
+        {
+            fail("empty body");
+            return false;
+        }
+
+        uint8_t cmf = m_in[m_inOffset];
+        uint8_t flg = (m_inAvailable > 1) ? m_in[m_inOffset + 1] : 0;
+        if ( (cmf & 0x0F) == 8 && ((cmf << 8) | flg) % 31 == 0 )
+            m_flags = TINFL_FLAG_PARSE_ZLIB_HEADER;
+
+        return true;
+    }
+
+    if ( m_encoding != GZIP )
+    {
+        fail("unsupported encoding");
+        return false;
+    }
+
+    uint8_t header[10];
+    for ( auto &b : header )
+    {
+        if ( !next(b) )
+        {
+            fail("short gzip header");
+            return false;
+        }
+    }
+
+    if ( header[0] != GZ_ID1 || header[1] != GZ_ID2 || header[2] != GZ_DEFLATE )
+    {
+        fail("not gzip");
+        return false;
+    }
+
+    uint8_t flags = header[3];
+    uint8_t b, b2;
+    bool ok = true;
+
+    if ( flags & GZ_FEXTRA )
+    {
+        ok = next(b) && next(b2);
+        for ( uint16_t length = b | (b2 << 8); ok && length > 0; length-- )
+            ok = next(b);
+    }
+
+    if ( ok && (flags & GZ_FNAME) )
+        while ( (ok = next(b)) && b != 0x00 );
+
+    if ( ok && (flags & GZ_FCOMMENT) )
+        while ( (ok = next(b)) && b != 0x00 );
+
+    if ( ok && (flags & GZ_FHCRC) )
+        ok = next(b) && next(b2);
+
+    if ( !ok )
+        fail("short gzip header");
+
+    return ok;
+}
+
+bool HTTPInflater::readTrailer()
+{
+    // tinfl reads ahead, the first bytes of the trailer may already be in its bit buffer
+    tinfl_decompressor &r = m_state->inflator;
+    uint32_t bits = r.m_num_bits - (r.m_num_bits & 7);
+    tinfl_bit_buf_t ahead = r.m_bit_buf >> (r.m_num_bits & 7);
+
+    uint8_t trailer[GZ_TRAILER_SIZE];
+    for ( auto &b : trailer )
+    {
+        if ( bits >= 8 )
+        {
+            b = ahead & 0xFF;
+            ahead >>= 8;
+            bits -= 8;
+        }
+        else if ( !next(b) )
+        {
+            fail("short gzip trailer");
+            return false;
+        }
+    }
+
+    uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+    uint32_t isize = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+    if ( crc != m_crc || isize != m_produced )
+    {
+        fail("gzip trailer mismatch");
+        return false;
+    }
+
+    return true;
+}
+
+bool HTTPInflater::inflate()
+{
+    if ( m_inAvailable == 0 )
+        refill();
+
+    if ( m_failed )
+        return false;
+
+    // Always "more input": without it tinfl pads a short body with zeros
+    // instead of stopping, the end of the body is caught below
+    uint32_t flags = m_flags | TINFL_FLAG_HAS_MORE_INPUT;
+    size_t in_bytes = m_inAvailable;
+    size_t out_bytes = TINFL_LZ_DICT_SIZE - m_state->dict_ofs;
+    tinfl_status status = tinfl_decompress(&m_state->inflator,
+                                           m_in.get() + m_inOffset, &in_bytes,
+                                           m_state->dict, m_state->dict + m_state->dict_ofs, &out_bytes,
+                                           flags);
+
+    m_inOffset += in_bytes;
+    m_inAvailable -= in_bytes;
+
+    m_pendingOffset = m_state->dict_ofs;
+    m_pending = out_bytes;
+    m_produced += out_bytes;
+    if ( m_encoding == GZIP )
+        m_crc = mz_crc32(m_crc, m_state->dict + m_state->dict_ofs, out_bytes);
+    m_state->dict_ofs = (m_state->dict_ofs + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+    if ( status == TINFL_STATUS_DONE )
+    {
+        m_done = true;
+        if ( m_encoding == GZIP && !readTrailer() )
+            return false;
+    }
+    else if ( status < 0 )
+    {
+        fail("bad deflate data");
+        return false;
+    }
+    else if ( status == TINFL_STATUS_NEEDS_MORE_INPUT && m_eof )
+    {
+        fail("body ends early");
+        return false;
+    }
+
+    return true;
+}
+
+void HTTPInflater::fail(const char *reason)
+{
+    Debug_printv("inflate failed [%s] in[%lu] out[%lu]", reason, m_consumed, m_produced);
+    m_failed = true;
+    m_done = true;
+    m_pending = 0;
+}
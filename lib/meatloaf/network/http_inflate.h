@@ -0,0 +1,96 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// HTTP Content-Encoding - gzip and deflate response bodies
+//
+// https://www.rfc-editor.org/rfc/rfc9110#name-content-codings
+//
+// The body is inflated with miniz's tinfl as it is read, through a 32KB
+// wrapping dictionary, so a response is never held in memory whole. gzip
+// bodies are checked against their CRC32 and size trailer, zlib wrapped
+// deflate bodies against their Adler-32. "deflate" is supposed to be zlib
+// wrapped but some servers send it raw, both are accepted.
+//
+
+#ifndef MEATLOAF_NETWORK_HTTP_INFLATE
+#define MEATLOAF_NETWORK_HTTP_INFLATE
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#define HTTP_INFLATE_INPUT_SIZE 1024
+#define HTTP_INFLATE_ACCEPT "gzip, deflate"
+
+// Inflate state + dictionary, defined in http_inflate.cpp next to miniz
+struct HTTPInflateState;
+
+class HTTPInflater {
+public:
+    enum Encoding { IDENTITY, GZIP, DEFLATE, UNSUPPORTED };
+
+    // Content-Encoding header value to Encoding
+    static Encoding encoding(std::string value);
+
+    // Read up to size bytes of the encoded body, 0 at its end, -1 on error
+    typedef std::function<int32_t(uint8_t *buf, uint32_t size)> Source;
+
+    HTTPInflater(Encoding encoding, Source source);
+    ~HTTPInflater();
+
+    // Copy out inflated bytes, less than size at the end of the body or on error
+    uint32_t read(uint8_t *buf, uint32_t size);
+
+    bool done() { return m_done; }
+    bool failed() { return m_failed; }
+
+    uint32_t consumed() { return m_consumed; }  // encoded bytes taken from the source
+    uint32_t produced() { return m_produced; }  // inflated bytes
+
+private:
+    bool next(uint8_t &byte);
+    bool refill();
+    bool readHeader();
+    bool readTrailer();
+    bool inflate();
+    void fail(const char *reason);
+
+    Encoding m_encoding;
+    Source m_source;
+    HTTPInflateState *m_state = nullptr;
+
+    std::unique_ptr<uint8_t[]> m_in;
+    uint32_t m_inOffset = 0;
+    uint32_t m_inAvailable = 0;
+    bool m_eof = false;
+
+    uint32_t m_flags = 0;
+    bool m_started = false;
+    bool m_done = false;
+    bool m_failed = false;
+
+    // Inflated, not yet read, at m_pendingOffset in the dictionary
+    uint32_t m_pendingOffset = 0;
+    uint32_t m_pending = 0;
+
+    uint32_t m_crc = 0;
+    uint32_t m_consumed = 0;
+    uint32_t m_produced = 0;
+};
+
+#endif /* MEATLOAF_NETWORK_HTTP_INFLATE */
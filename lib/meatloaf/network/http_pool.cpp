@@ -0,0 +1,51 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "http_pool.h"
+
+#include "peoples_url_parser.h"
+
+#include "../../../include/debug.h"
+
+// Only handles from esp_http_client_init() share connections with each other
+#define HTTP_POOL_CLIENT "MeatHttpClient"
+
+std::string HTTPConnectionPool::key(const std::string &url)
+{
+    auto u = PeoplesUrlParser::parseURL(url);
+    return fnConnectionPool::key(HTTP_POOL_CLIENT, u->scheme, u->user, u->host, u->getPort());
+}
+
+void HTTPConnectionPool::cleanup(void *client)
+{
+    esp_http_client_close((esp_http_client_handle_t)client);
+    esp_http_client_cleanup((esp_http_client_handle_t)client);
+}
+
+esp_http_client_handle_t HTTPConnectionPool::acquire(const std::string &url)
+{
+    return (esp_http_client_handle_t)fnConnectionPool::acquire(key(url));
+}
+
+void HTTPConnectionPool::release(const std::string &url, esp_http_client_handle_t client)
+{
+    esp_http_client_set_user_data(client, nullptr);
+
+    // esp_http_client doesn't give out its socket, a connection the server
+    // dropped while parked shows up as a failed request (and a retry)
+    fnConnectionPool::release(key(url), client, cleanup);
+}
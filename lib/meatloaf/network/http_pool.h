@@ -0,0 +1,50 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// HTTP keep-alive connection pool
+//
+// Every HTTPMFile used to open its own esp_http_client and throw it away
+// on close, so listing a directory and then loading a file from the same
+// server paid for a new TCP connect (and TLS handshake) each time. When a
+// MeatHttpClient is closed with its response fully read, the connected
+// client handle is parked in the process wide fnConnectionPool instead,
+// and the next client for that host picks it up.
+//
+
+#ifndef MEATLOAF_NETWORK_HTTP_POOL
+#define MEATLOAF_NETWORK_HTTP_POOL
+
+#include <esp_http_client.h>
+
+#include <string>
+
+#include "fnConnectionPool.h"
+
+class HTTPConnectionPool {
+public:
+    // Idle connected client for the host of url, or nullptr
+    static esp_http_client_handle_t acquire(const std::string &url);
+
+    // Park client for reuse, it is cleaned up if the pool is full
+    static void release(const std::string &url, esp_http_client_handle_t client);
+
+private:
+    static std::string key(const std::string &url);
+    static void cleanup(void *client);
+};
+
+#endif // MEATLOAF_NETWORK_HTTP_POOL
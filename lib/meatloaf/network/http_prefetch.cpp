@@ -0,0 +1,250 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "http_prefetch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#include "../../../include/debug.h"
+
+HTTPPrefetcher::HTTPPrefetcher(Fetcher fetcher, uint32_t position, uint32_t size, uint8_t workers, uint32_t chunk)
+{
+    m_fetcher = fetcher;
+    m_size = size;
+    m_chunk = chunk;
+    m_workers = std::min(workers, (uint8_t)HTTP_PREFETCH_WORKERS);
+
+    m_position = position;
+    m_firstChunk = position / chunk;
+    m_readChunk = m_firstChunk;
+    m_nextChunk = m_firstChunk;
+}
+
+HTTPPrefetcher::~HTTPPrefetcher()
+{
+    stop();
+
+    for (auto &slot : m_slots)
+        free(slot.data);
+}
+
+bool HTTPPrefetcher::start()
+{
+    for (auto &slot : m_slots)
+    {
+        if (slot.data != nullptr)
+            continue;
+
+#if defined(ESP_PLATFORM) && defined(BOARD_HAS_PSRAM)
+        slot.data = (uint8_t *)heap_caps_malloc(m_chunk, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+#endif
+        if (slot.data == nullptr)
+            slot.data = (uint8_t *)malloc(m_chunk);
+        if (slot.data == nullptr)
+        {
+            Debug_printv("Out of memory for read-ahead");
+            return false;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_stop = false;
+
+    for (uint8_t i = 0; i < m_workers; i++)
+    {
+        m_args[i] = { this, i };
+
+#ifdef ESP_PLATFORM
+#if CONFIG_FREERTOS_UNICORE
+        BaseType_t rc = xTaskCreate(task, "ml_prefetch", HTTP_PREFETCH_STACKSIZE, &m_args[i], HTTP_PREFETCH_PRIORITY, NULL);
+#else
+        BaseType_t rc = xTaskCreatePinnedToCore(task, "ml_prefetch", HTTP_PREFETCH_STACKSIZE, &m_args[i], HTTP_PREFETCH_PRIORITY, NULL, HTTP_PREFETCH_CPUAFFINITY);
+#endif
+        if (rc != pdPASS)
+        {
+            Debug_printv("Unable to start prefetch task[%d]", i);
+            break;
+        }
+#else
+        m_threads[i] = std::thread(task, &m_args[i]);
+#endif
+        m_running++;
+    }
+
+    return (m_running > 0);
+}
+
+void HTTPPrefetcher::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_stop = true;
+        m_changed.notify_all();
+
+        // Workers finish the request they are in, wait for them before the slots go away
+        while (m_running > 0)
+            m_changed.wait(lock);
+    }
+
+#ifndef ESP_PLATFORM
+    for (auto &thread : m_threads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+#endif
+}
+
+void HTTPPrefetcher::task(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    worker->owner->run(worker->index);
+
+#ifdef ESP_PLATFORM
+    vTaskDelete(NULL);
+#endif
+}
+
+void HTTPPrefetcher::run(uint8_t worker)
+{
+    while (true)
+    {
+        Slot *slot;
+        uint32_t chunk;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_changed.wait(lock, [&]() {
+                if (m_stop || m_failed || m_nextChunk >= chunks())
+                    return true;
+
+                // Inside the window and the slot was drained by the reader
+                return (m_nextChunk < m_readChunk + m_window && m_slots[m_nextChunk % HTTP_PREFETCH_SLOTS].state == SLOT_FREE);
+            });
+
+            if (m_stop || m_failed || m_nextChunk >= chunks())
+                break;
+
+            chunk = m_nextChunk++;
+            slot = &m_slots[chunk % HTTP_PREFETCH_SLOTS];
+            slot->chunk = chunk;
+            slot->state = SLOT_FETCHING;
+        }
+
+        uint32_t offset = chunk * m_chunk;
+        uint32_t length = std::min(m_chunk, m_size - offset);
+
+        auto started = std::chrono::steady_clock::now();
+        int32_t bytes = m_fetcher(worker, offset, slot->data, length);
+        uint32_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (bytes != (int32_t)length)
+        {
+            Debug_printv("worker[%d] chunk[%lu] fetched[%ld] of [%lu]", worker, chunk, bytes, length);
+            m_failed = true;
+        }
+        else
+        {
+            slot->length = length;
+            slot->state = SLOT_READY;
+
+            ms = std::max(ms, (uint32_t)1);
+            uint32_t bandwidth = (uint64_t)length * 1000 / ms;
+            m_latency = m_latency ? ((m_latency * 3) + ms) / 4 : ms;
+            m_bandwidth = m_bandwidth ? ((m_bandwidth * 3) + bandwidth) / 4 : bandwidth;
+        }
+        m_changed.notify_all();
+    }
+
+    // Notify while holding the lock, the owner may free us as soon as it's released
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_running--;
+    m_changed.notify_all();
+}
+
+uint32_t HTTPPrefetcher::read(uint8_t *buf, uint32_t size)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    uint32_t copied = 0;
+    bool stalled = false;
+    while (copied < size && m_position < m_size)
+    {
+        uint32_t chunk = m_position / m_chunk;
+        Slot &slot = m_slots[chunk % HTTP_PREFETCH_SLOTS];
+        auto ready = [&]() { return (slot.state == SLOT_READY && slot.chunk == chunk); };
+
+        if (!ready())
+        {
+            // Waiting on the network, the window doesn't cover the fetch latency.
+            // The very first chunk always has to be waited for, don't count it.
+            if (chunk != m_firstChunk && m_window < HTTP_PREFETCH_SLOTS)
+            {
+                m_window++;
+                m_changed.notify_all();
+            }
+            stalled = true;
+
+            m_changed.wait(lock, [&]() { return ready() || m_failed || m_running == 0; });
+            if (!ready())
+                break;
+        }
+
+        // The slot is ours until it is freed, copy without holding the lock
+        uint32_t offset = m_position - (chunk * m_chunk);
+        uint32_t length = std::min(size - copied, slot.length - offset);
+        lock.unlock();
+        memcpy(buf + copied, slot.data + offset, length);
+        lock.lock();
+
+        copied += length;
+        m_position += length;
+
+        if (offset + length == slot.length)
+        {
+            slot.state = SLOT_FREE;
+            m_readChunk = chunk + 1;
+
+            // Everything in the window is already here (bar the slot just freed),
+            // the reader is the slow side. Not right after a stall though, the
+            // chunks requested together then all land together.
+            if (!stalled && m_window > HTTP_PREFETCH_WINDOW_MIN && m_readChunk + m_window < chunks())
+            {
+                bool full = true;
+                for (uint32_t i = m_readChunk; i < m_readChunk + m_window - 1 && full; i++)
+                    full = (m_slots[i % HTTP_PREFETCH_SLOTS].state == SLOT_READY && m_slots[i % HTTP_PREFETCH_SLOTS].chunk == i);
+
+                if (full)
+                    m_window--;
+            }
+            stalled = false;
+
+            m_changed.notify_all();
+        }
+    }
+
+    return copied;
+}
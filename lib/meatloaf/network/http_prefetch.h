@@ -0,0 +1,130 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// HTTP read-ahead for sequential loads
+//
+// A LOAD over HTTP used to be request, wait, read, request. Once a stream
+// is read sequentially, a few workers (each with its own connection)
+// fetch the next chunks with Range requests while the bus side drains
+// the current one. Chunks land in a small ring indexed by chunk number,
+// so they are handed to the reader in order whichever worker finishes
+// first.
+//
+// The number of chunks requested ahead of the reader (the window) adapts:
+// when the reader has to wait for a chunk the fetch latency isn't hidden
+// and the window grows, when the whole window is already fetched the link
+// is faster than the reader and it shrinks, freeing connections.
+//
+// On non ESP builds the workers are std::threads so it can be unit tested.
+//
+
+#ifndef MEATLOAF_NETWORK_HTTP_PREFETCH
+#define MEATLOAF_NETWORK_HTTP_PREFETCH
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#ifndef ESP_PLATFORM
+#include <thread>
+#endif
+
+#include "http_blocks.h"
+
+#define HTTP_PREFETCH_WORKERS    3
+#define HTTP_PREFETCH_SLOTS      4
+#define HTTP_PREFETCH_WINDOW_MIN 2
+#define HTTP_PREFETCH_CHUNK_SIZE HTTP_CACHE_BLOCK_SIZE
+
+#define HTTP_PREFETCH_STACKSIZE   8192
+#define HTTP_PREFETCH_PRIORITY    5
+#define HTTP_PREFETCH_CPUAFFINITY 0
+
+class HTTPPrefetcher {
+public:
+    // Fetch length bytes at offset on worker's own connection, returns the count or -1
+    typedef std::function<int32_t(uint8_t worker, uint32_t offset, uint8_t *buf, uint32_t length)> Fetcher;
+
+    HTTPPrefetcher(Fetcher fetcher, uint32_t position, uint32_t size,
+                   uint8_t workers = HTTP_PREFETCH_WORKERS, uint32_t chunk = HTTP_PREFETCH_CHUNK_SIZE);
+    ~HTTPPrefetcher();
+
+    bool start();
+    void stop();
+
+    // Copy from the read position, waits for chunks still being fetched.
+    // Returns less than size at the end of the data or on error.
+    uint32_t read(uint8_t *buf, uint32_t size);
+
+    uint32_t position() { return m_position; }
+    bool failed() { return m_failed; }
+    uint8_t window() { return m_window; }
+
+    // Measured per chunk, for the debug log
+    uint32_t latency() { return m_latency; }       // ms
+    uint32_t bandwidth() { return m_bandwidth; }   // bytes/s
+
+private:
+    enum SlotState : uint8_t { SLOT_FREE, SLOT_FETCHING, SLOT_READY };
+
+    struct Slot {
+        uint32_t chunk = 0;
+        uint32_t length = 0;
+        SlotState state = SLOT_FREE;
+        uint8_t *data = nullptr;
+    };
+
+    struct Worker {
+        HTTPPrefetcher *owner;
+        uint8_t index;
+    };
+
+    static void task(void *arg);
+    void run(uint8_t worker);
+    uint32_t chunks() { return (m_size + m_chunk - 1) / m_chunk; }
+
+    Fetcher m_fetcher;
+    uint32_t m_size;
+    uint32_t m_chunk;
+    uint8_t m_workers;
+
+    uint32_t m_position;
+    uint32_t m_firstChunk;
+    uint32_t m_nextChunk;       // next chunk a worker will request
+    uint32_t m_readChunk;       // chunk the reader is in
+    uint8_t m_window = HTTP_PREFETCH_WINDOW_MIN;
+
+    Slot m_slots[HTTP_PREFETCH_SLOTS];
+    Worker m_args[HTTP_PREFETCH_WORKERS];
+
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+
+    uint8_t m_running = 0;
+    bool m_stop = false;
+    bool m_failed = false;
+
+    uint32_t m_latency = 0;
+    uint32_t m_bandwidth = 0;
+
+#ifndef ESP_PLATFORM
+    std::thread m_threads[HTTP_PREFETCH_WORKERS];
+#endif
+};
+
+#endif // MEATLOAF_NETWORK_HTTP_PREFETCH
@@ -17,23 +17,254 @@
 
 #include "ipfs.h"
 
+#include <cJSON.h>
+
 #include "../../../include/global_defines.h"
 #include "../../../include/debug.h"
 
 
+/********************************************************
+ * File impls
+ ********************************************************/
+
 MStream* IPFSMFile::getSourceStream(std::ios_base::openmode mode) {
     // has to return OPENED stream
     //Debug_printv("[%s]", url.c_str());
-    MStream* istream = new IPFSMStream(url);
+    MStream* istream = new IPFSMStream(url, cacheKey());
     istream->open(mode);   
     return istream;
 }; 
 
+std::string IPFSMFile::cacheKey() {
+    std::string key = path;
+    if ( mstr::startsWith(key, "/ipfs/") )
+        key = key.substr(6);
+
+    mstr::replaceAll(key, "//", "/");
+    while ( key.size() && key.back() == '/' )
+        key.pop_back();
+
+    return key;
+}
+
+bool IPFSMFile::rewindDirectory() {
+    m_entries.clear();
+    m_entry = 0;
+    m_listed = false;
+
+    if ( !isDirectory() )
+        return false;
+
+    m_listed = readListing();
+    return m_listed;
+}
+
+MFile* IPFSMFile::getNextFileInDir() {
+    if ( !m_listed && !rewindDirectory() )
+        return nullptr;
+
+    if ( m_entry >= m_entries.size() )
+    {
+        m_entries.clear();
+        m_listed = false;
+        return nullptr;
+    }
+
+    IPFSDirEntry &entry = m_entries[m_entry++];
+    auto file = new IPFSMFile("ipfs://" + cacheKey() + "/" + entry.name);
+    file->extension = " " + file->extension;
+    file->size = entry.isDir ? 0 : entry.size;
+
+    return file;
+}
+
+bool IPFSMFile::readListing() {
+    std::string key = cacheKey();
+    if ( IPFSCache::loadListing(key, m_entries) )
+    {
+        //Debug_printv("cached listing key[%s] entries[%d]", key.c_str(), m_entries.size());
+        return true;
+    }
+
+    // The gateway's ls gives names, sizes and types in one request
+    MeatHttpClient http;
+    if ( !http.GET(IPFS_GATEWAY "/api/v0/ls?arg=" + mstr::urlEncode(key)) )
+        return false;
+
+    std::string body;
+    uint8_t buf[512];
+    while ( body.size() < IPFS_LISTING_MAX_SIZE && (http._size == 0 || body.size() < http._size) )
+    {
+        uint32_t bytes = http.read(buf, sizeof(buf));
+        if ( bytes == 0 )
+            break;
+        body.append((char *)buf, bytes);
+    }
+    http.close();
+
+    // {"Objects":[{"Hash":"Qm...","Links":[{"Name":"...","Hash":"...","Size":123,"Type":2}]}]}
+    cJSON *json = cJSON_Parse(body.c_str());
+    cJSON *objects = cJSON_GetObjectItem(json, "Objects");
+    cJSON *links = cJSON_GetObjectItem(cJSON_GetArrayItem(objects, 0), "Links");
+    if ( !cJSON_IsArray(links) )
+    {
+        Debug_printv("no listing key[%s]", key.c_str());
+        cJSON_Delete(json);
+        return false;
+    }
+
+    cJSON *link;
+    cJSON_ArrayForEach(link, links)
+    {
+        cJSON *name = cJSON_GetObjectItem(link, "Name");
+        cJSON *size = cJSON_GetObjectItem(link, "Size");
+        cJSON *type = cJSON_GetObjectItem(link, "Type");
+        if ( !cJSON_IsString(name) )
+            continue;
+
+        IPFSDirEntry entry;
+        entry.name = name->valuestring;
+        entry.size = cJSON_IsNumber(size) ? (uint32_t)size->valuedouble : 0;
+        entry.isDir = cJSON_IsNumber(type) && (type->valueint == 1);
+        m_entries.push_back(entry);
+    }
+    cJSON_Delete(json);
+
+    Debug_printv("key[%s] entries[%d]", key.c_str(), m_entries.size());
+    IPFSCache::storeListing(key, m_entries);
+    return true;
+}
+
+
+/********************************************************
+ * Stream impls
+ ********************************************************/
 
 bool IPFSMStream::open(std::ios_base::openmode mode) {
-    return _http.GET(url);
+    // Read only, and nothing to ask the gateway if we've seen it before
+    if ( mode & std::ios_base::out )
+        return false;
+
+    if ( IPFSCache::open(m_key, m_object) )
+    {
+        // Missing blocks are fetched with Range requests later
+        _http.url = url;
+        _size = m_object.size;
+        _position = 0;
+        return true;
+    }
+
+    if ( !_http.GET(url) )
+        return false;
+
+    _size = ( _http._range_size > 0) ? _http._range_size : _http._size;
+    _position = 0;
+    if ( _http.wasRedirected )
+        url = _http.url;
+
+    // Without room on the card this is a plain HTTP stream
+    if ( !IPFSCache::create(m_key, _size, m_object) )
+        Debug_printv("not caching key[%s]", m_key.c_str());
+
+    return true;
 };
 
+void IPFSMStream::close() {
+    IPFSCache::close(m_object);
+    HTTPMStream::close();
+}
+
+bool IPFSMStream::isOpen() {
+    return m_object.isOpen() || HTTPMStream::isOpen();
+}
+
 bool IPFSMStream::seek(uint32_t pos) {
+    if ( !m_object.isOpen() )
+        return HTTPMStream::seek(pos);
+
+    // Blocks are fetched when they're read
+    if ( pos > _size )
+        return false;
+
+    _position = pos;
+    return true;
+}
+
+uint32_t IPFSMStream::read(uint8_t* buf, uint32_t size) {
+    if ( !m_object.isOpen() )
+        return HTTPMStream::read(buf, size);
+
+    if ( size > available() )
+        size = available();
+
+    uint32_t bytesRead = 0;
+    while ( size > 0 )
+    {
+        uint32_t block = _position / IPFS_CACHE_BLOCK_SIZE;
+        uint32_t offset = _position % IPFS_CACHE_BLOCK_SIZE;
+
+        uint32_t count = 0;
+        if ( m_blockNumber == (int32_t)block )
+        {
+            uint32_t length = std::min((uint32_t)IPFS_CACHE_BLOCK_SIZE, _size - (block * IPFS_CACHE_BLOCK_SIZE));
+            count = std::min(size, length - offset);
+            memcpy(buf, m_block.get() + offset, count);
+        }
+        else
+        {
+            count = IPFSCache::read(m_object, block, offset, buf, size);
+        }
+
+        if ( count == 0 )
+        {
+            if ( !fetchBlock(block) )
+                break;
+            continue;
+        }
+
+        buf += count;
+        size -= count;
+        bytesRead += count;
+        _position += count;
+    }
+
+    return bytesRead;
+}
+
+bool IPFSMStream::fetchBlock(uint32_t block) {
+    uint32_t start = block * IPFS_CACHE_BLOCK_SIZE;
+    uint32_t length = std::min((uint32_t)IPFS_CACHE_BLOCK_SIZE, _size - start);
+
+    if ( m_block == nullptr )
+        m_block.reset(new uint8_t[IPFS_CACHE_BLOCK_SIZE]);
+    m_blockNumber = -1;
+
+    // Carry on with the response from open() if it is right there,
+    // otherwise ask the gateway for just this block
+    int32_t filled = -1;
+    if ( !_http._is_open || _http._position != start )
+        filled = _http.readRange(start, m_block.get(), length);
+
+    if ( filled < 0 && (_http._position == start || _http.seek(start)) )
+    {
+        filled = 0;
+        while ( filled < (int32_t)length )
+        {
+            uint32_t bytes = _http.read(m_block.get() + filled, length - filled);
+            if ( bytes == 0 )
+                break;
+            filled += bytes;
+        }
+    }
+
+    if ( filled < (int32_t)length )
+    {
+        Debug_printv("Short block[%lu] filled[%ld] length[%lu] key[%s]", block, filled, length, m_key.c_str());
+        _error = 1;
+        return false;
+    }
+
+    m_blockNumber = block;
+    IPFSCache::write(m_object, block, m_block.get(), length);
     return true;
-}
\ No newline at end of file
+}
@@ -54,6 +54,9 @@
 // NumLinks = 0, it is a file
 // DataSize = {file_size} + 10 bytes
 //
+// Anything below a CID never changes, what we fetch is kept on the SD
+// card in IPFSCache (see ipfs_cache.h) and never revalidated.
+//
 // https://github.com/ipfs/kubo/issues/8528
 //
 // IPFS HEAD to determine DIR or FILE
@@ -76,7 +79,11 @@
 #ifndef MEATLOAF_SCHEME_IPFS
 #define MEATLOAF_SCHEME_IPFS
 
+#define IPFS_GATEWAY            "https://ipfs.io"
+#define IPFS_LISTING_MAX_SIZE   (64 * 1024)     // ls response we're willing to hold
+
 #include "network/http.h"
+#include "network/ipfs_cache.h"
 
 #include "../../../include/debug.h"
 
@@ -92,13 +99,26 @@ class IPFSMFile: public HTTPMFile {
 public:
     IPFSMFile(std::string path): HTTPMFile(path) {
         //this->url = "https://dweb.link/ipfs/" + this->host + "/" + this->path;
-        this->url = "https://ipfs.io/ipfs/" + this->host + "/" + this->path;
+        this->url = IPFS_GATEWAY "/ipfs/" + this->host + "/" + this->path;
         resetURL(this->url);
         Debug_printv("url[%s]", this->url.c_str());
     };
     ~IPFSMFile() {};
 
     MStream* getSourceStream(std::ios_base::openmode mode=std::ios_base::in) override; // file on IPFS server = standard HTTP file available via GET
+
+    bool rewindDirectory() override;
+    MFile* getNextFileInDir() override;
+
+    // Root CID and the path below it
+    std::string cacheKey();
+
+private:
+    bool readListing();
+
+    std::vector<IPFSDirEntry> m_entries;
+    size_t m_entry = 0;
+    bool m_listed = false;
 };
 
 
@@ -109,11 +129,29 @@ public:
 class IPFSMStream: public HTTPMStream {
 
 public:
-    IPFSMStream(std::string path) : HTTPMStream(path) {};
-    ~IPFSMStream() {};
+    IPFSMStream(std::string path, std::string key) : HTTPMStream(path) {
+        m_key = key;
+    };
+    ~IPFSMStream() {
+        close();
+    };
 
+    bool isOpen() override;
     bool open(std::ios_base::openmode mode) override;
+    void close() override;
+
+    uint32_t read(uint8_t* buf, uint32_t size) override;
     bool seek(uint32_t pos) override;
+
+private:
+    bool fetchBlock(uint32_t block);
+
+    std::string m_key;
+    IPFSCacheObject m_object;
+
+    // Last block fetched, in case the card couldn't take it
+    std::unique_ptr<uint8_t[]> m_block;
+    int32_t m_blockNumber = -1;
 };
 
 
@@ -0,0 +1,504 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ipfs_cache.h"
+
+#include <dirent.h>
+#include <cstring>
+#include <ctime>
+
+#include "fnFsSD.h"
+
+#include "../../../include/debug.h"
+
+#define IPFS_CACHE_VERSION 1
+
+struct IPFSCacheRecord {
+    char magic[4];          // "MLIP"
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t key;           // key follows, then the block bitmap
+    uint32_t size;
+    uint32_t used;
+};
+
+std::map<std::string, IPFSCache::Item> IPFSCache::index;
+std::set<std::string> IPFSCache::pins;
+uint32_t IPFSCache::total = 0;
+bool IPFSCache::loaded = false;
+std::mutex IPFSCache::lock;
+
+std::string IPFSCache::name(const std::string &key)
+{
+    // FNV-1a, same as the HTTP cache
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return hex;
+}
+
+std::string IPFSCache::path(const std::string &name, const char *ext)
+{
+    return std::string(IPFS_CACHE_DIR "/") + name + ext;
+}
+
+std::string IPFSCache::root(const std::string &key)
+{
+    return key.substr(0, key.find('/'));
+}
+
+bool IPFSCache::ready()
+{
+    if (!fnSDFAT.running())
+        return false;
+
+    if (!loaded)
+        load();
+
+    return true;
+}
+
+void IPFSCache::load()
+{
+    loaded = true;
+    fnSDFAT.create_path(IPFS_CACHE_DIR);
+
+    FILE *f = fnSDFAT.file_open(IPFS_CACHE_PINS, "r");
+    if (f != nullptr)
+    {
+        char line[128];
+        while (fgets(line, sizeof(line), f) != nullptr)
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] != '\0')
+                pins.insert(line);
+        }
+        fclose(f);
+    }
+
+    std::string dir = std::string(fnSDFAT.basepath()) + IPFS_CACHE_DIR;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr)
+        return;
+
+    struct dirent *e;
+    while ((e = readdir(d)) != nullptr)
+    {
+        std::string file = e->d_name;
+        if (file.size() != 20)
+            continue;
+
+        std::string ext = file.substr(16);
+        f = fnSDFAT.file_open(path(file.substr(0, 16), ext.c_str()).c_str(), "rb");
+        if (f == nullptr)
+            continue;
+
+        Item item = { "", 0, 0, 0 };
+        bool ok = false;
+        if (ext == ".ipm")
+        {
+            // Only the blocks on the card count
+            IPFSCacheRecord record;
+            ok = (fread(&record, sizeof(record), 1, f) == 1 && memcmp(record.magic, "MLIP", 4) == 0 && record.version == IPFS_CACHE_VERSION);
+            if (ok)
+            {
+                std::string key(record.key, '\0');
+                std::vector<uint8_t> blocks((record.size + (IPFS_CACHE_BLOCK_SIZE * 8) - 1) / (IPFS_CACHE_BLOCK_SIZE * 8));
+                ok = (fread(&key[0], record.key, 1, f) == 1 && fread(blocks.data(), blocks.size(), 1, f) == 1);
+
+                item.root = root(key);
+                item.used = record.used;
+                for (uint8_t b : blocks)
+                    item.bytes += __builtin_popcount(b) * IPFS_CACHE_BLOCK_SIZE;
+            }
+        }
+        else if (ext == ".ipl")
+        {
+            char line[128];
+            ok = (fgets(line, sizeof(line), f) != nullptr);
+            line[strcspn(line, "\r\n")] = '\0';
+            fseek(f, 0, SEEK_END);
+
+            item.root = root(line);
+            item.bytes = ftell(f);
+            item.used = 0;
+        }
+        else
+        {
+            // Data files are accounted for by their record
+            fclose(f);
+            continue;
+        }
+        fclose(f);
+
+        if (!ok)
+        {
+            drop(file);
+            continue;
+        }
+
+        index[file] = item;
+        total += item.bytes;
+    }
+    closedir(d);
+
+    Debug_printv("entries[%d] bytes[%lu] pins[%d]", index.size(), total, pins.size());
+}
+
+bool IPFSCache::writeRecord(IPFSCacheObject &object)
+{
+    IPFSCacheRecord record = {};
+    memcpy(record.magic, "MLIP", 4);
+    record.version = IPFS_CACHE_VERSION;
+    record.key = object.key.size();
+    record.size = object.size;
+    record.used = time(nullptr);
+
+    FILE *f = fnSDFAT.file_open(path(object.name, ".ipm").c_str(), "wb");
+    if (f == nullptr)
+        return false;
+
+    bool ok = (fwrite(&record, sizeof(record), 1, f) == 1);
+    ok = ok && (fwrite(object.key.c_str(), object.key.size(), 1, f) == 1);
+    ok = ok && (fwrite(object.blocks.data(), object.blocks.size(), 1, f) == 1);
+    ok = (fclose(f) == 0) && ok;
+
+    return ok;
+}
+
+bool IPFSCache::open(const std::string &key, IPFSCacheObject &object)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return false;
+
+    std::string file = name(key);
+    auto item = index.find(file + ".ipm");
+    if (item == index.end() || item->second.users > 0)
+        return false;
+
+    FILE *f = fnSDFAT.file_open(path(file, ".ipm").c_str(), "rb");
+    if (f == nullptr)
+        return false;
+
+    IPFSCacheRecord record;
+    std::string stored;
+    bool ok = (fread(&record, sizeof(record), 1, f) == 1);
+    if (ok)
+    {
+        stored.resize(record.key);
+        object.blocks.assign((record.size + (IPFS_CACHE_BLOCK_SIZE * 8) - 1) / (IPFS_CACHE_BLOCK_SIZE * 8), 0);
+        ok = (fread(&stored[0], record.key, 1, f) == 1 && fread(object.blocks.data(), object.blocks.size(), 1, f) == 1);
+    }
+    fclose(f);
+
+    // Hash collision
+    if (ok && stored != key)
+        return false;
+
+    if (ok)
+        object.data = fnSDFAT.file_open(path(file, ".ipd").c_str(), "r+b");
+
+    if (object.data == nullptr)
+    {
+        drop(file + ".ipm");
+        return false;
+    }
+
+    object.key = key;
+    object.name = file;
+    object.size = record.size;
+    object.dirty = false;
+
+    item->second.users++;
+    item->second.used = time(nullptr);
+    return true;
+}
+
+bool IPFSCache::create(const std::string &key, uint32_t size, IPFSCacheObject &object)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready() || size == 0)
+        return false;
+
+    std::string file = name(key);
+    auto item = index.find(file + ".ipm");
+    if (item != index.end())
+    {
+        if (item->second.users > 0)
+            return false;
+        drop(file + ".ipm");
+    }
+
+    object.key = key;
+    object.name = file;
+    object.size = size;
+    object.blocks.assign((object.count() + 7) / 8, 0);
+    object.dirty = false;
+
+    // Record first, an empty bitmap is always true
+    if (!writeRecord(object))
+        return false;
+
+    object.data = fnSDFAT.file_open(path(file, ".ipd").c_str(), "w+b");
+    if (object.data == nullptr)
+    {
+        drop(file + ".ipm");
+        return false;
+    }
+
+    index[file + ".ipm"] = { root(key), 0, (uint32_t)time(nullptr), 1 };
+    evict();
+    return true;
+}
+
+uint32_t IPFSCache::read(IPFSCacheObject &object, uint32_t block, uint32_t offset, uint8_t *buf, uint32_t size)
+{
+    if (!object.isOpen() || !object.has(block))
+        return 0;
+
+    uint32_t start = block * IPFS_CACHE_BLOCK_SIZE;
+    uint32_t length = std::min((uint32_t)IPFS_CACHE_BLOCK_SIZE, object.size - start);
+    if (offset >= length)
+        return 0;
+
+    size = std::min(size, length - offset);
+    if (fseek(object.data, start + offset, SEEK_SET) != 0)
+        return 0;
+
+    return fread(buf, 1, size, object.data);
+}
+
+bool IPFSCache::write(IPFSCacheObject &object, uint32_t block, const uint8_t *data, uint32_t length)
+{
+    if (!object.isOpen() || block >= object.count())
+        return false;
+
+    if (object.has(block))
+        return true;
+
+    // FAT fills the gap before a block past the end with zeros
+    if (fseek(object.data, block * IPFS_CACHE_BLOCK_SIZE, SEEK_SET) != 0 || fwrite(data, 1, length, object.data) != length)
+    {
+        Debug_printv("write failed key[%s] block[%lu]", object.key.c_str(), block);
+        return false;
+    }
+
+    object.blocks[block / 8] |= (1 << (block % 8));
+    object.dirty = true;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto item = index.find(object.name + ".ipm");
+    if (item != index.end())
+    {
+        item->second.bytes += IPFS_CACHE_BLOCK_SIZE;
+        total += IPFS_CACHE_BLOCK_SIZE;
+    }
+    return true;
+}
+
+void IPFSCache::close(IPFSCacheObject &object)
+{
+    if (!object.isOpen())
+        return;
+
+    // Blocks reach the card before the bitmap that says they're there
+    bool ok = (fclose(object.data) == 0);
+    object.data = nullptr;
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (object.dirty && !(ok && writeRecord(object)))
+    {
+        Debug_printv("not cached key[%s]", object.key.c_str());
+        drop(object.name + ".ipm");
+        return;
+    }
+
+    auto item = index.find(object.name + ".ipm");
+    if (item != index.end() && item->second.users > 0)
+        item->second.users--;
+
+    evict();
+}
+
+bool IPFSCache::loadListing(const std::string &key, std::vector<IPFSDirEntry> &entries)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return false;
+
+    std::string file = name(key);
+    auto item = index.find(file + ".ipl");
+    if (item == index.end())
+        return false;
+
+    FILE *f = fnSDFAT.file_open(path(file, ".ipl").c_str(), "r");
+    if (f == nullptr)
+    {
+        drop(file + ".ipl");
+        return false;
+    }
+
+    // key, then a line per entry: d|f <tab> size <tab> name
+    char line[300];
+    bool ok = (fgets(line, sizeof(line), f) != nullptr);
+    line[strcspn(line, "\r\n")] = '\0';
+    ok = ok && (key == line);
+
+    entries.clear();
+    while (ok && fgets(line, sizeof(line), f) != nullptr)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *size = strchr(line, '\t');
+        char *name = size ? strchr(size + 1, '\t') : nullptr;
+        if (name == nullptr)
+            continue;
+
+        IPFSDirEntry entry;
+        entry.isDir = (line[0] == 'd');
+        entry.size = strtoul(size + 1, nullptr, 10);
+        entry.name = name + 1;
+        entries.push_back(entry);
+    }
+    fclose(f);
+
+    if (ok)
+        item->second.used = time(nullptr);
+    return ok;
+}
+
+void IPFSCache::storeListing(const std::string &key, const std::vector<IPFSDirEntry> &entries)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return;
+
+    std::string file = name(key);
+    FILE *f = fnSDFAT.file_open(path(file, ".ipl").c_str(), "w");
+    if (f == nullptr)
+        return;
+
+    bool ok = (fprintf(f, "%s\n", key.c_str()) > 0);
+    for (auto &entry : entries)
+        ok = ok && (fprintf(f, "%c\t%lu\t%s\n", entry.isDir ? 'd' : 'f', (unsigned long)entry.size, entry.name.c_str()) > 0);
+    long bytes = ftell(f);
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok)
+    {
+        drop(file + ".ipl");
+        return;
+    }
+
+    auto item = index.find(file + ".ipl");
+    if (item != index.end())
+        total -= item->second.bytes;
+    index[file + ".ipl"] = { root(key), (uint32_t)bytes, (uint32_t)time(nullptr), 0 };
+    total += bytes;
+
+    evict();
+}
+
+void IPFSCache::pin(const std::string &cid)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return;
+
+    if (pins.insert(root(cid)).second)
+        savePins();
+}
+
+void IPFSCache::unpin(const std::string &cid)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ready())
+        return;
+
+    if (pins.erase(root(cid)) > 0)
+    {
+        savePins();
+        evict();
+    }
+}
+
+bool IPFSCache::pinned(const std::string &key)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return pins.count(root(key)) > 0;
+}
+
+void IPFSCache::savePins()
+{
+    FILE *f = fnSDFAT.file_open(IPFS_CACHE_PINS, "w");
+    if (f == nullptr)
+        return;
+
+    for (auto &cid : pins)
+        fprintf(f, "%s\n", cid.c_str());
+    fclose(f);
+}
+
+void IPFSCache::drop(const std::string &file)
+{
+    std::string hash = file.substr(0, 16);
+    if (file.compare(16, 4, ".ipl") == 0)
+    {
+        fnSDFAT.remove(path(hash, ".ipl").c_str());
+    }
+    else
+    {
+        fnSDFAT.remove(path(hash, ".ipm").c_str());
+        fnSDFAT.remove(path(hash, ".ipd").c_str());
+    }
+
+    auto item = index.find(file);
+    if (item != index.end())
+    {
+        total -= item->second.bytes;
+        index.erase(item);
+    }
+}
+
+void IPFSCache::evict()
+{
+    while (total > IPFS_CACHE_QUOTA || index.size() > IPFS_CACHE_MAX_ENTRIES)
+    {
+        // Least recently used, never pinned or open ones
+        auto oldest = index.end();
+        for (auto i = index.begin(); i != index.end(); ++i)
+        {
+            if (i->second.users > 0 || pins.count(i->second.root))
+                continue;
+
+            if (oldest == index.end() || i->second.used < oldest->second.used)
+                oldest = i;
+        }
+
+        if (oldest == index.end())
+            break;
+
+        //Debug_printv("evicting [%s] bytes[%lu]", oldest->first.c_str(), oldest->second.bytes);
+        drop(oldest->first);
+    }
+}
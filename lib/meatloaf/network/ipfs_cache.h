@@ -0,0 +1,126 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// IPFS block cache on the SD card
+//
+// Content under an IPFS CID never changes, so whatever we fetched once
+// through a gateway can be kept and used without asking again. Objects
+// are keyed by root CID plus the path below it ("Qm.../0-9/elite.d64")
+// and kept in IPFS_CACHE_DIR, each under the hash of its key:
+//
+//   <hash>.ipm  - record below, the key, then a bitmap of blocks present
+//   <hash>.ipd  - the object, each block at its own offset
+//   <hash>.ipl  - a directory listing, key on the first line
+//
+// Blocks are IPFS_CACHE_BLOCK_SIZE bytes and filled by gateway Range
+// requests as they are read, so a disk image that is only partly used
+// only takes the blocks that were. The bitmap is written when the
+// object is closed, after its blocks are on the card.
+//
+// Least recently used objects go once the cache is over
+// IPFS_CACHE_QUOTA, except for those under a pinned root CID. Pins are
+// kept one CID per line in IPFS_CACHE_PINS.
+//
+
+#ifndef MEATLOAF_NETWORK_IPFS_CACHE
+#define MEATLOAF_NETWORK_IPFS_CACHE
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../../include/global_defines.h"
+
+#define IPFS_CACHE_DIR          SYSTEM_DIR "/cache/ipfs"
+#define IPFS_CACHE_PINS         IPFS_CACHE_DIR "/pins"
+#define IPFS_CACHE_BLOCK_SIZE   (16 * 1024)
+#define IPFS_CACHE_QUOTA        (32 * 1024 * 1024)
+#define IPFS_CACHE_MAX_ENTRIES  512
+
+struct IPFSDirEntry {
+    std::string name;
+    uint32_t size = 0;
+    bool isDir = false;
+};
+
+// An object opened for reading and filling, owned by one stream
+struct IPFSCacheObject {
+    std::string key;
+    std::string name;
+    uint32_t size = 0;
+    std::vector<uint8_t> blocks;    // bit per block on the card
+    FILE *data = nullptr;
+    bool dirty = false;
+
+    uint32_t count() { return (size + IPFS_CACHE_BLOCK_SIZE - 1) / IPFS_CACHE_BLOCK_SIZE; };
+    bool has(uint32_t block) { return block < count() && (blocks[block / 8] & (1 << (block % 8))); };
+    bool isOpen() { return data != nullptr; };
+};
+
+class IPFSCache {
+public:
+    // Open what we have of key, false if we've never seen it
+    static bool open(const std::string &key, IPFSCacheObject &object);
+
+    // Start caching key once its size is known
+    static bool create(const std::string &key, uint32_t size, IPFSCacheObject &object);
+
+    // Copy from a block on the card starting at offset. Returns 0 if it isn't there.
+    static uint32_t read(IPFSCacheObject &object, uint32_t block, uint32_t offset, uint8_t *buf, uint32_t size);
+    static bool write(IPFSCacheObject &object, uint32_t block, const uint8_t *data, uint32_t length);
+
+    static void close(IPFSCacheObject &object);
+
+    // Directory listing of key
+    static bool loadListing(const std::string &key, std::vector<IPFSDirEntry> &entries);
+    static void storeListing(const std::string &key, const std::vector<IPFSDirEntry> &entries);
+
+    // Keep everything under a root CID
+    static void pin(const std::string &cid);
+    static void unpin(const std::string &cid);
+    static bool pinned(const std::string &key);
+
+private:
+    struct Item {
+        std::string root;
+        uint32_t bytes;
+        uint32_t used;
+        uint8_t users;
+    };
+
+    static std::string name(const std::string &key);
+    static std::string path(const std::string &name, const char *ext);
+    static std::string root(const std::string &key);
+    static bool ready();
+    static void load();
+    static void savePins();
+    static bool writeRecord(IPFSCacheObject &object);
+    static void drop(const std::string &file);
+    static void evict();
+
+    static std::map<std::string, Item> index;   // by file, <hash>.ipm or <hash>.ipl
+    static std::set<std::string> pins;
+    static uint32_t total;
+    static bool loaded;
+    static std::mutex lock;
+};
+
+#endif // MEATLOAF_NETWORK_IPFS_CACHE
@@ -0,0 +1,721 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "smb.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <strings.h>
+
+#include "smb2/smb2.h"
+
+#include "fnSystem.h"
+
+#include "../../../include/debug.h"
+
+
+static std::map<std::string, std::shared_ptr<SMBMSession>> smb_sessions;
+static std::mutex smb_sessions_lock;
+
+
+/********************************************************
+ * Session implementations
+ ********************************************************/
+
+std::shared_ptr<SMBMSession> SMBMSession::get(std::string server, std::string share, std::string user, std::string password)
+{
+    std::string key = user + "@" + server + "/" + share;
+
+    std::lock_guard<std::mutex> guard(smb_sessions_lock);
+    auto session = smb_sessions.find(key);
+    if (session != smb_sessions.end())
+        return session->second;
+
+    auto created = std::make_shared<SMBMSession>(server, share, user, password);
+    smb_sessions[key] = created;
+    return created;
+}
+
+bool SMBMSession::connect()
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (m_smb != nullptr)
+        return true;
+
+    m_smb = smb2_init_context();
+    if (m_smb == nullptr)
+        return false;
+
+    smb2_set_security_mode(m_smb, SMB2_NEGOTIATE_SIGNING_ENABLED);
+    smb2_set_timeout(m_smb, SMB_TIMEOUT);
+    if (!m_user.empty())
+    {
+        smb2_set_user(m_smb, m_user.c_str());
+        smb2_set_password(m_smb, m_password.c_str());
+    }
+
+    if (smb2_connect_share(m_smb, m_server.c_str(), m_share.c_str(), m_user.empty() ? nullptr : m_user.c_str()) < 0)
+    {
+        Debug_printv("connect failed //%s/%s error[%s]", m_server.c_str(), m_share.c_str(), smb2_get_error(m_smb));
+        smb2_destroy_context(m_smb);
+        m_smb = nullptr;
+        return false;
+    }
+
+    m_generation++;
+    m_listings.clear();
+    Debug_printv("connected //%s/%s max_read[%lu]", m_server.c_str(), m_share.c_str(), smb2_get_max_read_size(m_smb));
+    return true;
+}
+
+void SMBMSession::disconnect(bool logoff)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (m_smb == nullptr)
+        return;
+
+    if (logoff)
+        smb2_disconnect_share(m_smb);
+
+    // Anything still waiting gets its callback with -ECONNRESET
+    smb2_destroy_context(m_smb);
+    m_smb = nullptr;
+    m_listings.clear();
+}
+
+bool SMBMSession::service(std::function<bool()> done, uint32_t timeout_ms)
+{
+    uint64_t started = fnSystem.millis();
+    while (!done())
+    {
+        if (m_smb == nullptr)
+            return false;
+
+        if (fnSystem.millis() - started > timeout_ms)
+        {
+            Debug_printv("timeout //%s/%s", m_server.c_str(), m_share.c_str());
+            disconnect(false);
+            return false;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = smb2_get_fd(m_smb);
+        pfd.events = smb2_which_events(m_smb);
+        pfd.revents = 0;
+
+        // Also called without events so libsmb2 can time out commands
+        if (poll(&pfd, 1, 100) < 0 || smb2_service(m_smb, pfd.revents) < 0)
+        {
+            Debug_printv("connection lost //%s/%s error[%s]", m_server.c_str(), m_share.c_str(), smb2_get_error(m_smb));
+            disconnect(false);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct SMBCommand {
+    bool done = false;
+    int status = 0;
+    void *data = nullptr;
+};
+
+static void smb_command_done(struct smb2_context *smb2, int status, void *command_data, void *private_data)
+{
+    SMBCommand *command = (SMBCommand *)private_data;
+    command->status = status;
+    command->data = command_data;
+    command->done = true;
+}
+
+int SMBMSession::run(Command start, void **data)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+
+    int status = -ENOTCONN;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (!connect())
+            return -ENOTCONN;
+
+        SMBCommand command;
+        if (start(m_smb, smb_command_done, &command) < 0)
+        {
+            status = -ENOMEM;
+            Debug_printv("command not sent //%s/%s error[%s]", m_server.c_str(), m_share.c_str(), smb2_get_error(m_smb));
+            disconnect(false);
+            continue;
+        }
+
+        // service() drops a connection that times out or breaks
+        if (!service([&command]() { return command.done; }))
+        {
+            status = -ECONNRESET;
+            continue;
+        }
+
+        status = command.status;
+        if (status == -ECONNRESET || status == -ETIMEDOUT || status == -ENOTCONN || status == -EPIPE)
+        {
+            Debug_printv("connection lost //%s/%s status[%d]", m_server.c_str(), m_share.c_str(), status);
+            disconnect(false);
+            continue;
+        }
+
+        if (data != nullptr)
+            *data = command.data;
+        break;
+    }
+
+    return status;
+}
+
+bool SMBMSession::listing(std::string path, std::vector<SMBDirEntry> &entries)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (!connect())
+        return false;
+
+    const std::vector<SMBDirEntry> *cached = m_listings.find(path, fnSystem.millis());
+    if (cached != nullptr)
+    {
+        entries = *cached;
+        return true;
+    }
+
+    // libsmb2 reads the whole directory when it is opened
+    struct smb2dir *dir = nullptr;
+    int status = run([&path](struct smb2_context *smb2, smb2_command_cb cb, void *cb_data) {
+        return smb2_opendir_async(smb2, path.c_str(), cb, cb_data);
+    }, (void **)&dir);
+    if (status < 0 || dir == nullptr)
+    {
+        Debug_printv("opendir failed path[%s] status[%d]", path.c_str(), status);
+        return false;
+    }
+
+    entries.clear();
+    struct smb2dirent *de;
+    while ((de = smb2_readdir(m_smb, dir)) != nullptr)
+    {
+        if (de->name[0] == '.')
+            continue; // Skip hidden files
+
+        if (de->st.smb2_type != SMB2_TYPE_FILE && de->st.smb2_type != SMB2_TYPE_DIRECTORY)
+            continue;
+
+        SMBDirEntry entry;
+        entry.name = de->name;
+        entry.isDir = (de->st.smb2_type == SMB2_TYPE_DIRECTORY);
+        entry.size = (uint32_t)de->st.smb2_size;
+        entry.m_time = (time_t)de->st.smb2_mtime;
+        entry.c_time = (time_t)de->st.smb2_ctime;
+        entries.push_back(entry);
+    }
+    smb2_closedir(m_smb, dir);
+
+    m_listings.put(path, entries, fnSystem.millis());
+
+    Debug_printv("path[%s] entries[%d]", path.c_str(), entries.size());
+    return true;
+}
+
+bool SMBMSession::cached(std::string path, SMBDirEntry &entry)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+
+    size_t slash = path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "" : path.substr(0, slash);
+    std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+
+    const std::vector<SMBDirEntry> *listing = m_listings.find(dir, fnSystem.millis());
+    if (listing == nullptr)
+        return false;
+
+    // Names on a share aren't case sensitive
+    for (auto &e : *listing)
+    {
+        if (strcasecmp(e.name.c_str(), name.c_str()) == 0)
+        {
+            entry = e;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SMBMSession::invalidate(std::string path)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+
+    size_t slash = path.rfind('/');
+    m_listings.erase((slash == std::string::npos) ? "" : path.substr(0, slash));
+    m_listings.erase(path);
+}
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+std::shared_ptr<SMBMSession> SMBMFile::session()
+{
+    return SMBMSession::get(host, m_share, user, password);
+}
+
+// From the directory listing when we have it, otherwise ask the server
+bool SMBMFile::stat(SMBDirEntry &entry)
+{
+    if (m_isNull)
+        return false;
+
+    if (m_remote.empty())
+    {
+        entry.isDir = true;
+        return true;
+    }
+
+    auto s = session();
+    if (s->cached(m_remote, entry))
+        return true;
+
+    struct smb2_stat_64 st;
+    std::string remote = m_remote;
+    int status = s->run([&](struct smb2_context *smb2, smb2_command_cb cb, void *cb_data) {
+        return smb2_stat_async(smb2, remote.c_str(), &st, cb, cb_data);
+    });
+    if (status < 0)
+        return false;
+
+    entry.isDir = (st.smb2_type == SMB2_TYPE_DIRECTORY);
+    entry.size = (uint32_t)st.smb2_size;
+    entry.m_time = (time_t)st.smb2_mtime;
+    entry.c_time = (time_t)st.smb2_ctime;
+    return true;
+}
+
+bool SMBMFile::isDirectory()
+{
+    SMBDirEntry entry;
+    return stat(entry) && entry.isDir;
+}
+
+bool SMBMFile::exists()
+{
+    SMBDirEntry entry;
+    return stat(entry);
+}
+
+time_t SMBMFile::getLastWrite()
+{
+    SMBDirEntry entry;
+    return stat(entry) ? entry.m_time : 0;
+}
+
+time_t SMBMFile::getCreationTime()
+{
+    SMBDirEntry entry;
+    return stat(entry) ? entry.c_time : 0;
+}
+
+MStream* SMBMFile::getSourceStream(std::ios_base::openmode mode)
+{
+    MStream* istream = new SMBMStream(url, session(), m_remote);
+    istream->open(mode);
+    return istream;
+}
+
+MStream* SMBMFile::getDecodedStream(std::shared_ptr<MStream> is)
+{
+    return is.get(); // we don't have to process this stream in any way, just return the original stream
+}
+
+MStream* SMBMFile::createStream(std::ios_base::openmode mode)
+{
+    MStream* istream = new SMBMStream(url, session(), m_remote);
+    istream->open(mode);
+    return istream;
+}
+
+bool SMBMFile::mkDir()
+{
+    if (m_isNull || m_remote.empty())
+        return false;
+
+    auto s = session();
+    s->invalidate(m_remote);
+    return s->run([this](struct smb2_context *smb2, smb2_command_cb cb, void *cb_data) {
+        return smb2_mkdir_async(smb2, m_remote.c_str(), cb, cb_data);
+    }) == 0;
+}
+
+bool SMBMFile::remove()
+{
+    SMBDirEntry entry;
+    if (m_remote.empty() || !stat(entry))
+        return false;
+
+    auto s = session();
+    s->invalidate(m_remote);
+    bool isDir = entry.isDir;
+    return s->run([this, isDir](struct smb2_context *smb2, smb2_command_cb cb, void *cb_data) {
+        if (isDir)
+            return smb2_rmdir_async(smb2, m_remote.c_str(), cb, cb_data);
+        return smb2_unlink_async(smb2, m_remote.c_str(), cb, cb_data);
+    }) == 0;
+}
+
+bool SMBMFile::rename(std::string dest)
+{
+    // dest is a path inside the same share
+    while (mstr::startsWith(dest, "/"))
+        dest = dest.substr(1);
+
+    if (m_isNull || m_remote.empty() || dest.empty())
+        return false;
+
+    auto s = session();
+    s->invalidate(m_remote);
+    s->invalidate(dest);
+    return s->run([this, &dest](struct smb2_context *smb2, smb2_command_cb cb, void *cb_data) {
+        return smb2_rename_async(smb2, m_remote.c_str(), dest.c_str(), cb, cb_data);
+    }) == 0;
+}
+
+void SMBMFile::openDir()
+{
+    m_entries.clear();
+    m_entry = 0;
+    dirOpened = session()->listing(m_remote, m_entries);
+}
+
+void SMBMFile::closeDir()
+{
+    m_entries.clear();
+    m_entries.shrink_to_fit();
+    m_entry = 0;
+    dirOpened = false;
+}
+
+bool SMBMFile::rewindDirectory()
+{
+    if (!isDirectory())
+        return false;
+
+    openDir();
+    return dirOpened;
+}
+
+MFile* SMBMFile::getNextFileInDir()
+{
+    if (!dirOpened)
+        openDir();
+
+    if (m_entry >= m_entries.size())
+    {
+        closeDir();
+        return nullptr;
+    }
+
+    SMBDirEntry &entry = m_entries[m_entry++];
+    std::string entry_url = url + (mstr::endsWith(url, "/") ? "" : "/") + entry.name;
+
+    auto file = new SMBMFile(entry_url);
+    file->extension = " " + file->extension;
+    file->size = entry.isDir ? 0 : entry.size;
+
+    return file;
+}
+
+
+/********************************************************
+ * Stream implementations
+ ********************************************************/
+
+bool SMBMStream::alive()
+{
+    return m_session != nullptr && m_session->connected() && m_session->generation() == m_generation;
+}
+
+bool SMBMStream::isOpen()
+{
+    return m_fh != nullptr && alive();
+}
+
+void SMBMStream::openDone(struct smb2_context *smb2, int status, void *command_data, void *private_data)
+{
+    SMBMStream *stream = (SMBMStream *)private_data;
+    if (status < 0)
+    {
+        stream->m_status = status;
+        return;
+    }
+
+    // Size and the first read go out right behind the open reply
+    stream->m_fh = (struct smb2fh *)command_data;
+    if (smb2_fstat_async(smb2, stream->m_fh, &stream->m_stat, statDone, stream) < 0)
+        stream->m_stated = true;
+    if (stream->m_reading)
+        stream->issue();
+
+    stream->m_status = 0;
+}
+
+void SMBMStream::statDone(struct smb2_context *smb2, int status, void *command_data, void *private_data)
+{
+    SMBMStream *stream = (SMBMStream *)private_data;
+    if (status < 0)
+        stream->m_stat.smb2_size = 0;
+    stream->m_stated = true;
+}
+
+void SMBMStream::readDone(struct smb2_context *smb2, int status, void *command_data, void *private_data)
+{
+    Slot *slot = (Slot *)private_data;
+    slot->result = status;
+    slot->pending = false;
+}
+
+bool SMBMStream::open(std::ios_base::openmode mode)
+{
+    if (isOpen())
+        return true;
+
+    if (m_session == nullptr)
+        return false;
+
+    std::lock_guard<std::recursive_mutex> guard(m_session->lock);
+    if (!m_session->connect())
+        return false;
+
+    struct smb2_context *smb2 = m_session->context();
+    m_generation = m_session->generation();
+
+    uint32_t max_read = smb2_get_max_read_size(smb2);
+    m_chunk = (max_read > 0 && max_read < SMB_READ_CHUNK) ? max_read : SMB_READ_CHUNK;
+
+    m_reading = !(mode & std::ios_base::out);
+    int flags = O_RDONLY;
+    if (!m_reading)
+        flags = O_WRONLY | O_CREAT | ((mode & std::ios_base::app) ? 0 : O_TRUNC);
+
+    memset(&m_stat, 0, sizeof(m_stat));
+    m_status = 1;
+    m_stated = false;
+    m_head = m_count = 0;
+    m_next = 0;
+    _size = 0;
+    _position = 0;
+
+    if (smb2_open_async(smb2, m_remote.c_str(), flags, openDone, this) < 0)
+        return false;
+
+    // The first read is left in flight, read() picks it up
+    if (!m_session->service([this]() { return m_status < 0 || (m_status == 0 && m_stated); }) || m_status < 0)
+    {
+        Debug_printv("open failed path[%s] status[%d]", m_remote.c_str(), m_status);
+        m_fh = nullptr;
+        return false;
+    }
+
+    _size = (uint32_t)m_stat.smb2_size;
+    if (!m_reading)
+    {
+        m_session->invalidate(m_remote);
+        if (mode & std::ios_base::app)
+            _position = _size;
+    }
+
+    //Debug_printv("path[%s] size[%lu]", m_remote.c_str(), _size);
+    return true;
+}
+
+// Next read of the window, behind the ones already out
+bool SMBMStream::issue()
+{
+    if (m_count >= SMB_READ_WINDOW)
+        return false;
+
+    Slot &slot = m_slots[(m_head + m_count) % SMB_READ_WINDOW];
+    if (slot.data == nullptr)
+        slot.data.reset(new uint8_t[SMB_READ_CHUNK]);
+
+    slot.offset = m_next;
+    slot.result = 0;
+    slot.pending = true;
+    if (smb2_pread_async(m_session->context(), m_fh, slot.data.get(), m_chunk, m_next, readDone, &slot) < 0)
+    {
+        slot.pending = false;
+        return false;
+    }
+
+    m_count++;
+    m_next += m_chunk;
+    return true;
+}
+
+// Wait out every read in flight, their buffers can't be reused before that
+void SMBMStream::drain()
+{
+    if (m_count > 0 && alive())
+    {
+        m_session->service([this]() {
+            for (auto &slot : m_slots)
+                if (slot.pending)
+                    return false;
+            return true;
+        });
+    }
+
+    m_head = 0;
+    m_count = 0;
+}
+
+uint32_t SMBMStream::read(uint8_t* buf, uint32_t size)
+{
+    if (!isOpen() || !buf || !m_reading)
+        return 0;
+
+    if (size > available())
+        size = available();
+
+    std::lock_guard<std::recursive_mutex> guard(m_session->lock);
+
+    // Read ahead once the stream is read from start to end
+    m_sequential = (_position == m_lastEnd) ? m_sequential + 1 : 0;
+    uint8_t window = (m_sequential >= SMB_READ_TRIGGER) ? SMB_READ_WINDOW : 1;
+
+    uint32_t bytesRead = 0;
+    while (size > 0 && alive())
+    {
+        // Reads behind us are done with, reads that don't get to us are no use
+        while (m_count > 0 && _position >= m_slots[m_head].offset + m_chunk && !m_slots[m_head].pending)
+        {
+            m_head = (m_head + 1) % SMB_READ_WINDOW;
+            m_count--;
+        }
+        if (m_count > 0 && (_position < m_slots[m_head].offset || _position >= m_next))
+            drain();
+        if (m_count == 0)
+            m_next = _position;
+
+        while (m_count < window && m_next < _size && issue());
+
+        Slot &slot = m_slots[m_head];
+        if (m_count == 0 || !m_session->service([&slot]() { return !slot.pending; }))
+        {
+            _error = 1;
+            break;
+        }
+
+        // Answered but still behind us, move on to the next one
+        if (_position >= slot.offset + m_chunk)
+            continue;
+
+        uint32_t offset = _position - slot.offset;
+        if (slot.result < 0)
+        {
+            Debug_printv("read failed path[%s] offset[%lu] status[%ld]", m_remote.c_str(), slot.offset, slot.result);
+            _error = 1;
+            break;
+        }
+        if ((uint32_t)slot.result <= offset)
+        {
+            // Nothing at all is the end of the file
+            if (slot.result == 0 || slot.offset + slot.result >= _size)
+                break;
+
+            // The server sent less than asked for, the reads behind this one
+            // start too far on. Ask again from here.
+            drain();
+            continue;
+        }
+
+        uint32_t count = std::min(size, (uint32_t)slot.result - offset);
+        memcpy(buf, slot.data.get() + offset, count);
+        buf += count;
+        size -= count;
+        bytesRead += count;
+        _position += count;
+    }
+
+    m_lastEnd = _position;
+    return bytesRead;
+}
+
+uint32_t SMBMStream::write(const uint8_t *buf, uint32_t size)
+{
+    if (!isOpen() || !buf || m_reading)
+        return 0;
+
+    std::lock_guard<std::recursive_mutex> guard(m_session->lock);
+
+    uint32_t max_write = smb2_get_max_write_size(m_session->context());
+    if (max_write == 0 || max_write > SMB_READ_CHUNK * SMB_READ_WINDOW)
+        max_write = SMB_READ_CHUNK * SMB_READ_WINDOW;
+
+    uint32_t written = 0;
+    while (written < size)
+    {
+        int result = smb2_pwrite(m_session->context(), m_fh, (uint8_t *)buf + written, std::min(size - written, max_write), _position);
+        if (result <= 0)
+        {
+            Debug_printv("write failed path[%s] error[%s]", m_remote.c_str(), smb2_get_error(m_session->context()));
+            _error = 1;
+            break;
+        }
+
+        written += result;
+        _position += result;
+    }
+
+    if (_position > _size)
+        _size = _position;
+
+    return written;
+}
+
+bool SMBMStream::seek(uint32_t pos)
+{
+    if (!isOpen() || pos > _size)
+        return false;
+
+    // Reads in flight are kept if they cover pos
+    _position = pos;
+    return true;
+}
+
+void SMBMStream::close()
+{
+    if (m_fh == nullptr)
+        return;
+
+    std::lock_guard<std::recursive_mutex> guard(m_session->lock);
+    if (alive())
+    {
+        drain();
+        if (alive())
+            smb2_close(m_session->context(), m_fh);
+    }
+
+    // A lost connection took the handle with it
+    m_fh = nullptr;
+    m_head = m_count = 0;
+}
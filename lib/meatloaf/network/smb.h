@@ -1,3 +1,264 @@
 // SMB:// - Server Messagee Block Protocol
 // https://en.wikipedia.org/wiki/Server_Message_Block
 //
+// smb://[user[:password]@]server/share/path
+//
+// Built on the vendored libsmb2. Every file on a share uses the same
+// connection (SMBMSession), which also keeps the directory listings it
+// has read for a few seconds, so isDirectory()/exists()/size on files
+// from a listing don't go back to the server.
+//
+// Sequential reads keep up to SMB_READ_WINDOW smb2_pread_async requests
+// in flight. libsmb2 doesn't expose compounding an open with a read, so
+// the FSTAT and the first read are sent from the open reply's callback,
+// in the same round trip as far as the server is concerned.
+//
+
+#ifndef MEATLOAF_SCHEME_SMB
+#define MEATLOAF_SCHEME_SMB
+
+#include "meatloaf.h"
+
+#include <smb2/libsmb2.h>
+
+#include "listing_cache.h"
+
+#include "../../../include/debug.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef BOARD_HAS_PSRAM
+#define SMB_READ_CHUNK (32 * 1024)  // bytes per read, less if the server wants
+#else
+#define SMB_READ_CHUNK (4 * 1024)
+#endif
+#define SMB_READ_WINDOW 4           // reads in flight once the stream is read sequentially
+#define SMB_READ_TRIGGER 2          // sequential reads before reading ahead
+#define SMB_DIR_CACHE_TTL 10000     // ms a listing is used for without asking again
+#define SMB_DIR_CACHE_LISTINGS 8    // listings kept per connection
+#define SMB_TIMEOUT 10              // seconds before libsmb2 gives up on a command
+
+
+struct SMBDirEntry {
+    std::string name;
+    bool isDir = false;
+    uint32_t size = 0;
+    time_t m_time = 0;
+    time_t c_time = 0;
+};
+
+
+/********************************************************
+ * Session
+ ********************************************************/
+
+class SMBMSession {
+public:
+    SMBMSession(std::string server, std::string share, std::string user, std::string password) {
+        m_server = server;
+        m_share = share;
+        m_user = user;
+        m_password = password;
+    };
+    ~SMBMSession() {
+        disconnect();
+    };
+
+    // One connection per server, share and user
+    static std::shared_ptr<SMBMSession> get(std::string server, std::string share, std::string user, std::string password);
+
+    bool connect();
+    void disconnect(bool logoff = true);
+    bool connected() { return m_smb != nullptr; };
+
+    // Run the event loop until done() says so. False on a timeout or a dead connection.
+    bool service(std::function<bool()> done, uint32_t timeout_ms = SMB_TIMEOUT * 1000);
+
+    // Send one command with the callback and data given to start() and wait
+    // for its answer. If the connection turns out to be dead it is tried
+    // once more on a new one, the server may have dropped an idle session.
+    // Returns the command's status, data is what it answered with.
+    typedef std::function<int(struct smb2_context *smb2, smb2_command_cb cb, void *cb_data)> Command;
+    int run(Command start, void **data = nullptr);
+
+    // Directory listing of path (inside the share), from the cache when fresh
+    bool listing(std::string path, std::vector<SMBDirEntry> &entries);
+
+    // Entry for path from its directory's cached listing
+    bool cached(std::string path, SMBDirEntry &entry);
+
+    // Drop the cached listing of path's directory
+    void invalidate(std::string path);
+
+    struct smb2_context *context() { return m_smb; };
+
+    // Bumped on every new connection, old handles are no good after it
+    uint32_t generation() { return m_generation; };
+
+    // libsmb2 contexts aren't thread safe
+    std::recursive_mutex lock;
+
+private:
+    std::string m_server;
+    std::string m_share;
+    std::string m_user;
+    std::string m_password;
+
+    struct smb2_context *m_smb = nullptr;
+    uint32_t m_generation = 0;
+
+    ListingCache<SMBDirEntry> m_listings{ SMB_DIR_CACHE_TTL, SMB_DIR_CACHE_LISTINGS };
+};
+
+
+/********************************************************
+ * File
+ ********************************************************/
+
+class SMBMFile: public MFile
+{
+
+public:
+    SMBMFile(std::string path): MFile(path) {
+        // First part of the path is the share
+        std::string p = mstr::startsWith(this->path, "/") ? this->path.substr(1) : this->path;
+        size_t slash = p.find('/');
+        m_share = p.substr(0, slash);
+        m_remote = (slash == std::string::npos) ? "" : p.substr(slash + 1);
+        while (m_remote.size() && m_remote.back() == '/')
+            m_remote.pop_back();
+
+        m_isNull = host.empty() || m_share.empty();
+        m_rootfs = true;
+        //Debug_printv("url[%s] share[%s] remote[%s]", url.c_str(), m_share.c_str(), m_remote.c_str());
+    };
+    ~SMBMFile() {
+        closeDir();
+    }
+
+    MStream* getSourceStream(std::ios_base::openmode mode=std::ios_base::in) override ; // has to return OPENED stream
+    MStream* getDecodedStream(std::shared_ptr<MStream> src);
+    MStream* createStream(std::ios_base::openmode mode) override;
+
+    bool isDirectory() override;
+    time_t getLastWrite() override ;
+    time_t getCreationTime() override ;
+    bool rewindDirectory() override ;
+    MFile* getNextFileInDir() override ;
+    bool mkDir() override ;
+    bool exists() override ;
+
+    bool remove() override ;
+    bool rename(std::string dest);
+
+protected:
+    bool dirOpened = false;
+
+private:
+    std::shared_ptr<SMBMSession> session();
+    bool stat(SMBDirEntry &entry);
+    void openDir();
+    void closeDir();
+
+    std::string m_share;
+    std::string m_remote;   // path inside the share, no leading '/'
+
+    std::vector<SMBDirEntry> m_entries;
+    size_t m_entry = 0;
+};
+
+
+/********************************************************
+ * Stream
+ ********************************************************/
+
+class SMBMStream: public MStream {
+public:
+    SMBMStream(std::string path, std::shared_ptr<SMBMSession> session, std::string remote) {
+        url = path;
+        m_session = session;
+        m_remote = remote;
+    }
+    ~SMBMStream() override {
+        close();
+    }
+
+    // MStream methods
+    bool isOpen() override;
+    bool isBrowsable() override { return false; };
+    bool isRandomAccess() override { return true; };
+
+    bool open(std::ios_base::openmode mode) override;
+    void close() override;
+
+    uint32_t read(uint8_t* buf, uint32_t size) override;
+    uint32_t write(const uint8_t *buf, uint32_t size) override;
+
+    bool seek(uint32_t pos) override;
+
+private:
+    // One pread, in flight or answered
+    struct Slot {
+        uint32_t offset = 0;
+        int32_t result = 0;
+        bool pending = false;
+        std::unique_ptr<uint8_t[]> data;
+    };
+
+    static void openDone(struct smb2_context *smb2, int status, void *command_data, void *private_data);
+    static void statDone(struct smb2_context *smb2, int status, void *command_data, void *private_data);
+    static void readDone(struct smb2_context *smb2, int status, void *command_data, void *private_data);
+
+    bool issue();
+    void drain();
+    bool alive();
+
+    std::shared_ptr<SMBMSession> m_session;
+    uint32_t m_generation = 0;
+    std::string m_remote;
+
+    struct smb2fh *m_fh = nullptr;
+    bool m_reading = true;
+    int m_status = 1;               // open/stat result, 1 while waiting
+    bool m_stated = false;
+    struct smb2_stat_64 m_stat;
+
+    // Reads in offset order, m_head is the oldest
+    Slot m_slots[SMB_READ_WINDOW];
+    uint8_t m_head = 0;
+    uint8_t m_count = 0;
+    uint32_t m_next = 0;            // where the next read starts
+    uint32_t m_chunk = SMB_READ_CHUNK;
+
+    uint32_t m_sequential = 0;
+    uint32_t m_lastEnd = 0;
+};
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class SMBMFileSystem: public MFileSystem
+{
+public:
+    SMBMFileSystem(): MFileSystem("smb") {};
+
+    bool handles(std::string name) {
+        if ( mstr::equals(name, (char *)"smb:", false) )
+            return true;
+
+        return false;
+    }
+
+    MFile* getFile(std::string path) override {
+        return new SMBMFile(path);
+    }
+};
+
+
+#endif // MEATLOAF_SCHEME_SMB
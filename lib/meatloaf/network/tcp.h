@@ -108,6 +108,22 @@ public:
         return byteCount;
     }
 
+    // Wait up to timeout_ms for something to read
+    bool waitForData(uint32_t timeout_ms) {
+        if(!isOpen())
+            return false;
+
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(sock, &readfds);
+
+        struct timeval tv;
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+        return select(sock + 1, &readfds, nullptr, nullptr, &tv) > 0;
+    }
+
     bool isOpen() {
         return sock != -1;
     }
@@ -21,13 +21,22 @@
 #include "tnfslibMountInfo.h"
 
 #include "meatloaf.h"
+#include "fnSystem.h"
+#include "compat_string.h"
 
 #include "../../../include/debug.h"
 
-#include <sys/stat.h>
-#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
 
 
+// One session per server, shared by every file on it
+static std::map<std::string, std::unique_ptr<tnfsMountInfo>> tnfs_mounts;
+static std::mutex tnfs_mounts_lock;
+
+static TNFSStatCache tnfs_stat_cache;
+
 
 /********************************************************
  * MFile implementations
@@ -35,17 +44,17 @@
 
 bool TNFSMFile::pathValid(std::string path) 
 {
-    auto apath = std::string(basepath + path).c_str();
+    auto apath = path.c_str();
     while (*apath) {
         const char *slash = strchr(apath, '/');
         if (!slash) {
-            if (strlen(apath) >= FILENAME_MAX) {
+            if (strlen(apath) >= TNFS_MAX_FILELEN) {
                 // Terminal filename is too long
                 return false;
             }
             break;
         }
-        if ((slash - apath) >= FILENAME_MAX) {
+        if ((slash - apath) >= TNFS_MAX_FILELEN) {
             // This subdir name too long
             return false;
         }
@@ -55,21 +64,86 @@ bool TNFSMFile::pathValid(std::string path)
     return true;
 }
 
+tnfsMountInfo *TNFSMFile::mount()
+{
+    uint16_t server_port = port.empty() ? TNFS_DEFAULT_PORT : getPort();
+    std::string server = host + ":" + std::to_string(server_port);
+
+    std::lock_guard<std::mutex> guard(tnfs_mounts_lock);
+    auto m = tnfs_mounts.find(server);
+    if (m != tnfs_mounts.end())
+        return m->second.get();
+
+    auto info = std::make_unique<tnfsMountInfo>(host.c_str(), server_port);
+    strlcpy(info->user, user.c_str(), sizeof(info->user));
+    strlcpy(info->password, password.c_str(), sizeof(info->password));
+
+    int result = tnfs_mount(info.get());
+    if (result != TNFS_RESULT_SUCCESS)
+    {
+        Debug_printv("mount failed server[%s] result[%d]", server.c_str(), result);
+        return nullptr;
+    }
+    Debug_printv("mounted server[%s] session[0x%04x]", server.c_str(), info->session);
+
+    tnfsMountInfo *mounted = info.get();
+    tnfs_mounts[server] = std::move(info);
+    return mounted;
+}
+
+std::string TNFSMFile::cacheKey(std::string remote)
+{
+    return host + ":" + port + remote;
+}
+
+// What the server knows about this file, from the cache when we can
+bool TNFSMFile::stat(TNFSStatEntry &entry)
+{
+    std::string remote = remotePath();
+    std::string key = cacheKey(remote);
+    if (tnfs_stat_cache.get(key, entry, fnSystem.millis()))
+        return true;
+
+    tnfsMountInfo *m = mount();
+    if (m == nullptr)
+        return false;
+
+    tnfsStat tstat;
+    int result = tnfs_stat(m, &tstat, remote.c_str());
+    if (result == TNFS_RESULT_FILE_NOT_FOUND)
+    {
+        entry = TNFSStatEntry();
+        entry.exists = false;
+    }
+    else if (result == TNFS_RESULT_SUCCESS)
+    {
+        entry.exists = true;
+        entry.isDir = tstat.isDir;
+        entry.size = tstat.filesize;
+        entry.m_time = tstat.m_time;
+        entry.c_time = tstat.c_time;
+    }
+    else
+    {
+        return false;
+    }
+
+    tnfs_stat_cache.put(key, entry, fnSystem.millis());
+    return true;
+}
+
 bool TNFSMFile::isDirectory()
 {
     if(path=="/" || path.empty())
         return true;
 
-    struct stat info;
-    stat( std::string(basepath + path).c_str(), &info);
-    return S_ISDIR(info.st_mode);
+    TNFSStatEntry entry;
+    return stat(entry) && entry.exists && entry.isDir;
 }
 
 MStream* TNFSMFile::getSourceStream(std::ios_base::openmode mode)
 {
-    std::string full_path = basepath + path;
-    MStream* istream = new TNFSMStream(full_path);
-    //auto istream = StreamBroker::obtain<TNFSMStream>(full_path, mode);
+    MStream* istream = new TNFSMStream(url, mount(), remotePath());
     //Debug_printv("TNFSMFile::getSourceStream() 3, not null=%d", istream != nullptr);
     istream->open(mode);   
     //Debug_printv("TNFSMFile::getSourceStream() 4");
@@ -82,28 +156,30 @@ MStream* TNFSMFile::getDecodedStream(std::shared_ptr<MStream> is) {
 
 MStream* TNFSMFile::createStream(std::ios_base::openmode mode)
 {
-    std::string full_path = basepath + path;
-    MStream* istream = new TNFSMStream(full_path);
+    // The size and time we have are about to change
+    tnfs_stat_cache.invalidate(cacheKey(remotePath()));
+
+    MStream* istream = new TNFSMStream(url, mount(), remotePath());
     istream->open(mode);
     return istream;
 }
 
 time_t TNFSMFile::getLastWrite()
 {
-    struct stat info;
-    stat( std::string(basepath + path).c_str(), &info);
+    TNFSStatEntry entry;
+    if (!stat(entry))
+        return 0;
 
-    time_t ftime = info.st_mtime; // Time of last modification
-    return ftime;
+    return entry.m_time; // Time of last modification
 }
 
 time_t TNFSMFile::getCreationTime()
 {
-    struct stat info;
-    stat( std::string(basepath + path).c_str(), &info);
+    TNFSStatEntry entry;
+    if (!stat(entry))
+        return 0;
 
-    time_t ftime = info.st_ctime; // Time of last status change
-    return ftime;
+    return entry.c_time; // Time of last status change
 }
 
 bool TNFSMFile::mkDir()
@@ -111,8 +187,14 @@ bool TNFSMFile::mkDir()
     if (m_isNull) {
         return false;
     }
-    int rc = mkdir(std::string(basepath + path).c_str(), ALLPERMS);
-    return (rc==0);
+
+    tnfsMountInfo *m = mount();
+    if (m == nullptr)
+        return false;
+
+    tnfs_stat_cache.invalidate(cacheKey(remotePath()));
+    int rc = tnfs_mkdir(m, remotePath().c_str());
+    return (rc==TNFS_RESULT_SUCCESS);
 }
 
 bool TNFSMFile::exists()
@@ -124,31 +206,32 @@ bool TNFSMFile::exists()
         return true;
     }
 
-    //Debug_printv( "basepath[%s] path[%s]", basepath.c_str(), path.c_str() );
-
-    struct stat st;
-    int i = stat(std::string(basepath + path).c_str(), &st);
+    //Debug_printv( "host[%s] path[%s]", host.c_str(), path.c_str() );
 
-    return (i == 0);
+    TNFSStatEntry entry;
+    return stat(entry) && entry.exists;
 }
 
 
 bool TNFSMFile::remove() {
-    //if(path == nullptr)
-    //    return false;
+    tnfsMountInfo *m = mount();
+    if (m == nullptr)
+        return false;
+
+    // Figure out if this is a file or directory
+    TNFSStatEntry entry;
+    if (!stat(entry) || !entry.exists)
+        return false;
 
-    // // Figure out if this is a file or directory
-    // tnfsStat tstat;
-    // if(TNFS_RESULT_SUCCESS != tnfs_stat(&_mountinfo, &tstat, path))
-    //     return false;
+    tnfs_stat_cache.invalidate(cacheKey(remotePath()));
 
-    // int result;
-    // if(tstat.isDir)
-    //     result = tnfs_rmdir(&_mountinfo, path);
-    // else
-    //     result = tnfs_unlink(&_mountinfo, path);
+    int result;
+    if(entry.isDir)
+        result = tnfs_rmdir(m, remotePath().c_str());
+    else
+        result = tnfs_unlink(m, remotePath().c_str());
 
-    return true; //result == TNFS_RESULT_SUCCESS;
+    return result == TNFS_RESULT_SUCCESS;
 }
 
 
@@ -156,8 +239,15 @@ bool TNFSMFile::rename(std::string pathTo) {
     if(pathTo.empty())
         return false;
 
-    int rc = ::rename( std::string(basepath + path).c_str(), std::string(basepath + pathTo).c_str() );
-    if (rc != 0) {
+    tnfsMountInfo *m = mount();
+    if (m == nullptr)
+        return false;
+
+    tnfs_stat_cache.invalidate(cacheKey(remotePath()));
+    tnfs_stat_cache.invalidate(cacheKey(pathTo));
+
+    int rc = tnfs_rename(m, remotePath().c_str(), pathTo.c_str());
+    if (rc != TNFS_RESULT_SUCCESS) {
         return false;
     }
     return true;
@@ -166,150 +256,149 @@ bool TNFSMFile::rename(std::string pathTo) {
 
 void TNFSMFile::openDir(std::string apath) 
 {
+    _entries.clear();
+    _entry = 0;
+    dirOpened = false;
+
     if (!isDirectory()) { 
-        dirOpened = false;
         return;
     }
-    
-    // Debug_printv("path[%s]", apath.c_str());
-    // if(apath.empty()) {
-    //     dir = opendir( "/" );
-    // }
-    // else {
-    //     dir = opendir( apath.c_str() );
-    // }
 
-    dirOpened = true;
-    if ( dir == NULL ) {
-        dirOpened = false;
+    tnfsMountInfo *m = mount();
+    if (m == nullptr)
+        return;
+
+    // Debug_printv("path[%s] pattern[%s]", apath.c_str(), _pattern.c_str());
+
+    // Read the whole listing now, tnfs_readdirx() gets it from the server
+    // TNFS_MAX_DIRCACHE_ENTRIES at a time. Sorting (folders first, by name)
+    // and the pattern are done by the server.
+    {
+        std::lock_guard<std::recursive_mutex> guard(m->transaction_mutex);
+
+        const char *pattern = _pattern.empty() ? nullptr : _pattern.c_str();
+        if (tnfs_opendirx(m, apath.c_str(), 0, 0, pattern, 0) != TNFS_RESULT_SUCCESS)
+            return;
+
+        tnfsStat tstat;
+        char name[TNFS_MAX_FILELEN];
+        while (tnfs_readdirx(m, &tstat, name, sizeof(name)) == TNFS_RESULT_SUCCESS)
+        {
+            if (name[0] == '.')
+                continue; // Skip hidden files
+
+            TNFSDirEntry entry;
+            entry.name = name;
+            entry.stat.isDir = tstat.isDir;
+            entry.stat.size = tstat.filesize;
+            entry.stat.m_time = tstat.m_time;
+            entry.stat.c_time = tstat.c_time;
+            _entries.push_back(entry);
+        }
+
+        tnfs_closedir(m);
     }
-    // else {
-    //     // Skip the . and .. entries
-    //     struct dirent* dirent = NULL;
-    //     dirent = readdir( dir );
-    //     dirent = readdir( dir );
-    // }
+
+    // Files opened from this listing don't need to STAT again
+    std::string dir = (apath == "/") ? apath : apath + "/";
+    uint64_t now = fnSystem.millis();
+    for (auto &entry : _entries)
+        tnfs_stat_cache.put(cacheKey(dir + entry.name), entry.stat, now);
+
+    Debug_printv("path[%s] entries[%d]", apath.c_str(), _entries.size());
+    dirOpened = true;
 }
 
 
 void TNFSMFile::closeDir() 
 {
-    // if(dirOpened) {
-    //     closedir( dir );
-    //     dirOpened = false;
-    // }
+    _entries.clear();
+    _entries.shrink_to_fit();
+    _entry = 0;
+    dirOpened = false;
 }
 
 
 bool TNFSMFile::rewindDirectory()
 {
-    // _valid = false;
-    // rewinddir( dir );
-
-    // // // Skip the . and .. entries
-    // // struct dirent* dirent = NULL;
-    // // dirent = readdir( dir );
-    // // dirent = readdir( dir );
-
-    // return (dir != NULL) ? true: false;
-    return true;
+    openDir(remotePath());
+    return dirOpened;
 }
 
 
 MFile* TNFSMFile::getNextFileInDir()
 {
-    // // Debug_printv("base[%s] path[%s]", basepath.c_str(), path.c_str());
-    // if(!dirOpened)
-    //     openDir(std::string(basepath + path).c_str());
-
-    // if(dir == nullptr)
-    //     return nullptr;
-
-    // struct dirent* dirent = NULL;
-    // do
-    // {
-    //     dirent = readdir( dir );
-    // } while ( dirent != NULL && mstr::startsWith(dirent->d_name, ".") ); // Skip hidden files
-
-    // if ( dirent != NULL )
-    // {
-    //     //Debug_printv("path[%s] name[%s]", this->path.c_str(), dirent->d_name);
-    //     std::string entry_name = this->path + ((this->path == "/") ? "" : "/") + std::string(dirent->d_name);
-
-    //     auto file = new TNFSMFile(entry_name);
-    //     file->extension = " " + file->extension;
-
-    //     if(file->isDirectory()) {
-    //         file->size = 0;
-    //     }
-    //     else {
-    //         struct stat info;
-    //         stat( std::string(entry_name).c_str(), &info);
-    //         file->size = info.st_size;
-    //     }
-
-    //     return file;
-    // }
-    // else
-    // {
-    //     closeDir();
-    //     return nullptr;
-    // }
-    return nullptr;
+    // Debug_printv("url[%s] path[%s]", url.c_str(), path.c_str());
+    if(!dirOpened)
+        openDir(remotePath());
+
+    if(_entry >= _entries.size())
+    {
+        closeDir();
+        return nullptr;
+    }
+
+    TNFSDirEntry &entry = _entries[_entry++];
+    //Debug_printv("path[%s] name[%s]", this->path.c_str(), entry.name.c_str());
+    std::string entry_url = url + (mstr::endsWith(url, "/") ? "" : "/") + entry.name;
+
+    auto file = new TNFSMFile(entry_url);
+    file->extension = " " + file->extension;
+    file->size = entry.stat.isDir ? 0 : entry.stat.size;
+
+    return file;
 }
 
 
 bool TNFSMFile::readEntry( std::string filename )
 {
-    // DIR* d;
-    // std::string apath = (basepath + pathToFile()).c_str();
-    // if (apath.empty()) {
-    //     apath = "/";
-    // }
-
-    // Debug_printv( "path[%s] filename[%s] size[%d]", apath.c_str(), filename.c_str(), filename.size());
-
-    // d = opendir( apath.c_str() );
-    // if(d == nullptr)
-    //     return false;
-
-    // // Read Directory Entries
-    // struct dirent* dirent = NULL;
-    // if ( filename.size() > 0 )
-    // {
-    //     while ( (dirent = readdir( d )) != NULL )
-    //     {
-    //         std::string entryFilename = dirent->d_name;
-
-    //         Debug_printv("path[%s] filename[%s] entry.filename[%.16s]", apath.c_str(), filename.c_str(), entryFilename.c_str());
-
-    //         // Read Entry From Stream
-    //         if (filename == "*")
-    //         {
-    //             filename = entryFilename;
-    //             closedir( d );
-    //             return true;
-    //         }
-    //         else if ( filename == entryFilename )
-    //         {
-    //             closedir( d );
-    //             return true;
-    //         }
-    //         else if ( mstr::compare(filename, entryFilename) )
-    //         {
-    //             // Set filename to this filename
-    //             Debug_printv( "Found! file[%s] -> entry[%s]", filename.c_str(), entryFilename.c_str() );
-    //             resetURL(apath + "/" + std::string(dirent->d_name));
-    //             closedir( d );
-    //             return true;
-    //         }
-    //     }
-
-    //     Debug_printv( "Not Found! file[%s]", filename.c_str() );
-    // }
-
-    // closedir( d );
-    // return false;
+    tnfsMountInfo *m = mount();
+    if (m == nullptr)
+        return false;
+
+    std::string apath = pathToFile();
+    if (apath.empty()) {
+        apath = "/";
+    }
+
+    Debug_printv( "path[%s] filename[%s] size[%d]", apath.c_str(), filename.c_str(), filename.size());
+
+    // Let the server match the wildcard, the first hit is all we need
+    tnfsStat tstat;
+    char name[TNFS_MAX_FILELEN];
+    int result;
+    {
+        std::lock_guard<std::recursive_mutex> guard(m->transaction_mutex);
+
+        if (tnfs_opendirx(m, apath.c_str(), 0, TNFS_DIROPT_DIR_PATTERN, filename.c_str(), 1) != TNFS_RESULT_SUCCESS)
+            return false;
+
+        do
+        {
+            result = tnfs_readdirx(m, &tstat, name, sizeof(name));
+        } while (result == TNFS_RESULT_SUCCESS && name[0] == '.');
+
+        tnfs_closedir(m);
+    }
+
+    if (result != TNFS_RESULT_SUCCESS)
+    {
+        Debug_printv( "Not Found! file[%s]", filename.c_str() );
+        return false;
+    }
+
+    // Set filename to this filename
+    Debug_printv( "Found! file[%s] -> entry[%s]", filename.c_str(), name );
+    std::string dir = url.substr(0, url.size() - this->name.size());
+    resetURL(dir + name);
+
+    TNFSStatEntry entry;
+    entry.isDir = tstat.isDir;
+    entry.size = tstat.filesize;
+    entry.m_time = tstat.m_time;
+    entry.c_time = tstat.c_time;
+    tnfs_stat_cache.put(cacheKey(remotePath()), entry, fnSystem.millis());
+
     return true;
 }
 
@@ -323,17 +412,26 @@ uint32_t TNFSMStream::write(const uint8_t *buf, uint32_t size) {
         return 0;
     }
 
-    //Debug_printv("in byteWrite '%c', handle->file_h is null=[%d]\r\n", buf[0], handle->file_h == nullptr);
-
-    // buffer, element size, count, handle
-    int result = fwrite((void*) buf, 1, size, handle->file_h );
+    //Debug_printv("in byteWrite '%c', handle->file_h[%d]\r\n", buf[0], handle->file_h);
+
+    uint32_t written = 0;
+    while (written < size)
+    {
+        uint16_t chunk = std::min(size - written, (uint32_t)TNFS_MAX_READWRITE_PAYLOAD);
+        uint16_t result = 0;
+        int rc = tnfs_write(m_mount, handle->file_h, (uint8_t *)buf + written, chunk, &result);
+        written += result;
+        if (rc != TNFS_RESULT_SUCCESS || result == 0) {
+            Debug_printv("write rc=%d\r\n", rc);
+            break;
+        }
+    }
 
-    //Debug_printv("after lfs_file_write");
+    _position += written;
+    if (_position > _size)
+        _size = _position;
 
-    if (result < 0) {
-        Debug_printv("write rc=%d\r\n", result);
-    }
-    return result;
+    return written;
 };
 
 
@@ -343,26 +441,21 @@ uint32_t TNFSMStream::write(const uint8_t *buf, uint32_t size) {
 
 
 bool TNFSMStream::open(std::ios_base::openmode mode) {
-    // if(isOpen())
-    //     return true;
-
-    // //Debug_printv("IStream: trying to open flash fs, calling isOpen");
-
-    // //Debug_printv("IStream: wasn't open, calling obtain");
-    // handle->obtain(localPath, "r");
-
-    // if(isOpen()) {
-    //     //Debug_printv("IStream: past obtain");
-    //     // Set file size
-    //     fseek(handle->file_h, 0, SEEK_END);
-    //     //Debug_printv("IStream: past fseek 1");
-    //     _size = ftell(handle->file_h);
-    //     //Debug_printv("IStream: past ftell");
-    //     fseek(handle->file_h, 0, SEEK_SET);
-    //     //Debug_printv("IStream: past fseek 2");
-    //     return true;
-    // }
-    return false;
+    if(isOpen())
+        return true;
+
+    if(m_mount == nullptr)
+        return false;
+
+    //Debug_printv("IStream: wasn't open, calling obtain");
+    if(!handle->obtain(m_mount, localPath, mode))
+        return false;
+
+    // tnfs_open() has already asked the server for the size
+    tnfsFileHandleInfo *info = m_mount->get_filehandleinfo(handle->file_h);
+    _size = (info != nullptr) ? info->file_size : 0;
+    _position = 0;
+    return true;
 };
 
 void TNFSMStream::close() {
@@ -375,13 +468,22 @@ uint32_t TNFSMStream::read(uint8_t* buf, uint32_t size) {
         return 0;
     }
 
-    int bytesRead = fread((void*) buf, 1, size, handle->file_h );
-
-    if (bytesRead < 0) {
-        Debug_printv("read rc=%d\r\n", bytesRead);
-        return 0;
+    // Served from the handle's cache, which tnfslib refills a window of READs at a time
+    uint32_t bytesRead = 0;
+    while (bytesRead < size)
+    {
+        uint16_t chunk = std::min(size - bytesRead, (uint32_t)TNFS_MAX_READWRITE_PAYLOAD);
+        uint16_t result = 0;
+        int rc = tnfs_read(m_mount, handle->file_h, buf + bytesRead, chunk, &result);
+        bytesRead += result;
+        if (rc != TNFS_RESULT_SUCCESS || result == 0) {
+            if (rc != TNFS_RESULT_END_OF_FILE)
+                Debug_printv("read rc=%d\r\n", rc);
+            break;
+        }
     }
 
+    _position += bytesRead;
     return bytesRead;
 };
 
@@ -391,7 +493,11 @@ bool TNFSMStream::seek(uint32_t pos) {
         Debug_printv("Not open");
         return false;
     }
-    return ( fseek( handle->file_h, pos, SEEK_SET ) ) ? true : false;
+    if (tnfs_lseek(m_mount, handle->file_h, pos, SEEK_SET) != TNFS_RESULT_SUCCESS)
+        return false;
+
+    _position = pos;
+    return true;
 };
 
 bool TNFSMStream::seek(uint32_t pos, int mode) {
@@ -400,12 +506,12 @@ bool TNFSMStream::seek(uint32_t pos, int mode) {
         Debug_printv("Not open");
         return false;
     }
-    return ( fseek( handle->file_h, pos, mode ) ) ? true: false;
+    return MStream::seek(pos, mode);
 }
 
 bool TNFSMStream::isOpen() {
     // Debug_printv("Inside isOpen, handle notnull:%d", handle != nullptr);
-    auto temp = handle != nullptr && handle->file_h != nullptr;
+    auto temp = handle != nullptr && handle->file_h != -1;
     // Debug_printv("returning");
     return temp;
 }
@@ -421,38 +527,38 @@ TNFSHandle::~TNFSHandle() {
 
 void TNFSHandle::dispose() {
     //Debug_printv("file_h[%d]", file_h);
-    if (file_h != nullptr) {
+    if (file_h != -1) {
 
-        fclose( file_h );
-        file_h = nullptr;
-        // rc = -255;
+        tnfs_close(mount, file_h);
+        file_h = -1;
     }
 }
 
-void TNFSHandle::obtain(std::string m_path, std::string mode) {
-
-    //printf("*** Atempting opening flash  handle'%s'\r\n", m_path.c_str());
-
-    if ((mode[0] == 'w') && strchr(m_path.c_str(), '/')) {
-        // For file creation, silently make subdirs as needed.  If any fail,
-        // it will be caught by the real file open later on
+bool TNFSHandle::obtain(tnfsMountInfo *m_mount, std::string m_path, std::ios_base::openmode mode) {
 
-        char *pathStr = new char[m_path.length()];
-        strncpy(pathStr, m_path.data(), m_path.length());
+    //printf("*** Atempting opening tnfs handle'%s'\r\n", m_path.c_str());
 
-        if (pathStr) {
-            // Make dirs up to the final fnamepart
-            char *ptr = strchr(pathStr, '/');
-            while (ptr) {
-                *ptr = 0;
-                mkdir(pathStr, ALLPERMS);
-                *ptr = '/';
-                ptr = strchr(ptr+1, '/');
-            }
-        }
-        delete[] pathStr;
+    uint16_t open_mode = TNFS_OPENMODE_READ;
+    if (mode & std::ios_base::out)
+    {
+        // For file creation the server makes the file, but not the dirs leading to it
+        open_mode = TNFS_OPENMODE_WRITE | TNFS_OPENMODE_WRITE_CREATE;
+        if (mode & std::ios_base::app)
+            open_mode |= TNFS_OPENMODE_WRITE_APPEND;
+        else
+            open_mode |= TNFS_OPENMODE_WRITE_TRUNCATE;
+    }
+    uint16_t create_perms = TNFS_CREATEPERM_S_IRUSR | TNFS_CREATEPERM_S_IWUSR | TNFS_CREATEPERM_S_IRGRP | TNFS_CREATEPERM_S_IROTH;
+
+    //Debug_printv("m_path[%s] mode[%04x]", m_path.c_str(), open_mode);
+    mount = m_mount;
+    int result = tnfs_open(mount, m_path.c_str(), open_mode, create_perms, &file_h);
+    if (result != TNFS_RESULT_SUCCESS)
+    {
+        Debug_printv("open failed path[%s] result[%d]", m_path.c_str(), result);
+        file_h = -1;
+        return false;
     }
 
-    //Debug_printv("m_path[%s] mode[%s]", m_path.c_str(), mode.c_str());
-    file_h = fopen( m_path.c_str(), mode.c_str());
+    return true;
 }
@@ -20,14 +20,16 @@
 
 #include "meatloaf.h"
 
-#include "fnFS.h"
+#include "tnfs_cache.h"
 
 #include "../../../include/debug.h"
 
 #include "make_unique.h"
 
-#include <dirent.h>
 #include <string.h>
+#include <vector>
+
+class tnfsMountInfo;
 
 
 /********************************************************
@@ -38,24 +40,22 @@ class TNFSMFile: public MFile
 {
 
 public:
-    std::string basepath = "";
-    
-    TNFSMFile(std::string path) {
+    TNFSMFile(std::string path): MFile(path) {
 
         // Find full filename for wildcard
         if (mstr::contains(name, "?") || mstr::contains(name, "*"))
             readEntry( name );
 
-        if (!pathValid(path.c_str()))
+        if (!pathValid(this->path.c_str()))
             m_isNull = true;
         else
             m_isNull = false;
 
         m_rootfs = true;
-        //Debug_printv("basepath[%s] path[%s] valid[%d]", basepath.c_str(), this->path.c_str(), m_isNull);
+        //Debug_printv("url[%s] path[%s] valid[%d]", url.c_str(), this->path.c_str(), m_isNull);
     };
     ~TNFSMFile() {
-        //printf("*** Destroying flashfile %s\r\n", url.c_str());
+        //printf("*** Destroying tnfsfile %s\r\n", url.c_str());
         closeDir();
     }
 
@@ -78,20 +78,24 @@ public:
     bool readEntry( std::string filename );
 
 protected:
-    DIR* dir;
     bool dirOpened = false;
 
 private:
-    FileSystem *_fs = nullptr;
+    // Listing read in one go when the directory is opened
+    std::vector<TNFSDirEntry> _entries;
+    size_t _entry = 0;
 
     virtual void openDir(std::string path);
     virtual void closeDir();
 
-    bool _valid;
     std::string _pattern;
 
     bool pathValid(std::string path);
 
+    tnfsMountInfo *mount();
+    std::string remotePath() { return path.empty() ? "/" : path; };
+    std::string cacheKey(std::string remote);
+    bool stat(TNFSStatEntry &entry);
 };
 
 
@@ -101,20 +105,16 @@ private:
 
 class TNFSHandle {
 public:
-    //int rc;
-    FILE* file_h = nullptr;
+    tnfsMountInfo *mount = nullptr;
+    int16_t file_h = -1;
 
     TNFSHandle() 
     {
-        //Debug_printv("*** Creating flash handle");
-        memset(&file_h, 0, sizeof(file_h));
+        //Debug_printv("*** Creating tnfs handle");
     };
     ~TNFSHandle();
-    void obtain(std::string localPath, std::string mode);
+    bool obtain(tnfsMountInfo *mount, std::string remotePath, std::ios_base::openmode mode);
     void dispose();
-
-private:
-    int flags = 0;
 };
 
 
@@ -124,9 +124,10 @@ private:
 
 class TNFSMStream: public MStream {
 public:
-    TNFSMStream(std::string& path) {
-        localPath = path;
+    TNFSMStream(std::string& path, tnfsMountInfo *mount, std::string remotePath) {
+        localPath = remotePath;
         handle = std::make_unique<TNFSHandle>();
+        m_mount = mount;
         url = path;
     }
     ~TNFSMStream() override {
@@ -155,6 +156,7 @@ public:
 
 protected:
     std::string localPath;
+    tnfsMountInfo *m_mount;
 
     std::unique_ptr<TNFSHandle> handle;
 };
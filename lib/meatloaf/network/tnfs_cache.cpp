@@ -0,0 +1,88 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "tnfs_cache.h"
+
+bool TNFSStatCache::get(const std::string &path, TNFSStatEntry &entry, uint64_t now)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    auto item = m_items.find(path);
+    if (item == m_items.end())
+        return false;
+
+    if (now >= item->second.expires)
+    {
+        m_items.erase(item);
+        return false;
+    }
+
+    entry = item->second.entry;
+    return true;
+}
+
+void TNFSStatCache::put(const std::string &path, const TNFSStatEntry &entry, uint64_t now)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (m_items.find(path) == m_items.end() && m_items.size() >= m_max_entries)
+        evict(now);
+
+    m_items[path] = { entry, now + m_ttl };
+}
+
+void TNFSStatCache::invalidate(const std::string &path)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_items.erase(path);
+
+    std::string dir = path;
+    if (dir.empty() || dir.back() != '/')
+        dir += '/';
+
+    auto item = m_items.lower_bound(dir);
+    while (item != m_items.end() && item->first.compare(0, dir.size(), dir) == 0)
+        item = m_items.erase(item);
+}
+
+void TNFSStatCache::clear()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_items.clear();
+}
+
+void TNFSStatCache::evict(uint64_t now)
+{
+    // Expired entries first, then whichever would have expired soonest
+    auto oldest = m_items.end();
+    for (auto item = m_items.begin(); item != m_items.end(); )
+    {
+        if (now >= item->second.expires)
+        {
+            item = m_items.erase(item);
+            continue;
+        }
+
+        if (oldest == m_items.end() || item->second.expires < oldest->second.expires)
+            oldest = item;
+        ++item;
+    }
+
+    if (m_items.size() >= m_max_entries && oldest != m_items.end())
+        m_items.erase(oldest);
+}
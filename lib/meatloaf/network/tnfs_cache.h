@@ -0,0 +1,85 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// TNFS stat cache
+//
+// Every isDirectory(), exists() and size lookup on a TNFS file was a
+// STAT round trip to the server. A directory listing already carries
+// all of that for each entry, so the entries read while listing a
+// directory are kept here for a few seconds and the files opened from
+// the listing answer from them. STAT results are kept the same way, as
+// are "not found" answers for exists() probes.
+//
+// Entries are keyed by "host:port/path". Anything we change ourselves
+// (write, remove, rename, mkdir) invalidates the path and what's under it.
+//
+
+#ifndef MEATLOAF_NETWORK_TNFS_CACHE
+#define MEATLOAF_NETWORK_TNFS_CACHE
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#define TNFS_STAT_CACHE_TTL         5000    // ms, short so changes made by others show up
+#define TNFS_STAT_CACHE_MAX_ENTRIES 1024    // a couple of large directories
+
+struct TNFSStatEntry {
+    bool exists = true;
+    bool isDir = false;
+    uint32_t size = 0;
+    uint32_t m_time = 0;
+    uint32_t c_time = 0;
+};
+
+// One entry of a directory listing
+struct TNFSDirEntry {
+    std::string name;
+    TNFSStatEntry stat;
+};
+
+class TNFSStatCache {
+public:
+    TNFSStatCache(uint32_t ttl = TNFS_STAT_CACHE_TTL, size_t max_entries = TNFS_STAT_CACHE_MAX_ENTRIES)
+        : m_ttl(ttl), m_max_entries(max_entries) {};
+
+    // Cached entry for path, false if there is none or it expired
+    bool get(const std::string &path, TNFSStatEntry &entry, uint64_t now);
+    void put(const std::string &path, const TNFSStatEntry &entry, uint64_t now);
+
+    // Drop path and everything below it
+    void invalidate(const std::string &path);
+    void clear();
+
+    size_t size() { return m_items.size(); };
+
+private:
+    struct Item {
+        TNFSStatEntry entry;
+        uint64_t expires;
+    };
+
+    void evict(uint64_t now);
+
+    uint32_t m_ttl;
+    size_t m_max_entries;
+    std::map<std::string, Item> m_items;
+    std::mutex m_lock;
+};
+
+#endif // MEATLOAF_NETWORK_TNFS_CACHE
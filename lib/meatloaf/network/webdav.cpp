@@ -15,231 +15,386 @@
 // You should have received a copy of the GNU General Public License
 // along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
 
-// #include "webdav.h"
-
-// /********************************************************
-//  * File impls
-//  ********************************************************/
 
-// bool WebDAVFile::isDirectory() {
-//     // hey, why not?
-//     return false;
-// }
-
-// MStream* WebDAVFile::getSourceStream() {
-//     // has to return OPENED stream
-//     Debug_printv("[%s]", url.c_str());
-//     MStream* istream = new WebDAVIStream(url);
-//     istream->open();
-//     return istream;
-// }
-
-// MStream* WebDAVFile::getDecodedStream(std::shared_ptr<MStream> is) {
-//     return is.get(); // we've overriden istreamfunction, so this one won't be used
-// }
-
-// time_t WebDAVFile::getLastWrite() {
-//     return 0; // might be taken from Last-Modified, probably not worth it
-// }
-
-// time_t WebDAVFile::getCreationTime() {
-//     return 0; // might be taken from Last-Modified, probably not worth it
-// }
-
-// bool WebDAVFile::exists() {
-//     Debug_printv("[%s]", url.c_str());
-//     // we may try open the stream to check if it exists
-//     std::unique_ptr<MStream> test(getSourceStream());
-//     // remember that MStream destuctor should close the stream!
-//     return test->isOpen();
-// }
-
-// uint32_t WebDAVFile::size() {
-//     // we may take content-lenght from header if exists
-//     std::unique_ptr<MStream> test(getSourceStream());
-
-//     size_t size = 0;
-
-//     if(test->isOpen())
-//         size = test->available();
-
-//     test->close();
-
-//     return size;
-// }
-
-
-
-// // void WebDAVFile::addHeader(const String& name, const String& value, bool first, bool replace) {
-// //     //m_http.addHeader
-// // }
-
-
-// /********************************************************
-//  * Ostream impls
-//  ********************************************************/
-
-// bool WebDAVOStream::seek(uint32_t pos) {
-//     if(pos==_position)
-//         return true;
-
-//     if(isFriendlySkipper) {
-//         char str[40];
-//         // Range: bytes=91536-(91536+255)
-//         snprintf(str, sizeof str, "bytes=%lu-%lu", (unsigned long)pos, ((unsigned long)pos + 255));
-//         m_http.set_header("range",str);
-//         int httpCode = m_http.GET(); //Send the request
-//         Debug_printv("httpCode[%d] str[%s]", httpCode, str);
-//         if(httpCode != 200 || httpCode != 206)
-//             return false;
-
-//         Debug_printv("stream opened[%s]", url.c_str());
-//         //m_file = m_http.getStream();  //Get the response payload as Stream
-//         _position = pos;
-//         return true;
-
-//     } else {
-//         if(pos<_position) {
-//             // skipping backward and range not supported, let's simply reopen the stream...
-//             m_http.close();
-//             bool op = open();
-//             if(!op)
-//                 return false;
-//         }
-
-//         _position = 0;
-//         // ... and then read until we reach pos
-//         // while(_position < pos) {
-//         //  _position+=m_file.readBytes(buffer, size);  <----------- trurn this on!!!!
-//         // }
-
-//         return true;
-//     }
-// }
-
-
-
-// void WebDAVOStream::close() {
-//     m_http.close();
-// }
-
-// bool WebDAVOStream::open() {
-//     // we'll ad a lambda that will allow adding headers
-//     // m_http.addHeader("Content-Type", "application/x-www-form-urlencoded");
-//     mstr::replaceAll(url, "HTTP:", "http:");
-// //    m_http.setReuse(true);
-//     bool initOk = m_http.begin( url );
-//     Debug_printv("[%s] initOk[%d]", url.c_str(), initOk);
-//     if(!initOk)
-//         return false;
-
-//     //int httpCode = m_http.PUT(); //Send the request
-// //printf("URLSTR: httpCode=%d\r\n", httpCode);
-//     // if(httpCode != 200)
-//     //     return false;
-
-//     _is_open = true;
-//     //m_file = m_http.getStream();  //Get the response payload as Stream
-//     return true;
-// }
-
-// //uint32_t WebDAVOStream::write(uint8_t) {};
-// uint32_t WebDAVOStream::write(const uint8_t *buf, uint32_t size) {
-//     return 0; // m_file.write(buf, size);
-// }
-
-// bool WebDAVOStream::isOpen() {
-//     return _is_open;
-// }
-
-
-// /********************************************************
-//  * Istream impls
-//  ********************************************************/
-
-// bool WebDAVIStream::seek(uint32_t pos) {
-//     if(pos==_position)
-//         return true;
-
-//     if(isFriendlySkipper) {
-//         char str[40];
-//         // Range: bytes=91536-(91536+255)
-//         snprintf(str, sizeof str, "bytes=%lu-%lu", (unsigned long)pos, ((unsigned long)pos + 255));
-//         m_http.set_header("range",str);
-//         int httpCode = m_http.GET(); //Send the request
-//         Debug_printv("httpCode[%d] str[%s]", httpCode, str);
-//         if(httpCode != 200 || httpCode != 206)
-//             return false;
-
-//         Debug_printv("stream opened[%s]", url.c_str());
-//         //m_file = m_http.getStream();  //Get the response payload as Stream
-//         _position = pos;
-//         return true;
-
-//     } else {
-//         if(pos<_position) {
-//             // skipping backward and range not supported, let's simply reopen the stream...
-//             m_http.close();
-//             bool op = open();
-//             if(!op)
-//                 return false;
-//         }
-
-//         _position = 0;
-//         // ... and then read until we reach pos
-//         // while(_position < pos) {
-//         //  _position+=m_file.readBytes(buffer, size);  <----------- trurn this on!!!!
-//         // }
-
-//         return true;
-//     }
-// }
-
-// void WebDAVIStream::close() {
-//     m_http.close();
-// }
-
-// bool WebDAVIStream::open() {
-//     //mstr::replaceAll(url, "HTTP:", "http:");
-//     bool initOk = m_http.begin( url );
-//     Debug_printv("input %s: someRc=%d", url.c_str(), initOk);
-//     if(!initOk)
-//         return false;
-
-//     // Setup response headers we want to collect
-//     const char * headerKeys[] = {"accept-ranges", "content-type", "content-length"};
-//     const size_t numberOfHeaders = 2;
-//     m_http.collect_headers(headerKeys, numberOfHeaders);
-
-//     //Send the request
-//     int httpCode = m_http.GET();
-//     Debug_printv("httpCode=%d", httpCode);
-//     if(httpCode != 200)
-//         return false;
-
-//     // Accept-Ranges: bytes - if we get such header from any request, good!
-//     isFriendlySkipper = m_http.get_header("accept-ranges") == "bytes";
-//     Debug_printv("isFriendlySkipper[%d]", isFriendlySkipper);
-//     _is_open = true;
-//     Debug_printv("[%s]", url.c_str());
-//     //m_file = m_http.getStream();  //Get the response payload as Stream
-//     _size = stoi(m_http.get_header("content-length"));
-//     Debug_printv("length=%d", _size);
-
-//     // Is this text?
-//     std::string ct = m_http.get_header("content-type").c_str();
-//     Debug_printv("content_type[%s]", ct.c_str());
-//     isText = mstr::isText(ct);
-
-//     return true;
-// };
-
-// uint32_t WebDAVIStream::read(uint8_t* buf, uint32_t size) {
-//     auto bytesRead= m_http.read( buf, size );
-//     _position+=bytesRead;
-//     return bytesRead;
-// };
-
-// bool WebDAVIStream::isOpen() {
-//     return _is_open;
-// };
+#include "webdav.h"
+
+#include "fnSystem.h"
+
+#include "../../../include/debug.h"
+
+#include <time.h>
+
+WebDAVPropCache WebDAVMFileSystem::listings;
+
+// Only what a listing shows, a server lists every property it has otherwise
+static const char *PROPFIND_BODY =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+    "<D:propfind xmlns:D=\"DAV:\"><D:prop>"
+    "<D:resourcetype/><D:getcontentlength/><D:getlastmodified/><D:getetag/>"
+    "</D:prop></D:propfind>";
+
+
+/********************************************************
+ * PROPFIND helpers
+ ********************************************************/
+
+// Feed the parser straight off the connection until it has an entry, or the response ends
+static bool davNext(MeatHttpClient *http, WebDAV *parser, WebDAV::DAVEntry &entry)
+{
+    while ( !parser->next(entry) )
+    {
+        if ( parser->failed() || parser->finished() )
+            return false;
+
+        void *buf = parser->buffer(WEBDAV_CHUNK_SIZE);
+        if ( buf == nullptr )
+            return false;
+
+        uint32_t bytes = http->readBody((uint8_t *)buf, WEBDAV_CHUNK_SIZE);
+        parser->parse_buffer(bytes, bytes < WEBDAV_CHUNK_SIZE);
+    }
+
+    return true;
+}
+
+// Names come out of listings decoded and have to be encoded again for a
+// request. MeatHttpClient only escapes spaces, a '#', '?' or '%' in a name
+// would still break the URL.
+static std::string davUrl(const std::string &url)
+{
+    size_t host = url.find("://");
+    size_t path = ( host == std::string::npos ) ? std::string::npos : url.find('/', host + 3);
+    if ( path == std::string::npos )
+        return url;
+
+    return url.substr(0, path) + mstr::urlEncode(url.substr(path));
+}
+
+// Depth: 0 PROPFIND, the resource's own properties
+static bool davStat(const std::string &url, WebDAV::DAVEntry &self)
+{
+    MeatHttpClient http;
+    if ( !http.PROPFIND(davUrl(url), 0, PROPFIND_BODY) )
+        return false;
+
+    WebDAV parser;
+    if ( parser.begin_parser() )
+        return false;
+
+    // There are no members to hand out, this parses the whole response
+    WebDAV::DAVEntry member;
+    while ( davNext(&http, &parser, member) );
+
+    bool found = ( !parser.failed() && !parser.collection().href.empty() );
+    if ( found )
+        self = parser.collection();
+
+    parser.end_parser();
+    return found;
+}
+
+// timegm(), which newlib doesn't have. Days since the epoch as in
+// Howard Hinnant's days_from_civil()
+static time_t davTimegm(const struct tm &tm)
+{
+    int y = tm.tm_year + 1900 - (tm.tm_mon < 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (tm.tm_mon < 2 ? tm.tm_mon + 10 : tm.tm_mon - 2) + 2) / 5 + tm.tm_mday - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = (long)era * 146097 + (long)doe - 719468;
+
+    return (time_t)days * 86400 + tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+}
+
+// Rfc 1123 date, as in getlastmodified. Always GMT, whatever TZ is set to
+static time_t davTime(const std::string &date)
+{
+    struct tm tm = {};
+    if ( date.empty() || strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S", &tm) == nullptr )
+        return 0;
+
+    return davTimegm(tm);
+}
+
+static WebDAVProps davProps(const WebDAV::DAVEntry &entry)
+{
+    WebDAVProps props;
+
+    // The href is the name the server goes by, displayname is only a label
+    std::string name;
+    WebDAVPropCache::parentKey(entry.href, &name);
+    props.name = name.empty() ? entry.filename : mstr::urlDecode(name, false);
+
+    props.isDir = entry.isDir;
+    props.size = strtoul(entry.fileSize.c_str(), nullptr, 10);
+    props.lastWrite = davTime(entry.lastModified);
+    return props;
+}
+
+// What tells us a collection changed
+static std::string davValidator(const WebDAV::DAVEntry &entry)
+{
+    return entry.etag.empty() ? entry.lastModified : entry.etag;
+}
+
+
+/********************************************************
+ * File impls
+ ********************************************************/
+
+WebDAVMFile::WebDAVMFile(std::string path): MFile(path)
+{
+    m_rootfs = true;
+
+    // Listed a moment ago, everything about it is known already
+    m_found = WebDAVMFileSystem::listings.props(httpUrl(), m_props, fnSystem.millis());
+    m_statted = m_found;
+    if ( m_found && !m_props.isDir )
+        size = m_props.size;
+}
+
+std::string WebDAVMFile::httpUrl()
+{
+    // webdav://host/path is http://host/path, webdavs:// is https://
+    std::string rest = url.substr(scheme.size());
+    return ( mstr::equals(scheme, "webdavs", false) ? "https" : "http" ) + rest;
+}
+
+bool WebDAVMFile::stat(WebDAVProps &props)
+{
+    if ( !m_statted )
+    {
+        m_statted = true;
+
+        WebDAV::DAVEntry self;
+        m_found = davStat(httpUrl(), self);
+        if ( m_found )
+        {
+            m_props = davProps(self);
+            if ( !m_props.isDir )
+                size = m_props.size;
+        }
+    }
+
+    props = m_props;
+    return m_found;
+}
+
+MStream* WebDAVMFile::getSourceStream(std::ios_base::openmode mode) {
+    // has to return OPENED stream
+    MStream* istream = createStream(mode);
+    if ( !(mode & std::ios_base::out) )
+        size = istream->size();
+
+    return istream;
+}
+
+MStream* WebDAVMFile::getDecodedStream(std::shared_ptr<MStream> is) {
+    return is.get(); // DUMMY return value - we've overriden istreamfunction, so this one won't be used
+}
+
+MStream* WebDAVMFile::createStream(std::ios_base::openmode mode)
+{
+    MStream* istream = new WebDAVMStream(davUrl(httpUrl()), mode);
+    istream->open(mode);
+    return istream;
+}
+
+bool WebDAVMFile::isDirectory() {
+    WebDAVProps props;
+    return stat(props) && props.isDir;
+}
+
+time_t WebDAVMFile::getLastWrite() {
+    WebDAVProps props;
+    if ( !stat(props) )
+        return 0;
+
+    return props.lastWrite;
+}
+
+time_t WebDAVMFile::getCreationTime() {
+    // creationdate isn't asked for, few servers keep it anyway
+    return getLastWrite();
+}
+
+bool WebDAVMFile::exists() {
+    WebDAVProps props;
+    return stat(props);
+}
+
+bool WebDAVMFile::remove() {
+    MeatHttpClient http;
+    bool ok = http.open(davUrl(httpUrl()), HTTP_METHOD_DELETE);
+
+    WebDAVMFileSystem::listings.invalidate(httpUrl());
+    m_statted = false;
+    return ok;
+}
+
+bool WebDAVMFile::mkDir() {
+    MeatHttpClient http;
+    bool ok = http.open(davUrl(WebDAVPropCache::collectionKey(httpUrl())), HTTP_METHOD_MKCOL);
+
+    WebDAVMFileSystem::listings.invalidate(httpUrl());
+    m_statted = false;
+    return ok;
+}
+
+bool WebDAVMFile::rewindDirectory() {
+    return openDir();
+}
+
+MFile* WebDAVMFile::getNextFileInDir() {
+    if ( !dirOpened && !openDir() )
+        return nullptr;
+
+    WebDAVProps props;
+    if ( !nextEntry(props) )
+    {
+        closeDir();
+        return nullptr;
+    }
+
+    //Debug_printv("url[%s] name[%s]", url.c_str(), props.name.c_str());
+    std::string entry_url = url + (mstr::endsWith(url, "/") ? "" : "/") + props.name;
+
+    auto file = new WebDAVMFile(entry_url);
+    file->extension = " " + file->extension;
+    file->m_props = props;
+    file->m_statted = true;
+    file->m_found = true;
+    file->size = props.isDir ? 0 : props.size;
+
+    return file;
+}
+
+bool WebDAVMFile::openDir() {
+    closeDir();
+
+    std::string key = WebDAVPropCache::collectionKey(httpUrl());
+
+    bool fresh = false;
+    auto cached = WebDAVMFileSystem::listings.get(key, fnSystem.millis(), fresh);
+    if ( cached != nullptr && !fresh )
+    {
+        // Has it changed? Asking is one small response instead of the whole listing
+        WebDAV::DAVEntry self;
+        if ( !davStat(key, self) || !WebDAVMFileSystem::listings.revalidate(key, davValidator(self), fnSystem.millis()) )
+            cached = nullptr;
+    }
+
+    if ( cached != nullptr )
+    {
+        //Debug_printv("cached url[%s] entries[%d]", key.c_str(), cached->entries.size());
+        m_listing = cached;
+        m_entry = 0;
+        dirOpened = true;
+        return true;
+    }
+
+    // Entries are handed out as they arrive
+    m_propfind.reset(new MeatHttpClient());
+    m_parser.reset(new WebDAV());
+    if ( !m_propfind->PROPFIND(davUrl(key), 1, PROPFIND_BODY) || m_parser->begin_parser() )
+    {
+        Debug_printv("PROPFIND failed url[%s] httpCode[%d]", key.c_str(), m_propfind->lastRC);
+        closeDir();
+        return false;
+    }
+
+    m_building = WebDAVCollection();
+    dirOpened = true;
+    return true;
+}
+
+void WebDAVMFile::closeDir() {
+    if ( m_parser != nullptr )
+        m_parser->end_parser(true);
+
+    m_parser.reset();
+    m_propfind.reset();
+    m_listing.reset();
+    m_building.entries.clear();
+    m_entry = 0;
+    dirOpened = false;
+}
+
+bool WebDAVMFile::nextEntry(WebDAVProps &props) {
+    if ( m_listing != nullptr )
+    {
+        if ( m_entry >= m_listing->entries.size() )
+            return false;
+
+        props = m_listing->entries[m_entry++];
+        return true;
+    }
+
+    if ( m_parser == nullptr )
+        return false;
+
+    WebDAV::DAVEntry entry;
+    if ( davNext(m_propfind.get(), m_parser.get(), entry) )
+    {
+        props = davProps(entry);
+        m_building.entries.push_back(props);
+        return true;
+    }
+
+    // All of it arrived, the next look at this collection answers from it
+    if ( m_parser->finished() && !m_parser->failed() )
+    {
+        m_building.validator = davValidator(m_parser->collection());
+        WebDAVMFileSystem::listings.put(WebDAVPropCache::collectionKey(httpUrl()), m_building, fnSystem.millis());
+    }
+
+    return false;
+}
+
+
+/********************************************************
+ * Stream impls
+ ********************************************************/
+
+bool WebDAVMStream::open(std::ios_base::openmode mode) {
+    if ( !(mode & std::ios_base::out) )
+        return HTTPMStream::open(mode);
+
+    // Saves go out as they are written
+    m_upload = _http.beginUpload(url);
+    _size = 0;
+    _position = 0;
+    return m_upload;
+}
+
+void WebDAVMStream::close() {
+    if ( m_upload )
+    {
+        m_upload = false;
+        if ( !_http.endUpload() )
+            _error = 1;
+
+        // Whether it made it or not, the listing it is in may have changed
+        WebDAVMFileSystem::listings.invalidate(url);
+    }
+
+    HTTPMStream::close();
+}
+
+uint32_t WebDAVMStream::read(uint8_t* buf, uint32_t size) {
+    if ( m_upload )
+        return 0;
+
+    return HTTPMStream::read(buf, size);
+}
+
+uint32_t WebDAVMStream::write(const uint8_t *buf, uint32_t size) {
+    if ( !m_upload )
+        return 0;
+
+    uint32_t bytesWritten = _http.write(buf, size);
+    _position += bytesWritten;
+    _size = _position;
+    return bytesWritten;
+}
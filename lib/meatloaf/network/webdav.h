@@ -15,40 +15,78 @@
 // You should have received a copy of the GNU General Public License
 // along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
 
-// WEBDAV:// - WebDAV
+
+// WEBDAV://  - WebDAV over HTTP
+// WEBDAVS:// - WebDAV over HTTPS
+//
+// Directories are listed with a Depth: 1 PROPFIND, parsed as it arrives,
+// and kept in the property cache (webdav_cache.h) so files opened from a
+// listing don't ask the server about themselves. Files are read through
+// HTTPMStream, with Range requests and the block cache for random access
+// into disk images. Saves are streamed to the server with a chunked PUT.
+//
 
 #ifndef MEATLOAF_SCHEME_WEBDAV
 #define MEATLOAF_SCHEME_WEBDAV
 
 #include "http.h"
+#include "webdav_cache.h"
 
 #include "meatloaf.h"
+#include "../../network-protocol/WEBDAV.h"
 #include "../../include/global_defines.h"
 
+#include <memory>
+
 
 /********************************************************
  * File implementations
  ********************************************************/
 
 
-class WebDAVMFile: public HTTPMFile {
+class WebDAVMFile: public MFile {
 
 public:
-    WebDAVMFile(std::string path): HTTPMFile(path) {};
+    WebDAVMFile(std::string path);
+    ~WebDAVMFile() override {
+        closeDir();
+    }
 
-    bool isDirectory() override;
     MStream* getSourceStream(std::ios_base::openmode mode=std::ios_base::in) override ; // has to return OPENED stream
+    MStream* getDecodedStream(std::shared_ptr<MStream> src);
+    MStream* createStream(std::ios_base::openmode mode) override;
+
+    bool isDirectory() override;
     time_t getLastWrite() override ;
     time_t getCreationTime() override ;
-    bool rewindDirectory() override { return false; };
-    MFile* getNextFileInDir() override { return nullptr; };
-    bool mkDir() override { return false; };
+    bool rewindDirectory() override ;
+    MFile* getNextFileInDir() override ;
+    bool mkDir() override ;
     bool exists() override ;
 
-    bool remove() override { return false; };
+    bool remove() override ;
     bool rename(std::string dest) { return false; };
-    MStream* getDecodedStream(std::shared_ptr<MStream> src);
-    //void addHeader(const String& name, const String& value, bool first = false, bool replace = true);
+
+private:
+    // The http(s):// URL the server knows this file by
+    std::string httpUrl();
+
+    // Properties from the listing this file was in, or a Depth: 0 PROPFIND
+    bool stat(WebDAVProps &props);
+    bool m_statted = false;
+    bool m_found = false;
+    WebDAVProps m_props;
+
+    // The listing, from the cache or as it comes off a PROPFIND
+    bool openDir();
+    void closeDir();
+    bool nextEntry(WebDAVProps &props);
+    bool dirOpened = false;
+    std::shared_ptr<const WebDAVCollection> m_listing;
+    size_t m_entry = 0;
+    std::unique_ptr<MeatHttpClient> m_propfind;
+    std::unique_ptr<WebDAV> m_parser;
+    WebDAVCollection m_building;
 };
 
 
@@ -58,28 +96,19 @@ public:
 
 class WebDAVMStream: public HTTPMStream {
 public:
-WebDAVMStream(std::string& path): HTTPMStream(path) {
-        url = path;
-    }
+    WebDAVMStream(std::string path, std::ios_base::openmode m): HTTPMStream(path, m) {};
     ~WebDAVMStream() {
         close();
     }
 
+    bool open(std::ios_base::openmode mode) override;
     void close() override;
 
-    // MStream methods
-    uint32_t position() override;
-    uint32_t available() override;
     uint32_t read(uint8_t* buf, uint32_t size) override;
     uint32_t write(const uint8_t *buf, uint32_t size) override;
-    bool isOpen();
 
-protected:
-    std::string url;
-    bool _is_open;
-
-//    WiFiClient m_file;
-	MeatHttpClient m_http;
+private:
+    bool m_upload = false;
 };
 
 
@@ -87,20 +116,27 @@ protected:
  * FS
  ********************************************************/
 
-class WebDAVFileSystem: public MFileSystem 
+class WebDAVMFileSystem: public MFileSystem 
 {
 public:
-    WebDAVFileSystem(): MFileSystem("webdav") {};
+    WebDAVMFileSystem(): MFileSystem("webdav") {};
 
     bool handles(std::string name) {
-        std::string pattern = "webdav:";
-        return mstr::equals(name, pattern, false);
+        if ( mstr::equals(name, (char *)"webdav:", false) )
+            return true;
+
+        if ( mstr::equals(name, (char *)"webdavs:", false) )
+            return true;
+
+        return false;
     }
 
     MFile* getFile(std::string path) override {
         return new WebDAVMFile(path);
     }
+
+    static WebDAVPropCache listings;
 };
 
 
-#endif // MEATLOAF_SCHEME_WEBDAV
\ No newline at end of file
+#endif // MEATLOAF_SCHEME_WEBDAV
@@ -0,0 +1,141 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "webdav_cache.h"
+
+std::string WebDAVPropCache::collectionKey(const std::string &url)
+{
+    if (!url.empty() && url.back() == '/')
+        return url;
+
+    return url + '/';
+}
+
+std::string WebDAVPropCache::parentKey(const std::string &url, std::string *name)
+{
+    std::string path = url;
+    while (!path.empty() && path.back() == '/')
+        path.pop_back();
+
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos)
+        return "";
+
+    if (name != nullptr)
+        *name = path.substr(slash + 1);
+
+    return path.substr(0, slash + 1);
+}
+
+std::shared_ptr<const WebDAVCollection> WebDAVPropCache::get(const std::string &url, uint64_t now, bool &fresh)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    fresh = false;
+    auto item = m_items.find(collectionKey(url));
+    if (item == m_items.end())
+        return nullptr;
+
+    fresh = (now < item->second.expires);
+    return item->second.collection;
+}
+
+void WebDAVPropCache::put(const std::string &url, const WebDAVCollection &collection, uint64_t now)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    std::string key = collectionKey(url);
+    if (m_items.find(key) == m_items.end() && m_items.size() >= m_max_entries)
+        evict();
+
+    m_items[key] = { std::make_shared<const WebDAVCollection>(collection), now + m_ttl };
+}
+
+bool WebDAVPropCache::revalidate(const std::string &url, const std::string &validator, uint64_t now)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    auto item = m_items.find(collectionKey(url));
+    if (item == m_items.end())
+        return false;
+
+    if (validator.empty() || item->second.collection->validator != validator)
+    {
+        m_items.erase(item);
+        return false;
+    }
+
+    item->second.expires = now + m_ttl;
+    return true;
+}
+
+bool WebDAVPropCache::props(const std::string &url, WebDAVProps &props, uint64_t now)
+{
+    std::string name;
+    std::string parent = parentKey(url, &name);
+    if (parent.empty() || name.empty())
+        return false;
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    auto item = m_items.find(parent);
+    if (item == m_items.end() || now >= item->second.expires)
+        return false;
+
+    for (const auto &entry : item->second.collection->entries)
+    {
+        if (entry.name == name)
+        {
+            props = entry;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WebDAVPropCache::invalidate(const std::string &url)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_items.erase(collectionKey(url));
+
+    std::string parent = parentKey(url);
+    if (!parent.empty())
+        m_items.erase(parent);
+}
+
+void WebDAVPropCache::clear()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_items.clear();
+}
+
+void WebDAVPropCache::evict()
+{
+    // Whichever is (or would be) stale first, a stale listing is only worth a revalidation
+    auto oldest = m_items.begin();
+    for (auto item = m_items.begin(); item != m_items.end(); ++item)
+    {
+        if (item->second.expires < oldest->second.expires)
+            oldest = item;
+    }
+
+    if (oldest != m_items.end())
+        m_items.erase(oldest);
+}
@@ -0,0 +1,102 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// WebDAV property cache
+//
+// A Depth: 1 PROPFIND answers for a whole collection at once, so its
+// entries are kept here per collection URL and everything opened from
+// the listing (size, directory or not, date) answers from them without
+// asking the server again. Once a listing is older than
+// WEBDAV_PROP_CACHE_TTL it is only trusted again after a Depth: 0
+// PROPFIND shows the collection's ETag (or, without one, its
+// Last-Modified date) hasn't changed.
+//
+// Collections are keyed by their http(s) URL with a trailing '/'. Anything
+// we change ourselves (PUT, DELETE, MKCOL) drops the listing it is in.
+//
+
+#ifndef MEATLOAF_NETWORK_WEBDAV_CACHE
+#define MEATLOAF_NETWORK_WEBDAV_CACHE
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define WEBDAV_PROP_CACHE_TTL         10000   // ms before a listing is revalidated
+#define WEBDAV_PROP_CACHE_MAX_ENTRIES 16
+
+// Properties of one resource
+struct WebDAVProps {
+    std::string name;           // decoded last path segment
+    bool isDir = false;
+    uint32_t size = 0;
+    time_t lastWrite = 0;
+};
+
+// A collection and its members
+struct WebDAVCollection {
+    std::string validator;      // getetag, or getlastmodified if it has none
+    std::vector<WebDAVProps> entries;
+};
+
+class WebDAVPropCache {
+public:
+    WebDAVPropCache(uint32_t ttl = WEBDAV_PROP_CACHE_TTL, size_t max_entries = WEBDAV_PROP_CACHE_MAX_ENTRIES)
+        : m_ttl(ttl), m_max_entries(max_entries) {};
+
+    // Listing of the collection at url, nullptr if there is none. A listing
+    // past its TTL is still handed out with fresh false, to be revalidated.
+    std::shared_ptr<const WebDAVCollection> get(const std::string &url, uint64_t now, bool &fresh);
+    void put(const std::string &url, const WebDAVCollection &collection, uint64_t now);
+
+    // The server still has what we listed: good for another TTL. A changed
+    // validator drops the listing. Returns true if it was kept.
+    bool revalidate(const std::string &url, const std::string &validator, uint64_t now);
+
+    // Properties of url from a fresh listing of its collection
+    bool props(const std::string &url, WebDAVProps &props, uint64_t now);
+
+    // Drop the listing url is in, and its own if it is a collection
+    void invalidate(const std::string &url);
+    void clear();
+
+    size_t count() { return m_items.size(); };
+
+    // Collection url with a trailing '/'
+    static std::string collectionKey(const std::string &url);
+    // Collection url is in, and its name in it
+    static std::string parentKey(const std::string &url, std::string *name = nullptr);
+
+private:
+    struct Item {
+        std::shared_ptr<const WebDAVCollection> collection;
+        uint64_t expires;
+    };
+
+    void evict();
+
+    uint32_t m_ttl;
+    size_t m_max_entries;
+    std::map<std::string, Item> m_items;
+    std::mutex m_lock;
+};
+
+#endif // MEATLOAF_NETWORK_WEBDAV_CACHE
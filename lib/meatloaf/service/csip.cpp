@@ -28,27 +28,44 @@
 // utilities/disk tools/cie.d64
 
 CSIPMSessionMgr CSIPMFileSystem::session;
+CSIPListingCache CSIPMFileSystem::listings;
+
+static bool isImage(const std::string &part) {
+    return mstr::endsWith(part, ".d64", false);
+}
 
 bool CSIPMSessionMgr::establishSession() {
     if(!buf.is_open()) {
-        currentDir = "csip:/";
+        // Nothing is known about where a new connection is
+        m_location.clear();
+        m_locationKnown = false;
         buf.open();
     }
     
     return buf.is_open();
 }
 
-std::string CSIPMSessionMgr::readLn() {
-    char buffer[80];
+void CSIPMSessionMgr::reset() {
+    // Replies we no longer expect may still be coming, start over
+    buf.close();
+    clear();
+    m_location.clear();
+    m_locationKnown = false;
+}
+
+std::string CSIPMSessionMgr::readLn(uint32_t timeout) {
+    char buffer[80] = { 0 };
     std::string line;
+
+    // A reply that timed out leaves the stream failed
+    clear();
+    buf.m_timeout = timeout;
+
     // telnet line ends with 10;
     getline(buffer, 80, 10);
     line = buffer;
-    // if (line.empty()) {
-    //     usleep(150000000); // 1.5 sec delay if no data
-    //     getline(buffer, 80, 10);
-    // }
-    // line = buffer;
+    buf.m_timeout = CSIP_REPLY_TIMEOUT;
+
     if (line.empty()) {
         line = '\x04';
     }
@@ -58,104 +75,92 @@ std::string CSIPMSessionMgr::readLn() {
 }
 
 bool CSIPMSessionMgr::sendCommand(std::string command) {
-    std::string c = mstr::toPETSCII2(command);
+    return sendCommands({ command });
+}
+
+bool CSIPMSessionMgr::sendCommands(const std::vector<std::string> &commands) {
+    if(!establishSession())
+        return false;
+
     // 13 (CR) sends the command
-    if(establishSession()) {
-        Debug_printv("command[%s]", c.c_str());
-        (*this) << (c+'\r');
-        (*this).flush();
-        (*this).sync();
-        sleep(1);
-        return true;
+    std::string c;
+    for(const auto &command : commands) {
+        Debug_printv("command[%s]", command.c_str());
+        c += mstr::toPETSCII2(command) + '\r';
     }
-    else
-        return false;
+
+    (*this) << c;
+    (*this).flush();
+    return buf.is_open();
 }
 
 bool CSIPMSessionMgr::isOK() {
-    // auto a = readLn();
-
     auto reply = readLn();
-    // for(int i = 0 ; i<reply.length(); i++)
-    //     Debug_printv("'%d'", reply[i]);
 
-    bool equals = strncmp("00 - OK\x0d", reply.c_str(), 7);
+    // "00 - OK", errors look like "?500 - CANNOT CHANGE TO ..."
+    bool ok = ( reply[0] != '?' && reply[0] != '\x04' );
 
-    Debug_printv("ok[%s] equals[%d]", reply.c_str(), equals);
+    Debug_printv("ok[%s] equals[%d]", reply.c_str(), ok);
 
-    return equals;
+    return ok;
 }
 
-bool CSIPMSessionMgr::traversePath(MFile* path) {
-    // tricky. First we have to
-    // CF / - to go back to root
+bool CSIPMSessionMgr::traversePath(MFile* path, const std::string &next) {
+    // Directories from the root, ending with the disk image if there is one
+    std::vector<std::string> target;
+    for(const auto &part : mstr::split(path->path, '/')) {
+        if(part.empty())
+            continue;
+
+        target.push_back(part);
+        if(isImage(part))
+            break;
+    }
 
     //Debug_printv("Traversing path: [%s]", path->path.c_str());
+    establishSession();
 
-    if(buf.is_open()) {
-        // if we are still connected we can smart change dir by just going up or down
-        // but for time being, we stick to traversing from root
-        if(!sendCommand("cf /"))
-            return false;
-    }
-    else {
-        // if we aren't, change dir to root (alos connects the session);
-        if(!sendCommand("cf /"))
-            return false;
+    // Carry on from where we are when it's on the way, anywhere else is reached from the root
+    bool onTheWay = m_locationKnown && buf.is_open() &&
+        m_location.size() <= target.size() &&
+        std::equal(m_location.begin(), m_location.end(), target.begin());
+
+    std::vector<std::string> commands;
+    if(!onTheWay)
+        commands.push_back("cf /");
+
+    for(size_t i = onTheWay ? m_location.size() : 0; i < target.size(); i++) {
+        // INSERT mounts the image, CF xxx browses into subsequent dirs
+        commands.push_back((isImage(target[i]) ? "insert " : "cf ") + target[i]);
     }
 
-    if(isOK()) {
-        Debug_printv("path[%s]", path->path.c_str());
-        if(path->path.compare("/") == 0) {
-            currentDir = path->url;
-            return true;
-        }
+    size_t replies = commands.size();
+    if(next.size())
+        commands.push_back(next);
 
-        std::vector<std::string> chopped = mstr::split(path->path, '/');
-
-        //MFile::parsePath(&chopped, path->path); - nope this doessn't work and crases in the loop!
-
-        Debug_printv("Before loop");
-        //Debug_printv("Chopped size:%d\r\n", chopped.size());
-        fnSystem.delay(500);
-
-        for(size_t i = 1; i < chopped.size(); i++) {
-            //Debug_printv("Before chopped deref");
-
-            auto part = chopped[i];
-            
-            //Debug_printv("traverse path part: [%s]\r\n", part.c_str());
-            if(mstr::endsWith(part, ".d64", false)) 
-            {
-                // THEN we have to mount the image INSERT image_name
-                sendCommand("insert "+part);
-
-                // disk image is the end, so return
-                if(isOK()) {
-                    currentDir = path->url;
-                    return true;
-                }
-                else {
-                    // or: ?500 - DISK NOT FOUND.
-                    return false;
-                }
-            }
-            else 
-            {
-                // CF xxx - to browse into subsequent dirs
-                sendCommand("cf "+part);
-                if(!isOK()) {
-                    // or: ?500 - CANNOT CHANGE TO dupa
-                    return false;
-                }
-            }
-        }
-        
-        currentDir = path->url;
+    if(commands.empty())
         return true;
+
+    // Every command in one write, then their replies
+    m_locationKnown = false;
+    if(!sendCommands(commands)) {
+        reset();
+        return false;
     }
-    else
-        return false; // shouldn't really happen, right?
+
+    for(size_t i = 0; i < replies; i++) {
+        if(!isOK()) {
+            // or: ?500 - CANNOT CHANGE TO dupa, or: ?500 - DISK NOT FOUND.
+            Debug_printv("failed [%s]", commands[i].c_str());
+            reset();
+            return false;
+        }
+    }
+
+    Debug_printv("path[%s] commands[%d]", path->path.c_str(), replies);
+    m_location = target;
+    m_locationKnown = true;
+    return true;
 }
 
 /********************************************************
@@ -174,14 +179,13 @@ bool CSIPMStream::open(std::ios_base::openmode mode) {
     if(file->isDirectory())
         return false; // or do we want to stream whole d64 image? :D
 
-    if(CSIPMFileSystem::session.traversePath(file.get())) {
-        // should we allow loading of * in any directory?
-        // then we can LOAD and get available count from first 2 bytes in (LH) endian
-        // name here MUST BE UPPER CASE
-        // trim spaces from right of name too
-        mstr::rtrimA0(file->name);
-        //mstr::toPETSCII2(file->name);
-        CSIPMFileSystem::session.sendCommand("load "+file->name);
+    // should we allow loading of * in any directory?
+    // then we can LOAD and get available count from first 2 bytes in (LH) endian
+    // name here MUST BE UPPER CASE
+    // trim spaces from right of name too
+    mstr::rtrimA0(file->name);
+    //mstr::toPETSCII2(file->name);
+    if(CSIPMFileSystem::session.traversePath(file.get(), "load "+file->name)) {
         // read first 2 bytes with size, low first, but may also reply with: ?500 - ERROR
         uint8_t buffer[2] = { 0, 0 };
         read(buffer, 2);
@@ -226,6 +230,21 @@ bool CSIPMStream::isOpen() {
  * File impls
  ********************************************************/
 
+CSIPMFile::CSIPMFile(std::string path, size_t size): MFile(path)
+{
+    //Debug_printv("path[%s] size[%d]", path.c_str(), size);
+
+    // A file that was listed already has its size
+    uint32_t listed = 0;
+    if(size == 0 && CSIPMFileSystem::listings.fileSize(url, listed, fnSystem.millis()))
+        size = listed;
+    this->size = size;
+
+    media_blocks_free = 65535;
+    //media_block_size = 1; // blocks are already calculated
+    m_rootfs = true;
+};
+
 bool CSIPMFile::isDirectory() {
     // if penultimate part is .d64 - it is a file
     // otherwise - false
@@ -272,54 +291,140 @@ MStream* CSIPMFile::createStream(std::ios_base::openmode mode)
 
 bool CSIPMFile::rewindDirectory() {    
     dirIsOpen = false;
+    m_listing.reset();
+    m_entry = 0;
 
     if(!isDirectory())
         return false;
 
+    m_listing = CSIPMFileSystem::listings.get(url, fnSystem.millis());
+    if(m_listing == nullptr)
+    {
+        CSIPListing listing;
+        if(!readListing(listing))
+            return false;
 
-    //Debug_printv("pre traverse path");
+        CSIPMFileSystem::listings.put(url, listing, fnSystem.millis());
+        m_listing = std::make_shared<const CSIPListing>(listing);
+    }
 
-    if(!CSIPMFileSystem::session.traversePath(this)) return false;
+    dirIsImage = m_listing->isImage;
+    media_image = m_listing->media_image;
+    media_header = m_listing->media_header;
+    media_id = m_listing->media_id;
+    media_blocks_free = m_listing->media_blocks_free;
+    dirIsOpen = true;
 
-    //Debug_printv("post traverse path");
+    return true;
+};
+
+bool CSIPMFile::readListing(CSIPListing &listing) {
+    auto &session = CSIPMFileSystem::session;
+
+    std::string new_url = url;
+    if(url.size()>8) // If we are not at root then add additional "/"
+        new_url += "/";
 
-    if(mstr::endsWith(path, ".d64", false))
+    listing.isImage = mstr::endsWith(path, ".d64", false);
+    if(listing.isImage)
     {
-        dirIsImage = true;
         // to list image contents we have to run
         Debug_printv("cserver: this is a d64 img, sending $ command!");
-        CSIPMFileSystem::session.sendCommand("$");
-        auto line = CSIPMFileSystem::session.readLn(); // mounted image name
-        if(CSIPMFileSystem::session.is_open() && line.size()) {
-            dirIsOpen = true;
-            media_image = line.substr(5);
-            line = CSIPMFileSystem::session.readLn(); // dir header
-            media_header = line.substr(2, line.find_last_of("\""));
-            media_id = line.substr(line.find_last_of("\"")+2);
-            return true;
-        }
-        else
+        if(!session.traversePath(this, "$"))
             return false;
+
+        auto line = session.readLn(); // mounted image name
+        if(!session.is_open() || line.find('\x04')!=std::string::npos)
+            return false;
+
+        listing.media_image = line.substr(std::min(line.size(), (size_t)5));
+        line = session.readLn(); // dir header
+        listing.media_header = line.substr(std::min(line.size(), (size_t)2), line.find_last_of("\""));
+        listing.media_id = line.substr(std::min(line.size(), line.find_last_of("\"")+2));
+
+        while(true)
+        {
+            line = session.readLn(CSIP_LISTING_IDLE_TIMEOUT);
+            // 'ot line:'0 ␒"CIE�������������" 00�2A�
+            // 'ot line:'2   "CIE+SERIAL      " PRG   2049
+            // 'ot line:'1   "CIE-SYS31801    " PRG   2049
+            // 'ot line:'1   "CIE-SYS31801S   " PRG   2049
+            // 'ot line:'1   "CIE-SYS52281    " PRG   2049
+            // 'ot line:'1   "CIE-SYS52281S   " PRG   2049
+            // 'ot line:'658 BLOCKS FREE.
+
+            if(line.find('\x04')!=std::string::npos)
+                break;
+
+            if(line.find("BLOCKS FREE.")!=std::string::npos) {
+                listing.media_blocks_free = atoi(line.substr(0, line.find_first_of(" ")).c_str());
+                break;
+            }
+
+            if(line.size() <= 5)
+                continue;
+
+            CSIPDirEntry entry;
+            entry.name = line.substr(5,15);
+            entry.size = atoi(line.substr(0, line.find_first_of(" ")).c_str());
+            mstr::rtrim(entry.name);
+            entry.url = new_url + entry.name;
+            listing.entries.push_back(entry);
+        }
     }
-    else 
+    else
     {
-        dirIsImage = false;
         // to list directory contents we use
         Debug_printv("cserver: this is a directory!");
-        CSIPMFileSystem::session.sendCommand("disks");
-        auto line = CSIPMFileSystem::session.readLn(); // dir header
+        if(!session.traversePath(this, "disks"))
+            return false;
+
+        auto line = session.readLn(); // dir header
         //Debug_printv("line[%s]", line.c_str());
-        if(CSIPMFileSystem::session.is_open() && line.size()) {
-            media_header = line.substr(2, line.find_last_of("]")-1);
-            media_id = "C=SVR";
-            dirIsOpen = true;
+        if(!session.is_open() || line.find('\x04')!=std::string::npos)
+            return false;
 
-            return true;
+        listing.media_header = line.substr(std::min(line.size(), (size_t)2), line.find_last_of("]")-1);
+        listing.media_id = "C=SVR";
+
+        while(true)
+        {
+            line = session.readLn(CSIP_LISTING_IDLE_TIMEOUT);
+            // 'ot line:'FAST-TESTER DELUXE EXCESS.D64
+            // 'ot line:'EMPTY.D64
+            // 'ot line:'CMD UTILITIES D1.D64
+            // 'ot line:'SINGLE DISKCOPY 64 (1983)(KEVIN PICKELL).D64
+            // 'ot line:'FLOPPY REPAIR KIT (1984)(ORCHID SOFTWARE LABORATOR
+            // 'ot line:'1541 DEMO DISK (19XX)(-).D64
+
+            // 32 62 91 68 73 83 75 32 84 79 79 76 83 93 13 No more! = > [DISK TOOLS]
+
+            // The server has nothing more to say
+            if(line.find('\x04')!=std::string::npos)
+                break;
+
+            CSIPDirEntry entry;
+            if((*line.begin())=='[') {
+                entry.name = line.substr(1,line.length()-3);
+                entry.size = 0;
+            }
+            else {
+                entry.name = line.substr(0, line.length()-1);
+                entry.size = (683 * 256);
+            }
+            entry.name = mstr::toPETSCII2(entry.name);
+
+            if(entry.name.empty())
+                break;
+
+            entry.url = new_url + entry.name;
+            listing.entries.push_back(entry);
         }
-        else 
-            return false;
     }
-};
+
+    Debug_printv("url[%s] entries[%d]", url.c_str(), listing.entries.size());
+    return true;
+}
 
 MFile* CSIPMFile::getNextFileInDir() {
 
@@ -328,97 +433,18 @@ MFile* CSIPMFile::getNextFileInDir() {
     if(!dirIsOpen)
         rewindDirectory();
 
-    //Debug_printv("pre dir is open");
-
-    if(!dirIsOpen)
+    if(!dirIsOpen || m_listing == nullptr)
         return nullptr;
 
-    std::string name;
-    size_t size;
-    std::string new_url = url;
-
-    if(url.size()>8) // If we are not at root then add additional "/"
-        new_url += "/";
-
-    //Debug_printv("pre dir is image");
-
-    if(dirIsImage) {
-        auto line = CSIPMFileSystem::session.readLn();
-        Debug_printv("next file in dir got %s", line.c_str());
-        // 'ot line:'0 ␒"CIE�������������" 00�2A�
-        // 'ot line:'2   "CIE+SERIAL      " PRG   2049
-        // 'ot line:'1   "CIE-SYS31801    " PRG   2049
-        // 'ot line:'1   "CIE-SYS31801S   " PRG   2049
-        // 'ot line:'1   "CIE-SYS52281    " PRG   2049
-        // 'ot line:'1   "CIE-SYS52281S   " PRG   2049
-        // 'ot line:'658 BLOCKS FREE.
-
-        if(line.find('\x04')!=std::string::npos) {
-            Debug_printv("No more!");
-            dirIsOpen = false;
-            return nullptr;
-        }
-        if(line.find("BLOCKS FREE.")!=std::string::npos) {
-            media_blocks_free = atoi(line.substr(0, line.find_first_of(" ")).c_str());
-            dirIsOpen = false;
-            return nullptr;
-        }
-        else {
-            name = line.substr(5,15);
-            size = atoi(line.substr(0, line.find_first_of(" ")).c_str());
-            mstr::rtrim(name);
-            Debug_printv("xx: %s -- %s %d", line.c_str(), name.c_str(), size);
-            //return new CSIPMFile(path() +"/"+ name);
-            new_url += name;
-            return new CSIPMFile(new_url, size);
-        }
-    } else {
-        auto line = CSIPMFileSystem::session.readLn();
-        // Got line:''
-        // Got line:''
-        // 'ot line:'FAST-TESTER DELUXE EXCESS.D64
-        // 'ot line:'EMPTY.D64
-        // 'ot line:'CMD UTILITIES D1.D64
-        // 'ot line:'CBMCMD22.D64
-        // 'ot line:'NAV96.D64
-        // 'ot line:'NAV92.D64
-        // 'ot line:'SINGLE DISKCOPY 64 (1983)(KEVIN PICKELL).D64
-        // 'ot line:'LYNX (19XX)(-).D64
-        // 'ot line:'GEOS DISK EDITOR (1990)(GREG BADROS).D64
-        // 'ot line:'FLOPPY REPAIR KIT (1984)(ORCHID SOFTWARE LABORATOR
-        // 'ot line:'1541 DEMO DISK (19XX)(-).D64
-
-        // 32 62 91 68 73 83 75 32 84 79 79 76 83 93 13 No more! = > [DISK TOOLS]
-
-        //Debug_printv("line[%s]", line.c_str());
-        if(line.find('\x04')!=std::string::npos) {
-            Debug_printv("No more!");
-            dirIsOpen = false;
-            return nullptr;
-        }
-        else {
-
-            if((*line.begin())=='[') {
-                name = line.substr(1,line.length()-3);
-                size = 0;
-            }
-            else {
-                name = line.substr(0, line.length()-1);
-                size = (683 * 256);
-            }
-            name = mstr::toPETSCII2(name);
-
-            //Debug_printv("url[%s] name[%s] size[%d]", url.c_str(), name.c_str(), size);
-            if(name.size() > 0)
-            {
-                new_url += name;
-                //Debug_printv("new_url[%s]", new_url.c_str());
-                return new CSIPMFile(new_url, size);
-            }
-            else
-                return nullptr;
-        }
+    if(m_entry >= m_listing->entries.size()) {
+        Debug_printv("No more!");
+        dirIsOpen = false;
+        return nullptr;
     }
+
+    const auto &entry = m_listing->entries[m_entry++];
+    //Debug_printv("url[%s] name[%s] size[%d]", entry.url.c_str(), entry.name.c_str(), entry.size);
+    return new CSIPMFile(entry.url, entry.size);
 };
 
 bool CSIPMFile::exists() {
@@ -24,6 +24,7 @@
 
 #include "meatloaf.h"
 #include "network/tcp.h"
+#include "csip_cache.h"
 
 #include "fnSystem.h"
 #include "fnTcpClient.h"
@@ -34,16 +35,20 @@
 #include <streambuf>
 #include <istream>
 
+#define CSIP_REPLY_TIMEOUT        3500  // ms to wait for a reply to start
+#define CSIP_LISTING_IDLE_TIMEOUT 1000  // ms of quiet that ends a listing
+
 /********************************************************
  * Telnet buffer
  ********************************************************/
 
 class csstreambuf : public std::streambuf {
-    char* gbuf;
-    char* pbuf;
+    char* gbuf = nullptr;
+    char* pbuf = nullptr;
 
 protected:
     MeatSocket m_wifi;
+    uint32_t m_timeout = CSIP_REPLY_TIMEOUT;
 
 public:
     csstreambuf() {}
@@ -85,6 +90,9 @@ public:
             delete[] gbuf;
         if(pbuf != nullptr)
             delete[] pbuf;
+        gbuf = pbuf = nullptr;
+        setg(nullptr, nullptr, nullptr);
+        setp(nullptr, nullptr);
     }
 
     int underflow() override {
@@ -96,17 +104,13 @@ public:
         }
         else if (this->gptr() == this->egptr()) {
             int readCount = 0;
-            int attempts = 5;
-            int wait = 500;
-            
-            readCount = m_wifi.read((uint8_t*)gbuf, 512);
-
-            while( readCount <= 0 && (attempts--)>0 && m_wifi.isOpen()) {
-                Debug_printv("got rc: %d, retrying", readCount);
-                fnSystem.delay(wait);
-                wait+=100;
+
+            // Take the reply as soon as it arrives
+            if ( m_wifi.waitForData(m_timeout) )
                 readCount = m_wifi.read((uint8_t*)gbuf, 512);
-            } 
+
+            if ( readCount <= 0 )
+                readCount = 0;
             //Debug_printv("read success: %d", readCount);
             this->setg(gbuf, gbuf, gbuf + readCount);
         }
@@ -177,17 +181,26 @@ class CSIPMSessionMgr : public std::iostream {
     csstreambuf buf;
 
 protected:
-    std::string currentDir;
+    // Where the server has us: directories from the root, maybe an inserted image last
+    std::vector<std::string> m_location;
+    bool m_locationKnown = false;
 
     bool establishSession();
 
     bool sendCommand(std::string);
-    
-    bool traversePath(MFile* path);
+
+    // Commands go out in one write, replies are read afterwards in order
+    bool sendCommands(const std::vector<std::string> &commands);
+
+    // Change to the directory or image path is in, then send next (if any)
+    // with the same write. Its reply is left for the caller.
+    bool traversePath(MFile* path, const std::string &next = "");
 
     bool isOK();
 
-    std::string readLn();
+    std::string readLn(uint32_t timeout = CSIP_REPLY_TIMEOUT);
+
+    void reset();
 
 public:
     CSIPMSessionMgr(std::string user = "", std::string pass = "") : std::iostream(&buf), m_user(user), m_pass(pass)
@@ -199,8 +212,15 @@ public:
 
     // read/write are used only by MStream
     size_t receive(uint8_t* buffer, size_t size) {
-        if(buf.is_open())
-            return buf.m_wifi.read(buffer, size);
+        // Part of it may have come in with the replies before it
+        std::streamsize buffered = buf.in_avail();
+        if(buffered > 0)
+            return buf.sgetn((char*)buffer, std::min((std::streamsize)size, buffered));
+
+        if(buf.is_open() && buf.m_wifi.waitForData(CSIP_REPLY_TIMEOUT)) {
+            int count = buf.m_wifi.read(buffer, size);
+            return (count > 0) ? count : 0;
+        }
         else
             return 0;
     }
@@ -227,17 +247,7 @@ public:
 class CSIPMFile: public MFile {
 
 public:
-    CSIPMFile(std::string path, size_t size = 0): MFile(path)
-    {
-        //Debug_printv("path[%s] size[%d]", path.c_str(), size);
-        this->size = size;
-
-        media_blocks_free = 65535;
-        //media_block_size = 1; // blocks are already calculated
-        //parseUrl(path);
-        //Debug_printv("path[%s] size[%d]", path.c_str(), size);
-        m_rootfs = true;
-    };
+    CSIPMFile(std::string path, size_t size = 0);
 
 
     MStream* getSourceStream(std::ios_base::openmode mode=std::ios_base::in) override ; // has to return OPENED stream
@@ -261,6 +271,12 @@ public:
 
 private:
     bool dirIsImage = false;
+
+    // Listing being read, shared with the listing cache
+    std::shared_ptr<const CSIPListing> m_listing;
+    size_t m_entry = 0;
+
+    bool readListing(CSIPListing &listing);
 };
 
 /********************************************************
@@ -310,6 +326,7 @@ public:
     CSIPMFileSystem(): MFileSystem("csip") {};
 
     static CSIPMSessionMgr session;
+    static CSIPListingCache listings;
 
     bool handles(std::string name) 
     {
@@ -0,0 +1,111 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "csip_cache.h"
+
+std::shared_ptr<const CSIPListing> CSIPListingCache::get(const std::string &url, uint64_t now)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    auto item = m_items.find(url);
+    if (item == m_items.end())
+        return nullptr;
+
+    if (now >= item->second.expires)
+    {
+        m_items.erase(item);
+        return nullptr;
+    }
+
+    return item->second.listing;
+}
+
+void CSIPListingCache::put(const std::string &url, const CSIPListing &listing, uint64_t now)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (m_items.find(url) == m_items.end() && m_items.size() >= m_max_entries)
+        evict(now);
+
+    m_items[url] = { std::make_shared<const CSIPListing>(listing), now + m_ttl };
+}
+
+bool CSIPListingCache::fileSize(const std::string &url, uint32_t &size, uint64_t now)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    // The listing it was in is keyed by a prefix of its URL
+    for (const auto &item : m_items)
+    {
+        if (now >= item.second.expires || url.compare(0, item.first.size(), item.first) != 0)
+            continue;
+
+        for (const auto &entry : item.second.listing->entries)
+        {
+            if (entry.url == url)
+            {
+                size = entry.size;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void CSIPListingCache::invalidate(const std::string &url)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_items.erase(url);
+
+    std::string dir = url;
+    if (dir.empty() || dir.back() != '/')
+        dir += '/';
+
+    auto item = m_items.lower_bound(dir);
+    while (item != m_items.end() && item->first.compare(0, dir.size(), dir) == 0)
+        item = m_items.erase(item);
+}
+
+void CSIPListingCache::clear()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_items.clear();
+}
+
+void CSIPListingCache::evict(uint64_t now)
+{
+    // Expired entries first, then whichever would have expired soonest
+    auto oldest = m_items.end();
+    for (auto item = m_items.begin(); item != m_items.end(); )
+    {
+        if (now >= item->second.expires)
+        {
+            item = m_items.erase(item);
+            continue;
+        }
+
+        if (oldest == m_items.end() || item->second.expires < oldest->second.expires)
+            oldest = item;
+        ++item;
+    }
+
+    if (m_items.size() >= m_max_entries && oldest != m_items.end())
+        m_items.erase(oldest);
+}
@@ -0,0 +1,88 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// CSIP listing cache
+//
+// Listing a CommodoreServer directory took a walk from the root, one
+// "cf" per level, then a listing that only ends when the server goes
+// quiet. Listings are kept here per directory (or disk image) URL for
+// CSIP_LISTING_CACHE_TTL, so going back into a directory, or opening
+// a file that was listed in it, doesn't ask the server again. The size
+// of each listed file is answered from the listing it came in.
+//
+
+#ifndef MEATLOAF_SERVICE_CSIP_CACHE
+#define MEATLOAF_SERVICE_CSIP_CACHE
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CSIP_LISTING_CACHE_TTL         60000   // ms, CommodoreServer content changes rarely
+#define CSIP_LISTING_CACHE_MAX_ENTRIES 16
+
+struct CSIPDirEntry {
+    std::string url;
+    std::string name;
+    uint32_t size = 0;
+};
+
+struct CSIPListing {
+    bool isImage = false;
+    std::string media_image;
+    std::string media_header;
+    std::string media_id;
+    uint16_t media_blocks_free = 65535;
+    std::vector<CSIPDirEntry> entries;
+};
+
+class CSIPListingCache {
+public:
+    CSIPListingCache(uint32_t ttl = CSIP_LISTING_CACHE_TTL, size_t max_entries = CSIP_LISTING_CACHE_MAX_ENTRIES)
+        : m_ttl(ttl), m_max_entries(max_entries) {};
+
+    // Listing of url, nullptr if there is none or it expired
+    std::shared_ptr<const CSIPListing> get(const std::string &url, uint64_t now);
+    void put(const std::string &url, const CSIPListing &listing, uint64_t now);
+
+    // Size of a file from the listing it was in, false if it wasn't listed
+    bool fileSize(const std::string &url, uint32_t &size, uint64_t now);
+
+    // Drop url and every listing below it
+    void invalidate(const std::string &url);
+    void clear();
+
+    size_t count() { return m_items.size(); };
+
+private:
+    struct Item {
+        std::shared_ptr<const CSIPListing> listing;
+        uint64_t expires;
+    };
+
+    void evict(uint64_t now);
+
+    uint32_t m_ttl;
+    size_t m_max_entries;
+    std::map<std::string, Item> m_items;
+    std::mutex m_lock;
+};
+
+#endif // MEATLOAF_SERVICE_CSIP_CACHE
@@ -0,0 +1,130 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ml.h"
+
+#include <ctime>
+
+#include "fnFsSD.h"
+#include "fnSystem.h"
+
+#include "../../include/global_defines.h"
+#include "../../../include/debug.h"
+
+#define ML_RESOLVE_CACHE_FILE SYSTEM_DIR "/cache/ml.txt"
+#define ML_RESOLVE_EPOCH 1577836800     // 2020-01-01, anything earlier and the clock isn't set
+
+static MLResolveCache ml_resolve_cache;
+static bool ml_resolve_loaded = false;
+static std::mutex ml_resolve_file_lock;
+
+static uint32_t ml_now()
+{
+    time_t now = time(nullptr);
+    return (now < ML_RESOLVE_EPOCH) ? 0 : (uint32_t)now;
+}
+
+// Answers from before the reboot, once the SD card is there
+static void ml_resolve_load()
+{
+    std::lock_guard<std::mutex> guard(ml_resolve_file_lock);
+    if (ml_resolve_loaded || !fnSDFAT.running())
+        return;
+
+    ml_resolve_loaded = true;
+    FILE *f = fnSDFAT.file_open(ML_RESOLVE_CACHE_FILE, "r");
+    if (f == nullptr)
+        return;
+
+    ml_resolve_cache.load(f);
+    fclose(f);
+    Debug_printv("entries[%d]", ml_resolve_cache.size());
+}
+
+static void ml_resolve_save()
+{
+    std::lock_guard<std::mutex> guard(ml_resolve_file_lock);
+    if (!ml_resolve_cache.dirty() || !fnSDFAT.running())
+        return;
+
+    fnSDFAT.create_path(SYSTEM_DIR "/cache");
+    FILE *f = fnSDFAT.file_open(ML_RESOLVE_CACHE_FILE, "w");
+    if (f == nullptr)
+        return;
+
+    ml_resolve_cache.save(f, ml_now());
+    fclose(f);
+}
+
+static MLResolution ml_fetch(const std::string &ml_url)
+{
+    MLResolution result;
+
+    MeatHttpClient http;
+    bool opened = http.GET(ml_url);
+
+    if (http.wasRedirected)
+    {
+        // Where it points, whether or not that is there right now
+        result.reached = true;
+        result.found = true;
+        result.value = http.url;
+    }
+    else if (opened)
+    {
+        // Served by the API itself
+        result.reached = true;
+        result.found = true;
+        result.value = ml_url;
+    }
+    else if (http.lastRC == 404 || http.lastRC == 410)
+    {
+        result.reached = true;
+    }
+    http.close();
+
+    Debug_printv("ml_url[%s] rc[%d] target[%s]", ml_url.c_str(), http.lastRC, result.value.c_str());
+    return result;
+}
+
+std::string MLMFileSystem::resolve(std::string path) {
+    if ( path.size() == 0 )
+        return "";
+
+    //Debug_printv("MLFileSystem::getFile(%s)", path.c_str());
+    auto urlParser = PeoplesUrlParser::parseURL( path );
+    //std::string code = mstr::toUTF8(urlParser->name);
+
+    //Debug_printv("url[%s]", urlParser.name.c_str());
+    std::string ml_url = "https://api.meatloaf.cc/?" + urlParser->name;
+    if ( urlParser->query.size() > 0)
+        ml_url += "&" + urlParser->query;
+    if ( urlParser->fragment.size() > 0)
+        ml_url += "#" + urlParser->fragment;
+    Debug_printv("ml_url[%s]", ml_url.c_str());
+
+    ml_resolve_load();
+    std::string url = ml_resolve_cache.resolve(ml_url, ml_fetch, ml_now(), fnSystem.millis());
+    ml_resolve_save();
+
+    // Unknown or unreachable, the API answers for itself
+    if ( url.empty() )
+        url = ml_url;
+
+    Debug_printv("target url[%s]", url.c_str());
+    return url;
+}
@@ -17,6 +17,10 @@
 
 // ML:// - Meatloaf Server Protocol
 // 
+// ml:name is looked up on api.meatloaf.cc, which redirects to where the
+// name points. Answers are kept in an MLResolveCache, saved to SD so
+// they survive a reboot.
+//
 
 
 #ifndef MEATLOAF_SCHEME_ML
@@ -26,6 +30,8 @@
 
 #include "peoples_url_parser.h"
 
+#include "ml_cache.h"
+
 
 /********************************************************
  * FS
@@ -67,30 +73,8 @@ public:
         return nullptr;
     }
 
-    std::string resolve(std::string path) {
-        if ( path.size() == 0 )
-            return "";
-
-        //Debug_printv("MLFileSystem::getFile(%s)", path.c_str());
-        auto urlParser = PeoplesUrlParser::parseURL( path );
-        //std::string code = mstr::toUTF8(urlParser->name);
-
-        //Debug_printv("url[%s]", urlParser.name.c_str());
-        std::string ml_url = "https://api.meatloaf.cc/?" + urlParser->name;
-        if ( urlParser->query.size() > 0)
-            ml_url += "&" + urlParser->query;
-        if ( urlParser->fragment.size() > 0)
-            ml_url += "#" + urlParser->fragment;
-        Debug_printv("ml_url[%s]", ml_url.c_str());
-
-        auto http = new HTTPMFile(ml_url);
-        auto reader = http->getSourceStream();
-        auto url = reader->url;
-        delete http;
-
-        Debug_printv("target url[%s]", url.c_str());
-        return url;
-    }
+    // Where an ml: path points, from the resolution cache when we can
+    std::string resolve(std::string path);
 };
 
 
@@ -0,0 +1,70 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ml_cache.h"
+
+#include <cstdlib>
+#include <cstring>
+
+void MLResolveCache::save(FILE *file, uint32_t now)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    // expires \t name \t target
+    for (auto &e : _entries)
+    {
+        if (!e.second.found)
+            continue;
+
+        uint32_t expires = e.second.expires;
+        if (expires == 0 && now != 0)
+            expires = now + _ttl;  // resolved before the clock was set
+        if (expires == 0 || (now != 0 && expires <= now))
+            continue;
+
+        fprintf(file, "%lu\t%s\t%s\n", (unsigned long)expires, e.first.c_str(), e.second.value.c_str());
+    }
+
+    _changed = false;
+}
+
+void MLResolveCache::load(FILE *file)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    char line[512];
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *name = strchr(line, '\t');
+        char *target = name ? strchr(name + 1, '\t') : nullptr;
+        if (target == nullptr || target[1] == '\0')
+            continue;
+        *name++ = '\0';
+        *target++ = '\0';
+
+        // Resolved this boot already, that one is newer
+        if (_entries.find(name) != _entries.end() || _entries.size() >= _max_entries)
+            continue;
+
+        Entry entry;
+        entry.value = target;
+        entry.expires = strtoul(line, nullptr, 10);
+        _entries[name] = entry;
+    }
+}
@@ -0,0 +1,59 @@
+// Meatloaf - A Commodore 64/128 multi-device emulator
+// https://github.com/idolpx/meatloaf
+// Copyright(C) 2020 James Johnston
+//
+// Meatloaf is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Meatloaf is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Meatloaf. If not, see <http://www.gnu.org/licenses/>.
+
+// ml: resolution cache
+//
+// Every MFSOwner::File() on an ml: path asked api.meatloaf.cc where the
+// name points, several times during a single LOAD. Answers are kept here
+// for ML_RESOLVE_TTL, names the server doesn't know for
+// ML_RESOLVE_NEGATIVE_TTL.
+//
+// Answers are also saved to SD with their wall clock expiry so they can be
+// used after a reboot. Until SNTP has set the clock, saved entries are
+// trusted and the ones resolved since boot expire by millis().
+//
+
+#ifndef MEATLOAF_SERVICE_ML_CACHE
+#define MEATLOAF_SERVICE_ML_CACHE
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "resolve_cache.h"
+
+#define ML_RESOLVE_TTL          3600    // seconds
+#define ML_RESOLVE_NEGATIVE_TTL 60      // seconds, a name may be added any time
+#define ML_RESOLVE_MAX_ENTRIES  128
+
+// What the server said about a name, value is the target URL
+typedef ResolveAnswer<std::string> MLResolution;
+
+class MLResolveCache : public ResolveCache<std::string> {
+public:
+    MLResolveCache(uint32_t ttl = ML_RESOLVE_TTL, uint32_t negative_ttl = ML_RESOLVE_NEGATIVE_TTL, size_t max_entries = ML_RESOLVE_MAX_ENTRIES)
+        : ResolveCache("", ttl, negative_ttl, max_entries) {};
+
+    // Answers that are still good, one per line
+    void save(FILE *file, uint32_t now);
+    void load(FILE *file);
+
+    // Something worth saving changed since the last save()
+    bool dirty() { return _changed; };
+};
+
+#endif // MEATLOAF_SERVICE_ML_CACHE
@@ -21,7 +21,7 @@
 
 #define ENTRY_BUFFER_SIZE 256
 
-NetworkProtocolFS::NetworkProtocolFS(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf)
+NetworkProtocolFS::NetworkProtocolFS(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf)
     : NetworkProtocol(rx_buf, tx_buf, sp_buf)
 {
     fileSize = 0;
@@ -221,7 +221,7 @@ bool NetworkProtocolFS::read_file(unsigned short len)
         }
 
         // Append to receive buffer.
-        receiveBuffer->insert(receiveBuffer->end(), buf.begin(), buf.end());
+        receiveBuffer->append(buf.data(), buf.size());
         fileSize -= len;
     }
     else
@@ -32,7 +32,7 @@ DELETE, MKCOL, RMCOL, COPY, MOVE, are all handled via idempotent XIO commands.
 DELETE can be done via special/XIO if you do not want to handle the response, otherwise use aux1=5/9 with normal open/read.
 */
 
-NetworkProtocolHTTP::NetworkProtocolHTTP(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf)
+NetworkProtocolHTTP::NetworkProtocolHTTP(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf)
     : NetworkProtocolFS(rx_buf, tx_buf, sp_buf)
 {
     rename_implemented = true;
@@ -157,8 +157,6 @@ bool NetworkProtocolHTTP::open_file_handle()
 
 bool NetworkProtocolHTTP::open_dir_handle()
 {
-    int len, actual_len;
-
 #ifdef VERBOSE_PROTOCOL
     Debug_printf("NetworkProtocolHTTP::open_dir_handle()\r\n");
 #endif
@@ -194,7 +192,7 @@ bool NetworkProtocolHTTP::open_dir_handle()
         return true;
     }
 
-    // Setup XML WebDAV parser
+    // Setup XML WebDAV parser, read_dir_entry() parses as the response arrives
     if (webDAV.begin_parser())
     {
 #ifdef VERBOSE_PROTOCOL
@@ -204,23 +202,43 @@ bool NetworkProtocolHTTP::open_dir_handle()
         return true;
     }
 
-    std::vector<uint8_t> buf;
+    // Ready to be returned by read_dir_entry()
+    return false;
+}
+
+bool NetworkProtocolHTTP::next_dir_entry(WebDAV::DAVEntry &entry)
+{
+    char buf[WEBDAV_CHUNK_SIZE];
+    int len, actual_len;
 
-    // Process all response chunks
-    while ( !client->is_transaction_done() || client->available() > 0)
+    while (!webDAV.next(entry))
     {
+        if (webDAV.failed())
+        {
+#ifdef VERBOSE_PROTOCOL
+            Debug_printf("Could not parse buffer, returning 144\r\n");
+#endif
+            error = NETWORK_ERROR_GENERAL;
+            return false;
+        }
+
+        if (webDAV.finished())
+        {
+            error = NETWORK_ERROR_END_OF_FILE;
+            return false;
+        }
+
         len = client->available();
         if (len > 0)
         {
 #ifdef VERBOSE_PROTOCOL
             Debug_printf("data available %d ...\n", len);
 #endif
-            // increase chunk buffer if necessary
-            if (len >= buf.size())
-                buf.resize(len+1); // +1 for '\0'
+            if (len > (int)sizeof(buf))
+                len = sizeof(buf);
 
             // Grab the buffer
-            actual_len = client->read(buf.data(), len);
+            actual_len = client->read((uint8_t *)buf, len);
 
             if (actual_len != len)
             {
@@ -228,19 +246,16 @@ bool NetworkProtocolHTTP::open_dir_handle()
                 Debug_printf("Expected %d bytes, actually got %d bytes.\r\n", len, actual_len);
 #endif
                 error = NETWORK_ERROR_GENERAL;
-                break;
+                return false;
             }
-            buf[len] = '\0'; // make buffer C string compatible for Debug_printf()
 
-            // Parse the buffer
-            if (webDAV.parse((char *)buf.data(), len, false))
-            {
-#ifdef VERBOSE_PROTOCOL
-                Debug_printf("Could not parse buffer, returning 144\r\n");
-#endif
-                error = NETWORK_ERROR_GENERAL;
-                break;
-            }
+            // Parse the buffer, stops at the first entry in it
+            webDAV.parse(buf, len, false);
+        }
+        else if (len == 0 && client->is_transaction_done())
+        {
+            // No more data
+            webDAV.parse(nullptr, 0, true);
         }
         else if (len == 0)
         {
@@ -257,37 +272,11 @@ bool NetworkProtocolHTTP::open_dir_handle()
             Debug_println("ERROR: negative length returned from client->available()\r\n");
 #endif
             error = NETWORK_ERROR_GENERAL;
-            break;
+            return false;
         }
     }
 
-    if (error != NETWORK_ERROR_SUCCESS)
-    {
-#ifdef VERBOSE_PROTOCOL
-        Debug_printf("NetworkProtocolHTTP::open_dir_handle() - error %u\r\n", error);
-#endif
-        webDAV.end_parser(true); // release parser resources + clear collected entries
-        return true;
-    }
-
-    // finish parsing (not sure if this is necessary)
-    webDAV.parse(nullptr, 0, true);
-
-    // Release parser resources (keep directory entries)
-    webDAV.end_parser();
-
-    // Scoot to beginning of directory entries.
-    dirEntryCursor = webDAV.rewind();
-
-    if (client != nullptr)
-    {
-        delete client;
-        client = new HTTP_CLIENT_CLASS();
-        client->begin(opened_url->url);
-    }
-
-    // Directory parsed, ready to be returned by read_dir_entry()
-    return false;
+    return true;
 }
 
 bool NetworkProtocolHTTP::mount(PeoplesUrlParser *url)
@@ -537,20 +526,20 @@ bool NetworkProtocolHTTP::read_dir_entry(char *buf, unsigned short len)
     Debug_printf("NetworkProtocolHTTP::read_dir_entry(%p,%u)\r\n", buf, len);
 #endif
 
-    if (dirEntryCursor != webDAV.entries.end())
+    WebDAV::DAVEntry entry;
+
+    if (next_dir_entry(entry))
     {
-        strlcpy(buf, dirEntryCursor->filename.c_str(), len);
-        fileSize = atoi(dirEntryCursor->fileSize.c_str());
-        is_directory = dirEntryCursor->isDir;
-        ++dirEntryCursor;
+        strlcpy(buf, entry.filename.c_str(), len);
+        fileSize = atoi(entry.fileSize.c_str());
+        is_directory = entry.isDir;
 #ifdef VERBOSE_PROTOCOL
         Debug_printf("Returning: %s, %u, %s\r\n", buf, fileSize, is_directory ? "DIR" : "FILE");
 #endif
     }
     else
     {
-        // EOF
-        error = NETWORK_ERROR_END_OF_FILE;
+        // EOF, or the listing couldn't be read
         err = true;
     }
 
@@ -579,7 +568,16 @@ bool NetworkProtocolHTTP::close_dir_handle()
 #ifdef VERBOSE_PROTOCOL
     Debug_printf("NetworkProtocolHTTP::close_dir_handle()\r\n");
 #endif
-    webDAV.clear(); // release directory entries
+    webDAV.end_parser(true); // release parser resources + the entry in hand
+
+    // The PROPFIND may not have been read to the end
+    if (client != nullptr)
+    {
+        delete client;
+        client = new HTTP_CLIENT_CLASS();
+        client->begin(opened_url->url);
+    }
+
     return false;
 }
 
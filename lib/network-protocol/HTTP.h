@@ -38,7 +38,7 @@ public:
      * @param sp_buf pointer to special buffer
      * @return a NetworkProtocolFS object
      */
-    NetworkProtocolHTTP(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf);
+    NetworkProtocolHTTP(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf);
 
     /**
      * dTOR
@@ -245,9 +245,11 @@ private:
     WebDAV webDAV;
 
     /**
-     * Current Directory entry cursor
+     * @brief Feed the PROPFIND response to the parser until it has an entry
+     * @param entry receives the entry
+     * @return true if there was one, false (error set) at the end of the listing or on error
      */
-    std::vector<WebDAV::DAVEntry>::iterator dirEntryCursor;
+    bool next_dir_entry(WebDAV::DAVEntry &entry);
 
     /**
      * Do HTTP transaction
@@ -70,7 +70,7 @@ using namespace std;
  * @param tx_buf pointer to transmit buffer
  * @param sp_buf pointer to special buffer
  */
-NetworkProtocol::NetworkProtocol(std::string *rx_buf,
+NetworkProtocol::NetworkProtocol(NetworkRxBuffer *rx_buf,
                                  std::string *tx_buf,
                                  std::string *sp_buf)
 {
@@ -200,39 +200,57 @@ void NetworkProtocol::translate_receive_buffer()
 #ifdef VERBOSE_PROTOCOL
     Debug_printf("#### Translating receive buffer, mode: %u\r\n", translation_mode);
 #endif
+    // Only what arrived since last time, the rest is translated already
     if (translation_mode == 0)
+    {
+        receiveBuffer->translated();
         return;
+    }
 
-    #ifdef BUILD_ATARI
-    replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_BELL, ATASCII_BUZZER);
-    replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_BACKSPACE, ATASCII_DEL);
-    replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_TAB, ATASCII_TAB);
-    #endif   
-
-    switch (translation_mode)
+    if (translation_mode == TRANSLATION_MODE_PETSCII)
     {
-    case TRANSLATION_MODE_CR:
-        replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_CR, EOL);
-        break;
-    case TRANSLATION_MODE_LF:
-        replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_LF, EOL);
-        break;
-    case TRANSLATION_MODE_CRLF:
-    #ifndef BUILD_APPLE
-        // With Apple2, we would be translating CR to CR; a waste of CPU
-        replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_CR, EOL);
-    #endif
-        break;
-    case TRANSLATION_MODE_PETSCII:
 #ifdef VERBOSE_PROTOCOL
         Debug_printf("!!! PETSCII !!!\r\n");
 #endif
-        *receiveBuffer = mstr::toUTF8(*receiveBuffer);
-        break;
+        receiveBuffer->append(mstr::toUTF8(receiveBuffer->untranslated()));
+        receiveBuffer->translated();
+        return;
     }
 
-    if (translation_mode == TRANSLATION_MODE_CRLF)
-        receiveBuffer->erase(std::remove(receiveBuffer->begin(), receiveBuffer->end(), '\n'), receiveBuffer->end());
+    uint8_t mode = translation_mode;
+    receiveBuffer->translate([mode](uint8_t c) -> int {
+    #ifdef BUILD_ATARI
+        if (c == ASCII_BELL)
+            c = ATASCII_BUZZER;
+        else if (c == ASCII_BACKSPACE)
+            c = ATASCII_DEL;
+        else if (c == ASCII_TAB)
+            c = ATASCII_TAB;
+    #endif
+
+        switch (mode)
+        {
+        case TRANSLATION_MODE_CR:
+            if (c == ASCII_CR)
+                c = EOL;
+            break;
+        case TRANSLATION_MODE_LF:
+            if (c == ASCII_LF)
+                c = EOL;
+            break;
+        case TRANSLATION_MODE_CRLF:
+        #ifndef BUILD_APPLE
+            // With Apple2, we would be translating CR to CR; a waste of CPU
+            if (c == ASCII_CR)
+                c = EOL;
+        #endif
+            if (c == '\n')
+                return -1;
+            break;
+        }
+
+        return c;
+    });
 }
 
 /**
@@ -6,6 +6,7 @@
 #include "bus.h"
 #include "networkStatus.h"
 #include "peoples_url_parser.h"
+#include "rx_buffer.h"
 
 class NetworkProtocol
 {
@@ -19,7 +20,7 @@ public:
     /**
      * Pointer to the receive buffer
      */
-    std::string *receiveBuffer = nullptr;
+    NetworkRxBuffer *receiveBuffer = nullptr;
 
     /**
      * Pointer to the transmit buffer
@@ -42,7 +43,7 @@ public:
      * @param tx_buf pointer to transmit buffer
      * @param sp_buf pointer to special buffer
      */
-    NetworkProtocol(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf);
+    NetworkProtocol(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf);
 
     /**
      * dtor - Tear down network protocol object
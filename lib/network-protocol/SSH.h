@@ -29,7 +29,7 @@ public:
     /**
      * ctor
      */
-    NetworkProtocolSSH(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf);
+    NetworkProtocolSSH(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf);
 
     /**
      * dtor
@@ -25,7 +25,7 @@
  * @param sp_buf pointer to special buffer
  * @return a NetworkProtocolTCP object
  */
-NetworkProtocolTCP::NetworkProtocolTCP(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf)
+NetworkProtocolTCP::NetworkProtocolTCP(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf)
     : NetworkProtocol(rx_buf, tx_buf, sp_buf)
 {
     Debug_printf("NetworkProtocolTCP::ctor\r\n");
@@ -145,7 +145,7 @@ bool NetworkProtocolTCP::read(unsigned short len)
         }
 
         // Add new data to buffer.
-        receiveBuffer->insert(receiveBuffer->end(), newData.begin(), newData.end());
+        receiveBuffer->append(newData.data(), newData.size());
     }    
     error = 1;
     return NetworkProtocol::read(len);
@@ -15,7 +15,7 @@ public:
      * @param sp_buf pointer to special buffer
      * @return a NetworkProtocolFS object
      */
-    NetworkProtocolTNFS(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf);
+    NetworkProtocolTNFS(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf);
 
     /**
      * dTOR
@@ -38,12 +38,12 @@ static void _event_handler(telnet_t *telnet, telnet_event_t *ev, void *user_data
         return;
     }
 
-    std::string *receiveBuffer = protocol->getReceiveBuffer();
+    NetworkRxBuffer *receiveBuffer = protocol->getReceiveBuffer();
 
     switch (ev->type)
     {
     case TELNET_EV_DATA: // Received Data
-        *receiveBuffer += std::string(ev->data.buffer, ev->data.size);
+        receiveBuffer->append(ev->data.buffer, ev->data.size);
         protocol->newRxLen = receiveBuffer->size();
         break;
     case TELNET_EV_SEND:
@@ -73,7 +73,7 @@ static void _event_handler(telnet_t *telnet, telnet_event_t *ev, void *user_data
 /**
  * ctor
  */
-NetworkProtocolTELNET::NetworkProtocolTELNET(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf)
+NetworkProtocolTELNET::NetworkProtocolTELNET(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf)
     : NetworkProtocolTCP(rx_buf, tx_buf, sp_buf)
 {
     Debug_printf("NetworkProtocolTELNET::ctor\r\n");
@@ -133,7 +133,7 @@ bool NetworkProtocolTELNET::read(unsigned short len)
     // Return success
     error = 1;
 
-    Debug_printf("NetworkProtocolTELNET::read(%d) - %s\r\n", newRxLen, receiveBuffer->c_str());
+    Debug_printf("NetworkProtocolTELNET::read(%d) - %u buffered\r\n", newRxLen, (unsigned)receiveBuffer->length());
 
     return NetworkProtocol::read(newRxLen); // Set by calls into telnet_recv()
 }
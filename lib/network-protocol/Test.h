@@ -18,7 +18,7 @@ public:
     /**
      * ctor
      */
-    NetworkProtocolTest(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf);
+    NetworkProtocolTest(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf);
 
     /**
      * dtor
@@ -15,11 +15,11 @@
 #include "status_error_codes.h"
 #include "fnDNS.h"
 
-#include <vector>
+#include <algorithm>
 
 
 
-NetworkProtocolUDP::NetworkProtocolUDP(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf)
+NetworkProtocolUDP::NetworkProtocolUDP(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf)
     : NetworkProtocol(rx_buf, tx_buf, sp_buf)
 {
     Debug_printf("NetworkProtocolUDP::ctor\r\n");
@@ -91,28 +91,34 @@ bool NetworkProtocolUDP::close()
     // unbind.
     udp.stop();
 
+    Debug_printf("UDP datagrams received: %lu dropped: %lu\r\n", (unsigned long)packets.received(), (unsigned long)packets.dropped());
+    packets.release();
+
     return false; // all good.
 }
 
 bool NetworkProtocolUDP::read(unsigned short len)
 {
-    std::vector<uint8_t> newData = std::vector<uint8_t>(len);
-
     Debug_printf("NetworkProtocolUDP::read(%u)\r\n", len);
 
     if (receiveBuffer->length() == 0)
     {
-        if (udp.available() == 0)
+        if (packets.empty())
+            udp.receive(packets);
+
+        const fnUDPDatagram *packet = packets.front();
+        if (packet == nullptr)
         {
             errno_to_error();
             return true;
         }
 
-        // Do the read.
-        udp.read(newData.data(), len);
-
-        // Add new data to buffer.
-        receiveBuffer->insert(receiveBuffer->end(),newData.begin(),newData.end());
+        // From the slot it was received into, never past the end of this datagram.
+        // This is the one copy left: end of line translation rewrites the bytes
+        // and the network devices read them from receiveBuffer
+        size_t bytes = std::min((size_t)len, packet->remaining());
+        receiveBuffer->append(packet->data + packet->offset, bytes);
+        packets.consume(bytes);
     }
 
     // Return success
@@ -143,9 +149,7 @@ bool NetworkProtocolUDP::write(unsigned short len)
         return true;
     }
 
-    udp.write((uint8_t *)transmitBuffer->data(), len);
-
-    if (udp.endPacket() == false)
+    if (udp.send((uint8_t *)transmitBuffer->data(), len) == false)
     {
         errno_to_error();
         return true;
@@ -165,19 +169,18 @@ bool NetworkProtocolUDP::status(NetworkStatus *status)
         status->rxBytesWaiting = receiveBuffer->length();
     else
     {
-        in_addr_t addr = udp.remoteIP();
+        // Take everything that arrived since the last poll
+        udp.receive(packets);
 
-        status->rxBytesWaiting = udp.parsePacket();
-        
-        // Only change dest if we need to.
-#ifdef ESP_PLATFORM
-        if (udp.remoteIP() != IPADDR_NONE)
-#else
-        if (status->rxBytesWaiting > 0 && addr != IPADDR_NONE)
-#endif
+        // One datagram at a time, its size is what's waiting
+        const fnUDPDatagram *packet = packets.front();
+        status->rxBytesWaiting = (packet != nullptr) ? packet->remaining() : 0;
+
+        // Replies go to whoever sent it
+        if (packet != nullptr && packet->ip != IPADDR_NONE)
         {
-            dest = std::string(compat_inet_ntoa(addr));
-            port = udp.remotePort();
+            dest = std::string(compat_inet_ntoa(packet->ip));
+            port = packet->port;
         }
     }
 
@@ -276,8 +279,13 @@ bool NetworkProtocolUDP::get_remote(uint8_t *sp_buf, unsigned short len)
 {
     char port_part[8];
 
-    snprintf(port_part, sizeof port_part, ":%d\x9b", udp.remotePort());
-    strlcpy((char *)sp_buf, compat_inet_ntoa(udp.remoteIP()), len);
+    // The sender of the datagram being read, more may have arrived since
+    const fnUDPDatagram *packet = packets.front();
+    in_addr_t ip = (packet != nullptr) ? packet->ip : udp.remoteIP();
+    uint16_t remote_port = (packet != nullptr) ? packet->port : udp.remotePort();
+
+    snprintf(port_part, sizeof port_part, ":%d\x9b", remote_port);
+    strlcpy((char *)sp_buf, compat_inet_ntoa(ip), len);
     strlcat((char *)sp_buf, port_part, len);
     Debug_printf("UDP remote is %s\n", sp_buf);
 
@@ -14,7 +14,7 @@ public:
     /**
      * ctor
      */
-    NetworkProtocolUDP(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf);
+    NetworkProtocolUDP(NetworkRxBuffer *rx_buf, std::string *tx_buf, std::string *sp_buf);
 
     /**
      * dtor
@@ -90,6 +90,11 @@ protected:
      */
     fnUDP udp;
 
+    /**
+     * Datagrams received and not yet read, one is reported and read at a time
+     */
+    fnUDPRing packets;
+
     /**
      * UDP destination address
      */
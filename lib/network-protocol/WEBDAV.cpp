@@ -4,6 +4,8 @@
 
 #include "WEBDAV.h"
 
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 
 #include "../../include/debug.h"
@@ -50,6 +52,45 @@ void call_char(void *data, const XML_Char *s, int len)
     handler->Char(s, len);
 }
 
+/**
+ * @brief Empty an entry for the next response
+ */
+static void reset_entry(WebDAV::DAVEntry &entry)
+{
+    entry.filename.clear();
+    entry.fileSize.clear();
+    entry.href.clear();
+    entry.etag.clear();
+    entry.lastModified.clear();
+    entry.isDir = false;
+}
+
+/**
+ * @brief Last path segment of an href, percent-decoded
+ */
+static std::string href_name(const std::string &href)
+{
+    size_t end = href.find_last_not_of('/');
+    if (end == std::string::npos)
+        return "";
+
+    size_t start = href.rfind('/', end);
+    start = (start == std::string::npos) ? 0 : start + 1;
+
+    std::string name;
+    for (size_t i = start; i <= end; i++)
+    {
+        if (href[i] == '%' && i + 2 <= end && isxdigit((unsigned char)href[i + 1]) && isxdigit((unsigned char)href[i + 2]))
+        {
+            name += (char)strtol(href.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        }
+        else
+            name += href[i];
+    }
+    return name;
+}
+
 bool WebDAV::begin_parser()
 {
     // Create XML parser
@@ -67,7 +108,12 @@ bool WebDAV::begin_parser()
     insideResponse = false;
     insideDisplayName = false;
     insideGetContentLength = false;
+    insideHref = false;
+    insideGetETag = false;
+    insideGetLastModified = false;
     entriesCounter = 0;
+    reset_entry(selfEntry);
+    parseError = false;
 
     // Clear result storage
     clear();
@@ -96,27 +142,89 @@ bool WebDAV::parse(const char *buf, int len, int isFinal)
     // Put PROPFIND data to debug console
     Debug_printf("WebDAV::parse data (%d bytes):\r\n", len);
     if (len > 0)
-        Debug_printf("%s\r\n", buf);
+        Debug_printf("%.*s\r\n", len, buf);
 
-    // Parse the damned buffer
+    // Parse the damned buffer, expat keeps what's left of it if an entry stops it
     XML_Status xs = XML_Parse(parser, buf, len, isFinal);
 
     if (xs == XML_STATUS_ERROR)
     {
         Debug_printf("DAV response XML Parse Error! msg: %s line: %lu\r\n",
             XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser));
+        parseError = true;
         return true;
     }
     return false;
 }
 
+void *WebDAV::buffer(int len)
+{
+    if (parser == nullptr || parseError)
+        return nullptr;
+
+    return XML_GetBuffer(parser, len);
+}
+
+bool WebDAV::parse_buffer(int len, int isFinal)
+{
+    if (parser == nullptr)
+    {
+        Debug_printf("WebDAV::parse_buffer() - no parser!\r\n");
+        return true;
+    }
+
+    if (XML_ParseBuffer(parser, len, isFinal) == XML_STATUS_ERROR)
+    {
+        Debug_printf("DAV response XML Parse Error! msg: %s line: %lu\r\n",
+            XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser));
+        parseError = true;
+        return true;
+    }
+    return false;
+}
+
+bool WebDAV::next(DAVEntry &entry)
+{
+    if (parser == nullptr || parseError)
+        return false;
+
+    // Stopped at the entry taken last time, parse the rest of that chunk
+    XML_ParsingStatus status;
+    XML_GetParsingStatus(parser, &status);
+    if (!entryReady && status.parsing == XML_SUSPENDED)
+    {
+        if (XML_ResumeParser(parser) == XML_STATUS_ERROR)
+        {
+            Debug_printf("DAV response XML Parse Error! msg: %s line: %lu\r\n",
+                XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser));
+            parseError = true;
+            return false;
+        }
+    }
+
+    if (!entryReady)
+        return false;
+
+    entry = std::move(readyEntry);
+    entryReady = false;
+    return true;
+}
+
+bool WebDAV::finished()
+{
+    if (parser == nullptr)
+        return true;
+
+    XML_ParsingStatus status;
+    XML_GetParsingStatus(parser, &status);
+    return status.parsing == XML_FINISHED && !entryReady;
+}
+
 void WebDAV::clear()
 {
-    entries.clear();
-    entries.shrink_to_fit();
-    currentEntry.filename.clear();
-    currentEntry.fileSize.clear();
-    currentEntry.isDir = false;
+    entryReady = false;
+    reset_entry(readyEntry);
+    reset_entry(currentEntry);
 }
 
 void WebDAV::Start(const XML_Char *el, const XML_Char **attr)
@@ -132,6 +240,12 @@ void WebDAV::Start(const XML_Char *el, const XML_Char **attr)
         insideDisplayName = true;
     else if (IS_ANYNS_ELEMENT("getcontentlength", el, el_len))
         insideGetContentLength = true;
+    else if (IS_ANYNS_ELEMENT("href", el, el_len))
+        insideHref = true;
+    else if (IS_ANYNS_ELEMENT("getetag", el, el_len))
+        insideGetETag = true;
+    else if (IS_ANYNS_ELEMENT("getlastmodified", el, el_len))
+        insideGetLastModified = true;
 }
 
 void WebDAV::End(const XML_Char *el)
@@ -141,10 +255,17 @@ void WebDAV::End(const XML_Char *el)
     {
         insideResponse = false;
 
+        // displayname is optional, many servers leave it out
+        if (currentEntry.filename.empty())
+            currentEntry.filename = href_name(currentEntry.href);
+
         bool store = true;
-        // skip first entry (current directory)
+        // skip first entry (current directory), keep it for collection()
         if (entriesCounter++ == 0) 
+        {
+            selfEntry = currentEntry;
             store = false;
+        }
         // skip entries over limit
         else if (entriesCounter >= 1000)
         {
@@ -156,14 +277,16 @@ void WebDAV::End(const XML_Char *el)
         else if (currentEntry.filename.empty())
             store = false;
 
-        // store directory entry
+        // hand the entry out and stop until it's taken
         if (store)
-            entries.push_back(currentEntry);
+        {
+            readyEntry = currentEntry;
+            entryReady = true;
+            XML_StopParser(parser, XML_TRUE);
+        }
 
         // reset currentEntry
-        currentEntry.filename.clear();
-        currentEntry.fileSize.clear();
-        currentEntry.isDir = false;
+        reset_entry(currentEntry);
     }
     else if (IS_ANYNS_ELEMENT("displayname", el, el_len))
         insideDisplayName = false;
@@ -171,6 +294,12 @@ void WebDAV::End(const XML_Char *el)
         currentEntry.isDir = true;
     else if (IS_ANYNS_ELEMENT("getcontentlength", el, el_len))
         insideGetContentLength = false;
+    else if (IS_ANYNS_ELEMENT("href", el, el_len))
+        insideHref = false;
+    else if (IS_ANYNS_ELEMENT("getetag", el, el_len))
+        insideGetETag = false;
+    else if (IS_ANYNS_ELEMENT("getlastmodified", el, el_len))
+        insideGetLastModified = false;
 }
 
 void WebDAV::Char(const XML_Char *s, int len)
@@ -179,13 +308,20 @@ void WebDAV::Char(const XML_Char *s, int len)
     {
         if (insideDisplayName == true)
         {
-            currentEntry.filename = std::string(s, len);
+            // may arrive in pieces split across chunks
+            currentEntry.filename.append(s, len);
             Debug_printf("  filename = %s\n", currentEntry.filename.c_str());
         }
         else if (insideGetContentLength == true)
         {
-            currentEntry.fileSize = std::string(s, len);
+            currentEntry.fileSize.append(s, len);
             Debug_printf("  fileSize = %s\n", currentEntry.fileSize.c_str());
         }
+        else if (insideHref == true)
+            currentEntry.href.append(s, len);
+        else if (insideGetETag == true)
+            currentEntry.etag.append(s, len);
+        else if (insideGetLastModified == true)
+            currentEntry.lastModified.append(s, len);
     }
 }
@@ -1,5 +1,11 @@
 /** 
  * WebDAV parsing class for directory output
+ *
+ * The PROPFIND multistatus is parsed as it arrives. The parser stops as
+ * each <D:response> closes and hands that one entry out through next(),
+ * so a listing only ever holds one entry plus the expat state. Response
+ * bytes can be read straight into expat's own buffer with buffer() and
+ * parse_buffer() instead of being copied in by parse().
  */
 
 #ifndef WebDAV_H
@@ -11,6 +17,8 @@
 
 // using namespace std;
 
+#define WEBDAV_CHUNK_SIZE 512 // bytes of the PROPFIND response handed to expat at a time
+
 /**
  * @brief a class wrapping expat parser for directory entries
  */
@@ -35,6 +43,18 @@ public:
          * Entry filesize
          */
         std::string fileSize;
+        /**
+         * Entry href, as sent (percent-encoded)
+         */
+        std::string href;
+        /**
+         * Entry getetag
+         */
+        std::string etag;
+        /**
+         * Entry getlastmodified (RFC 1123 date)
+         */
+        std::string lastModified;
     };
 
     /**
@@ -49,17 +69,50 @@ public:
     void end_parser(bool clear_entries = false);
 
     /**
-     * @brief Called to parse data chunk
+     * @brief Called to parse data chunk. Stops after the next complete entry,
+     *        the rest of the chunk is parsed by the next() after the one that takes it.
+     * @return true on error
      */
     bool parse(const char *buf, int len, int isFinal);
 
     /**
-     * @brief Called to scoot to beginning of directory entries
+     * @brief Room for the next len bytes of the response inside the parser, so
+     *        they can be read into it without a copy. Only valid once next() has
+     *        nothing more to hand out.
+     * @return the buffer, nullptr on error
+     */
+    void *buffer(int len);
+
+    /**
+     * @brief Parse len bytes placed in buffer(). Stops like parse().
+     * @return true on error
      */
-    std::vector<WebDAV::DAVEntry>::iterator rewind() {return entries.begin();};
+    bool parse_buffer(int len, int isFinal);
 
     /**
-     * @brief Called to remove all stored directory entries
+     * @brief Take the next parsed entry, carrying on with the chunk it was in first.
+     * @param entry receives the entry
+     * @return true if there was one, false if the parser needs more data (or is done)
+     */
+    bool next(DAVEntry &entry);
+
+    /**
+     * @brief Is the whole response parsed and every entry taken?
+     */
+    bool finished();
+
+    /**
+     * @brief Did parsing fail?
+     */
+    bool failed() { return parseError; };
+
+    /**
+     * @brief The first response, the collection itself (or the resource, for Depth: 0)
+     */
+    const DAVEntry &collection() { return selfEntry; };
+
+    /**
+     * @brief Called to drop the entry being parsed
      */
     void clear();
 
@@ -83,17 +136,32 @@ public:
      */
     void Char(const XML_Char *s, int len);
 
-    /**
-     * @brief collection of DAV entries.
-     */
-    std::vector<DAVEntry> entries;
-
 protected:
     /**
      * @brief the current entry
      */
     DAVEntry currentEntry;
 
+    /**
+     * @brief the first response, not handed out by next()
+     */
+    DAVEntry selfEntry;
+
+    /**
+     * @brief the last complete entry, waiting for next()
+     */
+    DAVEntry readyEntry;
+
+    /**
+     * Is readyEntry waiting?
+     */
+    bool entryReady = false;
+
+    /**
+     * Did XML_Parse or XML_ResumeParser fail?
+     */
+    bool parseError = false;
+
     /**
      * Are we inside D:response?
      */
@@ -109,10 +177,25 @@ protected:
      */
     bool insideGetContentLength;
 
+    /**
+     * Are we inside D:href?
+     */
+    bool insideHref;
+
+    /**
+     * Are we inside D:getetag?
+     */
+    bool insideGetETag;
+
+    /**
+     * Are we inside D:getlastmodified?
+     */
+    bool insideGetLastModified;
+
     /**
      * Expat XML parser
      */
-    XML_Parser parser;
+    XML_Parser parser = nullptr;
 
     /*
      * Parsed entries counter
@@ -0,0 +1,106 @@
+/**
+ * Receive buffer for a network channel
+ */
+
+#include "rx_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+void NetworkRxBuffer::reserve(size_t len)
+{
+    if (len <= _alloc)
+        return;
+
+    size_t alloc = std::max(_alloc ? _alloc : _capacity, (size_t)1);
+    while (alloc < len)
+        alloc *= 2;
+
+    // Straighten out the ring while moving it
+    std::unique_ptr<uint8_t[]> data(new uint8_t[alloc]);
+    peek(data.get(), _size);
+    _data = std::move(data);
+    _alloc = alloc;
+    _head = 0;
+}
+
+void NetworkRxBuffer::append(const uint8_t *data, size_t len)
+{
+    if (len == 0)
+        return;
+
+    reserve(_size + len);
+
+    size_t tail = (_head + _size) % _alloc;
+    size_t first = std::min(len, _alloc - tail);
+    memcpy(_data.get() + tail, data, first);
+    memcpy(_data.get(), data + first, len - first);
+    _size += len;
+}
+
+NetworkRxBuffer &NetworkRxBuffer::operator=(const std::string &s)
+{
+    clear();
+    append(s);
+    return *this;
+}
+
+size_t NetworkRxBuffer::peek(uint8_t *dest, size_t len) const
+{
+    len = std::min(len, _size);
+    if (len == 0)
+        return 0;
+
+    size_t first = std::min(len, _alloc - _head);
+    memcpy(dest, _data.get() + _head, first);
+    memcpy(dest + first, _data.get(), len - first);
+    return len;
+}
+
+void NetworkRxBuffer::consume(size_t len)
+{
+    len = std::min(len, _size);
+    _size -= len;
+    _translated -= std::min(len, _translated);
+    _head = (_size == 0) ? 0 : (_head + len) % _alloc;
+}
+
+size_t NetworkRxBuffer::read(uint8_t *dest, size_t len)
+{
+    len = peek(dest, len);
+    consume(len);
+    return len;
+}
+
+std::string NetworkRxBuffer::str() const
+{
+    std::string s(_size, '\0');
+    peek((uint8_t *)&s[0], _size);
+    return s;
+}
+
+std::string NetworkRxBuffer::untranslated()
+{
+    std::string s(_size - _translated, '\0');
+    for (size_t i = 0; i < s.size(); i++)
+        s[i] = (char)at(_translated + i);
+    _size = _translated;
+    return s;
+}
+
+void NetworkRxBuffer::clear()
+{
+    _head = 0;
+    _size = 0;
+    _translated = 0;
+}
+
+void NetworkRxBuffer::shrink_to_fit()
+{
+    if (_size > 0)
+        return;
+
+    _data.reset();
+    _alloc = 0;
+    _head = 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * Receive buffer for a network channel
+ *
+ * A ring, so the device taking a few bytes at a time off the front costs
+ * only those bytes instead of moving everything behind them. Storage is
+ * allocated with the first data and released by shrink_to_fit().
+ *
+ * The capacity is for flow control: protocols ask space() before
+ * reading more from the network. Data that has arrived anyway (a telnet
+ * callback, translation growing PETSCII into UTF-8) is never dropped,
+ * the ring grows for it.
+ *
+ * End of line translation is done on the bytes that arrived since the
+ * last translation only (see translate()), the front of the buffer has
+ * been translated already.
+ */
+
+#ifndef NETWORK_RX_BUFFER_H
+#define NETWORK_RX_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#define NETWORK_RX_BUFFER_SIZE 8192
+
+class NetworkRxBuffer
+{
+public:
+    NetworkRxBuffer(size_t capacity = NETWORK_RX_BUFFER_SIZE) : _capacity(capacity) {};
+
+    size_t size() const { return _size; };
+    size_t length() const { return _size; };
+    bool empty() const { return _size == 0; };
+    size_t capacity() const { return _capacity; };
+
+    /**
+     * @brief How much more a protocol should add, 0 when full.
+     */
+    size_t space() const { return (_size < _capacity) ? _capacity - _size : 0; };
+
+    /**
+     * @brief Add bytes at the end.
+     */
+    void append(const uint8_t *data, size_t len);
+    void append(const char *data, size_t len) { append((const uint8_t *)data, len); };
+    void append(const std::string &s) { append(s.data(), s.size()); };
+    NetworkRxBuffer &operator+=(const std::string &s) { append(s); return *this; };
+
+    /**
+     * @brief Replace the contents. The new bytes are untranslated, like append().
+     */
+    NetworkRxBuffer &operator=(const std::string &s);
+
+    /**
+     * @brief Copy up to len bytes from the front, leaving them in the buffer.
+     * @return bytes copied.
+     */
+    size_t peek(uint8_t *dest, size_t len) const;
+
+    /**
+     * @brief Drop up to len bytes from the front.
+     */
+    void consume(size_t len);
+
+    /**
+     * @brief peek() and consume() in one.
+     */
+    size_t read(uint8_t *dest, size_t len);
+
+    uint8_t at(size_t pos) const { return _data[(_head + pos) % _alloc]; };
+
+    /**
+     * @brief Copy of the whole contents.
+     */
+    std::string str() const;
+
+    void clear();
+    void shrink_to_fit();
+
+    /**
+     * @brief Translate the bytes added since the last call, in place.
+     * map() returns the replacement for a byte, or -1 to drop it.
+     */
+    template <typename F>
+    void translate(F map)
+    {
+        size_t w = _translated;
+        for (size_t r = _translated; r < _size; r++)
+        {
+            int c = map(at(r));
+            if (c >= 0)
+                _data[(_head + w++) % _alloc] = (uint8_t)c;
+        }
+        _size = w;
+        _translated = _size;
+    }
+
+    /**
+     * @brief Take the bytes added since the last translation off the end,
+     * for translations that change their length. append() the result and
+     * call translated().
+     */
+    std::string untranslated();
+    void translated() { _translated = _size; };
+
+private:
+    void reserve(size_t len);
+
+    std::unique_ptr<uint8_t[]> _data;
+    size_t _alloc = 0;
+    size_t _capacity;
+    size_t _head = 0;
+    size_t _size = 0;
+    size_t _translated = 0; // bytes at the front that have been translated
+};
+
+#endif // NETWORK_RX_BUFFER_H
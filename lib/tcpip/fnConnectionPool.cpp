@@ -0,0 +1,231 @@
+#include "fnConnectionPool.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#endif
+
+#include <algorithm>
+#include <cctype>
+
+#include "../../include/debug.h"
+
+std::vector<fnConnectionPool::Connection> fnConnectionPool::_idle;
+fnConnectionPool::Stats fnConnectionPool::_stats;
+std::mutex fnConnectionPool::_lock;
+
+#ifdef ESP_PLATFORM
+// Connections parked when traffic stops would otherwise never be looked at again
+static esp_timer_handle_t expiry_timer = nullptr;
+static TaskHandle_t expiry_worker = nullptr;
+
+// Closing a TLS connection can block and takes more stack than the
+// esp_timer task has, the timer only wakes the worker that does it
+static void expiry_tick(void *arg)
+{
+    xTaskNotifyGive(expiry_worker);
+}
+
+static void expiry_task(void *arg)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        fnConnectionPool::expire();
+        if (fnConnectionPool::stats().idle == 0)
+            esp_timer_stop(expiry_timer);
+    }
+}
+#endif
+
+void fnConnectionPool::start_expiry()
+{
+#ifdef ESP_PLATFORM
+    if (expiry_worker == nullptr)
+    {
+        if (xTaskCreate(expiry_task, "pool_expiry", CONNECTION_POOL_EXPIRY_STACKSIZE, nullptr,
+                        CONNECTION_POOL_EXPIRY_PRIORITY, &expiry_worker) != pdPASS)
+        {
+            expiry_worker = nullptr;
+            return;
+        }
+    }
+
+    if (expiry_timer == nullptr)
+    {
+        esp_timer_create_args_t args = {};
+        args.callback = expiry_tick;
+        args.name = "pool_expiry";
+        if (esp_timer_create(&args, &expiry_timer) != ESP_OK)
+        {
+            expiry_timer = nullptr;
+            return;
+        }
+    }
+
+    if (!esp_timer_is_active(expiry_timer))
+        esp_timer_start_periodic(expiry_timer, (uint64_t)CONNECTION_POOL_IDLE_MS * 1000);
+#endif
+}
+
+uint64_t fnConnectionPool::millis()
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time() / 1000;
+#else
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+std::string fnConnectionPool::key(const char *client, const std::string &scheme, const std::string &user,
+                                  const std::string &host, uint16_t port, const std::string &tls)
+{
+    std::string server = scheme + "://" + host + ":" + std::to_string(port);
+    std::transform(server.begin(), server.end(), server.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    return std::string(client) + " " + user + "@" + server + " " + tls;
+}
+
+void *fnConnectionPool::acquire(const std::string &key)
+{
+    expire();
+
+    std::vector<Connection> bad;
+    void *connection = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        // Most recently parked first, it is the least likely to have been dropped by the server
+        for (auto i = _idle.rbegin(); i != _idle.rend();)
+        {
+            if (i->key != key)
+            {
+                ++i;
+                continue;
+            }
+
+            Connection c = *i;
+            i = decltype(i)(_idle.erase(std::next(i).base()));
+
+            if (c.healthy != nullptr && !c.healthy(c.connection))
+            {
+                _stats.unhealthy++;
+                bad.push_back(c);
+                continue;
+            }
+
+            connection = c.connection;
+            break;
+        }
+
+        if (connection != nullptr)
+            _stats.hits++;
+        else
+            _stats.misses++;
+        _stats.idle = _idle.size();
+    }
+
+    // Closing may block on the socket, don't hold the lock for it
+    for (auto &c : bad)
+        c.close(c.connection);
+
+    return connection;
+}
+
+void fnConnectionPool::release(const std::string &key, void *connection, close_fn close, health_fn healthy)
+{
+    Connection dropped = {};
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        uint8_t count = 0;
+        for (const auto &c : _idle)
+        {
+            if (c.key == key)
+                count++;
+        }
+
+        if (count >= CONNECTION_POOL_PER_HOST)
+        {
+            dropped = { key, connection, close, healthy, 0 };
+        }
+        else
+        {
+            // Full, make room by dropping the oldest
+            if (_idle.size() >= CONNECTION_POOL_MAX)
+            {
+                dropped = _idle.front();
+                _idle.erase(_idle.begin());
+            }
+
+            _idle.push_back({ key, connection, close, healthy, millis() });
+            _stats.parked++;
+        }
+
+        if (dropped.connection != nullptr)
+            _stats.dropped++;
+        _stats.idle = _idle.size();
+    }
+
+    if (dropped.connection != nullptr)
+        dropped.close(dropped.connection);
+
+    start_expiry();
+}
+
+void fnConnectionPool::expire(uint32_t idle_ms)
+{
+    std::vector<Connection> expired;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        uint64_t now = millis();
+        for (auto i = _idle.begin(); i != _idle.end();)
+        {
+            if (now - i->idle_since >= idle_ms)
+            {
+                expired.push_back(*i);
+                i = _idle.erase(i);
+            }
+            else
+                ++i;
+        }
+        _stats.expired += expired.size();
+        _stats.idle = _idle.size();
+    }
+
+    for (auto &c : expired)
+        c.close(c.connection);
+}
+
+void fnConnectionPool::clear()
+{
+    std::vector<Connection> all;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        all.swap(_idle);
+        _stats.idle = 0;
+    }
+
+    for (auto &c : all)
+        c.close(c.connection);
+}
+
+fnConnectionPool::Stats fnConnectionPool::stats()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _stats;
+}
+
+void fnConnectionPool::print_stats()
+{
+#ifdef DEBUG
+    Stats s = stats();
+    Debug_printf("Connection pool: %lu idle, %lu hits, %lu misses, %lu parked, %lu dropped, %lu expired, %lu unhealthy\r\n",
+                 (unsigned long)s.idle, (unsigned long)s.hits, (unsigned long)s.misses, (unsigned long)s.parked,
+                 (unsigned long)s.dropped, (unsigned long)s.expired, (unsigned long)s.unhealthy);
+#endif
+}
@@ -0,0 +1,101 @@
+/**
+ * Process wide pool of idle keep-alive connections
+ *
+ * Clients that would otherwise close a connection after a complete
+ * response park it here instead, and the next client for the same
+ * (client type, scheme, user, host, port, TLS parameters) picks it up
+ * without a new connect and TLS handshake. The pool doesn't know what
+ * a connection is; whoever parks one says how to close it and,
+ * optionally, how to tell it's still good after sitting idle.
+ */
+
+#ifndef _FN_CONNECTIONPOOL_H_
+#define _FN_CONNECTIONPOOL_H_
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CONNECTION_POOL_PER_HOST 2
+#define CONNECTION_POOL_MAX 6
+#define CONNECTION_POOL_IDLE_MS 5000 // most servers drop idle keep-alive connections after 5-15s
+#define CONNECTION_POOL_EXPIRY_STACKSIZE 4096 // closes expired connections, TLS ones included
+#define CONNECTION_POOL_EXPIRY_PRIORITY 1
+
+class fnConnectionPool
+{
+public:
+    typedef void (*close_fn)(void *connection);
+    typedef bool (*health_fn)(void *connection);
+
+    struct Stats
+    {
+        uint32_t hits = 0;      // acquire() handed out a parked connection
+        uint32_t misses = 0;    // acquire() found nothing
+        uint32_t parked = 0;    // release() kept the connection
+        uint32_t dropped = 0;   // release() closed it, or pushed out an older one, for lack of room
+        uint32_t expired = 0;   // closed after CONNECTION_POOL_IDLE_MS
+        uint32_t unhealthy = 0; // closed by the server (or otherwise no good) while parked
+        uint32_t idle = 0;      // parked right now
+    };
+
+    /**
+     * @brief Pool key for a connection to a server
+     * @param client the kind of client, connections are only shared between clients of one kind
+     * @param scheme, user, host, port the server, and who a parked connection may still carry credentials for
+     * @param tls whatever sets the client's TLS apart (CA, client cert, verification), empty for the defaults
+     */
+    static std::string key(const char *client, const std::string &scheme, const std::string &user,
+                           const std::string &host, uint16_t port, const std::string &tls = "");
+
+    /**
+     * @brief Take a parked connection for key, most recently parked first
+     * @return the connection, nullptr if there's none that's still good
+     */
+    static void *acquire(const std::string &key);
+
+    /**
+     * @brief Park a connection for reuse. It is closed right away if key already has
+     *        CONNECTION_POOL_PER_HOST parked; the oldest parked connection is closed to
+     *        make room if the pool is full.
+     * @param key from key()
+     * @param connection what acquire() hands back
+     * @param close closes and frees connection
+     * @param healthy checked before a connection is handed out again, may be nullptr
+     */
+    static void release(const std::string &key, void *connection, close_fn close, health_fn healthy = nullptr);
+
+    /**
+     * @brief Close connections parked for longer than idle_ms. Runs on a worker task
+     *        every CONNECTION_POOL_IDLE_MS while anything is parked, and on acquire()
+     */
+    static void expire(uint32_t idle_ms = CONNECTION_POOL_IDLE_MS);
+
+    /**
+     * @brief Close every parked connection (network down, WiFi reconnect)
+     */
+    static void clear();
+
+    static Stats stats();
+    static void print_stats();
+
+private:
+    struct Connection
+    {
+        std::string key;
+        void *connection;
+        close_fn close;
+        health_fn healthy;
+        uint64_t idle_since;
+    };
+
+    static uint64_t millis();
+    static void start_expiry();
+
+    static std::vector<Connection> _idle;
+    static Stats _stats;
+    static std::mutex _lock;
+};
+
+#endif // _FN_CONNECTIONPOOL_H_
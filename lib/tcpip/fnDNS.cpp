@@ -1,27 +1,165 @@
 #include "fnDNS.h"
 
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <mutex>
+
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
 #include "../../include/debug.h"
 
 
+static fnDNSCache dns_cache;
+
+static std::deque<std::string> prefetch_queue;
+static bool prefetch_running = false;
+static std::mutex prefetch_lock;
+
+
+static uint64_t dns_millis()
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time() / 1000;
+#else
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static std::string dns_name(const char *hostname)
+{
+    std::string name(hostname);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    return name;
+}
+
+// Dotted quads don't need the resolver
+static bool dns_numeric(const char *hostname, in_addr_t *address)
+{
+    struct in_addr a;
+    if (inet_pton(AF_INET, hostname, &a) != 1)
+        return false;
+    *address = a.s_addr;
+    return true;
+}
+
+// Ask the resolver
+static fnDNSLookup dns_lookup(const std::string &hostname)
+{
+    fnDNSLookup result;
+
+    Debug_printf("Resolving hostname \"%s\"\r\n", hostname.c_str());
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    struct addrinfo *info = nullptr;
+
+    int rc = getaddrinfo(hostname.c_str(), nullptr, &hints, &info);
+    if (rc != 0 || info == nullptr)
+    {
+        Debug_println("Name failed to resolve");
+        // Only a name the server says doesn't exist is remembered. lwIP
+        // reports that and a resolver that can't be reached alike, as
+        // EAI_FAIL, so on the device the last address is kept instead
+        result.reached = (rc == EAI_NONAME);
+    }
+    else
+    {
+        result.reached = true;
+        result.found = true;
+        result.value = ((struct sockaddr_in *)info->ai_addr)->sin_addr.s_addr;
+        Debug_printf("Resolved to address %s\r\n", compat_inet_ntoa(result.value));
+    }
+
+    if (info != nullptr)
+        freeaddrinfo(info);
+
+    return result;
+}
+
 // Return a single IP4 address given a hostname
 in_addr_t get_ip4_addr_by_name(const char *hostname)
 {
     in_addr_t result = IPADDR_NONE;
 
-    Debug_printf("Resolving hostname \"%s\"\r\n", hostname);
-    struct hostent *info = gethostbyname(hostname);
+    if (hostname == nullptr || hostname[0] == '\0')
+        return result;
+
+    if (dns_numeric(hostname, &result))
+        return result;
+
+    return dns_cache.resolve(dns_name(hostname), dns_lookup, dns_millis());
+}
+
+void dns_forget(const char *hostname)
+{
+    if (hostname != nullptr)
+        dns_cache.forget(dns_name(hostname));
+}
 
-    if(info == nullptr)
+static void dns_prefetch_task(void *arg)
+{
+    while (true)
     {
-        Debug_println("Name failed to resolve");
+        std::string name;
+        {
+            std::lock_guard<std::mutex> guard(prefetch_lock);
+            if (prefetch_queue.empty())
+            {
+                prefetch_running = false;
+                break;
+            }
+            name = prefetch_queue.front();
+            prefetch_queue.pop_front();
+        }
+
+        dns_cache.resolve(name, dns_lookup, dns_millis());
     }
-    else
+
+#ifdef ESP_PLATFORM
+    vTaskDelete(NULL);
+#endif
+}
+
+void dns_prefetch(const char *hostname)
+{
+    in_addr_t address;
+    if (hostname == nullptr || hostname[0] == '\0' || dns_numeric(hostname, &address))
+        return;
+
+    std::string name = dns_name(hostname);
+    if (dns_cache.known(name, dns_millis()))
+        return;
+
+    std::lock_guard<std::mutex> guard(prefetch_lock);
+
+    if (prefetch_queue.size() >= DNS_PREFETCH_QUEUE ||
+        std::find(prefetch_queue.begin(), prefetch_queue.end(), name) != prefetch_queue.end())
+        return;
+
+    prefetch_queue.push_back(name);
+
+    // One worker, it goes away when the queue is empty
+    if (!prefetch_running)
     {
-        if(info->h_addr_list[0] != nullptr)
+#ifdef ESP_PLATFORM
+        if (xTaskCreate(dns_prefetch_task, "dns_prefetch", DNS_PREFETCH_STACKSIZE, nullptr, DNS_PREFETCH_PRIORITY, nullptr) != pdPASS)
         {
-            result = *((in_addr_t*)(info->h_addr_list[0]));
-            Debug_printf("Resolved to address %s\r\n", compat_inet_ntoa(result));
+            Debug_println("Unable to start DNS prefetch task");
+            prefetch_queue.clear();
+            return;
         }
+#else
+        std::thread(dns_prefetch_task, nullptr).detach();
+#endif
+        prefetch_running = true;
     }
-    return result;
-}
\ No newline at end of file
+}
+
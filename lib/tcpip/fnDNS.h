@@ -3,6 +3,49 @@
 
 #include "compat_inet.h"
 
+#include <cstdint>
+#include <string>
+
+#include "resolve_cache.h"
+
+/*
+ Resolved names are kept so TCP, UDP and TNFS opens to a host we already
+ know don't wait on the resolver. Neither gethostbyname() nor getaddrinfo()
+ report the records' TTL, so answers are kept for DNS_CACHE_TTL, which is
+ shorter than what most hosts publish; lwIP's own table, which the HTTP
+ client's lookups go through, honors the real TTL. A name that doesn't
+ resolve is remembered for DNS_CACHE_NEGATIVE_TTL, and a connection that
+ fails can drop its host with dns_forget().
+*/
+#define DNS_CACHE_TTL 300           // seconds
+#define DNS_CACHE_NEGATIVE_TTL 10   // seconds
+#define DNS_CACHE_MAX_ENTRIES 32
+
+#define DNS_PREFETCH_QUEUE 8        // names waiting to be resolved in the background
+#define DNS_PREFETCH_STACKSIZE 3072
+#define DNS_PREFETCH_PRIORITY 5
+
+// Return a single IP4 address given a hostname, IPADDR_NONE if it has none
 in_addr_t get_ip4_addr_by_name(const char *hostname);
 
+// Resolve hostname in the background if it isn't cached
+void dns_prefetch(const char *hostname);
+
+// Drop hostname from the cache (its address stopped working)
+void dns_forget(const char *hostname);
+
+// What the resolver said, found with no address is NXDOMAIN
+typedef ResolveAnswer<in_addr_t> fnDNSLookup;
+
+class fnDNSCache : public ResolveCache<in_addr_t>
+{
+public:
+    fnDNSCache(uint32_t ttl = DNS_CACHE_TTL, uint32_t negative_ttl = DNS_CACHE_NEGATIVE_TTL, size_t max_entries = DNS_CACHE_MAX_ENTRIES)
+        : ResolveCache(IPADDR_NONE, ttl, negative_ttl, max_entries) {};
+
+    // Names are only ever timed by millis(), ms
+    in_addr_t resolve(const std::string &hostname, Lookup lookup, uint64_t ms) { return ResolveCache::resolve(hostname, lookup, 0, ms); };
+    bool known(const std::string &hostname, uint64_t ms) { return ResolveCache::known(hostname, 0, ms); };
+};
+
 #endif // _FN_DNS_
@@ -366,7 +366,13 @@ int fnTcpClient::connect(in_addr_t ip, uint16_t port, int32_t timeout)
 int fnTcpClient::connect(const char *host, uint16_t port, int32_t timeout)
 {
     in_addr_t ip = get_ip4_addr_by_name(host);
-    return connect(ip, port, timeout);
+    int result = connect(ip, port, timeout);
+
+    // The host may have moved, look it up again next time
+    if (result == 0 && ip != IPADDR_NONE)
+        dns_forget(host);
+
+    return result;
 }
 
 // Set both send and receive timeouts on the TCP socket
@@ -3,6 +3,7 @@
 
 #include "fnUDP.h"
 
+#include <algorithm>
 #include <cstring>
 #include <errno.h>
 
@@ -227,9 +228,19 @@ size_t fnUDP::write(uint8_t data)
 // Put bytes in buffer until full. Send if full and continue.
 size_t fnUDP::write(const uint8_t *buffer, size_t size)
 {
-    size_t i;
-    for (i = 0; i < size; i++)
-        write(buffer[i]);
+    size_t i = 0;
+    while (i < size)
+    {
+        if (tx_buffer_len == UDP_RXTX_BUFLEN)
+        {
+            endPacket();
+            tx_buffer_len = 0;
+        }
+        size_t n = std::min(size - i, (size_t)UDP_RXTX_BUFLEN - tx_buffer_len);
+        memcpy(tx_buffer + tx_buffer_len, buffer + i, n);
+        tx_buffer_len += n;
+        i += n;
+    }
     return i;
 }
 
@@ -270,6 +281,44 @@ int fnUDP::parsePacket()
     return len;
 }
 
+int fnUDP::receive(fnUDPRing &ring)
+{
+    if (udp_server == -1)
+        return 0;
+
+    // A flood can't keep us here, what doesn't fit waits for the next poll
+    int received = 0;
+    while (received < (int)ring.capacity())
+    {
+        uint8_t *slot = ring.reserve();
+        if (slot == nullptr)
+            break;
+
+        struct sockaddr_in si_other;
+        socklen_t slen = sizeof(si_other);
+        int len = recvfrom(udp_server, (char *)slot, ring.slot_size(), MSG_DONTWAIT, (struct sockaddr *)&si_other, &slen);
+        if (len == -1)
+        {
+            int err = compat_getsockerr();
+#if defined(_WIN32)
+            if (err != WSAEWOULDBLOCK)
+#else
+            if (err != EWOULDBLOCK)
+#endif
+                Debug_printf("could not receive data: %d\r\n", err);
+            break;
+        }
+
+        remote_ip = si_other.sin_addr.s_addr;
+        remote_port = ntohs(si_other.sin_port);
+
+        ring.commit(len, remote_ip, remote_port);
+        received++;
+    }
+
+    return received;
+}
+
 int fnUDP::read()
 {
     if (!rx_buffer)
@@ -343,6 +392,28 @@ bool fnUDP::endPacket()
     return true;
 }
 
+bool fnUDP::send(const uint8_t *buffer, size_t size)
+{
+    struct sockaddr_in recipient;
+    recipient.sin_addr.s_addr = remote_ip;
+    recipient.sin_family = AF_INET;
+    recipient.sin_port = htons(remote_port);
+
+    do
+    {
+        size_t len = std::min(size, (size_t)UDP_RXTX_BUFLEN);
+        if (sendto(udp_server, (const char *)buffer, len, 0, (struct sockaddr *)&recipient, sizeof(recipient)) < 0)
+        {
+            Debug_printf("could not send data: %d\r\n", compat_getsockerr());
+            return false;
+        }
+        buffer += len;
+        size -= len;
+    } while (size > 0);
+
+    return true;
+}
+
 in_addr_t fnUDP::remoteIP()
 {
     return remote_ip;
@@ -6,6 +6,7 @@
 #include "compat_inet.h"
 
 #include "cbuf.h"
+#include "fnUDPRing.h"
 
 
 class fnUDP
@@ -38,11 +39,18 @@ public:
 
     bool endPacket();
 
+    // Send buffer to the beginPacket() destination without copying it to the tx buffer,
+    // in datagrams no larger than the tx buffer
+    bool send(const uint8_t *buffer, size_t size);
+
     size_t write(uint8_t);
     size_t write(const uint8_t *buffer, size_t size);
 
     int parsePacket();
 
+    // Receive every datagram waiting on the socket into ring, returns how many arrived
+    int receive(fnUDPRing &ring);
+
     int read();
     int read(unsigned char* buffer, size_t len);
     int read(char* buffer, size_t len);
@@ -0,0 +1,88 @@
+#include "fnUDPRing.h"
+
+#include <new>
+
+uint8_t *fnUDPRing::reserve()
+{
+    if (_data == nullptr)
+    {
+        _data.reset(new (std::nothrow) uint8_t[storage() * _slot_size]);
+        _datagrams.reset(new (std::nothrow) fnUDPDatagram[storage()]);
+        if (_data == nullptr || _datagrams == nullptr)
+        {
+            release();
+            return nullptr;
+        }
+    }
+
+    return _data.get() + ((_head + _count) % storage()) * _slot_size;
+}
+
+void fnUDPRing::commit(size_t length, in_addr_t ip, uint16_t port)
+{
+    if (_data == nullptr || length == 0)
+        return;
+
+    _received++;
+
+    if (_count == _slots)
+    {
+        _dropped++;
+
+        // Half read, the reader keeps it and the new one goes
+        if (_datagrams[_head].offset > 0)
+            return;
+
+        pop();
+    }
+
+    size_t slot = (_head + _count) % storage();
+    fnUDPDatagram &d = _datagrams[slot];
+    d.data = _data.get() + slot * _slot_size;
+    d.length = (length < _slot_size) ? length : _slot_size;
+    d.offset = 0;
+    d.ip = ip;
+    d.port = port;
+    _count++;
+}
+
+const fnUDPDatagram *fnUDPRing::front() const
+{
+    if (_count == 0)
+        return nullptr;
+
+    return &_datagrams[_head];
+}
+
+void fnUDPRing::consume(size_t len)
+{
+    if (_count == 0)
+        return;
+
+    fnUDPDatagram &d = _datagrams[_head];
+    d.offset += (len < d.remaining()) ? len : d.remaining();
+    if (d.remaining() == 0)
+        pop();
+}
+
+void fnUDPRing::pop()
+{
+    if (_count == 0)
+        return;
+
+    _head = (_head + 1) % storage();
+    _count--;
+}
+
+void fnUDPRing::clear()
+{
+    _head = 0;
+    _count = 0;
+}
+
+void fnUDPRing::release()
+{
+    clear();
+    _data.reset();
+    _datagrams.reset();
+}
@@ -0,0 +1,104 @@
+/**
+ * Ring of received UDP datagrams
+ *
+ * fnUDP::receive() drains every datagram waiting on the socket straight
+ * into a free slot here, so a burst of small packets is taken off the
+ * network in one poll without a heap allocation per packet. Each slot
+ * keeps its datagram's length and sender, so readers see packet
+ * boundaries and read a datagram in place, a few bytes at a time if
+ * they like.
+ *
+ * When every slot is taken, a new datagram pushes out the oldest one,
+ * unless that one is being read, and the new one is dropped instead.
+ * Either way it is counted in dropped(). Storage is allocated with the
+ * first datagram and released by release().
+ */
+
+#ifndef _FN_UDPRING_
+#define _FN_UDPRING_
+
+#include "compat_inet.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#ifdef BOARD_HAS_PSRAM
+#define UDP_RING_SLOTS 32
+#else
+#define UDP_RING_SLOTS 8
+#endif
+#define UDP_RING_SLOT_SIZE 1460 // largest datagram fnUDP sends
+
+struct fnUDPDatagram
+{
+    uint8_t *data = nullptr;
+    size_t length = 0;
+    size_t offset = 0;          // bytes of it already read
+    in_addr_t ip = IPADDR_NONE;
+    uint16_t port = 0;
+
+    size_t remaining() const { return length - offset; };
+};
+
+class fnUDPRing
+{
+public:
+    fnUDPRing(size_t slots = UDP_RING_SLOTS, size_t slot_size = UDP_RING_SLOT_SIZE)
+        : _slots(slots), _slot_size(slot_size) {};
+
+    /**
+     * @brief Slot to receive the next datagram into, slot_size() bytes.
+     *        Nothing is queued until commit().
+     * @return the slot, nullptr if there's no memory for the ring
+     */
+    uint8_t *reserve();
+
+    /**
+     * @brief Queue the datagram received into reserve()'s slot
+     */
+    void commit(size_t length, in_addr_t ip, uint16_t port);
+
+    /**
+     * @brief The oldest datagram, nullptr if there's none
+     */
+    const fnUDPDatagram *front() const;
+
+    /**
+     * @brief Mark len bytes of the oldest datagram read, its slot is free once all of it is
+     */
+    void consume(size_t len);
+
+    /**
+     * @brief Drop the oldest datagram, read or not
+     */
+    void pop();
+
+    size_t count() const { return _count; };
+    bool empty() const { return _count == 0; };
+    size_t capacity() const { return _slots; };
+    size_t slot_size() const { return _slot_size; };
+
+    uint32_t received() const { return _received; };
+    uint32_t dropped() const { return _dropped; };
+
+    void clear();
+    void release();
+
+private:
+    // One slot more than the capacity, so reserve() never has to drop anything
+    size_t storage() const { return _slots + 1; };
+
+    size_t _slots;
+    size_t _slot_size;
+
+    std::unique_ptr<uint8_t[]> _data;
+    std::unique_ptr<fnUDPDatagram[]> _datagrams;
+    size_t _head = 0;
+    size_t _count = 0;
+
+    uint32_t _received = 0;
+    uint32_t _dropped = 0;
+};
+
+#endif // _FN_UDPRING_
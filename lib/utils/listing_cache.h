@@ -0,0 +1,71 @@
+#ifndef LISTING_CACHE_H
+#define LISTING_CACHE_H
+
+/*
+ Directory listings a network filesystem session has read, by path, so
+ that a directory walked again, or a file looked up in it, doesn't go back
+ to the server. Listings are used for ttl ms after they were read, and the
+ cache holds at most max_listings; when it is full whichever listing would
+ expire first makes room.
+
+ Not locked, the session that owns it already serializes its requests.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+template <typename E>
+class ListingCache
+{
+public:
+    ListingCache(uint32_t ttl, size_t max_listings)
+        : _ttl(ttl), _max_listings(max_listings) {};
+
+    // Listing of path if it is still fresh, nullptr if not. ms is millis()
+    const std::vector<E> *find(const std::string &path, uint64_t ms)
+    {
+        auto cached = _listings.find(path);
+        if (cached == _listings.end() || ms >= cached->second.expires)
+            return nullptr;
+
+        return &cached->second.entries;
+    }
+
+    void put(const std::string &path, const std::vector<E> &entries, uint64_t ms)
+    {
+        if (_listings.size() >= _max_listings && _listings.find(path) == _listings.end())
+        {
+            // Make room, whichever would expire first goes
+            auto oldest = _listings.begin();
+            for (auto l = _listings.begin(); l != _listings.end(); ++l)
+            {
+                if (l->second.expires < oldest->second.expires)
+                    oldest = l;
+            }
+            _listings.erase(oldest);
+        }
+
+        _listings[path] = { entries, ms + _ttl };
+    }
+
+    void erase(const std::string &path) { _listings.erase(path); }
+    void clear() { _listings.clear(); }
+    size_t size() { return _listings.size(); }
+
+private:
+    struct Listing
+    {
+        std::vector<E> entries;
+        uint64_t expires;
+    };
+
+    uint32_t _ttl;
+    size_t _max_listings;
+
+    std::map<std::string, Listing> _listings;
+};
+
+#endif // LISTING_CACHE_H
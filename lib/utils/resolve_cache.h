@@ -0,0 +1,203 @@
+#ifndef RESOLVE_CACHE_H
+#define RESOLVE_CACHE_H
+
+/*
+ Name to value cache for lookups that go over the network: DNS names to
+ addresses, ml: names to URLs.
+
+ Answers are kept for ttl seconds, names that were definitely not found for
+ negative_ttl. A lookup of a name that is already being looked up waits for
+ that one instead of sending its own, and when a lookup gets no answer at
+ all an expired value is returned rather than none.
+
+ Entries expire by millis(). Entries that come from somewhere else (saved
+ to SD before a reboot) have no deadline and expire by the wall clock
+ instead, and are kept until the clock says otherwise.
+*/
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+template <typename V>
+struct ResolveAnswer
+{
+    bool reached = false;   // false: nobody answered, try again next time
+    bool found = false;     // false: the name doesn't exist
+    V value = V();
+};
+
+template <typename V>
+class ResolveCache
+{
+public:
+    typedef ResolveAnswer<V> Answer;
+    typedef std::function<Answer(const std::string &name)> Lookup;
+
+    ResolveCache(const V &none, uint32_t ttl, uint32_t negative_ttl, size_t max_entries)
+        : _none(none), _ttl(ttl), _negative_ttl(negative_ttl), _max_entries(max_entries) {};
+
+    // Value for name, none if it doesn't have one. now is wall clock
+    // seconds (0 until the clock is set), ms is millis().
+    V resolve(const std::string &name, Lookup lookup, uint32_t now, uint64_t ms)
+    {
+        std::unique_lock<std::mutex> guard(_lock);
+
+        auto cached = _entries.find(name);
+        if (cached != _entries.end() && fresh(cached->second, now, ms))
+            return cached->second.value;
+
+        auto asking = _pending.find(name);
+        if (asking != _pending.end())
+        {
+            std::shared_ptr<Pending> pending = asking->second;
+            pending->ready.wait(guard, [&pending]() { return pending->done; });
+            return pending->value;
+        }
+
+        auto pending = std::make_shared<Pending>();
+        pending->value = _none;
+        _pending[name] = pending;
+
+        guard.unlock();
+        Answer answer = lookup(name);
+        guard.lock();
+
+        if (answer.reached)
+        {
+            uint32_t ttl = answer.found ? _ttl : _negative_ttl;
+
+            Entry entry;
+            entry.value = answer.found ? answer.value : _none;
+            entry.found = answer.found;
+            entry.expires = (now != 0) ? now + ttl : 0;
+            entry.deadline = ms + (uint64_t)ttl * 1000;
+            put(name, entry, now, ms);
+
+            if (answer.found)
+                _changed = true;
+
+            pending->value = entry.value;
+        }
+        else
+        {
+            cached = _entries.find(name);
+            if (cached != _entries.end())
+                pending->value = cached->second.value;
+        }
+
+        pending->done = true;
+        _pending.erase(name);
+        pending->ready.notify_all();
+
+        return pending->value;
+    }
+
+    // Fresh answer cached, or a lookup on its way
+    bool known(const std::string &name, uint32_t now, uint64_t ms)
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        auto cached = _entries.find(name);
+        return (cached != _entries.end() && fresh(cached->second, now, ms)) || _pending.count(name) > 0;
+    }
+
+    void forget(const std::string &name)
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _entries.erase(name);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _entries.clear();
+        _changed = false;
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _entries.size();
+    }
+
+protected:
+    struct Entry
+    {
+        V value = V();
+        bool found = true;
+        uint32_t expires = 0;   // wall clock, 0 if it was resolved before the clock was set
+        uint64_t deadline = 0;  // millis(), 0 if it didn't come from a lookup
+    };
+
+    bool fresh(const Entry &entry, uint32_t now, uint64_t ms)
+    {
+        if (entry.deadline != 0)
+            return ms < entry.deadline;
+
+        return (now == 0 || now < entry.expires);
+    }
+
+    // ms until entry expires. One without a deadline goes by the wall clock,
+    // or is good for a whole TTL until the clock is set
+    uint64_t remaining(const Entry &entry, uint32_t now, uint64_t ms)
+    {
+        if (entry.deadline != 0)
+            return (entry.deadline > ms) ? entry.deadline - ms : 0;
+
+        if (now == 0)
+            return (uint64_t)(entry.found ? _ttl : _negative_ttl) * 1000;
+
+        return (entry.expires > now) ? (uint64_t)(entry.expires - now) * 1000 : 0;
+    }
+
+    void put(const std::string &name, const Entry &entry, uint32_t now, uint64_t ms)
+    {
+        if (_entries.size() >= _max_entries && _entries.find(name) == _entries.end())
+        {
+            // Expired ones first, then whichever would expire soonest
+            auto victim = _entries.begin();
+            uint64_t soonest = UINT64_MAX;
+            for (auto e = _entries.begin(); e != _entries.end(); ++e)
+            {
+                uint64_t left = fresh(e->second, now, ms) ? remaining(e->second, now, ms) : 0;
+                if (left < soonest)
+                {
+                    victim = e;
+                    soonest = left;
+                }
+                if (left == 0)
+                    break;
+            }
+            _entries.erase(victim);
+        }
+
+        _entries[name] = entry;
+    }
+
+    V _none;
+    uint32_t _ttl;
+    uint32_t _negative_ttl;
+    size_t _max_entries;
+
+    bool _changed = false;  // a name was found since this was last cleared
+
+    std::map<std::string, Entry> _entries;
+    std::mutex _lock;
+
+private:
+    struct Pending
+    {
+        bool done = false;
+        V value;
+        std::condition_variable ready;
+    };
+
+    std::map<std::string, std::shared_ptr<Pending>> _pending;
+};
+
+#endif // RESOLVE_CACHE_H
@@ -0,0 +1,109 @@
+#include "unity.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../lib/meatloaf/archive/archive_inflate.cpp"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Stand in for archive_read_data(), produces a known pattern
+static int32_t pattern(uint32_t &position, uint32_t size, uint8_t *buf, uint32_t want)
+{
+    uint32_t n = std::min(want, size - position);
+    for (uint32_t i = 0; i < n; i++)
+        buf[i] = (uint8_t)((position + i) * 7);
+    position += n;
+    return n;
+}
+
+void test_inflate_drains_all_blocks_in_order(void)
+{
+    const uint32_t size = (ARCHIVE_INFLATE_BLOCK_SIZE * ARCHIVE_INFLATE_RING_SIZE * 3) + 123;
+    uint32_t position = 0;
+
+    ArchiveInflater inflater([&](uint8_t *buf, uint32_t want) {
+        return pattern(position, size, buf, want);
+    }, size);
+    TEST_ASSERT_TRUE(inflater.start());
+
+    std::vector<uint8_t> out;
+    uint32_t length;
+    const uint8_t *block;
+    while ((block = inflater.peek(length)) != nullptr)
+    {
+        // Slow reader, the worker has to wait on the full ring
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        out.insert(out.end(), block, block + length);
+        inflater.pop();
+    }
+
+    TEST_ASSERT_FALSE(inflater.failed());
+    TEST_ASSERT_EQUAL_UINT32(size, out.size());
+    for (uint32_t i = 0; i < size; i++)
+        TEST_ASSERT_EQUAL_UINT8((uint8_t)(i * 7), out[i]);
+}
+
+void test_inflate_reports_short_member(void)
+{
+    const uint32_t size = ARCHIVE_INFLATE_BLOCK_SIZE * 2;
+    uint32_t position = 0;
+
+    // Archive ends half way through the member
+    ArchiveInflater inflater([&](uint8_t *buf, uint32_t want) {
+        return pattern(position, size / 2, buf, want);
+    }, size);
+    TEST_ASSERT_TRUE(inflater.start());
+
+    uint32_t total = 0, length;
+    const uint8_t *block;
+    while ((block = inflater.peek(length)) != nullptr)
+    {
+        total += length;
+        inflater.pop();
+    }
+
+    TEST_ASSERT_TRUE(inflater.failed());
+    TEST_ASSERT_EQUAL_UINT32(size / 2, total);
+}
+
+void test_inflate_stop_while_ring_full(void)
+{
+    const uint32_t size = ARCHIVE_INFLATE_BLOCK_SIZE * ARCHIVE_INFLATE_RING_SIZE * 8;
+    uint32_t position = 0;
+
+    auto inflater = new ArchiveInflater([&](uint8_t *buf, uint32_t want) {
+        return pattern(position, size, buf, want);
+    }, size);
+    TEST_ASSERT_TRUE(inflater->start());
+
+    // Let the worker fill the ring, then tear it down without reading
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    delete inflater;
+
+    TEST_ASSERT_EQUAL_UINT32(ARCHIVE_INFLATE_BLOCK_SIZE * ARCHIVE_INFLATE_RING_SIZE, position);
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_inflate_drains_all_blocks_in_order);
+    RUN_TEST(test_inflate_reports_short_member);
+    RUN_TEST(test_inflate_stop_while_ring_full);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
@@ -0,0 +1,161 @@
+#include "unity.h"
+
+#include <chrono>
+#include <set>
+#include <thread>
+
+#include "../lib/tcpip/fnConnectionPool.cpp"
+
+// Stand-in connections: an id and whether the "server" still has it open
+struct FakeConnection
+{
+    int id;
+    bool open = true;
+};
+
+static std::set<int> closed;
+
+static void fake_close(void *c)
+{
+    closed.insert(((FakeConnection *)c)->id);
+    delete (FakeConnection *)c;
+}
+
+static bool fake_healthy(void *c)
+{
+    return ((FakeConnection *)c)->open;
+}
+
+static FakeConnection *fake(int id)
+{
+    return new FakeConnection{id};
+}
+
+void setUp(void)
+{
+    fnConnectionPool::clear();
+    closed.clear();
+}
+
+void tearDown(void)
+{
+}
+
+
+void test_pool_key()
+{
+    // Scheme and host aren't case sensitive, everything else sets connections apart
+    TEST_ASSERT_EQUAL_STRING(fnConnectionPool::key("a", "HTTP", "", "Example.COM", 80).c_str(),
+                             fnConnectionPool::key("a", "http", "", "example.com", 80).c_str());
+    TEST_ASSERT_TRUE(fnConnectionPool::key("a", "http", "", "example.com", 80) != fnConnectionPool::key("b", "http", "", "example.com", 80));
+    TEST_ASSERT_TRUE(fnConnectionPool::key("a", "http", "", "example.com", 80) != fnConnectionPool::key("a", "https", "", "example.com", 80));
+    TEST_ASSERT_TRUE(fnConnectionPool::key("a", "http", "", "example.com", 80) != fnConnectionPool::key("a", "http", "", "example.com", 8080));
+    TEST_ASSERT_TRUE(fnConnectionPool::key("a", "http", "", "example.com", 80) != fnConnectionPool::key("a", "http", "bob", "example.com", 80));
+    TEST_ASSERT_TRUE(fnConnectionPool::key("a", "https", "", "example.com", 443) != fnConnectionPool::key("a", "https", "", "example.com", 443, "insecure"));
+}
+
+void test_pool_reuses_most_recent()
+{
+    std::string k = fnConnectionPool::key("t", "http", "", "host", 80);
+    std::string other = fnConnectionPool::key("t", "http", "", "other", 80);
+
+    TEST_ASSERT_NULL(fnConnectionPool::acquire(k));
+
+    fnConnectionPool::release(k, fake(1), fake_close, fake_healthy);
+    fnConnectionPool::release(k, fake(2), fake_close, fake_healthy);
+
+    TEST_ASSERT_NULL(fnConnectionPool::acquire(other));
+
+    FakeConnection *c = (FakeConnection *)fnConnectionPool::acquire(k);
+    TEST_ASSERT_NOT_NULL(c);
+    TEST_ASSERT_EQUAL(2, c->id);
+    fake_close(c);
+
+    c = (FakeConnection *)fnConnectionPool::acquire(k);
+    TEST_ASSERT_EQUAL(1, c->id);
+    fake_close(c);
+
+    auto s = fnConnectionPool::stats();
+    TEST_ASSERT_EQUAL(0, s.idle);
+    TEST_ASSERT_TRUE(s.hits >= 2);
+}
+
+void test_pool_limits()
+{
+    // Per host
+    std::string k = fnConnectionPool::key("t", "http", "", "limit", 80);
+    for (int i = 0; i < CONNECTION_POOL_PER_HOST + 1; i++)
+        fnConnectionPool::release(k, fake(i), fake_close);
+
+    TEST_ASSERT_EQUAL(1, closed.size());
+    TEST_ASSERT_TRUE(closed.count(CONNECTION_POOL_PER_HOST));
+    TEST_ASSERT_EQUAL(CONNECTION_POOL_PER_HOST, fnConnectionPool::stats().idle);
+
+    // Whole pool, the oldest goes
+    fnConnectionPool::clear();
+    closed.clear();
+    for (int i = 0; i < CONNECTION_POOL_MAX + 1; i++)
+        fnConnectionPool::release(fnConnectionPool::key("t", "http", "", "host" + std::to_string(i), 80), fake(100 + i), fake_close);
+
+    TEST_ASSERT_EQUAL(1, closed.size());
+    TEST_ASSERT_TRUE(closed.count(100));
+    TEST_ASSERT_EQUAL(CONNECTION_POOL_MAX, fnConnectionPool::stats().idle);
+}
+
+void test_pool_health_check()
+{
+    std::string k = fnConnectionPool::key("t", "https", "", "health", 443);
+
+    FakeConnection *good = fake(1);
+    FakeConnection *dropped = fake(2);
+    dropped->open = false;
+    fnConnectionPool::release(k, good, fake_close, fake_healthy);
+    fnConnectionPool::release(k, dropped, fake_close, fake_healthy);
+
+    uint32_t before = fnConnectionPool::stats().unhealthy;
+
+    // The newer one was closed by the server, the older one is handed out
+    FakeConnection *c = (FakeConnection *)fnConnectionPool::acquire(k);
+    TEST_ASSERT_EQUAL(1, c->id);
+    TEST_ASSERT_TRUE(closed.count(2));
+    TEST_ASSERT_EQUAL(before + 1, fnConnectionPool::stats().unhealthy);
+    fake_close(c);
+}
+
+void test_pool_idle_timeout()
+{
+    std::string k = fnConnectionPool::key("t", "http", "", "idle", 80);
+    fnConnectionPool::release(k, fake(1), fake_close);
+
+    // Not idle long enough
+    fnConnectionPool::expire(60000);
+    TEST_ASSERT_EQUAL(1, fnConnectionPool::stats().idle);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint32_t before = fnConnectionPool::stats().expired;
+    fnConnectionPool::expire(10);
+
+    TEST_ASSERT_EQUAL(0, fnConnectionPool::stats().idle);
+    TEST_ASSERT_TRUE(closed.count(1));
+    TEST_ASSERT_EQUAL(before + 1, fnConnectionPool::stats().expired);
+    TEST_ASSERT_NULL(fnConnectionPool::acquire(k));
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_pool_key);
+    RUN_TEST(test_pool_reuses_most_recent);
+    RUN_TEST(test_pool_limits);
+    RUN_TEST(test_pool_health_check);
+    RUN_TEST(test_pool_idle_timeout);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
@@ -0,0 +1,113 @@
+#include "unity.h"
+
+#include "../lib/meatloaf/service/csip_cache.cpp"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static CSIPListing listing(const std::string &url, std::initializer_list<std::pair<const char *, uint32_t>> files)
+{
+    CSIPListing l;
+    l.media_header = "DISK TOOLS";
+    l.media_id = "C=SVR";
+    for (const auto &f : files)
+    {
+        CSIPDirEntry entry;
+        entry.name = f.first;
+        entry.url = url + "/" + f.first;
+        entry.size = f.second;
+        l.entries.push_back(entry);
+    }
+    return l;
+}
+
+void test_csip_listing_hit_and_expiry(void)
+{
+    CSIPListingCache cache(60000, 4);
+
+    TEST_ASSERT_NULL(cache.get("csip:/utilities", 0));
+
+    cache.put("csip:/utilities", listing("csip:/utilities", { { "CIE.D64", 174848 }, { "NAV96.D64", 174848 } }), 1000);
+
+    auto l = cache.get("csip:/utilities", 60999);
+    TEST_ASSERT_NOT_NULL(l);
+    TEST_ASSERT_EQUAL(2, l->entries.size());
+    TEST_ASSERT_EQUAL_STRING("DISK TOOLS", l->media_header.c_str());
+
+    // Gone once the TTL runs out
+    TEST_ASSERT_NULL(cache.get("csip:/utilities", 61000));
+    TEST_ASSERT_EQUAL(0, cache.count());
+}
+
+void test_csip_listing_survives_replacement(void)
+{
+    CSIPListingCache cache(60000, 4);
+    cache.put("csip:/games", listing("csip:/games", { { "ELITE.D64", 1 } }), 0);
+
+    // A file still walking the old listing keeps it
+    auto held = cache.get("csip:/games", 1);
+    cache.put("csip:/games", listing("csip:/games", { { "A.D64", 1 }, { "B.D64", 2 } }), 2);
+
+    TEST_ASSERT_EQUAL(1, held->entries.size());
+    TEST_ASSERT_EQUAL(2, cache.get("csip:/games", 3)->entries.size());
+}
+
+void test_csip_file_size_from_listing(void)
+{
+    CSIPListingCache cache(60000, 4);
+    cache.put("csip:/games/elite.d64", listing("csip:/games/elite.d64", { { "ELITE", 131 }, { "ELITE DATA", 12 } }), 0);
+    cache.put("csip:/games", listing("csip:/games", { { "elite.d64", 174848 } }), 0);
+
+    uint32_t size = 0;
+    TEST_ASSERT_TRUE(cache.fileSize("csip:/games/elite.d64/ELITE DATA", size, 10));
+    TEST_ASSERT_EQUAL_UINT32(12, size);
+    TEST_ASSERT_TRUE(cache.fileSize("csip:/games/elite.d64", size, 10));
+    TEST_ASSERT_EQUAL_UINT32(174848, size);
+
+    TEST_ASSERT_FALSE(cache.fileSize("csip:/games/elite.d64/MISSING", size, 10));
+    TEST_ASSERT_FALSE(cache.fileSize("csip:/games/elite.d64/ELITE", size, 60000));
+}
+
+void test_csip_listing_invalidate_and_bound(void)
+{
+    CSIPListingCache cache(60000, 3);
+    cache.put("csip:/games", listing("csip:/games", {}), 0);
+    cache.put("csip:/games/elite.d64", listing("csip:/games/elite.d64", {}), 0);
+    cache.put("csip:/games2", listing("csip:/games2", {}), 0);
+
+    cache.invalidate("csip:/games");
+    TEST_ASSERT_NULL(cache.get("csip:/games", 1));
+    TEST_ASSERT_NULL(cache.get("csip:/games/elite.d64", 1));
+    TEST_ASSERT_NOT_NULL(cache.get("csip:/games2", 1));
+
+    // Full, the one closest to expiring makes room
+    cache.put("csip:/a", listing("csip:/a", {}), 100);
+    cache.put("csip:/b", listing("csip:/b", {}), 200);
+    cache.put("csip:/c", listing("csip:/c", {}), 300);
+    TEST_ASSERT_EQUAL(3, cache.count());
+    TEST_ASSERT_NULL(cache.get("csip:/games2", 301));
+    TEST_ASSERT_NOT_NULL(cache.get("csip:/c", 301));
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_csip_listing_hit_and_expiry);
+    RUN_TEST(test_csip_listing_survives_replacement);
+    RUN_TEST(test_csip_file_size_from_listing);
+    RUN_TEST(test_csip_listing_invalidate_and_bound);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
@@ -0,0 +1,61 @@
+#include "unity.h"
+
+#include "../lib/compat/compat_inet.c"
+#include "../lib/tcpip/fnDNS.cpp"
+
+// TTLs, coalescing and eviction are covered by test_resolve_cache
+
+static int lookups;
+
+static fnDNSLookup nxdomain(const std::string &)
+{
+    lookups++;
+    fnDNSLookup result;
+    result.reached = true;
+    return result;
+}
+
+void setUp(void)
+{
+    lookups = 0;
+}
+
+void tearDown(void)
+{
+}
+
+
+void test_dns_cache_nxdomain()
+{
+    fnDNSCache cache(300, 10);
+
+    // A name that doesn't exist has no address, and that is remembered
+    TEST_ASSERT_EQUAL_UINT32(IPADDR_NONE, cache.resolve("nope", nxdomain, 0));
+    TEST_ASSERT_TRUE(cache.known("nope", 9999));
+    TEST_ASSERT_EQUAL_UINT32(IPADDR_NONE, cache.resolve("nope", nxdomain, 9999));
+    TEST_ASSERT_EQUAL(1, lookups);
+}
+
+void test_dns_numeric()
+{
+    // Addresses never reach the resolver or the cache
+    TEST_ASSERT_EQUAL_UINT32(inet_addr("192.168.1.10"), get_ip4_addr_by_name("192.168.1.10"));
+    TEST_ASSERT_EQUAL_UINT32(IPADDR_NONE, get_ip4_addr_by_name(""));
+    TEST_ASSERT_EQUAL(0, dns_cache.size());
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_dns_cache_nxdomain);
+    RUN_TEST(test_dns_numeric);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
@@ -0,0 +1,177 @@
+#include "unity.h"
+
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Stand-in for the SD card: a scratch directory
+#define _FN_FSSD_
+class FakeSD
+{
+public:
+    std::string base;
+
+    bool running() { return !base.empty(); }
+    const char *basepath() { return base.c_str(); }
+
+    FILE *file_open(const char *path, const char *mode) { return fopen((base + path).c_str(), mode); }
+    bool remove(const char *path) { return ::remove((base + path).c_str()) == 0; }
+    bool rename(const char *from, const char *to) { return ::rename((base + from).c_str(), (base + to).c_str()) == 0; }
+
+    bool create_path(const char *path)
+    {
+        std::string p = base;
+        for (const char *c = path; *c; c++)
+        {
+            if (*c == '/')
+                mkdir(p.c_str(), 0755);
+            p += *c;
+        }
+        mkdir(p.c_str(), 0755);
+        return true;
+    }
+};
+static FakeSD fnSDFAT;
+
+#include "../lib/meatloaf/network/http_cache.cpp"
+
+static bool download(const std::string &url, const std::string &body, uint32_t expires)
+{
+    FILE *f = HTTPDiskCache::createBody(url);
+    if (f == nullptr)
+        return false;
+
+    fwrite(body.data(), 1, body.size(), f);
+
+    HTTPCacheEntry entry;
+    entry.url = url;
+    entry.etag = "\"v1\"";
+    entry.size = body.size();
+    entry.expires = expires;
+    return HTTPDiskCache::commitBody(f, entry);
+}
+
+static std::string cached(const std::string &url)
+{
+    FILE *f = HTTPDiskCache::openBody(url);
+    if (f == nullptr)
+        return "";
+
+    char buf[64] = {};
+    size_t n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    return std::string(buf, n);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+
+void test_http_cache_hit()
+{
+    const std::string url = "http://example.com/games/elite.prg";
+    TEST_ASSERT_TRUE(download(url, "ELITE", time(nullptr) + 3600));
+
+    HTTPCacheEntry entry;
+    TEST_ASSERT_TRUE(HTTPDiskCache::lookup(url, entry));
+    TEST_ASSERT_TRUE(entry.fresh());
+    TEST_ASSERT_TRUE(entry.hasBody);
+    TEST_ASSERT_EQUAL_UINT32(5, entry.size);
+    TEST_ASSERT_EQUAL_STRING("\"v1\"", entry.etag.c_str());
+    TEST_ASSERT_EQUAL_STRING("ELITE", cached(url).c_str());
+
+    TEST_ASSERT_FALSE(HTTPDiskCache::lookup("http://example.com/games/other.prg", entry));
+}
+
+void test_http_cache_revalidate()
+{
+    // Expired, it is asked about again
+    const std::string url = "http://example.com/games/stale.prg";
+    TEST_ASSERT_TRUE(download(url, "STALE", 1));
+
+    HTTPCacheEntry entry;
+    TEST_ASSERT_TRUE(HTTPDiskCache::lookup(url, entry));
+    TEST_ASSERT_FALSE(entry.fresh());
+
+    // 304, the body on SD is still good
+    entry.expires = time(nullptr) + 3600;
+    TEST_ASSERT_TRUE(HTTPDiskCache::store(entry));
+    TEST_ASSERT_TRUE(HTTPDiskCache::lookup(url, entry));
+    TEST_ASSERT_TRUE(entry.fresh());
+    TEST_ASSERT_EQUAL_STRING("STALE", cached(url).c_str());
+
+    // 200 with a new version, the old body goes
+    entry.etag = "\"v2\"";
+    entry.hasBody = false;
+    TEST_ASSERT_TRUE(HTTPDiskCache::store(entry));
+    TEST_ASSERT_TRUE(HTTPDiskCache::lookup(url, entry));
+    TEST_ASSERT_FALSE(entry.hasBody);
+    TEST_ASSERT_NULL(HTTPDiskCache::openBody(url));
+}
+
+void test_http_cache_one_fill()
+{
+    // A second reader of the same url doesn't write over the first one's download
+    const std::string url = "http://example.com/games/twice.prg";
+    FILE *first = HTTPDiskCache::createBody(url);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_NULL(HTTPDiskCache::createBody(url));
+
+    HTTPDiskCache::abortBody(first, url);
+    TEST_ASSERT_TRUE(download(url, "TWICE", time(nullptr) + 3600));
+    TEST_ASSERT_EQUAL_STRING("TWICE", cached(url).c_str());
+}
+
+void test_http_cache_eviction()
+{
+    // Least recently read goes first, whatever the clock says. Fill up
+    // behind the three entries the other tests left
+    HTTPCacheEntry entry;
+    for (int i = 0; i < HTTP_DISK_CACHE_MAX_ENTRIES - 3; i++)
+    {
+        entry.url = "http://example.com/dir/" + std::to_string(i);
+        TEST_ASSERT_TRUE(HTTPDiskCache::store(entry));
+    }
+
+    const std::string kept = "http://example.com/games/elite.prg";
+    const std::string oldest = "http://example.com/games/twice.prg";
+    TEST_ASSERT_EQUAL_STRING("ELITE", cached(kept).c_str());
+
+    // Three more push out the three least recently used, not the one just read
+    for (int i = 0; i < 3; i++)
+    {
+        entry.url = "http://example.com/more/" + std::to_string(i);
+        TEST_ASSERT_TRUE(HTTPDiskCache::store(entry));
+    }
+
+    TEST_ASSERT_TRUE(HTTPDiskCache::lookup(kept, entry));
+    TEST_ASSERT_FALSE(HTTPDiskCache::lookup(oldest, entry));
+    TEST_ASSERT_FALSE(HTTPDiskCache::lookup("http://example.com/dir/0", entry));
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_http_cache_hit);
+    RUN_TEST(test_http_cache_revalidate);
+    RUN_TEST(test_http_cache_one_fill);
+    RUN_TEST(test_http_cache_eviction);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    char dir[] = "/tmp/http_cacheXXXXXX";
+    fnSDFAT.base = mkdtemp(dir);
+
+    process();
+}
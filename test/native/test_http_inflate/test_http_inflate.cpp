@@ -0,0 +1,172 @@
+#include "unity.h"
+
+#include <string>
+#include <vector>
+
+// The miniz implementation, http_inflate.cpp only takes its header
+#define MINIZ_NO_STDIO
+#define MINIZ_NO_ARCHIVE_APIS
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "../lib/vdrive/miniz.h"
+
+#include "../lib/meatloaf/network/http_inflate.cpp"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Compressible, but not trivially: a directory listing with varying numbers
+static std::vector<uint8_t> listing(uint32_t lines)
+{
+    std::string text;
+    for (uint32_t i = 0; i < lines; i++)
+        text += std::to_string((i * 37) % 664) + " \"GAME " + std::to_string(i) + "\" PRG\n";
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+static std::vector<uint8_t> deflate(const std::vector<uint8_t> &data, bool zlib)
+{
+    size_t length = 0;
+    int flags = 128 | (zlib ? TDEFL_WRITE_ZLIB_HEADER : 0);
+    uint8_t *out = (uint8_t *)tdefl_compress_mem_to_heap(data.data(), data.size(), &length, flags);
+    std::vector<uint8_t> result(out, out + length);
+    free(out);
+    return result;
+}
+
+static std::vector<uint8_t> gzip(const std::vector<uint8_t> &data, bool name = false)
+{
+    std::vector<uint8_t> out = { 0x1F, 0x8B, 0x08, (uint8_t)(name ? 0x08 : 0x00), 0, 0, 0, 0, 0, 0x03 };
+    if (name)
+    {
+        const char *n = "dir.txt";
+        out.insert(out.end(), n, n + strlen(n) + 1);
+    }
+
+    auto body = deflate(data, false);
+    out.insert(out.end(), body.begin(), body.end());
+
+    uint32_t crc = mz_crc32(MZ_CRC32_INIT, data.data(), data.size());
+    uint32_t size = data.size();
+    for (int i = 0; i < 4; i++)
+        out.push_back(crc >> (i * 8));
+    for (int i = 0; i < 4; i++)
+        out.push_back(size >> (i * 8));
+    return out;
+}
+
+// Hands the body out in small uneven pieces, like a socket would
+static HTTPInflater::Source feeder(const std::vector<uint8_t> &body, uint32_t &offset, uint32_t piece = 97)
+{
+    return [&body, &offset, piece](uint8_t *buf, uint32_t size) -> int32_t {
+        uint32_t n = std::min({ size, piece, (uint32_t)body.size() - offset });
+        memcpy(buf, body.data() + offset, n);
+        offset += n;
+        return n;
+    };
+}
+
+static std::vector<uint8_t> drain(HTTPInflater &inflater, uint32_t chunk = 254)
+{
+    std::vector<uint8_t> out;
+    std::vector<uint8_t> buf(chunk);
+    uint32_t bytes;
+    while ((bytes = inflater.read(buf.data(), chunk)) > 0)
+        out.insert(out.end(), buf.begin(), buf.begin() + bytes);
+    return out;
+}
+
+
+void test_inflate_encoding_names()
+{
+    TEST_ASSERT_EQUAL(HTTPInflater::IDENTITY, HTTPInflater::encoding(""));
+    TEST_ASSERT_EQUAL(HTTPInflater::IDENTITY, HTTPInflater::encoding("identity"));
+    TEST_ASSERT_EQUAL(HTTPInflater::GZIP, HTTPInflater::encoding(" GZip "));
+    TEST_ASSERT_EQUAL(HTTPInflater::GZIP, HTTPInflater::encoding("x-gzip"));
+    TEST_ASSERT_EQUAL(HTTPInflater::DEFLATE, HTTPInflater::encoding("deflate"));
+    TEST_ASSERT_EQUAL(HTTPInflater::UNSUPPORTED, HTTPInflater::encoding("br"));
+}
+
+void test_inflate_gzip()
+{
+    // Larger than the dictionary, so it wraps
+    auto data = listing(5000);
+    auto body = gzip(data, true);
+    TEST_ASSERT_TRUE(body.size() < data.size() / 2);
+
+    uint32_t offset = 0;
+    HTTPInflater inflater(HTTPInflater::GZIP, feeder(body, offset));
+    auto out = drain(inflater);
+
+    TEST_ASSERT_FALSE(inflater.failed());
+    TEST_ASSERT_TRUE(inflater.done());
+    TEST_ASSERT_EQUAL_UINT32(data.size(), out.size());
+    TEST_ASSERT_TRUE(out == data);
+    TEST_ASSERT_EQUAL_UINT32(body.size(), inflater.consumed());
+}
+
+void test_inflate_deflate_zlib_and_raw()
+{
+    auto data = listing(800);
+
+    for (bool zlib : { true, false })
+    {
+        auto body = deflate(data, zlib);
+        uint32_t offset = 0;
+        HTTPInflater inflater(HTTPInflater::DEFLATE, feeder(body, offset, 1000));
+        auto out = drain(inflater, 1);
+
+        TEST_ASSERT_FALSE(inflater.failed());
+        TEST_ASSERT_TRUE(out == data);
+    }
+}
+
+void test_inflate_detects_damage()
+{
+    auto data = listing(300);
+
+    // Truncated body
+    auto body = gzip(data);
+    body.resize(body.size() / 2);
+    uint32_t offset = 0;
+    HTTPInflater truncated(HTTPInflater::GZIP, feeder(body, offset));
+    auto out = drain(truncated);
+    TEST_ASSERT_TRUE(truncated.failed());
+    TEST_ASSERT_TRUE(out.size() < data.size());
+
+    // Wrong CRC in the trailer
+    body = gzip(data);
+    body[body.size() - 8] ^= 0xFF;
+    offset = 0;
+    HTTPInflater corrupt(HTTPInflater::GZIP, feeder(body, offset));
+    drain(corrupt);
+    TEST_ASSERT_TRUE(corrupt.failed());
+
+    // Not gzip at all
+    offset = 0;
+    HTTPInflater plain(HTTPInflater::GZIP, feeder(data, offset));
+    TEST_ASSERT_EQUAL_UINT32(0, drain(plain).size());
+    TEST_ASSERT_TRUE(plain.failed());
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_inflate_encoding_names);
+    RUN_TEST(test_inflate_gzip);
+    RUN_TEST(test_inflate_deflate_zlib_and_raw);
+    RUN_TEST(test_inflate_detects_damage);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
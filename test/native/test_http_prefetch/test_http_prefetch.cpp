@@ -0,0 +1,314 @@
+#include "unity.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../lib/meatloaf/network/http_prefetch.cpp"
+
+#define TEST_CHUNK 4096
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Local HTTP/1.1 server answering Range requests after a fixed delay,
+// stands in for a far away server on a high RTT link
+class LatencyServer {
+public:
+    LatencyServer(uint32_t size, uint32_t latency_ms) : m_latency(latency_ms)
+    {
+        for (uint32_t i = 0; i < size; i++)
+            m_body.push_back((uint8_t)((i * 7) + (i >> 8)));
+
+        m_listen = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(m_listen, (sockaddr *)&addr, sizeof(addr));
+        listen(m_listen, 8);
+
+        socklen_t len = sizeof(addr);
+        getsockname(m_listen, (sockaddr *)&addr, &len);
+        port = ntohs(addr.sin_port);
+
+        m_acceptor = std::thread([this]() { accept_loop(); });
+    }
+
+    ~LatencyServer()
+    {
+        m_stop = true;
+        m_acceptor.join();
+        for (int fd : m_clients)
+            shutdown(fd, SHUT_RDWR);
+        for (auto &thread : m_threads)
+            thread.join();
+        for (int fd : m_clients)
+            close(fd);
+        close(m_listen);
+    }
+
+    const std::vector<uint8_t> &body() { return m_body; }
+
+    uint16_t port;
+    std::atomic<uint32_t> requests{0};
+
+private:
+    void accept_loop()
+    {
+        while (!m_stop)
+        {
+            pollfd p = { m_listen, POLLIN, 0 };
+            if (poll(&p, 1, 20) <= 0)
+                continue;
+
+            int fd = accept(m_listen, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            m_clients.push_back(fd);
+            m_threads.emplace_back([this, fd]() { serve(fd); });
+        }
+    }
+
+    void serve(int fd)
+    {
+        std::string request;
+        char buf[512];
+        while (true)
+        {
+            size_t end = request.find("\r\n\r\n");
+            if (end == std::string::npos)
+            {
+                ssize_t n = recv(fd, buf, sizeof(buf), 0);
+                if (n <= 0)
+                    return;
+                request.append(buf, n);
+                continue;
+            }
+
+            uint32_t first = 0, last = m_body.size() - 1;
+            size_t range = request.find("Range: bytes=");
+            if (range != std::string::npos && range < end)
+                sscanf(request.c_str() + range, "Range: bytes=%u-%u", &first, &last);
+            request.erase(0, end + 4);
+            last = std::min(last, (uint32_t)m_body.size() - 1);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_latency));
+            requests++;
+
+            char header[256];
+            int h = snprintf(header, sizeof(header),
+                             "HTTP/1.1 206 Partial Content\r\nContent-Length: %u\r\nContent-Range: bytes %u-%u/%zu\r\n\r\n",
+                             last - first + 1, first, last, m_body.size());
+            send(fd, header, h, MSG_NOSIGNAL);
+            send(fd, m_body.data() + first, last - first + 1, MSG_NOSIGNAL);
+        }
+    }
+
+    uint32_t m_latency;
+    std::vector<uint8_t> m_body;
+    int m_listen;
+    std::atomic<bool> m_stop{false};
+    std::thread m_acceptor;
+    std::vector<int> m_clients;
+    std::vector<std::thread> m_threads;
+};
+
+// Keep-alive Range GET per worker, stands in for MeatHttpClient::readRange()
+class RangeClient {
+public:
+    RangeClient(uint16_t port) : m_port(port) {}
+    ~RangeClient()
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    int32_t get(uint32_t offset, uint8_t *buf, uint32_t length)
+    {
+        if (m_fd < 0)
+        {
+            m_fd = socket(AF_INET, SOCK_STREAM, 0);
+            int one = 1;
+            setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(m_port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (connect(m_fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+                return -1;
+        }
+
+        char request[128];
+        int r = snprintf(request, sizeof(request), "GET /image.d64 HTTP/1.1\r\nRange: bytes=%u-%u\r\n\r\n", offset, offset + length - 1);
+        send(m_fd, request, r, MSG_NOSIGNAL);
+
+        std::string header;
+        char c;
+        while (header.find("\r\n\r\n") == std::string::npos)
+        {
+            if (recv(m_fd, &c, 1, 0) != 1)
+                return -1;
+            header += c;
+        }
+
+        uint32_t content_length = 0;
+        sscanf(header.c_str() + header.find("Content-Length: "), "Content-Length: %u", &content_length);
+
+        uint32_t filled = 0;
+        while (filled < content_length)
+        {
+            ssize_t n = recv(m_fd, buf + filled, content_length - filled, 0);
+            if (n <= 0)
+                return -1;
+            filled += n;
+        }
+        return filled;
+    }
+
+private:
+    uint16_t m_port;
+    int m_fd = -1;
+};
+
+// Drain the whole body through the prefetcher, returns the elapsed ms
+static uint32_t timed_load(LatencyServer &server, uint8_t workers, std::vector<uint8_t> &out, uint8_t *window = nullptr)
+{
+    std::vector<std::unique_ptr<RangeClient>> clients;
+    for (uint8_t i = 0; i < workers; i++)
+        clients.emplace_back(new RangeClient(server.port));
+
+    auto started = std::chrono::steady_clock::now();
+
+    HTTPPrefetcher prefetch([&](uint8_t worker, uint32_t offset, uint8_t *buf, uint32_t length) {
+        return clients[worker]->get(offset, buf, length);
+    }, 0, server.body().size(), workers, TEST_CHUNK);
+    out.clear();
+    if (!prefetch.start())
+        return 0;
+
+    // The bus side reads a sector at a time
+    uint8_t sector[254];
+    uint32_t n;
+    while ((n = prefetch.read(sector, sizeof(sector))) > 0)
+        out.insert(out.end(), sector, sector + n);
+
+    if (window != nullptr)
+        *window = prefetch.window();
+
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+}
+
+void test_prefetch_reassembles_in_order(void)
+{
+    LatencyServer server((TEST_CHUNK * 10) + 123, 5);
+
+    std::vector<uint8_t> out;
+    timed_load(server, HTTP_PREFETCH_WORKERS, out);
+
+    TEST_ASSERT_EQUAL_UINT32(server.body().size(), out.size());
+    TEST_ASSERT_TRUE(out == server.body());
+    TEST_ASSERT_EQUAL_UINT32(11, server.requests.load());
+}
+
+void test_prefetch_hides_latency(void)
+{
+    LatencyServer server(TEST_CHUNK * 16, 40);
+
+    std::vector<uint8_t> out;
+    uint32_t serial = timed_load(server, 1, out);
+    TEST_ASSERT_TRUE(out == server.body());
+
+    uint8_t window = 0;
+    uint32_t parallel = timed_load(server, HTTP_PREFETCH_WORKERS, out, &window);
+    TEST_ASSERT_TRUE(out == server.body());
+
+    // Three requests in flight, the reader stalls and the window opens up
+    TEST_ASSERT_LESS_THAN_UINT32(serial * 6 / 10, parallel);
+    TEST_ASSERT_GREATER_THAN_UINT8(HTTP_PREFETCH_WINDOW_MIN, window);
+}
+
+void test_prefetch_window_shrinks_for_slow_reader(void)
+{
+    LatencyServer server(TEST_CHUNK * 24, 20);
+    RangeClient clients[HTTP_PREFETCH_WORKERS] = { server.port, server.port, server.port };
+
+    HTTPPrefetcher prefetch([&](uint8_t worker, uint32_t offset, uint8_t *buf, uint32_t length) {
+        return clients[worker].get(offset, buf, length);
+    }, 0, server.body().size(), HTTP_PREFETCH_WORKERS, TEST_CHUNK);
+    TEST_ASSERT_TRUE(prefetch.start());
+
+    // Reading flat out stalls on the network and opens the window
+    uint8_t buf[TEST_CHUNK];
+    uint8_t widest = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        prefetch.read(buf, TEST_CHUNK);
+        widest = std::max(widest, prefetch.window());
+    }
+    TEST_ASSERT_GREATER_THAN_UINT8(HTTP_PREFETCH_WINDOW_MIN, widest);
+
+    // Then read slower than the link and it closes again
+    for (int i = 0; i < 12; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(60));
+        prefetch.read(buf, TEST_CHUNK);
+    }
+    TEST_ASSERT_EQUAL_UINT8(HTTP_PREFETCH_WINDOW_MIN, prefetch.window());
+}
+
+void test_prefetch_reports_failed_fetch(void)
+{
+    const uint32_t size = TEST_CHUNK * 8;
+
+    // Connection drops on the fourth chunk
+    HTTPPrefetcher prefetch([&](uint8_t worker, uint32_t offset, uint8_t *buf, uint32_t length) {
+        if (offset == TEST_CHUNK * 3)
+            return (int32_t)-1;
+        memset(buf, worker, length);
+        return (int32_t)length;
+    }, 0, size, HTTP_PREFETCH_WORKERS, TEST_CHUNK);
+    TEST_ASSERT_TRUE(prefetch.start());
+
+    uint8_t buf[TEST_CHUNK];
+    uint32_t total = 0, n;
+    while ((n = prefetch.read(buf, sizeof(buf))) > 0)
+        total += n;
+
+    TEST_ASSERT_TRUE(prefetch.failed());
+    TEST_ASSERT_EQUAL_UINT32(TEST_CHUNK * 3, total);
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_prefetch_reassembles_in_order);
+    RUN_TEST(test_prefetch_hides_latency);
+    RUN_TEST(test_prefetch_window_shrinks_for_slow_reader);
+    RUN_TEST(test_prefetch_reports_failed_fetch);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
@@ -0,0 +1,155 @@
+#include "unity.h"
+
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Stand-in for the SD card: a scratch directory
+#define _FN_FSSD_
+class FakeSD
+{
+public:
+    std::string base;
+
+    bool running() { return !base.empty(); }
+    const char *basepath() { return base.c_str(); }
+
+    FILE *file_open(const char *path, const char *mode) { return fopen((base + path).c_str(), mode); }
+    bool remove(const char *path) { return ::remove((base + path).c_str()) == 0; }
+
+    bool create_path(const char *path)
+    {
+        std::string p = base;
+        for (const char *c = path; *c; c++)
+        {
+            if (*c == '/')
+                mkdir(p.c_str(), 0755);
+            p += *c;
+        }
+        mkdir(p.c_str(), 0755);
+        return true;
+    }
+};
+static FakeSD fnSDFAT;
+
+#include "../lib/meatloaf/network/ipfs_cache.cpp"
+
+static void fill(uint8_t *buf, uint32_t length, uint8_t seed)
+{
+    for (uint32_t i = 0; i < length; i++)
+        buf[i] = (uint8_t)(seed + i);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+
+void test_ipfs_cache_blocks()
+{
+    // Three full blocks and a short one
+    const std::string key = "QmBlocks/games/elite.d64";
+    const uint32_t size = IPFS_CACHE_BLOCK_SIZE * 3 + 100;
+    static uint8_t block[IPFS_CACHE_BLOCK_SIZE];
+
+    IPFSCacheObject object;
+    TEST_ASSERT_FALSE(IPFSCache::open(key, object));
+    TEST_ASSERT_TRUE(IPFSCache::create(key, size, object));
+    TEST_ASSERT_EQUAL(4, object.count());
+
+    // Only what was read through gets filled
+    fill(block, IPFS_CACHE_BLOCK_SIZE, 1);
+    TEST_ASSERT_TRUE(IPFSCache::write(object, 0, block, IPFS_CACHE_BLOCK_SIZE));
+    fill(block, 100, 3);
+    TEST_ASSERT_TRUE(IPFSCache::write(object, 3, block, 100));
+    TEST_ASSERT_FALSE(IPFSCache::write(object, 4, block, 100));
+    IPFSCache::close(object);
+
+    IPFSCacheObject again;
+    TEST_ASSERT_TRUE(IPFSCache::open(key, again));
+    TEST_ASSERT_EQUAL(size, again.size);
+    TEST_ASSERT_TRUE(again.has(0));
+    TEST_ASSERT_FALSE(again.has(1));
+    TEST_ASSERT_FALSE(again.has(2));
+    TEST_ASSERT_TRUE(again.has(3));
+
+    // One stream at a time
+    IPFSCacheObject other;
+    TEST_ASSERT_FALSE(IPFSCache::open(key, other));
+
+    uint8_t buf[200];
+    TEST_ASSERT_EQUAL(10, IPFSCache::read(again, 0, 20, buf, 10));
+    TEST_ASSERT_EQUAL(21, buf[0]);
+    TEST_ASSERT_EQUAL(0, IPFSCache::read(again, 1, 0, buf, 10));
+
+    // The last block stops at the end of the object
+    TEST_ASSERT_EQUAL(50, IPFSCache::read(again, 3, 50, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL(53, buf[0]);
+    IPFSCache::close(again);
+}
+
+void test_ipfs_cache_listing()
+{
+    std::vector<IPFSDirEntry> entries(2);
+    entries[0].name = "elite.d64";
+    entries[0].size = 174848;
+    entries[1].name = "demos";
+    entries[1].isDir = true;
+
+    std::vector<IPFSDirEntry> loaded;
+    TEST_ASSERT_FALSE(IPFSCache::loadListing("QmList/games", loaded));
+
+    IPFSCache::storeListing("QmList/games", entries);
+    TEST_ASSERT_TRUE(IPFSCache::loadListing("QmList/games", loaded));
+    TEST_ASSERT_EQUAL(2, loaded.size());
+    TEST_ASSERT_EQUAL_STRING("elite.d64", loaded[0].name.c_str());
+    TEST_ASSERT_EQUAL(174848, loaded[0].size);
+    TEST_ASSERT_FALSE(loaded[0].isDir);
+    TEST_ASSERT_TRUE(loaded[1].isDir);
+
+    TEST_ASSERT_FALSE(IPFSCache::loadListing("QmList/other", loaded));
+}
+
+void test_ipfs_cache_pins()
+{
+    // Pins are by root CID, they cover everything below it
+    IPFSCache::pin("QmPinned/games/elite.d64");
+    TEST_ASSERT_TRUE(IPFSCache::pinned("QmPinned"));
+    TEST_ASSERT_TRUE(IPFSCache::pinned("QmPinned/demos/x.prg"));
+    TEST_ASSERT_FALSE(IPFSCache::pinned("QmOther/games/elite.d64"));
+
+    FILE *f = fnSDFAT.file_open(IPFS_CACHE_PINS, "r");
+    TEST_ASSERT_NOT_NULL(f);
+    char line[64] = {};
+    fgets(line, sizeof(line), f);
+    fclose(f);
+    TEST_ASSERT_EQUAL_STRING("QmPinned\n", line);
+
+    IPFSCache::unpin("QmPinned");
+    TEST_ASSERT_FALSE(IPFSCache::pinned("QmPinned/games/elite.d64"));
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_ipfs_cache_blocks);
+    RUN_TEST(test_ipfs_cache_listing);
+    RUN_TEST(test_ipfs_cache_pins);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    char dir[] = "/tmp/ipfs_cacheXXXXXX";
+    fnSDFAT.base = mkdtemp(dir);
+
+    process();
+}
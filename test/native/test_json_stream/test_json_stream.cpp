@@ -0,0 +1,193 @@
+#include "unity.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "../lib/fnjson/json_stream.cpp"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Feed in pieces of the given size, finish at the end
+static JSONQueryStream::Result query(JSONQueryStream &q, const std::string &doc, size_t piece)
+{
+    for (size_t pos = 0; pos < doc.size() && q.result() == JSONQueryStream::MORE; pos += piece)
+        q.feed(doc.data() + pos, std::min(piece, doc.size() - pos));
+    return q.finish();
+}
+
+static std::string value(const std::string &doc, const std::string &pointer, size_t piece = 1)
+{
+    JSONQueryStream q(pointer);
+    if (query(q, doc, piece) != JSONQueryStream::FOUND)
+        return "<none>";
+    return q.match();
+}
+
+// Large fixture: {"count":N,"items":[{"id":0,"name":"item 0","tags":[...],"text":"..."},...],"last":"end"}
+static std::string fixture(size_t items, size_t text)
+{
+    std::string doc = "{\"count\":" + std::to_string(items) + ",\"items\":[";
+    for (size_t i = 0; i < items; i++)
+    {
+        if (i)
+            doc += ",";
+        doc += "{\"id\":" + std::to_string(i) + ",\"name\":\"item " + std::to_string(i) + "\",";
+        doc += "\"tags\":[\"a\",\"b\",{\"deep\":[1,2,3]}],\"text\":\"" + std::string(text, 'x') + "\\n\"}";
+    }
+    doc += "],\"last\":\"end\"}";
+    return doc;
+}
+
+
+void test_whole_document()
+{
+    std::string doc = " { \"a\" : [1, 2] } ";
+    TEST_ASSERT_EQUAL_STRING("{ \"a\" : [1, 2] }", value(doc, "").c_str());
+    TEST_ASSERT_EQUAL_STRING("42", value("42", "").c_str());
+    TEST_ASSERT_EQUAL_STRING("\"hi\"", value("\"hi\"", "").c_str());
+}
+
+void test_paths()
+{
+    std::string doc = "{\"a\":{\"b\":[10,{\"c\":\"x\\\"y\"},[true,null]]},\"n\":-1.5e3,\"e\":{}}";
+
+    for (size_t piece : {1, 3, 7, 1000})
+    {
+        TEST_ASSERT_EQUAL_STRING("10", value(doc, "/a/b/0", piece).c_str());
+        TEST_ASSERT_EQUAL_STRING("{\"c\":\"x\\\"y\"}", value(doc, "/a/b/1", piece).c_str());
+        TEST_ASSERT_EQUAL_STRING("\"x\\\"y\"", value(doc, "/a/b/1/c", piece).c_str());
+        TEST_ASSERT_EQUAL_STRING("null", value(doc, "/a/b/2/1", piece).c_str());
+        TEST_ASSERT_EQUAL_STRING("-1.5e3", value(doc, "/n", piece).c_str());
+        TEST_ASSERT_EQUAL_STRING("{}", value(doc, "/e", piece).c_str());
+    }
+}
+
+void test_keys_like_cjson_utils()
+{
+    // Case insensitive, ~1 and ~0 escapes, \u escapes in keys, first duplicate wins
+    std::string doc = "{\"Name\":1,\"a/b\":2,\"m~n\":3,\"caf\\u00e9\":4,\"\\ud83d\\ude00\":5,\"d\":6,\"d\":7}";
+
+    TEST_ASSERT_EQUAL_STRING("1", value(doc, "/name").c_str());
+    TEST_ASSERT_EQUAL_STRING("2", value(doc, "/a~1b").c_str());
+    TEST_ASSERT_EQUAL_STRING("3", value(doc, "/m~0n").c_str());
+    TEST_ASSERT_EQUAL_STRING("4", value(doc, "/caf\xc3\xa9").c_str());
+    TEST_ASSERT_EQUAL_STRING("5", value(doc, "/\xf0\x9f\x98\x80").c_str());
+    TEST_ASSERT_EQUAL_STRING("6", value(doc, "/d").c_str());
+
+    // Array indexes have no leading zeros
+    TEST_ASSERT_EQUAL_STRING("<none>", value("[1,2]", "/01").c_str());
+    TEST_ASSERT_EQUAL_STRING("2", value("[1,2]", "/1").c_str());
+}
+
+void test_not_found_stops_early()
+{
+    std::string doc = "{\"a\":{\"b\":1},\"rest\":[" + std::string(1000, ' ') + "]}";
+
+    JSONQueryStream q("/a/c");
+    size_t used = 0;
+    TEST_ASSERT_EQUAL(JSONQueryStream::NOT_FOUND, q.feed(doc.data(), doc.size(), &used));
+    TEST_ASSERT_TRUE(used < 20);
+
+    TEST_ASSERT_EQUAL_STRING("<none>", value(doc, "/a/b/c").c_str());
+    TEST_ASSERT_EQUAL_STRING("<none>", value(doc, "/rest/0").c_str());
+    TEST_ASSERT_EQUAL_STRING("<none>", value(doc, "/missing").c_str());
+
+    // Found values end the read too
+    JSONQueryStream found("/a/b");
+    TEST_ASSERT_EQUAL(JSONQueryStream::FOUND, found.feed(doc.data(), doc.size(), &used));
+    TEST_ASSERT_TRUE(used < 20);
+}
+
+void test_errors()
+{
+    JSONQueryStream q("/a");
+    TEST_ASSERT_EQUAL(JSONQueryStream::ERROR, query(q, "{\"x\" 1}", 1));
+
+    q.reset("/a");
+    TEST_ASSERT_EQUAL(JSONQueryStream::ERROR, query(q, "{\"x\":[1}", 1));
+
+    q.reset("/a");
+    TEST_ASSERT_EQUAL(JSONQueryStream::ERROR, query(q, "{\"x\":1", 1));
+
+    q.reset("");
+    TEST_ASSERT_EQUAL(JSONQueryStream::ERROR, query(q, "<html>", 1));
+}
+
+void test_parse_mode()
+{
+    // FNJSON::parse() streams a query that names part of the document,
+    // anything else gets the whole tree
+    TEST_ASSERT_TRUE(JSONQueryStream::whole(""));
+    TEST_ASSERT_TRUE(JSONQueryStream::whole("items"));
+    TEST_ASSERT_FALSE(JSONQueryStream::whole("/"));
+    TEST_ASSERT_FALSE(JSONQueryStream::whole("/items/0/name"));
+
+    // and a streamed document still has the value a tree would
+    std::string doc = "{\"a\":{\"b\":[1,2,{\"c\":\"x\"}]}}";
+    TEST_ASSERT_EQUAL_STRING(doc.c_str(), value(doc, "").c_str());
+    TEST_ASSERT_EQUAL_STRING("\"x\"", value(doc, "/a/b/2/c").c_str());
+}
+
+void test_benchmark_large_documents()
+{
+    struct
+    {
+        const char *name;
+        size_t items;
+        size_t text;
+    } fixtures[] = {
+        {"many small items", 20000, 16},
+        {"long strings", 2000, 2048},
+    };
+
+    for (auto &f : fixtures)
+    {
+        std::string doc = fixture(f.items, f.text);
+        std::string pointer = "/items/" + std::to_string(f.items - 1) + "/name";
+        std::string expected = "\"item " + std::to_string(f.items - 1) + "\"";
+
+        auto start = std::chrono::steady_clock::now();
+        JSONQueryStream q(pointer);
+        TEST_ASSERT_EQUAL(JSONQueryStream::FOUND, query(q, doc, 512));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), q.match().c_str());
+
+        // Bounded by the answer, not the document
+        TEST_ASSERT_TRUE(q.peak() < 256);
+
+        printf("%-18s %8zu bytes  %7.2f ms  %7.1f MB/s  peak %zu bytes\n",
+               f.name, doc.size(), ms, (doc.size() / 1048576.0) / (ms / 1000.0), q.peak());
+
+        // The last key is after the big array
+        TEST_ASSERT_EQUAL_STRING("\"end\"", value(doc, "/last", 4096).c_str());
+    }
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_whole_document);
+    RUN_TEST(test_paths);
+    RUN_TEST(test_keys_like_cjson_utils);
+    RUN_TEST(test_not_found_stops_early);
+    RUN_TEST(test_errors);
+    RUN_TEST(test_parse_mode);
+    RUN_TEST(test_benchmark_large_documents);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
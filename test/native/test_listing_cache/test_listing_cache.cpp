@@ -0,0 +1,86 @@
+#include "unity.h"
+
+#include <string>
+#include <vector>
+
+#include "../lib/utils/listing_cache.h"
+
+typedef ListingCache<std::string> Cache;
+
+static std::vector<std::string> files(const std::string &dir)
+{
+    return { dir + "/a.prg", dir + "/b.d64" };
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+
+void test_listing_fresh_then_expired()
+{
+    Cache cache(10000, 4);
+    TEST_ASSERT_NULL(cache.find("/games", 0));
+
+    cache.put("/games", files("/games"), 1000);
+    const std::vector<std::string> *listing = cache.find("/games", 10999);
+    TEST_ASSERT_NOT_NULL(listing);
+    TEST_ASSERT_EQUAL(2, listing->size());
+    TEST_ASSERT_EQUAL_STRING("/games/b.d64", (*listing)[1].c_str());
+
+    TEST_ASSERT_NULL(cache.find("/games", 11000));
+}
+
+void test_listing_soonest_to_expire_makes_room()
+{
+    Cache cache(10000, 3);
+    cache.put("/a", files("/a"), 300);
+    cache.put("/b", files("/b"), 100);
+    cache.put("/c", files("/c"), 200);
+
+    // Replacing one doesn't push anything out
+    cache.put("/a", files("/a"), 400);
+    TEST_ASSERT_EQUAL(3, cache.size());
+
+    cache.put("/d", files("/d"), 500);
+    TEST_ASSERT_EQUAL(3, cache.size());
+    TEST_ASSERT_NULL(cache.find("/b", 500));
+    TEST_ASSERT_NOT_NULL(cache.find("/a", 500));
+    TEST_ASSERT_NOT_NULL(cache.find("/c", 500));
+    TEST_ASSERT_NOT_NULL(cache.find("/d", 500));
+}
+
+void test_listing_erase()
+{
+    Cache cache(10000, 4);
+    cache.put("/a", files("/a"), 0);
+    cache.put("/b", files("/b"), 0);
+
+    cache.erase("/a");
+    TEST_ASSERT_NULL(cache.find("/a", 0));
+    TEST_ASSERT_NOT_NULL(cache.find("/b", 0));
+
+    cache.clear();
+    TEST_ASSERT_EQUAL(0, cache.size());
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_listing_fresh_then_expired);
+    RUN_TEST(test_listing_soonest_to_expire_makes_room);
+    RUN_TEST(test_listing_erase);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
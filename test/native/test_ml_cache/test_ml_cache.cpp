@@ -0,0 +1,111 @@
+#include "unity.h"
+
+#include "../lib/meatloaf/service/ml_cache.cpp"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static const uint32_t NOW = 1700000000;
+
+// TTLs, coalescing and eviction are covered by test_resolve_cache
+
+void test_only_found_names_are_dirty(void)
+{
+    MLResolveCache cache(60, 10, 16);
+    auto fetch = [](const std::string &name) {
+        MLResolution r;
+        r.reached = true;
+        return r;
+    };
+
+    TEST_ASSERT_EQUAL_STRING("", cache.resolve("nothing", fetch, NOW, 1000).c_str());
+
+    // Misses aren't worth saving
+    TEST_ASSERT_FALSE(cache.dirty());
+}
+
+void test_save_and_load(void)
+{
+    MLResolveCache cache(60, 10, 16);
+    auto fetch = [](const std::string &name) {
+        MLResolution r;
+        r.reached = true;
+        r.found = (name != "nothing");
+        r.value = "https://example.com/" + name;
+        return r;
+    };
+
+    cache.resolve("elite", fetch, NOW, 1000);
+    cache.resolve("nothing", fetch, NOW, 1000);
+    TEST_ASSERT_TRUE(cache.dirty());
+
+    FILE *f = tmpfile();
+    cache.save(f, NOW);
+    TEST_ASSERT_FALSE(cache.dirty());
+    rewind(f);
+
+    // After a reboot, with and without the clock set
+    MLResolveCache loaded(60, 10, 16);
+    loaded.load(f);
+    fclose(f);
+    TEST_ASSERT_EQUAL_UINT32(1, loaded.size());
+
+    int fetches = 0;
+    auto counting = [&](const std::string &name) { fetches++; return fetch(name); };
+    TEST_ASSERT_EQUAL_STRING("https://example.com/elite", loaded.resolve("elite", counting, 0, 10).c_str());
+    TEST_ASSERT_EQUAL_STRING("https://example.com/elite", loaded.resolve("elite", counting, NOW + 30, 20).c_str());
+    TEST_ASSERT_EQUAL_INT(0, fetches);
+
+    loaded.resolve("elite", counting, NOW + 61, 30);
+    TEST_ASSERT_EQUAL_INT(1, fetches);
+}
+
+void test_saved_entries_not_evicted_first(void)
+{
+    FILE *f = tmpfile();
+    fprintf(f, "%lu\telite\thttps://example.com/elite\n", (unsigned long)(NOW + 3600));
+    rewind(f);
+
+    MLResolveCache cache(60, 10, 2);
+    cache.load(f);
+    fclose(f);
+
+    auto fetch = [](const std::string &name) {
+        MLResolution r;
+        r.reached = true;
+        r.found = true;
+        r.value = name;
+        return r;
+    };
+
+    // The saved one has an hour left, the others a minute
+    cache.resolve("a", fetch, NOW, 1000);
+    cache.resolve("b", fetch, NOW, 2000);
+
+    int fetches = 0;
+    auto counting = [&](const std::string &name) { fetches++; return fetch(name); };
+    TEST_ASSERT_EQUAL_STRING("https://example.com/elite", cache.resolve("elite", counting, NOW, 3000).c_str());
+    TEST_ASSERT_EQUAL_STRING("b", cache.resolve("b", counting, NOW, 3000).c_str());
+    TEST_ASSERT_EQUAL_INT(0, fetches);
+}
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_only_found_names_are_dirty);
+    RUN_TEST(test_save_and_load);
+    RUN_TEST(test_saved_entries_not_evicted_first);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
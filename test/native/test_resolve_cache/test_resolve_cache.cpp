@@ -0,0 +1,162 @@
+#include "unity.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../lib/utils/resolve_cache.h"
+
+typedef ResolveCache<std::string> Cache;
+
+static int lookups;
+
+static Cache::Answer found(const std::string &name)
+{
+    lookups++;
+    Cache::Answer answer;
+    answer.reached = true;
+    answer.found = true;
+    answer.value = "at:" + name;
+    return answer;
+}
+
+static Cache::Answer missing(const std::string &)
+{
+    lookups++;
+    Cache::Answer answer;
+    answer.reached = true;
+    return answer;
+}
+
+static Cache::Answer unreachable(const std::string &)
+{
+    lookups++;
+    return Cache::Answer();
+}
+
+void setUp(void)
+{
+    lookups = 0;
+}
+
+void tearDown(void)
+{
+}
+
+
+void test_resolve_ttl()
+{
+    Cache cache("none", 300, 10, 16);
+
+    TEST_ASSERT_EQUAL_STRING("at:host", cache.resolve("host", found, 0, 1000).c_str());
+    TEST_ASSERT_EQUAL_STRING("at:host", cache.resolve("host", found, 0, 1000 + 299999).c_str());
+    TEST_ASSERT_EQUAL(1, lookups);
+    TEST_ASSERT_TRUE(cache.known("host", 0, 2000));
+
+    // Expired, asked again
+    TEST_ASSERT_FALSE(cache.known("host", 0, 1000 + 300000));
+    cache.resolve("host", found, 0, 1000 + 300000);
+    TEST_ASSERT_EQUAL(2, lookups);
+}
+
+void test_resolve_negative()
+{
+    Cache cache("none", 300, 10, 16);
+
+    TEST_ASSERT_EQUAL_STRING("none", cache.resolve("nope", missing, 0, 0).c_str());
+    TEST_ASSERT_EQUAL_STRING("none", cache.resolve("nope", missing, 0, 9999).c_str());
+    TEST_ASSERT_EQUAL(1, lookups);
+
+    // The negative answer goes away much sooner than a positive one
+    cache.resolve("nope", missing, 0, 10000);
+    TEST_ASSERT_EQUAL(2, lookups);
+}
+
+void test_resolve_stale_if_unreachable()
+{
+    Cache cache("none", 300, 10, 16);
+
+    cache.resolve("host", found, 0, 0);
+
+    // Past the TTL and nobody answers, the old value beats none
+    TEST_ASSERT_EQUAL_STRING("at:host", cache.resolve("host", unreachable, 0, 400000).c_str());
+    TEST_ASSERT_EQUAL(2, lookups);
+
+    // Nothing cached, nothing to fall back on, and nothing remembered
+    TEST_ASSERT_EQUAL_STRING("none", cache.resolve("other", unreachable, 0, 0).c_str());
+    TEST_ASSERT_FALSE(cache.known("other", 0, 0));
+}
+
+void test_resolve_coalesces()
+{
+    Cache cache("none", 300, 10, 16);
+    std::atomic<int> asked(0);
+
+    auto slow = [&asked](const std::string &name) {
+        asked++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        Cache::Answer answer;
+        answer.reached = true;
+        answer.found = true;
+        answer.value = "at:" + name;
+        return answer;
+    };
+
+    std::vector<std::thread> threads;
+    std::atomic<int> right(0);
+    for (int i = 0; i < 8; i++)
+        threads.emplace_back([&]() {
+            if (cache.resolve("busy", slow, 0, 0) == "at:busy")
+                right++;
+        });
+    for (auto &t : threads)
+        t.join();
+
+    TEST_ASSERT_EQUAL(1, asked.load());
+    TEST_ASSERT_EQUAL(8, right.load());
+}
+
+void test_resolve_forget_and_evict()
+{
+    Cache cache("none", 300, 10, 3);
+
+    cache.resolve("a", found, 0, 0);
+    cache.forget("a");
+    TEST_ASSERT_FALSE(cache.known("a", 0, 0));
+
+    cache.resolve("a", found, 0, 0);
+    cache.resolve("b", found, 0, 1000);
+    cache.resolve("c", found, 0, 2000);
+    cache.resolve("d", found, 0, 3000);
+
+    // Full, the one closest to expiring made room
+    TEST_ASSERT_EQUAL(3, cache.size());
+    TEST_ASSERT_FALSE(cache.known("a", 0, 3000));
+    TEST_ASSERT_TRUE(cache.known("d", 0, 3000));
+
+    // An expired one goes before any that are still good
+    cache.resolve("e", missing, 0, 3000);
+    cache.resolve("f", found, 0, 20000);
+    TEST_ASSERT_FALSE(cache.known("e", 0, 20000));
+    TEST_ASSERT_TRUE(cache.known("c", 0, 20000));
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_resolve_ttl);
+    RUN_TEST(test_resolve_negative);
+    RUN_TEST(test_resolve_stale_if_unreachable);
+    RUN_TEST(test_resolve_coalesces);
+    RUN_TEST(test_resolve_forget_and_evict);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
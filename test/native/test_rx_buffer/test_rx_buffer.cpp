@@ -0,0 +1,161 @@
+#include "unity.h"
+
+#include "../lib/network-protocol/rx_buffer.cpp"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_rx_buffer_wraps_around(void)
+{
+    NetworkRxBuffer rx(8);
+    uint8_t out[8];
+
+    rx.append("abcdef", 6);
+    TEST_ASSERT_EQUAL_UINT32(4, rx.read(out, 4));
+    TEST_ASSERT_EQUAL_MEMORY("abcd", out, 4);
+
+    // Goes round the end of the storage
+    rx.append("ghijk", 5);
+    TEST_ASSERT_EQUAL_UINT32(7, rx.size());
+    TEST_ASSERT_EQUAL_UINT32(1, rx.space());
+    TEST_ASSERT_EQUAL_STRING("efghijk", rx.str().c_str());
+
+    TEST_ASSERT_EQUAL_UINT32(3, rx.peek(out, 3));
+    TEST_ASSERT_EQUAL_MEMORY("efg", out, 3);
+    TEST_ASSERT_EQUAL_UINT32(7, rx.size());
+
+    TEST_ASSERT_EQUAL_UINT32(7, rx.read(out, 8));
+    TEST_ASSERT_EQUAL_MEMORY("efghijk", out, 7);
+    TEST_ASSERT_TRUE(rx.empty());
+}
+
+void test_rx_buffer_grows_past_capacity(void)
+{
+    NetworkRxBuffer rx(4);
+    uint8_t out[4];
+
+    rx.append("abc", 3);
+    rx.read(out, 2);
+    rx.append("defghij", 7);
+
+    // Nothing lost, but the protocol is told to hold off
+    TEST_ASSERT_EQUAL_STRING("cdefghij", rx.str().c_str());
+    TEST_ASSERT_EQUAL_UINT32(0, rx.space());
+}
+
+void test_rx_buffer_translates_new_bytes_only(void)
+{
+    NetworkRxBuffer rx(16);
+    auto crlf = [](uint8_t c) -> int { return (c == '\n') ? -1 : c; };
+    auto upper = [](uint8_t c) -> int { return (c >= 'a' && c <= 'z') ? c - 32 : c; };
+
+    rx.append("ab\r\ncd", 6);
+    rx.translate(crlf);
+    TEST_ASSERT_EQUAL_STRING("ab\rcd", rx.str().c_str());
+
+    // Already translated bytes are left alone
+    rx.append("ef\r\n", 4);
+    rx.translate(upper);
+    TEST_ASSERT_EQUAL_STRING("ab\rcdEF\r\n", rx.str().c_str());
+
+    uint8_t out[3];
+    rx.read(out, 3);
+    rx.append("g\n", 2);
+    rx.translate(crlf);
+    TEST_ASSERT_EQUAL_STRING("cdEF\r\ng", rx.str().c_str());
+}
+
+void test_rx_buffer_untranslated_tail(void)
+{
+    NetworkRxBuffer rx(8);
+    rx.append("abc", 3);
+    rx.translated();
+    rx.append("xy", 2);
+
+    std::string tail = rx.untranslated();
+    TEST_ASSERT_EQUAL_STRING("xy", tail.c_str());
+    TEST_ASSERT_EQUAL_STRING("abc", rx.str().c_str());
+
+    rx.append("[x][y]");
+    rx.translated();
+    TEST_ASSERT_EQUAL_STRING("abc[x][y]", rx.str().c_str());
+    TEST_ASSERT_EQUAL_STRING("", rx.untranslated().c_str());
+}
+
+void test_rx_buffer_streams_large_transfer(void)
+{
+    NetworkRxBuffer rx(2048);
+    uint8_t chunk[512];
+    uint8_t out[254];
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    bool ordered = true;
+
+    // 4 MB through the ring, a chunk in whenever there is room, IEC sized reads out
+    while (received < 4 * 1024 * 1024)
+    {
+        if (rx.space() >= sizeof(chunk))
+        {
+            for (size_t i = 0; i < sizeof(chunk); i++)
+                chunk[i] = (uint8_t)(sent + i);
+            rx.append(chunk, sizeof(chunk));
+            sent += sizeof(chunk);
+        }
+
+        size_t n = rx.read(out, sizeof(out));
+        for (size_t i = 0; i < n; i++)
+            ordered = ordered && (out[i] == (uint8_t)(received + i));
+        received += n;
+    }
+
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_EQUAL_UINT32(2048, rx.capacity());
+}
+
+void test_rx_buffer_shrink_releases(void)
+{
+    NetworkRxBuffer rx(8);
+    rx.append("abc", 3);
+    rx.shrink_to_fit();
+    TEST_ASSERT_EQUAL_STRING("abc", rx.str().c_str());
+
+    rx.clear();
+    rx.shrink_to_fit();
+    rx = std::string("new");
+    TEST_ASSERT_EQUAL_STRING("new", rx.str().c_str());
+}
+
+void test_rx_buffer_assign_is_untranslated(void)
+{
+    // Directory listings are assigned in, they still need end of line translation
+    NetworkRxBuffer rx(64);
+    rx = std::string("a\nb\n");
+    rx.translate([](uint8_t c) { return c == '\n' ? 0x9B : c; });
+
+    TEST_ASSERT_EQUAL_STRING("a\x9B" "b\x9B", rx.str().c_str());
+}
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_rx_buffer_wraps_around);
+    RUN_TEST(test_rx_buffer_grows_past_capacity);
+    RUN_TEST(test_rx_buffer_translates_new_bytes_only);
+    RUN_TEST(test_rx_buffer_untranslated_tail);
+    RUN_TEST(test_rx_buffer_streams_large_transfer);
+    RUN_TEST(test_rx_buffer_shrink_releases);
+    RUN_TEST(test_rx_buffer_assign_is_untranslated);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
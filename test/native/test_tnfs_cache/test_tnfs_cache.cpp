@@ -0,0 +1,115 @@
+#include "unity.h"
+
+#include "../lib/meatloaf/network/tnfs_cache.cpp"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static TNFSStatEntry file_entry(uint32_t size)
+{
+    TNFSStatEntry entry;
+    entry.size = size;
+    entry.m_time = 1700000000;
+    return entry;
+}
+
+void test_stat_cache_hit_and_expiry(void)
+{
+    TNFSStatCache cache(5000, 16);
+    TNFSStatEntry entry;
+
+    TEST_ASSERT_FALSE(cache.get("host:/games/elite.d64", entry, 1000));
+
+    cache.put("host:/games/elite.d64", file_entry(174848), 1000);
+    TEST_ASSERT_TRUE(cache.get("host:/games/elite.d64", entry, 5999));
+    TEST_ASSERT_TRUE(entry.exists);
+    TEST_ASSERT_FALSE(entry.isDir);
+    TEST_ASSERT_EQUAL_UINT32(174848, entry.size);
+
+    // Gone once the TTL runs out
+    TEST_ASSERT_FALSE(cache.get("host:/games/elite.d64", entry, 6000));
+    TEST_ASSERT_EQUAL_UINT32(0, cache.size());
+}
+
+void test_stat_cache_not_found(void)
+{
+    TNFSStatCache cache(5000, 16);
+
+    TNFSStatEntry missing;
+    missing.exists = false;
+    cache.put("host:/nothing.prg", missing, 0);
+
+    TNFSStatEntry entry;
+    TEST_ASSERT_TRUE(cache.get("host:/nothing.prg", entry, 10));
+    TEST_ASSERT_FALSE(entry.exists);
+}
+
+void test_stat_cache_invalidate_tree(void)
+{
+    TNFSStatCache cache(5000, 16);
+    TNFSStatEntry dir;
+    dir.isDir = true;
+
+    cache.put("host:/games", dir, 0);
+    cache.put("host:/games/elite.d64", file_entry(1), 0);
+    cache.put("host:/games/disk2/a.prg", file_entry(2), 0);
+    cache.put("host:/games2", dir, 0);
+    cache.put("host:/gamesx.prg", file_entry(3), 0);
+
+    cache.invalidate("host:/games");
+
+    TNFSStatEntry entry;
+    TEST_ASSERT_FALSE(cache.get("host:/games", entry, 1));
+    TEST_ASSERT_FALSE(cache.get("host:/games/elite.d64", entry, 1));
+    TEST_ASSERT_FALSE(cache.get("host:/games/disk2/a.prg", entry, 1));
+
+    // Siblings that only share the prefix stay
+    TEST_ASSERT_TRUE(cache.get("host:/games2", entry, 1));
+    TEST_ASSERT_TRUE(cache.get("host:/gamesx.prg", entry, 1));
+}
+
+void test_stat_cache_bounded(void)
+{
+    TNFSStatCache cache(5000, 4);
+
+    for (uint32_t i = 0; i < 4; i++)
+        cache.put("host:/" + std::to_string(i), file_entry(i), i * 10);
+
+    // Full, the entry that would expire first makes room
+    cache.put("host:/new", file_entry(99), 100);
+    TEST_ASSERT_EQUAL_UINT32(4, cache.size());
+
+    TNFSStatEntry entry;
+    TEST_ASSERT_FALSE(cache.get("host:/0", entry, 101));
+    TEST_ASSERT_TRUE(cache.get("host:/1", entry, 101));
+    TEST_ASSERT_TRUE(cache.get("host:/new", entry, 101));
+
+    // Expired entries all go before anything live
+    cache.put("host:/later", file_entry(5), 5025);
+    TEST_ASSERT_EQUAL_UINT32(3, cache.size());
+    TEST_ASSERT_TRUE(cache.get("host:/3", entry, 5025));
+    TEST_ASSERT_TRUE(cache.get("host:/new", entry, 5025));
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_stat_cache_hit_and_expiry);
+    RUN_TEST(test_stat_cache_not_found);
+    RUN_TEST(test_stat_cache_invalidate_tree);
+    RUN_TEST(test_stat_cache_bounded);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
@@ -0,0 +1,389 @@
+#include "unity.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "../lib/TNFSlib/tnfslib_pipeline.cpp"
+
+#define TEST_FILE_SIZE 10000
+#define TEST_CACHE_SIZE (TNFS_READ_CHUNK * TNFS_READ_WINDOW_MAX)
+#define TEST_TIMEOUT 300
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static uint64_t now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Stand-in TNFS server with one open file, answers READ and LSEEK.
+// Like tnfsd it handles datagrams in the order they arrive. Replies go
+// out after a fixed latency, and requests and replies can be dropped,
+// held back or doubled to act like a bad link.
+class TNFSServer {
+public:
+    TNFSServer(uint32_t latency_ms) : m_latency(latency_ms)
+    {
+        for (uint32_t i = 0; i < TEST_FILE_SIZE; i++)
+            m_file.push_back((uint8_t)((i * 13) + (i >> 9)));
+
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(m_socket, (sockaddr *)&addr, sizeof(addr));
+
+        socklen_t len = sizeof(addr);
+        getsockname(m_socket, (sockaddr *)&addr, &len);
+        port = ntohs(addr.sin_port);
+
+        m_thread = std::thread([this]() { serve(); });
+    }
+
+    ~TNFSServer()
+    {
+        m_stop = true;
+        m_thread.join();
+        close(m_socket);
+    }
+
+    const std::vector<uint8_t> &file() { return m_file; }
+
+    uint16_t port;
+    std::atomic<uint32_t> reads{0};
+
+    // Counted in READ requests received, from 1
+    std::set<uint32_t> drop_requests;
+    std::set<uint32_t> drop_replies;
+    std::set<uint32_t> hold_requests;   // handled after the next request
+    bool double_replies = false;
+
+private:
+    struct Outgoing {
+        uint64_t due;
+        sockaddr_in to;
+        std::vector<uint8_t> data;
+    };
+
+    void serve()
+    {
+        while (!m_stop)
+        {
+            pollfd p = { m_socket, POLLIN, 0 };
+            if (poll(&p, 1, 1) > 0)
+            {
+                uint8_t buf[600];
+                sockaddr_in from;
+                socklen_t len = sizeof(from);
+                ssize_t n = recvfrom(m_socket, buf, sizeof(buf), 0, (sockaddr *)&from, &len);
+                if (n >= 4)
+                    receive(std::vector<uint8_t>(buf, buf + n), from);
+            }
+
+            uint64_t now = now_ms();
+            while (!m_outgoing.empty() && m_outgoing.front().due <= now)
+            {
+                Outgoing &o = m_outgoing.front();
+                sendto(m_socket, o.data.data(), o.data.size(), 0, (sockaddr *)&o.to, sizeof(o.to));
+                m_outgoing.pop_front();
+            }
+        }
+    }
+
+    void receive(std::vector<uint8_t> request, sockaddr_in from)
+    {
+        if (request[3] == 0x21)
+        {
+            uint32_t n = ++reads;
+            if (drop_requests.count(n))
+                return;
+            if (hold_requests.count(n))
+            {
+                m_held = request;
+                return;
+            }
+
+            handle(request, from, n);
+            if (!m_held.empty())
+            {
+                handle(m_held, from, 0);
+                m_held.clear();
+            }
+            return;
+        }
+
+        handle(request, from, 0);
+    }
+
+    void handle(const std::vector<uint8_t> &request, sockaddr_in from, uint32_t n)
+    {
+        std::vector<uint8_t> reply(request.begin(), request.begin() + 4);
+
+        if (request[3] == 0x21)
+        {
+            uint16_t count = request[5] | (request[6] << 8);
+            uint32_t bytes = std::min((uint32_t)count, (uint32_t)m_file.size() - std::min(m_pointer, (uint32_t)m_file.size()));
+            if (bytes == 0)
+            {
+                reply.push_back(TNFS_RESULT_END_OF_FILE);
+            }
+            else
+            {
+                reply.push_back(TNFS_RESULT_SUCCESS);
+                reply.push_back(bytes & 0xFF);
+                reply.push_back(bytes >> 8);
+                reply.insert(reply.end(), m_file.begin() + m_pointer, m_file.begin() + m_pointer + bytes);
+                m_pointer += bytes;
+            }
+
+            if (drop_replies.count(n))
+                return;
+        }
+        else if (request[3] == 0x25)
+        {
+            m_pointer = request[6] | (request[7] << 8) | (request[8] << 16) | (request[9] << 24);
+            reply.push_back(TNFS_RESULT_SUCCESS);
+            reply.insert(reply.end(), request.begin() + 6, request.begin() + 10);
+        }
+
+        m_outgoing.push_back({ now_ms() + m_latency, from, reply });
+        if (double_replies)
+            m_outgoing.push_back({ now_ms() + m_latency, from, reply });
+    }
+
+    uint32_t m_latency;
+    std::vector<uint8_t> m_file;
+    uint32_t m_pointer = 0;
+    std::vector<uint8_t> m_held;
+    std::deque<Outgoing> m_outgoing;
+
+    int m_socket;
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+};
+
+// Client side over a plain UDP socket, stands in for fnUDP in tnfslib.cpp
+class TNFSClient {
+public:
+    TNFSClient(uint16_t port)
+    {
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        connect(m_socket, (sockaddr *)&addr, sizeof(addr));
+
+        io.send_read = [this](uint8_t sequence_num, uint16_t count) {
+            uint8_t packet[7] = { 0x01, 0x00, sequence_num, 0x21, 0x00, (uint8_t)(count & 0xFF), (uint8_t)(count >> 8) };
+            return send(m_socket, packet, sizeof(packet), 0) == sizeof(packet);
+        };
+        io.recv_reply = [this](tnfsReadReply &reply) {
+            ssize_t n = recv(m_socket, m_reply, sizeof(m_reply), MSG_DONTWAIT);
+            if (n < 5 || m_reply[3] != 0x21)
+                return false;
+
+            reply.sequence_num = m_reply[2];
+            reply.result = m_reply[4];
+            reply.length = (reply.result == TNFS_RESULT_SUCCESS) ? (m_reply[5] | (m_reply[6] << 8)) : 0;
+            reply.data = m_reply + 7;
+            return true;
+        };
+        io.seek = [this](uint32_t position) { return seek(position); };
+        io.millis = []() { return now_ms(); };
+        io.wait = []() {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            return true;
+        };
+    }
+
+    ~TNFSClient()
+    {
+        close(m_socket);
+    }
+
+    int read(uint32_t position, uint8_t *dest, uint32_t size, uint32_t *loaded, bool *eof)
+    {
+        return _tnfs_read_pipelined(io, window, sequence_num, position, dest, size, loaded, eof, TEST_TIMEOUT, 5);
+    }
+
+    // Synchronous LSEEK with retries, what _tnfs_transaction() does
+    int seek(uint32_t position)
+    {
+        seeks++;
+        for (int retry = 0; retry < 5; retry++)
+        {
+            uint8_t seq = sequence_num++;
+            uint8_t packet[10] = { 0x01, 0x00, seq, 0x25, 0x00, SEEK_SET,
+                                   (uint8_t)position, (uint8_t)(position >> 8), (uint8_t)(position >> 16), (uint8_t)(position >> 24) };
+            send(m_socket, packet, sizeof(packet), 0);
+
+            uint64_t started = now_ms();
+            while (now_ms() - started < TEST_TIMEOUT)
+            {
+                uint8_t reply[600];
+                ssize_t n = recv(m_socket, reply, sizeof(reply), MSG_DONTWAIT);
+                if (n >= 5 && reply[2] == seq)
+                    return reply[4];
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+        return -1;
+    }
+
+    tnfsReadTransport io;
+    tnfsReadWindow window;
+    uint8_t sequence_num = 0;
+    uint32_t seeks = 0;
+
+private:
+    int m_socket;
+    uint8_t m_reply[600];
+};
+
+static void check_read(TNFSServer &server, TNFSClient &client, uint32_t position, uint32_t size)
+{
+    std::vector<uint8_t> cache(size);
+    uint32_t loaded = 0;
+    bool eof = false;
+
+    TEST_ASSERT_EQUAL_INT(0, client.read(position, cache.data(), size, &loaded, &eof));
+    TEST_ASSERT_FALSE(eof);
+    TEST_ASSERT_EQUAL_UINT32(size, loaded);
+    TEST_ASSERT_EQUAL_MEMORY(server.file().data() + position, cache.data(), size);
+}
+
+void test_pipeline_reads_in_order(void)
+{
+    TNFSServer server(20);
+    TNFSClient client(server.port);
+
+    uint64_t started = now_ms();
+    check_read(server, client, 0, TEST_CACHE_SIZE);
+    uint64_t elapsed = now_ms() - started;
+
+    // One READ at a time this is 8 round trips, 160ms
+    TEST_ASSERT_LESS_THAN_UINT32(100, elapsed);
+    TEST_ASSERT_EQUAL_UINT32(0, client.seeks);
+    TEST_ASSERT_GREATER_THAN_UINT8(TNFS_READ_WINDOW_START, client.window.size);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, client.window.rtt_ms);
+
+    // The next fill carries on from the server's file pointer
+    check_read(server, client, TEST_CACHE_SIZE, TEST_CACHE_SIZE);
+}
+
+void test_pipeline_lost_request(void)
+{
+    TNFSServer server(5);
+    server.drop_requests = { 3 };
+    TNFSClient client(server.port);
+
+    check_read(server, client, 0, TEST_CACHE_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(1, client.seeks);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(TNFS_READ_WINDOW_START, client.window.size);
+}
+
+void test_pipeline_lost_reply(void)
+{
+    TNFSServer server(5);
+    server.drop_replies = { 2 };
+    TNFSClient client(server.port);
+
+    check_read(server, client, 0, TEST_CACHE_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(1, client.seeks);
+}
+
+void test_pipeline_reordered_requests(void)
+{
+    // The third READ reaches the server after the fourth and reads its data
+    TNFSServer server(5);
+    server.hold_requests = { 3 };
+    TNFSClient client(server.port);
+
+    check_read(server, client, 0, TEST_CACHE_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(1, client.seeks);
+}
+
+void test_pipeline_duplicate_replies(void)
+{
+    TNFSServer server(5);
+    server.double_replies = true;
+    TNFSClient client(server.port);
+
+    check_read(server, client, 0, TEST_CACHE_SIZE);
+    check_read(server, client, TEST_CACHE_SIZE, TEST_CACHE_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(0, client.seeks);
+}
+
+void test_pipeline_end_of_file(void)
+{
+    TNFSServer server(5);
+    TNFSClient client(server.port);
+
+    // Put the server's file pointer near the end first
+    uint32_t position = TEST_FILE_SIZE - 1000;
+    TEST_ASSERT_EQUAL_INT(0, client.seek(position));
+
+    std::vector<uint8_t> cache(TEST_CACHE_SIZE);
+    uint32_t loaded = 0;
+    bool eof = false;
+    TEST_ASSERT_EQUAL_INT(0, client.read(position, cache.data(), TEST_CACHE_SIZE, &loaded, &eof));
+    TEST_ASSERT_TRUE(eof);
+    TEST_ASSERT_EQUAL_UINT32(1000, loaded);
+    TEST_ASSERT_EQUAL_MEMORY(server.file().data() + position, cache.data(), 1000);
+}
+
+void test_pipeline_server_gone(void)
+{
+    TNFSServer server(5);
+    server.drop_requests = { 1, 2, 3, 4 };
+    TNFSClient client(server.port);
+
+    // Nothing comes back and the LSEEKs are dropped too
+    client.io.seek = [](uint32_t position) { return -1; };
+
+    std::vector<uint8_t> cache(TEST_CACHE_SIZE);
+    uint32_t loaded = 0;
+    bool eof = false;
+    TEST_ASSERT_EQUAL_INT(-1, client.read(0, cache.data(), TEST_CACHE_SIZE, &loaded, &eof));
+    TEST_ASSERT_EQUAL_UINT32(0, loaded);
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_pipeline_reads_in_order);
+    RUN_TEST(test_pipeline_lost_request);
+    RUN_TEST(test_pipeline_lost_reply);
+    RUN_TEST(test_pipeline_reordered_requests);
+    RUN_TEST(test_pipeline_duplicate_replies);
+    RUN_TEST(test_pipeline_end_of_file);
+    RUN_TEST(test_pipeline_server_gone);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
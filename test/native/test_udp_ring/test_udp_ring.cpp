@@ -0,0 +1,139 @@
+#include "unity.h"
+
+#include <cstring>
+#include <string>
+
+#include "../lib/tcpip/fnUDPRing.cpp"
+
+// What recvfrom() would do: the datagram lands in the reserved slot
+static void receive(fnUDPRing &ring, const std::string &payload, uint16_t port = 6502)
+{
+    uint8_t *slot = ring.reserve();
+    TEST_ASSERT_NOT_NULL(slot);
+    memcpy(slot, payload.data(), payload.size());
+    ring.commit(payload.size(), htonl(0x0A000001), port);
+}
+
+static std::string front(fnUDPRing &ring)
+{
+    const fnUDPDatagram *d = ring.front();
+    if (d == nullptr)
+        return "";
+    return std::string((const char *)d->data + d->offset, d->remaining());
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+
+void test_udp_ring_keeps_boundaries()
+{
+    fnUDPRing ring(4, 64);
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_NULL(ring.front());
+
+    receive(ring, "hello", 1);
+    receive(ring, "world!", 2);
+    receive(ring, "", 3);  // empty datagrams aren't queued
+    TEST_ASSERT_EQUAL(2, ring.count());
+
+    // Read in place, one datagram at a time
+    TEST_ASSERT_EQUAL_STRING("hello", front(ring).c_str());
+    TEST_ASSERT_EQUAL(1, ring.front()->port);
+    TEST_ASSERT_EQUAL_UINT32(htonl(0x0A000001), ring.front()->ip);
+
+    ring.consume(2);
+    TEST_ASSERT_EQUAL_STRING("llo", front(ring).c_str());
+    ring.consume(100);
+    TEST_ASSERT_EQUAL_STRING("world!", front(ring).c_str());
+    TEST_ASSERT_EQUAL(2, ring.front()->port);
+
+    ring.consume(6);
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_EQUAL(2, ring.received());
+    TEST_ASSERT_EQUAL(0, ring.dropped());
+}
+
+void test_udp_ring_wraps_around()
+{
+    fnUDPRing ring(3, 16);
+
+    for (int i = 0; i < 20; i++)
+    {
+        receive(ring, "packet" + std::to_string(i));
+        receive(ring, "next" + std::to_string(i));
+        TEST_ASSERT_EQUAL_STRING(("packet" + std::to_string(i)).c_str(), front(ring).c_str());
+        ring.pop();
+        TEST_ASSERT_EQUAL_STRING(("next" + std::to_string(i)).c_str(), front(ring).c_str());
+        ring.pop();
+    }
+
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_EQUAL(0, ring.dropped());
+}
+
+void test_udp_ring_drops_oldest_when_full()
+{
+    fnUDPRing ring(3, 16);
+
+    for (int i = 0; i < 5; i++)
+        receive(ring, "p" + std::to_string(i));
+
+    // The newest three are kept
+    TEST_ASSERT_EQUAL(3, ring.count());
+    TEST_ASSERT_EQUAL(5, ring.received());
+    TEST_ASSERT_EQUAL(2, ring.dropped());
+    TEST_ASSERT_EQUAL_STRING("p2", front(ring).c_str());
+
+    // One being read isn't pulled out from under the reader, the new one goes instead
+    ring.consume(1);
+    receive(ring, "p5");
+    TEST_ASSERT_EQUAL(3, ring.dropped());
+    TEST_ASSERT_EQUAL_STRING("2", front(ring).c_str());
+    ring.consume(1);
+    TEST_ASSERT_EQUAL_STRING("p3", front(ring).c_str());
+    ring.pop();
+    TEST_ASSERT_EQUAL_STRING("p4", front(ring).c_str());
+    ring.pop();
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_udp_ring_truncates_and_releases()
+{
+    fnUDPRing ring(2, 4);
+
+    uint8_t *slot = ring.reserve();
+    memcpy(slot, "abcd", 4);
+    ring.commit(9, IPADDR_NONE, 0);
+    TEST_ASSERT_EQUAL(4, ring.front()->length);
+
+    ring.release();
+    TEST_ASSERT_TRUE(ring.empty());
+
+    // Storage comes back with the next datagram
+    receive(ring, "xy");
+    TEST_ASSERT_EQUAL_STRING("xy", front(ring).c_str());
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_udp_ring_keeps_boundaries);
+    RUN_TEST(test_udp_ring_wraps_around);
+    RUN_TEST(test_udp_ring_drops_oldest_when_full);
+    RUN_TEST(test_udp_ring_truncates_and_releases);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
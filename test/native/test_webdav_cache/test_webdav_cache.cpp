@@ -0,0 +1,136 @@
+#include "unity.h"
+
+#include "../lib/meatloaf/network/webdav_cache.cpp"
+
+static WebDAVCollection games()
+{
+    WebDAVCollection c;
+    c.validator = "\"dir-1\"";
+
+    WebDAVProps disk;
+    disk.name = "My Disk.d64";
+    disk.size = 174848;
+    c.entries.push_back(disk);
+
+    WebDAVProps sub;
+    sub.name = "demos";
+    sub.isDir = true;
+    c.entries.push_back(sub);
+
+    return c;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+
+void test_webdav_cache_keys()
+{
+    TEST_ASSERT_EQUAL_STRING("http://h/games/", WebDAVPropCache::collectionKey("http://h/games").c_str());
+    TEST_ASSERT_EQUAL_STRING("http://h/games/", WebDAVPropCache::collectionKey("http://h/games/").c_str());
+
+    std::string name;
+    TEST_ASSERT_EQUAL_STRING("http://h/games/", WebDAVPropCache::parentKey("http://h/games/x.prg", &name).c_str());
+    TEST_ASSERT_EQUAL_STRING("x.prg", name.c_str());
+    TEST_ASSERT_EQUAL_STRING("http://h/", WebDAVPropCache::parentKey("http://h/games/", &name).c_str());
+    TEST_ASSERT_EQUAL_STRING("games", name.c_str());
+}
+
+void test_webdav_cache_props()
+{
+    WebDAVPropCache cache(1000);
+    cache.put("http://h/games", games(), 0);
+
+    WebDAVProps props;
+    TEST_ASSERT_TRUE(cache.props("http://h/games/My Disk.d64", props, 10));
+    TEST_ASSERT_EQUAL(174848, props.size);
+    TEST_ASSERT_FALSE(props.isDir);
+
+    TEST_ASSERT_TRUE(cache.props("http://h/games/demos/", props, 10));
+    TEST_ASSERT_TRUE(props.isDir);
+
+    TEST_ASSERT_FALSE(cache.props("http://h/games/missing.prg", props, 10));
+    TEST_ASSERT_FALSE(cache.props("http://h/other/My Disk.d64", props, 10));
+
+    // Stale listings don't answer for their files
+    TEST_ASSERT_FALSE(cache.props("http://h/games/My Disk.d64", props, 1000));
+}
+
+void test_webdav_cache_revalidate()
+{
+    WebDAVPropCache cache(1000);
+    cache.put("http://h/games/", games(), 0);
+
+    bool fresh = false;
+    TEST_ASSERT_NOT_NULL(cache.get("http://h/games/", 500, fresh).get());
+    TEST_ASSERT_TRUE(fresh);
+
+    // Past its TTL it is still there, to be revalidated
+    auto stale = cache.get("http://h/games/", 1500, fresh);
+    TEST_ASSERT_NOT_NULL(stale.get());
+    TEST_ASSERT_FALSE(fresh);
+
+    // Same ETag, good for another TTL
+    TEST_ASSERT_TRUE(cache.revalidate("http://h/games/", "\"dir-1\"", 1500));
+    cache.get("http://h/games/", 2000, fresh);
+    TEST_ASSERT_TRUE(fresh);
+
+    // Changed, or no validator to go by: gone
+    TEST_ASSERT_FALSE(cache.revalidate("http://h/games/", "\"dir-2\"", 2600));
+    TEST_ASSERT_NULL(cache.get("http://h/games/", 2600, fresh).get());
+
+    WebDAVCollection bare = games();
+    bare.validator.clear();
+    cache.put("http://h/bare/", bare, 0);
+    TEST_ASSERT_FALSE(cache.revalidate("http://h/bare/", "", 10));
+    TEST_ASSERT_EQUAL(0, cache.count());
+}
+
+void test_webdav_cache_invalidate_and_evict()
+{
+    WebDAVPropCache cache(1000, 2);
+    cache.put("http://h/games/", games(), 0);
+    cache.put("http://h/games/demos/", WebDAVCollection(), 0);
+
+    // A file saved into demos/ drops that listing, not its parent's
+    cache.invalidate("http://h/games/demos/new.prg");
+    bool fresh;
+    TEST_ASSERT_NULL(cache.get("http://h/games/demos/", 10, fresh).get());
+    TEST_ASSERT_NOT_NULL(cache.get("http://h/games/", 10, fresh).get());
+
+    // A new collection drops its own listing and the one it is in
+    cache.put("http://h/games/demos/", WebDAVCollection(), 0);
+    cache.invalidate("http://h/games/demos");
+    TEST_ASSERT_EQUAL(0, cache.count());
+
+    // Full, the one stale first goes
+    cache.put("http://h/a/", WebDAVCollection(), 0);
+    cache.put("http://h/b/", WebDAVCollection(), 100);
+    cache.put("http://h/c/", WebDAVCollection(), 200);
+    TEST_ASSERT_EQUAL(2, cache.count());
+    TEST_ASSERT_NULL(cache.get("http://h/a/", 300, fresh).get());
+    TEST_ASSERT_NOT_NULL(cache.get("http://h/c/", 300, fresh).get());
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_webdav_cache_keys);
+    RUN_TEST(test_webdav_cache_props);
+    RUN_TEST(test_webdav_cache_revalidate);
+    RUN_TEST(test_webdav_cache_invalidate_and_evict);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}
@@ -0,0 +1,214 @@
+#include "unity.h"
+
+#include <string>
+#include <vector>
+
+#include "../lib/network-protocol/WEBDAV.cpp"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static std::string response(const std::string &href, const std::string &name, const std::string &size, bool dir)
+{
+    return "<D:response><D:href>" + href + "</D:href><D:propstat><D:prop>"
+           "<D:displayname>" + name + "</D:displayname>"
+           "<D:getcontentlength>" + size + "</D:getcontentlength>"
+           "<D:resourcetype>" + (dir ? "<D:collection/>" : "") + "</D:resourcetype>"
+           "</D:prop></D:propstat></D:response>\r\n";
+}
+
+static std::string multistatus(size_t files)
+{
+    std::string xml = "<?xml version=\"1.0\"?>\r\n<D:multistatus xmlns:D=\"DAV:\">\r\n";
+    xml += response("/games/", "games", "", true);
+    xml += response("/games/disks/", "disks", "", true);
+    for (size_t i = 0; i < files; i++)
+        xml += response("/games/file" + std::to_string(i) + ".prg", "file" + std::to_string(i) + ".prg", std::to_string(1000 + i), false);
+    xml += "</D:multistatus>\r\n";
+    return xml;
+}
+
+// Feed like read_dir_entry() does: parse only when no entry is waiting
+static std::vector<WebDAV::DAVEntry> list(WebDAV &dav, const std::string &xml, size_t chunk, size_t *fed_first = nullptr)
+{
+    std::vector<WebDAV::DAVEntry> entries;
+    WebDAV::DAVEntry entry;
+    size_t pos = 0;
+
+    while (true)
+    {
+        if (dav.next(entry))
+        {
+            if (entries.empty() && fed_first)
+                *fed_first = pos;
+            entries.push_back(entry);
+            continue;
+        }
+        if (dav.failed() || dav.finished())
+            break;
+
+        if (pos < xml.size())
+        {
+            size_t len = std::min(chunk, xml.size() - pos);
+            dav.parse(xml.data() + pos, len, false);
+            pos += len;
+        }
+        else
+            dav.parse(nullptr, 0, true);
+    }
+    return entries;
+}
+
+
+void test_webdav_entries_in_order()
+{
+    std::string xml = multistatus(5);
+
+    for (size_t chunk : {1, 7, 64, 512, 100000})
+    {
+        WebDAV dav;
+        TEST_ASSERT_FALSE(dav.begin_parser());
+
+        auto entries = list(dav, xml, chunk);
+        TEST_ASSERT_FALSE(dav.failed());
+        TEST_ASSERT_EQUAL(6, entries.size());
+
+        // The directory itself is skipped
+        TEST_ASSERT_EQUAL_STRING("disks", entries[0].filename.c_str());
+        TEST_ASSERT_TRUE(entries[0].isDir);
+        for (size_t i = 0; i < 5; i++)
+        {
+            TEST_ASSERT_EQUAL_STRING(("file" + std::to_string(i) + ".prg").c_str(), entries[i + 1].filename.c_str());
+            TEST_ASSERT_EQUAL_STRING(std::to_string(1000 + i).c_str(), entries[i + 1].fileSize.c_str());
+            TEST_ASSERT_FALSE(entries[i + 1].isDir);
+        }
+
+        dav.end_parser(true);
+    }
+}
+
+void test_webdav_first_entry_before_rest()
+{
+    std::string xml = multistatus(200);
+
+    WebDAV dav;
+    TEST_ASSERT_FALSE(dav.begin_parser());
+
+    size_t fed = 0;
+    auto entries = list(dav, xml, WEBDAV_CHUNK_SIZE, &fed);
+    TEST_ASSERT_EQUAL(201, entries.size());
+
+    // The first entry was out after a chunk or two, not the whole document
+    TEST_ASSERT_TRUE(fed <= 2 * WEBDAV_CHUNK_SIZE);
+    TEST_ASSERT_TRUE(fed < xml.size() / 10);
+
+    dav.end_parser(true);
+}
+
+void test_webdav_parse_error()
+{
+    std::string xml = "<?xml version=\"1.0\"?><D:multistatus xmlns:D=\"DAV:\">" + response("/a/", "a", "", true) + "</D:wrong>";
+
+    WebDAV dav;
+    TEST_ASSERT_FALSE(dav.begin_parser());
+
+    auto entries = list(dav, xml, 16);
+    TEST_ASSERT_TRUE(dav.failed());
+    TEST_ASSERT_EQUAL(0, entries.size());
+
+    dav.end_parser(true);
+}
+
+
+void test_webdav_properties()
+{
+    std::string xml = "<?xml version=\"1.0\"?><D:multistatus xmlns:D=\"DAV:\">"
+        "<D:response><D:href>/games/</D:href><D:propstat><D:prop>"
+        "<D:getetag>\"dir-1\"</D:getetag><D:resourcetype><D:collection/></D:resourcetype>"
+        "</D:prop></D:propstat></D:response>"
+        "<D:response><D:href>/games/My%20Disk.d64</D:href><D:propstat><D:prop>"
+        "<D:getcontentlength>174848</D:getcontentlength><D:getetag>\"abc\"</D:getetag>"
+        "<D:getlastmodified>Mon, 19 Oct 2026 10:00:00 GMT</D:getlastmodified><D:resourcetype/>"
+        "</D:prop></D:propstat></D:response></D:multistatus>";
+
+    WebDAV dav;
+    TEST_ASSERT_FALSE(dav.begin_parser());
+
+    auto entries = list(dav, xml, 5);
+    TEST_ASSERT_EQUAL(1, entries.size());
+    TEST_ASSERT_EQUAL_STRING("/games/My%20Disk.d64", entries[0].href.c_str());
+    TEST_ASSERT_EQUAL_STRING("\"abc\"", entries[0].etag.c_str());
+    TEST_ASSERT_EQUAL_STRING("Mon, 19 Oct 2026 10:00:00 GMT", entries[0].lastModified.c_str());
+    TEST_ASSERT_EQUAL_STRING("174848", entries[0].fileSize.c_str());
+
+    // No displayname, the name comes from the href
+    TEST_ASSERT_EQUAL_STRING("My Disk.d64", entries[0].filename.c_str());
+
+    // The collection's own response is kept aside
+    TEST_ASSERT_EQUAL_STRING("/games/", dav.collection().href.c_str());
+    TEST_ASSERT_EQUAL_STRING("\"dir-1\"", dav.collection().etag.c_str());
+    TEST_ASSERT_TRUE(dav.collection().isDir);
+
+    dav.end_parser(true);
+}
+
+void test_webdav_parse_in_place()
+{
+    std::string xml = multistatus(50);
+
+    WebDAV dav;
+    TEST_ASSERT_FALSE(dav.begin_parser());
+
+    // Bytes go straight into expat's buffer, as they are read off the connection
+    std::vector<WebDAV::DAVEntry> entries;
+    WebDAV::DAVEntry entry;
+    size_t pos = 0;
+    while (true)
+    {
+        if (dav.next(entry))
+        {
+            entries.push_back(entry);
+            continue;
+        }
+        if (dav.failed() || dav.finished())
+            break;
+
+        void *buf = dav.buffer(WEBDAV_CHUNK_SIZE);
+        TEST_ASSERT_NOT_NULL(buf);
+        size_t len = std::min((size_t)WEBDAV_CHUNK_SIZE, xml.size() - pos);
+        memcpy(buf, xml.data() + pos, len);
+        pos += len;
+        dav.parse_buffer(len, len < WEBDAV_CHUNK_SIZE);
+    }
+
+    TEST_ASSERT_FALSE(dav.failed());
+    TEST_ASSERT_EQUAL(51, entries.size());
+    TEST_ASSERT_EQUAL_STRING("file49.prg", entries[50].filename.c_str());
+    TEST_ASSERT_EQUAL_STRING("/games/", dav.collection().href.c_str());
+
+    dav.end_parser(true);
+}
+
+
+void process()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_webdav_entries_in_order);
+    RUN_TEST(test_webdav_first_entry_before_rest);
+    RUN_TEST(test_webdav_parse_error);
+    RUN_TEST(test_webdav_properties);
+    RUN_TEST(test_webdav_parse_in_place);
+
+    UNITY_END();
+}
+
+int main(int argc, char **argv)
+{
+    process();
+}